@@ -9,8 +9,26 @@
 #define WP_LIBWPD__H
 
 #include <wp_common.h>
+#include <wp_cpu.h>
 #include <wp_daemonizer.h>
+#include <wp_event_loop.h>
+#include <wp_listener.h>
+#include <wp_datagram.h>
+#include <wp_buffer_chain.h>
+#include <wp_mpmc_queue.h>
+#include <wp_mailbox.h>
+#include <wp_channel.h>
+#include <wp_fiber.h>
+#include <wp_hash_map.h>
+#include <wp_cache.h>
+#include <wp_format.h>
+#include <wp_text.h>
+#include <wp_limiter.h>
+#include <wp_supervisor.h>
+#include <wp_timer_wheel.h>
+#include <wp_profiler.h>
+#include <wp_watchdog.h>
 
-const int MAX_RETRY;
+extern const int MAX_RETRY;
 
 #endif
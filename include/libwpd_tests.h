@@ -8,17 +8,25 @@
 #ifndef WP_LIBWPD_TESTS__H
 #define WP_LIBWPD_TESTS__H
 
+#include <stdio.h>
+
 #include <libwpd.h>
 
-/*
 // Test object.
 typedef struct wp_test {
   int    argc;
   char **argv;
 } wp_test_t;
 
-typedef wp_status_t(*wp_test_fn)(const wp_test_t* t); 
-*/
+typedef wp_status_t(*wp_test_fn)(const wp_test_t* t);
 
-#endif
+/* Report a failed condition with where it is and fail the test. */
+#define WP_TEST_CHECK(cond) \
+  do { \
+    if(!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return WP_FAILURE; \
+    } \
+  } while(0)
 
+#endif
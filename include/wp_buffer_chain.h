@@ -0,0 +1,82 @@
+/*
+ * File:   wp_buffer_chain.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:23 AM
+ */
+
+#ifndef WP_BUFFER_CHAIN__H
+#define WP_BUFFER_CHAIN__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+
+struct wp_buffer_chain;
+
+/* Keep the private impementation... private. */
+struct __wp_buffer_chain_private_t;
+typedef struct __wp_buffer_chain_private_t *wp_buffer_chain_private_t;
+
+/* Called once no chain references memory passed to append_ref any more. */
+typedef void (*wp_buffer_release_fn)(const void *data, void *arg);
+
+/*
+ * A chain of segments, each a view onto a reference counted slice: pool
+ * memory, caller memory or a range of a file. Splitting, appending chains and
+ * consuming only adjust views and reference counts; bytes are copied only by
+ * append. Chains split from one another share slices and must stay on one
+ * thread.
+ */
+typedef struct wp_buffer_chain {
+  /* Copy len bytes to the end, filling the last slice's spare room first. */
+  wp_status_t (*append)(const struct wp_buffer_chain *self, const void *data, size_t len);
+  /* Reference len bytes of caller memory; release(data, arg) runs when unreferenced. */
+  wp_status_t (*append_ref)(const struct wp_buffer_chain *self, const void *data, size_t len,
+                            wp_buffer_release_fn release, void *arg);
+  /*
+   * Reference len bytes of fd starting at offset, sent with sendfile. Use an
+   * offset of -1 for pipes and sockets, which are sent with splice. The fd
+   * must stay open until the bytes are flushed or consumed.
+   */
+  wp_status_t (*append_file)(const struct wp_buffer_chain *self, int fd, off_t offset, size_t len);
+  /* Move every segment of other to the end of this chain, leaving other empty. */
+  wp_status_t (*append_chain)(const struct wp_buffer_chain *self, const struct wp_buffer_chain *other);
+
+  /* Move the first len bytes into a new chain on the same pool. */
+  wp_status_t (*split)(const struct wp_buffer_chain *self, size_t len, struct wp_buffer_chain **out);
+  /* Drop up to len bytes from the front. */
+  void (*consume)(const struct wp_buffer_chain *self, size_t len);
+  /* Copy up to len bytes from the front of memory segments without consuming them. */
+  size_t (*copy_out)(const struct wp_buffer_chain *self, void *dest, size_t len);
+
+  /*
+   * Write and consume as much as fd accepts: memory segments with writev,
+   * file segments with sendfile or splice. Returns the bytes written, or -1
+   * with errno set (EAGAIN when fd is full) if nothing could be written.
+   */
+  ssize_t (*flush)(const struct wp_buffer_chain *self, int fd);
+
+  size_t (*get_length)(const struct wp_buffer_chain *self);
+  bool (*is_empty)(const struct wp_buffer_chain *self);
+
+  wp_buffer_chain_private_t data;
+} wp_buffer_chain_t;
+
+/**
+ * Create an empty chain whose slices and bookkeeping come from pool.
+ * @param self_out will point to the new chain, or NULL on failure.
+ * @param pool the pool to allocate from.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_buffer_chain_new(wp_buffer_chain_t **self_out, const wp_pool_t *pool);
+
+/**
+ * Delete a chain, dropping its references.
+ * @param self the chain to delete.
+ */
+void wp_buffer_chain_delete(wp_buffer_chain_t *self);
+
+#endif /* WP_BUFFER_CHAIN__H */
@@ -0,0 +1,108 @@
+/*
+ * File:   wp_cache.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:40 AM
+ */
+
+#ifndef WP_CACHE__H
+#define WP_CACHE__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+#include <wp_string.h>
+
+/* Shard count used when wp_cache_new is passed 0. */
+#define WP_CACHE_DEFAULT_SHARDS 16
+
+struct wp_cache;
+
+/* Keep the private impementation... private. */
+struct __wp_cache_private_t;
+typedef struct __wp_cache_private_t *wp_cache_private_t;
+
+typedef struct wp_cache_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t insertions;
+  uint64_t evictions;
+  size_t entries;
+  /* Bytes charged against the budget, headers and rounding included. */
+  size_t bytes;
+  size_t budget;
+} wp_cache_stats_t;
+
+/*
+ * A thread safe cache of byte values keyed by wp_string, split into shards by
+ * key hash. Each shard evicts with S3-FIFO: new entries go to a small FIFO,
+ * and only those read again while there are promoted to the main FIFO, which
+ * gives entries a second chance per read. Keys recently evicted from the small
+ * FIFO (the "ghosts") go straight to main when they come back.
+ *
+ * Writers take their shard's lock. Readers take no lock and write nothing
+ * shared but a frequency hint: they copy the value out under the shard's
+ * sequence counter and retry if a writer got in the way.
+ */
+typedef struct wp_cache {
+  /* Copy value in under key, replacing any previous value. WP_FAILURE if it can never fit. */
+  wp_status_t (*put)(const struct wp_cache *self, const wp_string_t *key, const void *value, size_t len);
+  wp_status_t (*put_bytes)(const struct wp_cache *self, const char *key, size_t key_len, const void *value, size_t len);
+  /*
+   * Copy up to size bytes of key's value into dest and return the value's full
+   * length, or -1 on a miss. Retry with a bigger buffer if that exceeds size.
+   */
+  ssize_t (*get)(const struct wp_cache *self, const wp_string_t *key, void *dest, size_t size);
+  ssize_t (*get_bytes)(const struct wp_cache *self, const char *key, size_t key_len, void *dest, size_t size);
+  /* Drop key; false if it wasn't cached. */
+  bool (*remove)(const struct wp_cache *self, const wp_string_t *key);
+  bool (*remove_bytes)(const struct wp_cache *self, const char *key, size_t key_len);
+
+  /* Totals across shards; each counter is read without stopping writers. */
+  void (*get_stats)(const struct wp_cache *self, wp_cache_stats_t *stats);
+
+  wp_cache_private_t data;
+} wp_cache_t;
+
+/**
+ * Create a cache. Pass config->get_cache_memory_budget(config) for the
+ * configured budget.
+ * @param self_out will point to the new cache, or NULL on failure.
+ * @param budget the bytes the cache may hold, split evenly between shards.
+ * @param shards the shard count, rounded up to a power of two; 0 for WP_CACHE_DEFAULT_SHARDS.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_cache_new(wp_cache_t **self_out, size_t budget, unsigned shards);
+
+/**
+ * Delete a cache and every entry. No other thread may be using it.
+ * @param self the cache to delete.
+ */
+void wp_cache_delete(wp_cache_t *self);
+
+/**
+ * Copy every entry into a persistent pool, e.g. the daemonizer's state pool
+ * at shutdown, so that the next run can load them instead of refilling the
+ * cache from scratch. Keep the offset in the pool's root. Writers wait while
+ * the shards are copied.
+ * @param self the cache.
+ * @param state a persistent pool.
+ * @return the image's offset, or 0 if the pool has no room for it.
+ */
+wp_pool_offset_t wp_cache_save(const wp_cache_t *self, const wp_pool_t *state);
+
+/**
+ * Put back the entries of an image saved by wp_cache_save, oldest first, so
+ * that what doesn't fit the budget is what would have been evicted anyway.
+ * The image stays in the pool; wp_pool_rewind it once it's loaded.
+ * @param self the cache.
+ * @param state the persistent pool holding the image.
+ * @param image the offset wp_cache_save returned.
+ * @return the entries loaded, or -1 if image isn't a valid cache image.
+ */
+ssize_t wp_cache_load(const wp_cache_t *self, const wp_pool_t *state, wp_pool_offset_t image);
+
+#endif /* WP_CACHE__H */
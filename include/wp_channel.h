@@ -0,0 +1,72 @@
+/*
+ * File:   wp_channel.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:29 AM
+ */
+
+#ifndef WP_CHANNEL__H
+#define WP_CHANNEL__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <wp_common.h>
+
+struct wp_channel;
+
+/* Keep the private impementation... private. */
+struct __wp_channel_private_t;
+typedef struct __wp_channel_private_t *wp_channel_private_t;
+
+/*
+ * A single-producer single-consumer ring of length prefixed messages in a
+ * shared memfd mapping. Create it before fork (or pass get_fd to a child) and
+ * use it from exactly one writer and one reader process; use two channels for
+ * a conversation. Sending and receiving are plain memory operations. The only
+ * syscall is a futex wake, made when the reader is asleep in wait.
+ */
+typedef struct wp_channel {
+  /* Copy a message in; WP_FAILURE when there is not room for it. */
+  wp_status_t (*send)(const struct wp_channel *self, const void *data, size_t len);
+  /*
+   * Copy the oldest message into dest and return its length. Returns -1 with
+   * errno EAGAIN when empty, or EMSGSIZE (leaving it queued) when size is too
+   * small for it.
+   */
+  ssize_t (*receive)(const struct wp_channel *self, void *dest, size_t size);
+  /* Sleep until a message is available or timeout_ms passes (-1 waits forever). */
+  wp_status_t (*wait)(const struct wp_channel *self, int timeout_ms);
+  bool (*is_empty)(const struct wp_channel *self);
+
+  /* The largest message send accepts. */
+  size_t (*get_max_message)(const struct wp_channel *self);
+  /* The memfd backing the ring. */
+  int (*get_fd)(const struct wp_channel *self);
+
+  wp_channel_private_t data;
+} wp_channel_t;
+
+/**
+ * Create a channel backed by a new memfd.
+ * @param self_out will point to the new channel, or NULL on failure.
+ * @param capacity ring bytes, rounded up to a power of two (minimum 4096).
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_channel_new(wp_channel_t **self_out, size_t capacity);
+
+/**
+ * Map a channel from a memfd created by wp_channel_new in another process.
+ * @param self_out will point to the new channel, or NULL on failure.
+ * @param fd the channel's memfd; the channel takes ownership of it.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_channel_open(wp_channel_t **self_out, int fd);
+
+/**
+ * Unmap a channel and close its memfd. The other side is unaffected.
+ * @param self the channel to delete.
+ */
+void wp_channel_delete(wp_channel_t *self);
+
+#endif /* WP_CHANNEL__H */
@@ -13,12 +13,16 @@
 
 typedef int wp_status_t;
 
-const size_t WP_MAX_LINE;
-const wp_status_t WP_SUCCESS;
-const wp_status_t WP_FAILURE;
+extern const size_t WP_MAX_LINE;
+extern const wp_status_t WP_SUCCESS;
+extern const wp_status_t WP_FAILURE;
 
 char *wp_safe_strcpy(char **dest, const char *src);
 
+/* Keep data written by different threads on different cache lines. */
+#define WP_CACHE_LINE_SIZE 64
+#define WP_CACHE_ALIGNED __attribute__((aligned(WP_CACHE_LINE_SIZE)))
+
 #ifdef NDEBUG
   #define wp_log(fileptr, priority, ...) ((void)0)
 #else
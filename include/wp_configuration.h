@@ -9,6 +9,8 @@
 #define	WP_CONFIGURATION__H
 
 #include <stdbool.h>
+#include <wp_cpu.h>
+#include <wp_pool.h>
 
 struct wp_daemonizer;
 struct __wp_configuration_private_t;
@@ -19,7 +21,11 @@ typedef void (*wp_daemon_on_start_method_fn)(const struct wp_daemonizer *);
 typedef struct wp_configuration {
   wp_status_t (*populate_from_file)(struct wp_configuration *self, const char *file_path);
   
-  /* TODO: revise: wp_status_t (*reload)(const struct wp_configuration *self); */
+  /*
+   * Re-read the settings that may change while running, the admission
+   * limits, from the file populate_from_file read. Others are left alone.
+   */
+  wp_status_t (*reload)(struct wp_configuration *self);
   
   bool (*get_enable_pid_lock)(const struct wp_configuration *self);
   void (*set_enable_pid_lock)(const struct wp_configuration *self, bool value);
@@ -32,9 +38,20 @@ typedef struct wp_configuration {
   void (*set_print_arguments)(const struct wp_configuration *self, bool value);
   bool (*get_print_config_options)(const struct wp_configuration *self);
   void (*set_print_config_options)(const struct wp_configuration *self, bool value);
+  bool (*get_enable_ready_on_start)(const struct wp_configuration *self);
+  void (*set_enable_ready_on_start)(const struct wp_configuration *self, bool value);
 
   void (*configuration_print)(const struct wp_configuration *self);
 
+  /*
+   * Keep a parsed copy of the config file in <file>.snap, which later starts
+   * and reloads map instead of parsing the text while the file is unchanged.
+   * It holds the settings as the parse left them, so make any settings of
+   * your own after populate_from_file.
+   */
+  bool (*get_enable_config_snapshot)(const struct wp_configuration *self);
+  void (*set_enable_config_snapshot)(const struct wp_configuration *self, bool value);
+
   char *(*get_config_file_path)(const struct wp_configuration *self);
   void (*set_config_file_path)(const struct wp_configuration *self, const char *value);
   char *(*get_run_folder_path)(const struct wp_configuration *self);
@@ -42,9 +59,83 @@ typedef struct wp_configuration {
   void (*set_lock_file_path)(const struct wp_configuration *self, const char *value);
   char *(*get_uid)(const struct wp_configuration *self);
 
+  /* Listen addresses: "tcp://host:port", "udp://host:port" (IPv6 hosts in brackets) or "unix:/path". */
+  size_t (*get_listen_address_count)(const struct wp_configuration *self);
+  const char *(*get_listen_address)(const struct wp_configuration *self, size_t index);
+  wp_status_t (*add_listen_address)(const struct wp_configuration *self, const char *value);
+  int (*get_listen_backlog)(const struct wp_configuration *self);
+  void (*set_listen_backlog)(const struct wp_configuration *self, int value);
+  /* Seconds for TCP_DEFER_ACCEPT on TCP listeners, 0 to leave it off. */
+  int (*get_listen_defer_accept)(const struct wp_configuration *self);
+  void (*set_listen_defer_accept)(const struct wp_configuration *self, int value);
+  /*
+   * Number of workers; each gets its own SO_REUSEPORT socket per address.
+   * Set 0 ("workers = auto") to use wp_cpu_count_available over the workers'
+   * CPU set, which respects affinity and cgroup quotas.
+   */
+  unsigned (*get_worker_count)(const struct wp_configuration *self);
+  void (*set_worker_count)(const struct wp_configuration *self, unsigned value);
+  /* CPUs a role is pinned to ("cpu_affinity_main" and so on take CPU lists), or NULL to leave it alone. */
+  const cpu_set_t *(*get_cpu_affinity)(const struct wp_configuration *self, wp_cpu_role_t role);
+  void (*set_cpu_affinity)(const struct wp_configuration *self, wp_cpu_role_t role, const cpu_set_t *value);
+
+  /* Milliseconds a handler on the main loop may run before the watchdog reports a stall; 0 for no watchdog. */
+  unsigned (*get_watchdog_budget_ms)(const struct wp_configuration *self);
+  void (*set_watchdog_budget_ms)(const struct wp_configuration *self, unsigned value);
+
+  /* Samples per CPU second for the built-in profiler; 0 leaves it off. */
+  unsigned (*get_profiler_hz)(const struct wp_configuration *self);
+  void (*set_profiler_hz)(const struct wp_configuration *self, unsigned value);
+  /* Write the profile to profile.<pid>.folded in the run folder on shutdown; off by default. */
+  bool (*get_profiler_dump)(const struct wp_configuration *self);
+  void (*set_profiler_dump)(const struct wp_configuration *self, bool value);
+
+  /* Milliseconds shutdown waits for in-flight work to drain before giving up on it. */
+  unsigned (*get_shutdown_drain_timeout_ms)(const struct wp_configuration *self);
+  void (*set_shutdown_drain_timeout_ms)(const struct wp_configuration *self, unsigned value);
+
+  /*
+   * Admission limits, reloaded on SIGHUP. Rates are per second and 0 means
+   * unlimited; a burst of 0 allows one second's worth. The accept rate is
+   * shared by every listener worker, the client rate applies to each client
+   * key, and the adaptive concurrency limit stays within
+   * [concurrency_limit_min, concurrency_limit_max] (a max of 0 leaves it off,
+   * a min of 0 means 1).
+   */
+  unsigned (*get_accept_rate_limit)(const struct wp_configuration *self);
+  void (*set_accept_rate_limit)(const struct wp_configuration *self, unsigned value);
+  unsigned (*get_accept_rate_burst)(const struct wp_configuration *self);
+  void (*set_accept_rate_burst)(const struct wp_configuration *self, unsigned value);
+  unsigned (*get_client_rate_limit)(const struct wp_configuration *self);
+  void (*set_client_rate_limit)(const struct wp_configuration *self, unsigned value);
+  unsigned (*get_client_rate_burst)(const struct wp_configuration *self);
+  void (*set_client_rate_burst)(const struct wp_configuration *self, unsigned value);
+  unsigned (*get_concurrency_limit_min)(const struct wp_configuration *self);
+  void (*set_concurrency_limit_min)(const struct wp_configuration *self, unsigned value);
+  unsigned (*get_concurrency_limit_max)(const struct wp_configuration *self);
+  void (*set_concurrency_limit_max)(const struct wp_configuration *self, unsigned value);
+
+  /* Bytes of the persistent state pool kept in the run folder; 0 leaves it off. */
+  size_t (*get_state_pool_size)(const struct wp_configuration *self);
+  void (*set_state_pool_size)(const struct wp_configuration *self, size_t value);
+
+  /* Bytes a wp_cache may hold; "cache_memory_budget" accepts k, m and g suffixes. */
+  size_t (*get_cache_memory_budget)(const struct wp_configuration *self);
+  void (*set_cache_memory_budget)(const struct wp_configuration *self, size_t value);
+
+  /* Backing for pools made with wp_pool_options_from_config. "pool_hugepages" is off, transparent or explicit. */
+  wp_pool_hugepages_t (*get_pool_hugepages)(const struct wp_configuration *self);
+  void (*set_pool_hugepages)(const struct wp_configuration *self, wp_pool_hugepages_t value);
+  bool (*get_pool_prefault)(const struct wp_configuration *self);
+  void (*set_pool_prefault)(const struct wp_configuration *self, bool value);
+  /* NUMA node to bind pools to, -1 for none. */
+  int (*get_pool_numa_node)(const struct wp_configuration *self);
+  void (*set_pool_numa_node)(const struct wp_configuration *self, int value);
+
   /**
    * Get the current wp_daemon_start_method_fn function pointer reference called
-   * on daemon start.
+   * on daemon start, or NULL, in which case start runs the main loop. A custom
+   * method must poll the daemonizer's should_stop to see signals.
    * @param self self must be an instance of the wp_configuration_pt.
    */
   wp_daemon_on_start_method_fn (*get_daemon_on_start_method)(const struct wp_configuration *self);
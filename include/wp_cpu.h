@@ -0,0 +1,66 @@
+/*
+ * File:   wp_cpu.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:47 AM
+ */
+
+#ifndef WP_CPU__H
+#define WP_CPU__H
+
+#include <sched.h>
+#include <stddef.h>
+#include <wp_common.h>
+
+/* The threads a daemon can pin, each to its own configured CPU set. */
+typedef enum wp_cpu_role {
+  WP_CPU_ROLE_MAIN = 0,
+  WP_CPU_ROLE_WORKERS,
+  WP_CPU_ROLE_LOGGER,
+  WP_CPU_ROLE_COUNT
+} wp_cpu_role_t;
+
+/**
+ * Parse a CPU list such as "0-3,8,10-11" into a set.
+ * @param list the CPU list.
+ * @param set receives the CPUs; cleared first.
+ * @return WP_SUCCESS, or WP_FAILURE if list is malformed or names a CPU past CPU_SETSIZE.
+ */
+wp_status_t wp_cpu_parse_list(const char *list, cpu_set_t *set);
+
+/**
+ * Format a set as a CPU list, the inverse of wp_cpu_parse_list.
+ * @param set the CPUs.
+ * @param buf receives the list, truncated to fit.
+ * @param size the size of buf.
+ * @return buf.
+ */
+char *wp_cpu_format_list(const cpu_set_t *set, char *buf, size_t size);
+
+/**
+ * Count the CPUs this process can actually use: those in its affinity mask
+ * (intersected with within, if given), capped by the cgroup v2 cpu.max
+ * quota of its cgroup and every ancestor, rounded up. Use this rather than
+ * the host's core count to size thread and process pools.
+ * @param within limit the count to these CPUs, or NULL.
+ * @return the count, at least 1.
+ */
+unsigned wp_cpu_count_available(const cpu_set_t *within);
+
+/**
+ * Pin the calling thread to a set of CPUs.
+ * @param set the CPUs; CPUs outside the process's affinity are dropped.
+ * @return WP_SUCCESS, or WP_FAILURE if no CPU in set is usable.
+ */
+wp_status_t wp_cpu_pin_thread(const cpu_set_t *set);
+
+/**
+ * Pin the calling thread to the index'th CPU of set, wrapping around, so
+ * that workers 0..n-1 each get a core of their own.
+ * @param set the CPUs.
+ * @param index the worker's index.
+ * @return WP_SUCCESS, or WP_FAILURE if set is empty or the CPU is unusable.
+ */
+wp_status_t wp_cpu_pin_thread_to_nth(const cpu_set_t *set, unsigned index);
+
+#endif /* WP_CPU__H */
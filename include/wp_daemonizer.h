@@ -8,8 +8,17 @@
 #ifndef WP_DAEMONIZER__H
 #define WP_DAEMONIZER__H
 
+#include <stdint.h>
 #include <wp_common.h>
 #include <wp_configuration.h>
+#include <wp_cpu.h>
+#include <wp_event_loop.h>
+#include <wp_fiber.h>
+#include <wp_limiter.h>
+#include <wp_listener.h>
+#include <wp_profiler.h>
+#include <wp_supervisor.h>
+#include <wp_watchdog.h>
 
 struct wp_daemonizer;
 
@@ -19,23 +28,120 @@ typedef struct __wp_daemonizer_private_t *wp_daemonizer_private_t;
 
 typedef void (*wp_reconfigure_method_fn)(const struct wp_daemonizer *, wp_configuration_pt);
 
+/*
+ * Polled while shutdown drains: return true once no work is in flight. The
+ * first call comes just after the listener closes, and is the cue to stop
+ * taking new work, e.g. by closing idle keep-alive connections.
+ */
+typedef bool (*wp_drain_method_fn)(const struct wp_daemonizer *self, void *arg);
+
+/* Startup phases recorded by the daemonizer, in the order they happen. */
+typedef enum wp_startup_phase {
+  WP_STARTUP_PHASE_CONFIG_LOAD = 0,
+  WP_STARTUP_PHASE_BIND,
+  WP_STARTUP_PHASE_SETUID,
+  WP_STARTUP_PHASE_FORK,
+  WP_STARTUP_PHASE_CHDIR,
+  WP_STARTUP_PHASE_PID_LOCK,
+  WP_STARTUP_PHASE_REDIRECT_FDS,
+  /* From initialization until the daemon reported itself ready. */
+  WP_STARTUP_PHASE_READY,
+  WP_STARTUP_PHASE_COUNT
+} wp_startup_phase_t;
+
 /* Here's the public interface! */
 typedef struct wp_daemonizer {
   /* The daemonize method which will fork, etc., our process */
   wp_status_t (*daemonize)(const struct wp_daemonizer *self);
   /* Start the "main loop." */
   wp_status_t (*start)(const struct wp_daemonizer *self);
+  /* The main loop, run by start when no on start method is configured. */
+  const wp_event_loop_t *(*get_event_loop)(const struct wp_daemonizer *self);
+  /* Sockets bound by daemonize from the listen configuration, or NULL. */
+  const wp_listener_t *(*get_listener)(const struct wp_daemonizer *self);
+  /* Fibers run from the main loop, created on first use; NULL if that fails. */
+  const wp_fiber_scheduler_t *(*get_fiber_scheduler)(const struct wp_daemonizer *self);
+  /*
+   * The persistent pool in <run folder>/wpd.state, opened on first use when
+   * state_pool_size and a run folder are set, or NULL. layout and
+   * reattached_out are as for wp_pool_new_persistent; later calls return the
+   * same pool. Shutdown seals it, so save caches and maps into it
+   * (wp_cache_save, wp_hash_map_save) before then, and load them back when
+   * it's reattached.
+   */
+  const wp_pool_t *(*get_state_pool)(const struct wp_daemonizer *self, uint32_t layout, bool *reattached_out);
+  /* Helper processes reaped from the main loop, created on first use; NULL if that fails. */
+  const wp_supervisor_t *(*get_supervisor)(const struct wp_daemonizer *self);
+  /* The watchdog start runs on the main loop when watchdog_budget_ms is set, or NULL. Watch worker loops with it too. */
+  const wp_watchdog_t *(*get_watchdog)(const struct wp_daemonizer *self);
+  /*
+   * The profiler started when profiler_hz is set, or NULL. It samples the
+   * main thread; other threads register themselves. With profiler_dump set,
+   * shutdown writes the stacks to profile.<pid>.folded in the run folder.
+   */
+  const wp_profiler_t *(*get_profiler)(const struct wp_daemonizer *self);
+  /* Write the folded stacks profiled so far to path. */
+  wp_status_t (*dump_profile)(const struct wp_daemonizer *self, const char *path);
+  /*
+   * Admission control, created on first use when client_rate_limit or
+   * concurrency_limit_max is set, or NULL. Key the client limiter by, e.g.,
+   * peer address. The listener sheds over accept_rate_limit by itself.
+   */
+  const wp_rate_limiter_t *(*get_client_limiter)(const struct wp_daemonizer *self);
+  const wp_concurrency_limiter_t *(*get_concurrency_limiter)(const struct wp_daemonizer *self);
+  /*
+   * Re-read the limits from the config file and apply them, then call the
+   * reconfigure method so the application can pick up its own. SIGHUP does this.
+   */
+  wp_status_t (*reload)(const struct wp_daemonizer *self);
 
   /* Return an instance of the daemon singleton. */
   struct wp_daemonizer* (*get_instance)();
 
-  /* Handle signals from the OS. */
+  /* Handle signals from the OS. Async-signal-safe: it queues them for the main loop. */
   void (*signal_handler)(int sig);
   void (*install_signal_handlers)();
-  /* Shutdown the daemon. */
+  /* Release everything and remove the pid lock. Register it with atexit. */
   void (*shutdown)();
+  /*
+   * Shut down gracefully, as SIGTERM and SIGINT do: send STOPPING=1, close
+   * the listener, then poll the drain method until it reports idle or
+   * shutdown_drain_timeout_ms passes, and stop the main loop so that start
+   * returns. A second signal cuts the drain short. An on start method that
+   * doesn't run the main loop uses should_stop instead.
+   */
+  void (*begin_shutdown)(const struct wp_daemonizer *self);
+  bool (*is_shutting_down)(const struct wp_daemonizer *self);
+  /*
+   * For on start methods with a loop of their own: act on queued signals
+   * (SIGHUP reloads, SIGTERM and SIGINT begin shutdown) and return true once
+   * shutdown has begun. The on start method then drains its own work and
+   * returns. Call it whenever get_signal_fd is readable, or on every pass.
+   */
+  bool (*should_stop)(const struct wp_daemonizer *self);
+  /* Readable while signals are queued, for on start methods to poll; -1 if signals aren't watched. */
+  int (*get_signal_fd)(const struct wp_daemonizer *self);
+  void (*set_drain_method)(const struct wp_daemonizer *self, wp_drain_method_fn fn, void *arg);
 
   void (*set_reconfigure_method)(const struct wp_daemonizer *self, wp_reconfigure_method_fn fn);
+
+  /* Tell the original parent and the service manager that we're serving. */
+  wp_status_t (*notify_ready)(const struct wp_daemonizer *self);
+  /* Send a state string (e.g. "STATUS=loading") to $NOTIFY_SOCKET, if set. */
+  wp_status_t (*notify)(const struct wp_daemonizer *self, const char *state);
+
+  /* Nanoseconds spent in a startup phase, or 0 if the phase didn't run. */
+  uint64_t (*get_startup_phase_ns)(const struct wp_daemonizer *self, wp_startup_phase_t phase);
+  /* Log the startup timeline, one line per phase. */
+  void (*log_startup_timeline)(const struct wp_daemonizer *self);
+  /*
+   * Pin the calling thread to its role's configured CPUs. Worker index gets
+   * the index'th CPU of the workers' set to itself. A no-op for roles with no
+   * CPU set configured. daemonize pins the main thread.
+   */
+  wp_status_t (*pin_thread)(const struct wp_daemonizer *self, wp_cpu_role_t role, unsigned index);
+  /* Log the accounting of every pool not yet deleted; shutdown does this too. */
+  void (*log_pool_report)(const struct wp_daemonizer *self);
   
   /* Our private implementation details. */
   wp_daemonizer_private_t data;
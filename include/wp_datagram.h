@@ -0,0 +1,86 @@
+/*
+ * File:   wp_datagram.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:36 AM
+ */
+
+#ifndef WP_DATAGRAM__H
+#define WP_DATAGRAM__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_pool.h>
+
+struct wp_datagram_batch;
+
+/* Keep the private impementation... private. */
+struct __wp_datagram_batch_private_t;
+typedef struct __wp_datagram_batch_private_t *wp_datagram_batch_private_t;
+
+typedef struct wp_datagram {
+  /* Received: points into the batch's buffers. Sent: the caller's bytes. */
+  char *data;
+  size_t len;
+  /*
+   * With GRO, data holds len / segment_size coalesced datagrams from the same
+   * peer, each segment_size bytes except perhaps the last; 0 otherwise.
+   */
+  size_t segment_size;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+} wp_datagram_t;
+
+/* Called with every datagram received on fd by one recvmmsg. */
+typedef void (*wp_datagram_batch_fn)(const struct wp_datagram_batch *batch, int fd,
+                                     wp_datagram_t *datagrams, size_t count, void *arg);
+
+typedef struct wp_datagram_batch {
+  /* Receive up to capacity datagrams with a single recvmmsg; -1 on error. */
+  int (*recv)(const struct wp_datagram_batch *self, int fd);
+  /* The index'th datagram from the last recv. */
+  wp_datagram_t *(*get)(const struct wp_datagram_batch *self, size_t index);
+
+  /*
+   * Send datagrams with as few sendmmsg calls as possible; returns how many
+   * went out whole. GSO datagrams of more than 64 segments go as several messages.
+   */
+  int (*send)(const struct wp_datagram_batch *self, int fd, const wp_datagram_t *datagrams, size_t count);
+  /* Send len bytes as segment_size sized datagrams in one call using UDP GSO. */
+  wp_status_t (*send_segmented)(const struct wp_datagram_batch *self, int fd, const void *data, size_t len,
+                                size_t segment_size, const struct sockaddr *addr, socklen_t addr_len);
+
+  /* Receive on fd from loop, handing each batch to fn. */
+  wp_status_t (*attach)(const struct wp_datagram_batch *self, const wp_event_loop_t *loop, int fd,
+                        wp_datagram_batch_fn fn, void *arg);
+  void (*detach)(const struct wp_datagram_batch *self, const wp_event_loop_t *loop, int fd);
+
+  size_t (*get_capacity)(const struct wp_datagram_batch *self);
+
+  wp_datagram_batch_private_t data;
+} wp_datagram_batch_t;
+
+/**
+ * Create a batch of capacity receive buffers of buffer_size bytes each, all
+ * preallocated from a child of pool. A batch is used by one thread at a time,
+ * the pool's thread.
+ * @param self_out will point to the new batch, or NULL on failure.
+ * @param pool the pool the buffers and message headers are allocated from; not a persistent pool.
+ * @param capacity the most datagrams a single recv returns.
+ * @param buffer_size the bytes per datagram; use 65535 or more with GRO.
+ * @param enable_gro ask the kernel to coalesce datagrams on attached sockets.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_datagram_batch_new(wp_datagram_batch_t **self_out, const wp_pool_t *pool,
+                                  size_t capacity, size_t buffer_size, bool enable_gro);
+
+/**
+ * Delete a batch, giving its buffers back to the pool. Delete it before the pool.
+ * @param self the batch to delete.
+ */
+void wp_datagram_batch_delete(wp_datagram_batch_t *self);
+
+#endif /* WP_DATAGRAM__H */
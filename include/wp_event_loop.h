@@ -0,0 +1,127 @@
+/*
+ * File:   wp_event_loop.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:17 AM
+ */
+
+#ifndef WP_EVENT_LOOP__H
+#define WP_EVENT_LOOP__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+
+struct wp_event_loop;
+
+/* Keep the private impementation... private. */
+struct __wp_event_loop_private_t;
+typedef struct __wp_event_loop_private_t *wp_event_loop_private_t;
+
+/* Called with the ready epoll events (EPOLLIN, EPOLLOUT, ...) for fd. */
+typedef void (*wp_event_handler_fn)(const struct wp_event_loop *loop, int fd, uint32_t events, void *arg);
+
+/* Bucket 0 counts durations under 1us, bucket n those in [2^(n-1), 2^n) us. */
+#define WP_LATENCY_BUCKETS 32
+
+typedef struct wp_latency_histogram {
+  uint64_t buckets[WP_LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} wp_latency_histogram_t;
+
+/* Runtimes of one handler function, across every fd it serves. */
+typedef struct wp_callback_histogram {
+  wp_event_handler_fn fn;
+  wp_latency_histogram_t histogram;
+} wp_callback_histogram_t;
+
+/* What an instrumented loop is doing, for a watchdog on another thread. */
+typedef struct wp_event_loop_heartbeat {
+  /* Handlers dispatched so far. */
+  uint64_t progress;
+  /* CLOCK_MONOTONIC nanoseconds when the running handler started, 0 between handlers. */
+  uint64_t busy_since_ns;
+  /* The running handler, or NULL. */
+  wp_event_handler_fn handler;
+  /* The thread that last ran the loop, 0 if none has. */
+  pid_t tid;
+} wp_event_loop_heartbeat_t;
+
+typedef struct wp_event_loop {
+  /* Watch fd for events, calling fn whenever any of them is ready. */
+  wp_status_t (*add)(const struct wp_event_loop *self, int fd, uint32_t events, wp_event_handler_fn fn, void *arg);
+  /* Change the events watched on an fd already added. */
+  wp_status_t (*modify)(const struct wp_event_loop *self, int fd, uint32_t events);
+  /* Stop watching fd. Safe to call from inside a handler. */
+  wp_status_t (*remove)(const struct wp_event_loop *self, int fd);
+
+  /* Dispatch events until stop is called. */
+  wp_status_t (*run)(const struct wp_event_loop *self);
+  /* Dispatch a single batch, waiting at most timeout_ms (-1 waits forever). */
+  wp_status_t (*run_once)(const struct wp_event_loop *self, int timeout_ms);
+  /* Ask run to return after the current batch. Async-signal-safe. */
+  void (*stop)(const struct wp_event_loop *self);
+  bool (*is_running)(const struct wp_event_loop *self);
+
+  /*
+   * Time every handler and batch, at the cost of a clock read per handler.
+   * Off by default; a wp_watchdog turns it on for the loops it watches.
+   */
+  wp_status_t (*set_instrumented)(const struct wp_event_loop *self, bool value);
+  /* Read from any thread; fields are each current but not a consistent snapshot. */
+  void (*get_heartbeat)(const struct wp_event_loop *self, wp_event_loop_heartbeat_t *heartbeat);
+  /* Loop lag: how long each batch took to dispatch, so how long a ready event could wait. */
+  void (*get_lag_histogram)(const struct wp_event_loop *self, wp_latency_histogram_t *histogram);
+  /* Copy up to max per-handler histograms into out; returns how many there are. */
+  size_t (*get_callback_histograms)(const struct wp_event_loop *self, wp_callback_histogram_t *out, size_t max);
+
+  /*
+   * The request arena for fd: a pool handlers allocate from (wp_string
+   * values, buffers) without freeing anything themselves. It's made on first
+   * use, and reset and kept for another fd when fd is removed or added
+   * again, so fetch it after add; reset it yourself between requests on one
+   * connection. Arenas are recycled from a free list and share spare blocks,
+   * so a steady load makes no allocations. Use it on the loop's thread only.
+   * NULL if one couldn't be made.
+   */
+  const wp_pool_t *(*get_arena)(const struct wp_event_loop *self, int fd);
+
+  wp_event_loop_private_t data;
+} wp_event_loop_t;
+
+/**
+ * Create a new epoll backed event loop.
+ * @param self_out will point to the new loop, or NULL on failure.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_event_loop_new(wp_event_loop_t **self_out);
+
+/**
+ * Delete an event loop. Watched fds are not closed.
+ * @param self the loop to delete.
+ */
+void wp_event_loop_delete(wp_event_loop_t *self);
+
+/**
+ * Count a duration in a histogram. Only one thread may record into a
+ * histogram, though any may read it.
+ * @param histogram the histogram.
+ * @param ns the duration in nanoseconds.
+ */
+void wp_latency_histogram_record(wp_latency_histogram_t *histogram, uint64_t ns);
+
+/**
+ * Estimate a percentile from a histogram.
+ * @param histogram the histogram.
+ * @param percentile 0 to 100.
+ * @return the upper bound of the bucket holding the percentile, in microseconds.
+ */
+uint64_t wp_latency_histogram_percentile_us(const wp_latency_histogram_t *histogram, double percentile);
+
+#endif /* WP_EVENT_LOOP__H */
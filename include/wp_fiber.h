@@ -0,0 +1,86 @@
+/*
+ * File:   wp_fiber.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:34 AM
+ */
+
+#ifndef WP_FIBER__H
+#define WP_FIBER__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+
+/* Stack size used when wp_fiber_scheduler_new is passed 0. */
+#define WP_FIBER_DEFAULT_STACK_SIZE (64 * 1024)
+
+struct wp_fiber_scheduler;
+
+/* Keep the private impementation... private. */
+struct __wp_fiber_scheduler_private_t;
+typedef struct __wp_fiber_scheduler_private_t *wp_fiber_scheduler_private_t;
+
+/* The body of a fiber. The fiber ends when it returns. */
+typedef void (*wp_fiber_fn)(const struct wp_fiber_scheduler *scheduler, void *arg);
+
+/*
+ * Cooperative fibers multiplexed onto an event loop's thread. A fiber runs
+ * until it yields or its I/O would block; it then parks while the loop
+ * dispatches other work and resumes once its fd is ready. Stacks come from a
+ * pool of guard-paged mappings and are reused. Context switches are
+ * hand-written for x86-64 and aarch64, and use ucontext elsewhere.
+ *
+ * Everything here must be called on the loop's thread. The blocking calls
+ * (yield, wait_fd, read, write, accept) must be called from inside a fiber.
+ */
+typedef struct wp_fiber_scheduler {
+  /* Start fn(arg) in a new fiber. It first runs once the caller yields or returns to the loop. */
+  wp_status_t (*spawn)(const struct wp_fiber_scheduler *self, wp_fiber_fn fn, void *arg);
+  /* Let every other ready fiber run, then continue. */
+  void (*yield)(const struct wp_fiber_scheduler *self);
+  /*
+   * Park until fd reports any of events (EPOLLIN, EPOLLOUT). Call only after
+   * an operation on fd failed with EAGAIN: fds are watched edge-triggered.
+   * Fails with EBADF if another fiber closes fd meanwhile.
+   */
+  wp_status_t (*wait_fd)(const struct wp_fiber_scheduler *self, int fd, uint32_t events);
+
+  /* Like read(2) on a non-blocking fd, parking instead of failing with EAGAIN. */
+  ssize_t (*read)(const struct wp_fiber_scheduler *self, int fd, void *buf, size_t len);
+  /* Like write(2) on a non-blocking fd, parking until all of buf is written. */
+  ssize_t (*write)(const struct wp_fiber_scheduler *self, int fd, const void *buf, size_t len);
+  /* Like accept4(2) with SOCK_NONBLOCK | SOCK_CLOEXEC, parking until a connection arrives. */
+  int (*accept)(const struct wp_fiber_scheduler *self, int fd, struct sockaddr *addr, socklen_t *addr_len);
+  /* Stop watching fd and close it; fibers parked on it fail with EBADF. Use instead of close(2) on fds waited on. */
+  int (*close)(const struct wp_fiber_scheduler *self, int fd);
+
+  /* Is the caller running inside one of our fibers? */
+  bool (*in_fiber)(const struct wp_fiber_scheduler *self);
+  /* Fibers started and not yet finished. */
+  size_t (*get_fiber_count)(const struct wp_fiber_scheduler *self);
+
+  wp_fiber_scheduler_private_t data;
+} wp_fiber_scheduler_t;
+
+/**
+ * Create a scheduler that runs its fibers from loop.
+ * @param self_out will point to the new scheduler, or NULL on failure.
+ * @param loop the event loop that wakes parked fibers.
+ * @param stack_size usable bytes per fiber stack, or 0 for WP_FIBER_DEFAULT_STACK_SIZE.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_fiber_scheduler_new(wp_fiber_scheduler_t **self_out, const wp_event_loop_t *loop, size_t stack_size);
+
+/**
+ * Delete a scheduler. Fibers that have not finished are abandoned and their
+ * stacks unmapped. Must not be called from inside a fiber.
+ * @param self the scheduler to delete.
+ */
+void wp_fiber_scheduler_delete(wp_fiber_scheduler_t *self);
+
+#endif /* WP_FIBER__H */
@@ -0,0 +1,117 @@
+/*
+ * File:   wp_format.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:07 AM
+ */
+
+#ifndef WP_FORMAT__H
+#define WP_FORMAT__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+#include <wp_string.h>
+
+/* Longest output of wp_fmt_double, e.g. "-0.0000012345678901234567". */
+#define WP_FMT_DOUBLE_MAX 25
+
+/*
+ * A formatting buffer, embedded by the caller, that appenders write into
+ * with no format string parsing, no locale and no stdio locks. It writes
+ * either into a fixed buffer, dropping what doesn't fit and setting
+ * truncated, or into memory from a pool, growing as needed. The contents are
+ * always NUL terminated. The fields are for reading only.
+ */
+typedef struct wp_fmt {
+  char *buf;
+  size_t len;
+  /* Bytes available, the terminator included. */
+  size_t cap;
+  const wp_pool_t *pool;
+  bool truncated;
+} wp_fmt_t;
+
+/**
+ * Format into a fixed buffer, e.g. on the stack.
+ * @param fmt the formatter to initialize.
+ * @param buf the buffer.
+ * @param cap its size; at least 1.
+ */
+void wp_fmt_init(wp_fmt_t *fmt, char *buf, size_t cap);
+
+/**
+ * Format into memory from pool. Growing leaves the outgrown buffers in the
+ * pool until it's deleted, so size initial for the common case.
+ * @param fmt the formatter to initialize.
+ * @param pool the pool to allocate from.
+ * @param initial the first buffer's size, 0 for 128.
+ * @return WP_SUCCESS, or WP_FAILURE if the pool couldn't allocate.
+ */
+wp_status_t wp_fmt_init_pool(wp_fmt_t *fmt, const wp_pool_t *pool, size_t initial);
+
+/* Empty the formatter, keeping its buffer. */
+void wp_fmt_reset(wp_fmt_t *fmt);
+
+void wp_fmt_bytes(wp_fmt_t *fmt, const char *bytes, size_t len);
+void wp_fmt_str(wp_fmt_t *fmt, const char *str);
+void wp_fmt_char(wp_fmt_t *fmt, char c);
+/* Decimal, two digits at a time. */
+void wp_fmt_u64(wp_fmt_t *fmt, uint64_t value);
+void wp_fmt_i64(wp_fmt_t *fmt, int64_t value);
+/* Lower case hex without a prefix, zero padded to at least digits digits. */
+void wp_fmt_hex(wp_fmt_t *fmt, uint64_t value, unsigned digits);
+/*
+ * The shortest decimal that reads back as value (Grisu2, so shortest in all
+ * but rare cases, and always exact on the way back): "0.1", "1.0", "1e+21",
+ * "nan", "-inf".
+ */
+void wp_fmt_double(wp_fmt_t *fmt, double value);
+/*
+ * bytes quoted and escaped as a JSON string: quotes, backslashes and control
+ * characters are escaped, everything else is copied.
+ */
+void wp_fmt_escaped(wp_fmt_t *fmt, const char *bytes, size_t len);
+
+/**
+ * Make a wp_string of what's been formatted.
+ * @param fmt the formatter.
+ * @param pool the pool for the string.
+ * @param str_out will point to the new string.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_fmt_to_string(const wp_fmt_t *fmt, const wp_pool_t *pool, wp_string_t **str_out);
+
+/**
+ * Write what's been formatted and a newline to fd in a single write, so
+ * that lines from different threads don't interleave.
+ * @param fmt the formatter.
+ * @param fd the file descriptor.
+ * @return WP_SUCCESS if everything was written, otherwise WP_FAILURE.
+ */
+wp_status_t wp_fmt_write_line(const wp_fmt_t *fmt, int fd);
+
+/*
+ * wp_log for a line already formatted with a wp_fmt_t. It skips printf
+ * entirely, and bypasses fileptr's buffer when not running as a daemon.
+ */
+#ifdef NDEBUG
+  #define wp_log_fmt(fileptr, config, priority, fmt) ((void)0)
+#else
+  #define wp_log_fmt(fileptr, config, priority, fmt) \
+    do { \
+      if(config) { \
+        if(config->get_enable_verbose_logging(config)) { \
+          if(config->get_enable_daemon(config)) { \
+            syslog((priority), "%s", (fmt)->buf); \
+          } else { \
+            wp_fmt_write_line((fmt), fileno(fileptr)); \
+          } \
+        } \
+      } \
+    } while(0)
+#endif
+
+#endif /* WP_FORMAT__H */
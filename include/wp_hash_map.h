@@ -0,0 +1,98 @@
+/*
+ * File:   wp_hash_map.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:37 AM
+ */
+
+#ifndef WP_HASH_MAP__H
+#define WP_HASH_MAP__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+#include <wp_string.h>
+
+struct wp_hash_map;
+
+/* Keep the private impementation... private. */
+struct __wp_hash_map_private_t;
+typedef struct __wp_hash_map_private_t *wp_hash_map_private_t;
+
+/* Called by for_each with every entry. */
+typedef void (*wp_hash_map_fn)(const wp_string_t *key, void *value, void *arg);
+
+/*
+ * An open addressing hash map from wp_string keys to pointers, laid out as a
+ * "Swiss table": a byte of control data per slot holds 7 bits of the hash, and
+ * lookups compare a whole group of control bytes at once (16 with SSE2, 8 with
+ * plain 64 bit arithmetic) before touching any keys.
+ *
+ * Keys are referenced, not copied, and must outlive their entries. Tables
+ * come from the pool; growing abandons the old table to the pool, so reserve
+ * up front when the size is known. Not thread safe.
+ */
+typedef struct wp_hash_map {
+  /* Insert or replace the value for key. */
+  wp_status_t (*put)(const struct wp_hash_map *self, const wp_string_t *key, void *value);
+  /* The value for key, or NULL if there is none. */
+  void *(*get)(const struct wp_hash_map *self, const wp_string_t *key);
+  /* The value for the len bytes at key, or NULL; no wp_string needed. */
+  void *(*get_bytes)(const struct wp_hash_map *self, const char *key, size_t len);
+  /* Like get_bytes, but tells a missing key from a NULL value. */
+  bool (*find_bytes)(const struct wp_hash_map *self, const char *key, size_t len, void **value_out);
+  /* Remove key; false if it wasn't there. */
+  bool (*remove)(const struct wp_hash_map *self, const wp_string_t *key);
+  bool (*remove_bytes)(const struct wp_hash_map *self, const char *key, size_t len);
+
+  /* Make room for count entries without further growth. */
+  wp_status_t (*reserve)(const struct wp_hash_map *self, size_t count);
+  /* Remove every entry, keeping the table. */
+  void (*clear)(const struct wp_hash_map *self);
+  void (*for_each)(const struct wp_hash_map *self, wp_hash_map_fn fn, void *arg);
+  size_t (*get_size)(const struct wp_hash_map *self);
+
+  wp_hash_map_private_t data;
+} wp_hash_map_t;
+
+/**
+ * Create a map allocating from pool.
+ * @param self_out will point to the new map, or NULL on failure.
+ * @param pool the pool to allocate tables from.
+ * @param capacity the number of entries to reserve room for; 0 defers allocation.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_hash_map_new(wp_hash_map_t **self_out, const wp_pool_t *pool, size_t capacity);
+
+/**
+ * Delete a map. Keys and values are untouched, and its tables stay in the pool.
+ * @param self the map to delete.
+ */
+void wp_hash_map_delete(wp_hash_map_t *self);
+
+/**
+ * Save a map whose values live in a persistent pool (or are NULL) into that
+ * pool, e.g. the daemonizer's state pool at shutdown. Key bytes are copied;
+ * values are kept as offsets, so the next run gets the same objects back
+ * without rebuilding them. Keep the offset in the pool's root.
+ * @param self the map.
+ * @param state the persistent pool holding the values.
+ * @return the image's offset, or 0 if a value is outside the pool or there's no room.
+ */
+wp_pool_offset_t wp_hash_map_save(const wp_hash_map_t *self, const wp_pool_t *state);
+
+/**
+ * Put back the entries of an image saved by wp_hash_map_save. Keys are made
+ * again as wp_strings from key_pool, read as C strings; values point into
+ * state. The image stays in the pool; wp_pool_rewind it once it's loaded.
+ * @param self the map.
+ * @param state the persistent pool holding the image and the values.
+ * @param image the offset wp_hash_map_save returned.
+ * @param key_pool the pool to make keys from.
+ * @return the entries loaded, or -1 if image isn't a valid map image or a key couldn't be made.
+ */
+ssize_t wp_hash_map_load(const wp_hash_map_t *self, const wp_pool_t *state, wp_pool_offset_t image, const wp_pool_t *key_pool);
+
+#endif /* WP_HASH_MAP__H */
@@ -0,0 +1,142 @@
+/*
+ * File:   wp_limiter.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:21 AM
+ */
+
+#ifndef WP_LIMITER__H
+#define WP_LIMITER__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wp_common.h>
+
+/*
+ * Admission control: cheap checks that refuse work up front, so overload
+ * sheds requests instead of queueing them until latency explodes.
+ */
+
+/*
+ * A token bucket, embedded by the caller and shared by any number of
+ * threads. It's kept as the time the bucket will next be full (GCRA), so a
+ * take is a single compare-and-swap on that one word, with no lock and no
+ * separate refill.
+ */
+typedef struct wp_token_bucket {
+  /* CLOCK_MONOTONIC nanoseconds when the bucket is next full. */
+  uint64_t full_at;
+  /* Nanoseconds per token, 0 for unlimited, and how far ahead of now full_at may run. */
+  uint64_t interval_ns;
+  uint64_t burst_ns;
+} wp_token_bucket_t;
+
+/**
+ * Prepare a full bucket.
+ * @param bucket the bucket to initialize.
+ * @param rate tokens per second; 0 or less never refuses.
+ * @param burst tokens the bucket holds; 0 for one second's worth.
+ */
+void wp_token_bucket_init(wp_token_bucket_t *bucket, double rate, unsigned burst);
+
+/* Change the rate and burst of a bucket in use, e.g. on reload. */
+void wp_token_bucket_set_rate(wp_token_bucket_t *bucket, double rate, unsigned burst);
+
+/**
+ * Take tokens if the bucket has them. Lock free.
+ * @param bucket the bucket.
+ * @param tokens how many to take.
+ * @return true if taken, false to refuse the work.
+ */
+bool wp_token_bucket_take(wp_token_bucket_t *bucket, unsigned tokens);
+
+/* wp_token_bucket_take with the time, in CLOCK_MONOTONIC nanoseconds, already read. */
+bool wp_token_bucket_take_at(wp_token_bucket_t *bucket, unsigned tokens, uint64_t now_ns);
+
+struct wp_rate_limiter;
+
+/* Keep the private impementation... private. */
+struct __wp_rate_limiter_private_t;
+typedef struct __wp_rate_limiter_private_t *wp_rate_limiter_private_t;
+
+/*
+ * A token bucket per key (a client address, an API key...), all at the same
+ * rate, in a fixed table indexed by wp_string_hash_bytes. Safe to share
+ * between threads without locks. A full bucket is the same as a new one, so
+ * idle keys' slots are reused freely; only with more busy keys than a probe
+ * window holds does a key take over another's bucket, debt and all.
+ */
+typedef struct wp_rate_limiter {
+  /* Take tokens from key's bucket; false to refuse the work. */
+  bool (*take)(const struct wp_rate_limiter *self, const char *key, size_t len, unsigned tokens);
+  /* Change every key's rate and burst, as for wp_token_bucket_set_rate. */
+  void (*set_rate)(const struct wp_rate_limiter *self, double rate, unsigned burst);
+  /* Takes refused so far. */
+  uint64_t (*get_refused)(const struct wp_rate_limiter *self);
+
+  wp_rate_limiter_private_t data;
+} wp_rate_limiter_t;
+
+/**
+ * Create a keyed rate limiter.
+ * @param self_out will point to the new limiter, or NULL on failure.
+ * @param slots buckets in the table, rounded up to a power of two; 16 bytes each.
+ * @param rate tokens per second for each key.
+ * @param burst tokens each key's bucket holds; 0 for one second's worth.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_rate_limiter_new(wp_rate_limiter_t **self_out, size_t slots, double rate, unsigned burst);
+
+/**
+ * Delete a keyed rate limiter.
+ * @param self the limiter to delete.
+ */
+void wp_rate_limiter_delete(wp_rate_limiter_t *self);
+
+struct wp_concurrency_limiter;
+
+/* Keep the private impementation... private. */
+struct __wp_concurrency_limiter_private_t;
+typedef struct __wp_concurrency_limiter_private_t *wp_concurrency_limiter_private_t;
+
+/*
+ * Caps the requests in flight at a limit it finds from their latency, after
+ * the gradient approach: every window of samples it compares the recent
+ * latency with a slow moving baseline, shrinking the limit as the two part
+ * (a queue is building) and growing it by about its square root while they
+ * agree. A request that failed from overload cuts the limit by a tenth. All
+ * of it is lock free; the window's update runs on whichever thread closes it.
+ */
+typedef struct wp_concurrency_limiter {
+  /* Admit a request, or return false to shed it. Pair every true with a release. */
+  bool (*acquire)(const struct wp_concurrency_limiter *self);
+  /* Finish an admitted request that took latency_ns; dropped if it timed out or was refused downstream. */
+  void (*release)(const struct wp_concurrency_limiter *self, uint64_t latency_ns, bool dropped);
+  /* Keep the limit within [min, max], e.g. on reload. */
+  void (*set_bounds)(const struct wp_concurrency_limiter *self, unsigned min, unsigned max);
+
+  unsigned (*get_limit)(const struct wp_concurrency_limiter *self);
+  unsigned (*get_in_flight)(const struct wp_concurrency_limiter *self);
+  /* Requests shed so far. */
+  uint64_t (*get_shed)(const struct wp_concurrency_limiter *self);
+
+  wp_concurrency_limiter_private_t data;
+} wp_concurrency_limiter_t;
+
+/**
+ * Create an adaptive concurrency limiter.
+ * @param self_out will point to the new limiter, or NULL on failure.
+ * @param min the lowest the limit goes; 0 means 1.
+ * @param max the highest the limit goes.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_concurrency_limiter_new(wp_concurrency_limiter_t **self_out, unsigned min, unsigned max);
+
+/**
+ * Delete an adaptive concurrency limiter.
+ * @param self the limiter to delete.
+ */
+void wp_concurrency_limiter_delete(wp_concurrency_limiter_t *self);
+
+#endif /* WP_LIMITER__H */
@@ -0,0 +1,87 @@
+/*
+ * File:   wp_listener.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:19 AM
+ */
+
+#ifndef WP_LISTENER__H
+#define WP_LISTENER__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <wp_common.h>
+#include <wp_configuration.h>
+#include <wp_event_loop.h>
+#include <wp_datagram.h>
+
+struct wp_listener;
+
+/* Keep the private impementation... private. */
+struct __wp_listener_private_t;
+typedef struct __wp_listener_private_t *wp_listener_private_t;
+
+/*
+ * Called for every accepted connection. client_fd is already non-blocking and
+ * close-on-exec, and belongs to the callee.
+ */
+typedef void (*wp_listener_accept_fn)(const struct wp_listener *listener, int client_fd,
+                                      const struct sockaddr *addr, socklen_t addr_len, void *arg);
+
+typedef struct wp_listener {
+  /*
+   * Bind and listen on every configured address. TCP and UDP addresses get
+   * one SO_REUSEPORT socket per worker so the kernel spreads load across
+   * workers; a Unix socket is shared by all of them. Call before dropping
+   * privileges so that privileged ports work.
+   */
+  wp_status_t (*bind)(const struct wp_listener *self);
+  /* Close every socket, removing Unix socket files. */
+  void (*close)(const struct wp_listener *self);
+
+  size_t (*get_endpoint_count)(const struct wp_listener *self);
+  unsigned (*get_worker_count)(const struct wp_listener *self);
+  /* Is the endpoint a "udp://" one? */
+  bool (*is_datagram)(const struct wp_listener *self, size_t endpoint);
+  /* The socket worker uses for an endpoint, or -1 if unbound. */
+  int (*get_fd)(const struct wp_listener *self, size_t endpoint, unsigned worker);
+
+  /* Watch worker's stream sockets on loop, calling fn for each accepted connection. */
+  wp_status_t (*attach)(const struct wp_listener *self, const wp_event_loop_t *loop, unsigned worker,
+                        wp_listener_accept_fn fn, void *arg);
+  /* Receive on worker's UDP sockets with batch, calling fn with each batch. */
+  wp_status_t (*attach_datagram)(const struct wp_listener *self, const wp_event_loop_t *loop, unsigned worker,
+                                 const wp_datagram_batch_t *batch, wp_datagram_batch_fn fn, void *arg);
+  /* Stop watching worker's stream sockets on loop. */
+  void (*detach)(const struct wp_listener *self, const wp_event_loop_t *loop, unsigned worker);
+
+  /*
+   * Cap connections accepted per second across every worker, closing the
+   * excess on accept; a rate of 0 lifts the cap. Starts from accept_rate_limit.
+   */
+  void (*set_accept_rate)(const struct wp_listener *self, double rate, unsigned burst);
+  /* Connections closed for going over the accept rate. */
+  uint64_t (*get_shed_count)(const struct wp_listener *self);
+
+  wp_listener_private_t data;
+} wp_listener_t;
+
+/**
+ * Create a listener for the listen addresses, backlog, TCP_DEFER_ACCEPT,
+ * worker count and accept rate in config. Nothing is bound until bind is
+ * called.
+ * @param self_out will point to the new listener, or NULL on failure.
+ * @param config the configuration to read listen settings from.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_listener_new(wp_listener_t **self_out, const wp_configuration_t *config);
+
+/**
+ * Close and delete a listener.
+ * @param self the listener to delete.
+ */
+void wp_listener_delete(wp_listener_t *self);
+
+#endif /* WP_LISTENER__H */
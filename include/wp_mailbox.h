@@ -0,0 +1,64 @@
+/*
+ * File:   wp_mailbox.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:27 AM
+ */
+
+#ifndef WP_MAILBOX__H
+#define WP_MAILBOX__H
+
+#include <stdbool.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+
+struct wp_mailbox;
+
+/* Keep the private impementation... private. */
+struct __wp_mailbox_private_t;
+typedef struct __wp_mailbox_private_t *wp_mailbox_private_t;
+
+/* Embed in the message; the mailbox links messages through it without allocating. */
+typedef struct wp_mailbox_node {
+  struct wp_mailbox_node *next;
+} wp_mailbox_node_t;
+
+/* Called on the consumer's loop for every message taken from the mailbox. */
+typedef void (*wp_mailbox_fn)(const struct wp_mailbox *mailbox, wp_mailbox_node_t *node, void *arg);
+
+/*
+ * An unbounded, intrusive multi-producer single-consumer queue (Vyukov). Any
+ * thread may post; only the thread owning the attached loop takes. The eventfd
+ * is written only by the post that finds the consumer idle, so a burst of
+ * messages costs one wakeup.
+ */
+typedef struct wp_mailbox {
+  /* Queue node. Safe from any thread; never blocks. */
+  void (*post)(const struct wp_mailbox *self, wp_mailbox_node_t *node);
+  /* Dequeue the oldest node, or NULL if there is none. Consumer only. */
+  wp_mailbox_node_t *(*take)(const struct wp_mailbox *self);
+  bool (*is_empty)(const struct wp_mailbox *self);
+
+  /* Deliver posted nodes to fn on loop's thread. */
+  wp_status_t (*attach)(const struct wp_mailbox *self, const wp_event_loop_t *loop, wp_mailbox_fn fn, void *arg);
+  void (*detach)(const struct wp_mailbox *self, const wp_event_loop_t *loop);
+  /* The eventfd that becomes readable when the idle consumer should wake. */
+  int (*get_fd)(const struct wp_mailbox *self);
+
+  wp_mailbox_private_t data;
+} wp_mailbox_t;
+
+/**
+ * Create an empty mailbox.
+ * @param self_out will point to the new mailbox, or NULL on failure.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_mailbox_new(wp_mailbox_t **self_out);
+
+/**
+ * Delete a mailbox. Nodes still queued belong to their owners.
+ * @param self the mailbox to delete.
+ */
+void wp_mailbox_delete(wp_mailbox_t *self);
+
+#endif /* WP_MAILBOX__H */
@@ -0,0 +1,50 @@
+/*
+ * File:   wp_mpmc_queue.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:27 AM
+ */
+
+#ifndef WP_MPMC_QUEUE__H
+#define WP_MPMC_QUEUE__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wp_common.h>
+
+struct wp_mpmc_queue;
+
+/* Keep the private impementation... private. */
+struct __wp_mpmc_queue_private_t;
+typedef struct __wp_mpmc_queue_private_t *wp_mpmc_queue_private_t;
+
+/*
+ * A bounded, lock-free multi-producer multi-consumer ring of pointers
+ * (Vyukov). Every cell carries a sequence number, so producers and consumers
+ * only contend on their own index and never on each other's.
+ */
+typedef struct wp_mpmc_queue {
+  /* Enqueue item; false when the queue is full. */
+  bool (*push)(const struct wp_mpmc_queue *self, void *item);
+  /* Dequeue into *item; false when the queue is empty. */
+  bool (*pop)(const struct wp_mpmc_queue *self, void **item);
+  size_t (*get_capacity)(const struct wp_mpmc_queue *self);
+
+  wp_mpmc_queue_private_t data;
+} wp_mpmc_queue_t;
+
+/**
+ * Create a queue.
+ * @param self_out will point to the new queue, or NULL on failure.
+ * @param capacity the number of slots, rounded up to a power of two (minimum 2).
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_mpmc_queue_new(wp_mpmc_queue_t **self_out, size_t capacity);
+
+/**
+ * Delete a queue. Items still queued are not freed.
+ * @param self the queue to delete.
+ */
+void wp_mpmc_queue_delete(wp_mpmc_queue_t *self);
+
+#endif /* WP_MPMC_QUEUE__H */
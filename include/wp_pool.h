@@ -8,20 +8,185 @@
 #ifndef WP_POOL__H
 #define	WP_POOL__H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <wp_common.h>
 
+struct wp_configuration;
+
 struct __wp_pool_private_t;
 typedef struct __wp_pool_private_t *wp_pool_private_t;
 
+/* Allocation size classes counted per pool: up to 16 bytes, 32, ... 256K, and anything larger. */
+#define WP_POOL_STAT_CLASSES 16
+
+#define WP_POOL_STRINGIFY_(x) #x
+#define WP_POOL_STRINGIFY(x) WP_POOL_STRINGIFY_(x)
+/* palloc, tagging the allocation with the calling file and line for reports. */
+#define WP_PALLOC(pool, size) \
+  ((pool)->palloc_tagged((pool), (size), __FILE__ ":" WP_POOL_STRINGIFY(__LINE__)))
+
+typedef struct wp_pool_stats {
+  /* Bytes handed out and not given back by pfree, alignment included. */
+  size_t live;
+  /* High-water mark of live, sampled whenever the pool grows or is reported. */
+  size_t peak;
+  /* Bytes of blocks held, headers included, and the number of blocks. */
+  size_t reserved;
+  size_t blocks;
+  uint64_t allocations;
+  uint64_t frees;
+  /* Allocations by size class; class n holds sizes up to 16 << n. */
+  uint64_t classes[WP_POOL_STAT_CLASSES];
+} wp_pool_stats_t;
+
+/*
+ * An arena: allocations are carved sequentially out of blocks of the size
+ * given to wp_pool_new and are released all at once when the pool is reset
+ * or deleted. pfree only gives memory back when it was the most recent
+ * allocation. Pools are not thread safe.
+ *
+ * Every pool keeps allocation counters in per-thread slots that are only
+ * summed when stats are read, so accounting stays on in production. Live
+ * pools are registered for wp_pool_report_all, which the daemonizer calls
+ * on shutdown to list what was never deleted.
+ */
 typedef struct wp_pool {
-  /* TODO: Create the pool. */
-  void *(*palloc)(size_t size);
-  void (*pfree)(void *what);
+  void *(*palloc)(const struct wp_pool *self, size_t size);
+  void (*pfree)(const struct wp_pool *self, void *what);
+  /* palloc, adding the bytes to tag's running total (tag is a string literal; see WP_PALLOC). */
+  void *(*palloc_tagged)(const struct wp_pool *self, size_t size, const char *tag);
+  /*
+   * Release every allocation at once, keeping the current block for what
+   * comes next. O(1) unless the pool grew past one block.
+   */
+  void (*reset)(const struct wp_pool *self);
+
+  /* Name the pool in reports; copied, and truncated to 31 characters. */
+  void (*set_name)(const struct wp_pool *self, const char *name);
+  /* Totals across threads, read without stopping allocating threads. */
+  void (*get_stats)(const struct wp_pool *self, wp_pool_stats_t *stats);
 
   wp_pool_private_t data;
 } wp_pool_t;
 
+/* Receives each line of a report, without the newline. */
+typedef void (*wp_pool_report_fn)(const char *line, void *arg);
+
+typedef enum wp_pool_hugepages {
+  WP_POOL_HUGEPAGES_OFF = 0,
+  /* Transparent huge pages, requested with madvise(MADV_HUGEPAGE). */
+  WP_POOL_HUGEPAGES_TRANSPARENT,
+  /* Reserved huge pages (MAP_HUGETLB), falling back to transparent ones. */
+  WP_POOL_HUGEPAGES_EXPLICIT
+} wp_pool_hugepages_t;
+
+/* How a pool backs its blocks. Anything but the defaults maps blocks with mmap. */
+typedef struct wp_pool_options {
+  wp_pool_hugepages_t hugepages;
+  /* Fault every page in when the block is created rather than on first touch. */
+  bool prefault;
+  /* Bind blocks to this NUMA node, or -1 for the default policy. Nodes the
+   * system doesn't have are ignored. */
+  int numa_node;
+} wp_pool_options_t;
+
 wp_status_t wp_pool_new(wp_pool_t **self_out, size_t size);
 
+/**
+ * Create a pool whose blocks are backed as options ask. Each option degrades
+ * quietly when the system can't honour it: no reserved huge pages falls back
+ * to transparent ones, and no NUMA support leaves the default policy.
+ * @param self_out will point to the new pool.
+ * @param size the block size; rounded up to the (huge) page size when mapped.
+ * @param options the backing options, or NULL for wp_pool_new's behaviour.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_pool_new_with_options(wp_pool_t **self_out, size_t size, const wp_pool_options_t *options);
+
+/* Default options: small pages, fault on touch, no NUMA binding. */
+void wp_pool_options_init(wp_pool_options_t *options);
+/* Options from the pool_hugepages, pool_prefault and pool_numa_node settings. */
+void wp_pool_options_from_config(wp_pool_options_t *options, const struct wp_configuration *config);
+
+/**
+ * Create a child pool, e.g. for one request. It has its parent's block size
+ * and options, and takes blocks from the spares its parent keeps, giving them
+ * back when it's reset or deleted; so children made and deleted over and over
+ * settle at no allocations beyond their own headers. Use a child on its
+ * parent's thread only, and delete it before the parent.
+ * @param self_out will point to the new pool.
+ * @param parent the pool to share blocks with; not a persistent pool.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_pool_new_child(wp_pool_t **self_out, const wp_pool_t *parent);
+
+void wp_pool_delete(wp_pool_t *self);
+
+/**
+ * Report a pool's stats, its size classes and its busiest allocation tags.
+ * @param self the pool to report.
+ * @param fn called with each line of the report.
+ * @param arg passed through to fn.
+ */
+void wp_pool_report(const wp_pool_t *self, wp_pool_report_fn fn, void *arg);
+
+/**
+ * Report every pool that has been created and not yet deleted.
+ * @param fn called with each line of the report.
+ * @param arg passed through to fn.
+ * @return the number of pools reported.
+ */
+size_t wp_pool_report_all(wp_pool_report_fn fn, void *arg);
+
+/* A wp_pool_report_fn printing each line to the FILE * given as arg. */
+void wp_pool_report_print(const char *line, void *arg);
+
+/* A position in a persistent pool, relative to its mapping; 0 is the null offset. */
+typedef uint64_t wp_pool_offset_t;
+
+/**
+ * Create a pool in a file mapping that outlives the process, so that a
+ * restarted daemon can pick up what the last one built. Objects in it must
+ * refer to each other by wp_pool_offset_t rather than by pointer, since the
+ * mapping moves between runs, and hold no pointers out of the region at all
+ * (no vtables, no malloc'd memory). Reach them from the root.
+ *
+ * The file is reattached only when its header carries this build's format and
+ * the caller's layout version, it was sealed by wp_pool_delete, and its
+ * checksum matches. Otherwise (a crash, an upgrade, corruption) it is zeroed
+ * and the pool starts empty. The file is locked while attached, so a second
+ * instance fails rather than sharing it. The pool never grows past size.
+ * @param self_out will point to the new pool.
+ * @param path the backing file, created if missing.
+ * @param size the bytes available to palloc.
+ * @param layout the caller's version of what it keeps in the region; bump it whenever that changes.
+ * @param reattached_out set to whether the previous contents were kept; may be NULL.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_pool_new_persistent(wp_pool_t **self_out, const char *path, size_t size, uint32_t layout, bool *reattached_out);
+
+/* The offset of ptr, memory from a persistent pool, or 0 for NULL. */
+wp_pool_offset_t wp_pool_offset_of(const wp_pool_t *self, const void *ptr);
+/* The memory at offset in a persistent pool, or NULL for 0. */
+void *wp_pool_pointer_at(const wp_pool_t *self, wp_pool_offset_t offset);
+
+/* Whether ptr is memory in a persistent pool's region. */
+bool wp_pool_contains(const wp_pool_t *self, const void *ptr);
+
+/**
+ * Give back everything allocated from a persistent pool at or after mark,
+ * e.g. an image from wp_cache_save once the next run has loaded it. A root
+ * at or after mark is cleared.
+ * @param self the persistent pool.
+ * @param mark memory from palloc, or NULL to keep everything.
+ */
+void wp_pool_rewind(const wp_pool_t *self, const void *mark);
+
+/* Record where a persistent pool's contents start, for the next run to find. */
+void wp_pool_set_root(const wp_pool_t *self, const void *root);
+/* The root recorded by this or the previous run, or NULL. */
+void *wp_pool_get_root(const wp_pool_t *self);
+
 #endif
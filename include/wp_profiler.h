@@ -0,0 +1,79 @@
+/*
+ * File:   wp_profiler.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:55 AM
+ */
+
+#ifndef WP_PROFILER__H
+#define WP_PROFILER__H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <wp_common.h>
+
+/* Deepest stack recorded per sample; deeper stacks lose their outermost frames. */
+#define WP_PROFILER_MAX_DEPTH 64
+/* Threads a profiler can sample. */
+#define WP_PROFILER_MAX_THREADS 256
+
+struct wp_profiler;
+
+/* Keep the private impementation... private. */
+struct __wp_profiler_private_t;
+typedef struct __wp_profiler_private_t *wp_profiler_private_t;
+
+typedef struct wp_profiler_stats {
+  uint64_t samples;
+  /* Samples lost to a full thread buffer between dumps. */
+  uint64_t dropped;
+  unsigned threads;
+} wp_profiler_stats_t;
+
+/*
+ * A sampling CPU profiler. Each registered thread gets a timer on its own CPU
+ * time clock that raises SIGPROF hz times per CPU second; the handler walks
+ * the interrupted stack and appends it to that thread's buffer, with no locks
+ * and no allocation. dump drains the buffers and writes folded stacks
+ * ("main;wp_event_loop_run;handler 42"), the input to flamegraph.pl.
+ *
+ * Stacks are walked by frame pointer, so build with -fno-omit-frame-pointer
+ * (configure does), or with libunwind (WP_PROFILER_LIBUNWIND) where
+ * available. Frames outside the thread's stack, as on a fiber's, end the walk.
+ * Only one profiler may be started at a time.
+ */
+typedef struct wp_profiler {
+  /* Sample the calling thread from now on, naming it name in dumps. */
+  wp_status_t (*register_thread)(const struct wp_profiler *self, const char *name);
+  /* Stop sampling the calling thread; call before it exits. */
+  void (*unregister_thread)(const struct wp_profiler *self);
+
+  /* Start and stop the timers of every registered thread. */
+  wp_status_t (*start)(const struct wp_profiler *self);
+  void (*stop)(const struct wp_profiler *self);
+
+  /* Drain the buffers and write every stack seen since the last reset, in folded form. */
+  wp_status_t (*dump)(const struct wp_profiler *self, FILE *out);
+  /* Forget the stacks collected so far. */
+  void (*reset)(const struct wp_profiler *self);
+  void (*get_stats)(const struct wp_profiler *self, wp_profiler_stats_t *stats);
+
+  wp_profiler_private_t data;
+} wp_profiler_t;
+
+/**
+ * Create a profiler; no thread is sampled until it registers and the profiler starts.
+ * @param self_out will point to the new profiler, or NULL on failure.
+ * @param hz samples per second of each thread's CPU time; 0 for 99.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_profiler_new(wp_profiler_t **self_out, unsigned hz);
+
+/**
+ * Stop and delete a profiler, unregistering the calling thread. Other threads
+ * must unregister themselves first.
+ * @param self the profiler to delete.
+ */
+void wp_profiler_delete(wp_profiler_t *self);
+
+#endif /* WP_PROFILER__H */
@@ -9,6 +9,8 @@
 #define	WP_STRING__H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <wp_pool.h>
 
 struct __wp_string_private_t;
@@ -20,6 +22,9 @@ typedef struct wp_string {
 
   bool (*equals)(const struct wp_string *self, const struct wp_string *to);
   int (*compare)(const struct wp_string *self, const struct wp_string *to);
+  /* equals, with ASCII letters compared case insensitively. */
+  bool (*equals_ignore_case)(const struct wp_string *self, const struct wp_string *to);
+  bool (*is_valid_utf8)(const struct wp_string *self);
 
   const char *(*get_str)(const struct wp_string *self);
   size_t (*get_length)(const struct wp_string *self);
@@ -27,9 +32,12 @@ typedef struct wp_string {
   int (*get_ref_count)(const struct wp_string *self);
   wp_pool_t *(*get_pool)(const struct wp_string *self);
 
+  /* A new string of self followed by each wp_string_t * argument; end the list with NULL. */
   wp_status_t (*concat)(const struct wp_string *self, struct wp_string **self_out, ...);
+  /* A new string of up to len bytes from index; a negative index counts from the end. */
   wp_status_t (*substr)(const struct wp_string *self, struct wp_string **self_out, int index, size_t len);
   
+  /* New strings without leading, trailing or both ASCII white space; NULL on failure. */
   struct wp_string *(*ltrim)(const struct wp_string *self);
   struct wp_string *(*rtrim)(const struct wp_string *self);
   struct wp_string *(*trim)(const struct wp_string *self);
@@ -43,4 +51,15 @@ wp_status_t wp_string_delete(wp_string_t **self_out);
 int wp_string_compare(const wp_string_t *left, const wp_string_t *right);
 int wp_string_get_ref_count(const wp_string_t *str);
 
+/* The 64 bit hash of str, computed once and cached. get_hash truncates it. */
+uint64_t wp_string_hash(const wp_string_t *str);
+/* The hash of len raw bytes; equal to wp_string_hash of a string holding them. */
+uint64_t wp_string_hash_bytes(const char *bytes, size_t len);
+/*
+ * Hashes that ignore ASCII case, matching equals_ignore_case: the hash of the
+ * bytes with their ASCII letters lower cased. Not cached.
+ */
+uint64_t wp_string_hash_ignore_case(const wp_string_t *str);
+uint64_t wp_string_hash_bytes_ignore_case(const char *bytes, size_t len);
+
 #endif
@@ -0,0 +1,99 @@
+/*
+ * File:   wp_supervisor.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:00 AM
+ */
+
+#ifndef WP_SUPERVISOR__H
+#define WP_SUPERVISOR__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+
+struct wp_supervisor;
+
+/* Keep the private impementation... private. */
+struct __wp_supervisor_private_t;
+typedef struct __wp_supervisor_private_t *wp_supervisor_private_t;
+
+/* When a helper is started again after it exits. */
+typedef enum wp_restart_policy {
+  WP_RESTART_NEVER = 0,
+  /* Unless it exited with status 0. */
+  WP_RESTART_ON_FAILURE,
+  WP_RESTART_ALWAYS
+} wp_restart_policy_t;
+
+/* What to run and how to keep it running. spawn copies everything it needs. */
+typedef struct wp_process_spec {
+  /* The program, looked up in $PATH when it has no slash. */
+  const char *path;
+  /* NULL terminated, argv[0] included. */
+  char *const *argv;
+  /* NULL terminated, or NULL to inherit the daemon's environment. */
+  char *const *envp;
+
+  wp_restart_policy_t restart;
+  /* The first restart's delay, doubled for each restart after it; 0 for 100. */
+  unsigned backoff_min_ms;
+  /* The longest restart delay; 0 for 30000. */
+  unsigned backoff_max_ms;
+  /* A run at least this long resets the restart delay and count; 0 for 10000. */
+  unsigned stable_ms;
+  /* Restarts in a row, without a stable run, before giving up; 0 for no limit. */
+  unsigned max_restarts;
+} wp_process_spec_t;
+
+/*
+ * Called on the loop's thread when a helper exits. status is as from waitpid,
+ * so WIFEXITED and friends apply; a helper that couldn't be started at all
+ * exits with 127. restarting tells whether it's going to be started again.
+ */
+typedef void (*wp_process_exit_fn)(const struct wp_supervisor *self, unsigned id, pid_t pid, int status, bool restarting, void *arg);
+
+/*
+ * Runs helper processes from an event loop. Helpers are started with
+ * posix_spawn, which vforks, so starting one costs the same however large the
+ * daemon is; a fork would copy every page table first.
+ *
+ * Exits are noticed through a pidfd per helper, or on kernels without pidfds
+ * (before 5.3) through a signalfd for SIGCHLD, which the supervisor blocks in
+ * the thread creating it; create it before other threads so that they inherit
+ * the mask. Either way every helper that exited by the time the loop wakes is
+ * reaped in that one wakeup. Only the supervisor's own helpers are reaped.
+ */
+typedef struct wp_supervisor {
+  /* Start a helper, setting *id_out to its id. Fails if it couldn't be started. */
+  wp_status_t (*spawn)(const struct wp_supervisor *self, const wp_process_spec_t *spec, wp_process_exit_fn fn, void *arg, unsigned *id_out);
+  /* Send sig to a helper, if it's running. */
+  wp_status_t (*kill)(const struct wp_supervisor *self, unsigned id, int sig);
+  /* Stop restarting a helper and send it SIGTERM; it's forgotten once it exits. */
+  wp_status_t (*stop)(const struct wp_supervisor *self, unsigned id);
+
+  /* The helper's current pid, or 0 while it's waiting to restart or gone. */
+  pid_t (*get_pid)(const struct wp_supervisor *self, unsigned id);
+  /* Helpers running or waiting to restart. */
+  size_t (*get_count)(const struct wp_supervisor *self);
+
+  wp_supervisor_private_t data;
+} wp_supervisor_t;
+
+/**
+ * Create a supervisor reaping its helpers from loop.
+ * @param self_out will point to the new supervisor, or NULL on failure.
+ * @param loop the loop to reap and restart helpers from.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_supervisor_new(wp_supervisor_t **self_out, const wp_event_loop_t *loop);
+
+/**
+ * Delete a supervisor. Running helpers are sent SIGTERM but not waited for.
+ * @param self the supervisor to delete.
+ */
+void wp_supervisor_delete(wp_supervisor_t *self);
+
+#endif /* WP_SUPERVISOR__H */
@@ -0,0 +1,46 @@
+/*
+ * File:   wp_text.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:11 AM
+ */
+
+#ifndef WP_TEXT__H
+#define WP_TEXT__H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Byte level text checks for untrusted input. Nothing here looks at the
+ * locale: case folding only touches ASCII letters, and passes every other
+ * byte, UTF-8 included, through unchanged.
+ */
+
+/**
+ * Is bytes well formed UTF-8? Rejects overlong forms, surrogates, code
+ * points past U+10FFFF and truncated sequences, as RFC 3629 requires. Uses
+ * AVX2 or SSSE3 when the CPU has them, picked on first use.
+ * @param bytes the text; need not be NUL terminated.
+ * @param len its length in bytes.
+ * @return true if valid.
+ */
+bool wp_utf8_validate(const char *bytes, size_t len);
+
+/* Copy len bytes from src to dst with ASCII letters lower (upper) cased. dst may be src. */
+void wp_ascii_lower(char *dst, const char *src, size_t len);
+void wp_ascii_upper(char *dst, const char *src, size_t len);
+
+/* Are a and b equal ignoring ASCII case? */
+bool wp_ascii_equals_ignore_case(const char *a, const char *b, size_t len);
+
+/* tolower for ASCII only, whatever the locale. */
+static inline int wp_ascii_tolower(int c) {
+  return (unsigned)(c - 'A') < 26u ? c | 0x20 : c;
+}
+
+static inline int wp_ascii_toupper(int c) {
+  return (unsigned)(c - 'a') < 26u ? c & ~0x20 : c;
+}
+
+#endif /* WP_TEXT__H */
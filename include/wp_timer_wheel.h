@@ -0,0 +1,87 @@
+/*
+ * File:   wp_timer_wheel.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:17 AM
+ */
+
+#ifndef WP_TIMER_WHEEL__H
+#define WP_TIMER_WHEEL__H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+
+struct wp_timer;
+struct wp_timer_wheel;
+
+typedef void (*wp_timer_fn)(struct wp_timer *timer, void *arg);
+
+/*
+ * A timer is embedded in the caller's own object (a connection, a request...)
+ * so that scheduling never allocates. Zero it, or call wp_timer_init, before
+ * first use; the fields are owned by the wheel while the timer is pending.
+ */
+typedef struct wp_timer {
+  struct wp_timer *next;
+  struct wp_timer *prev;
+  uint64_t expires;
+  uint16_t slot;
+  wp_timer_fn fn;
+  void *arg;
+} wp_timer_t;
+
+/* Keep the private impementation... private. */
+struct __wp_timer_wheel_private_t;
+typedef struct __wp_timer_wheel_private_t *wp_timer_wheel_private_t;
+
+typedef struct wp_timer_wheel {
+  /* (Re)schedule timer to call fn after timeout_ms. O(1). */
+  wp_status_t (*schedule)(const struct wp_timer_wheel *self, wp_timer_t *timer, uint64_t timeout_ms, wp_timer_fn fn, void *arg);
+  /* Cancel a pending timer. Cancelling an idle timer does nothing. O(1). */
+  void (*cancel)(const struct wp_timer_wheel *self, wp_timer_t *timer);
+
+  /* Run every timer due by now; returns how many fired. Called by the loop. */
+  size_t (*expire)(const struct wp_timer_wheel *self);
+
+  /* Number of pending timers. */
+  size_t (*get_count)(const struct wp_timer_wheel *self);
+  /* The timerfd driving this wheel. */
+  int (*get_fd)(const struct wp_timer_wheel *self);
+
+  wp_timer_wheel_private_t data;
+} wp_timer_wheel_t;
+
+/**
+ * Prepare a timer for first use.
+ * @param timer the timer to initialize.
+ */
+void wp_timer_init(wp_timer_t *timer);
+
+/**
+ * Is the timer scheduled and not yet fired or cancelled?
+ * @param timer the timer to check.
+ * @return true if pending, otherwise false.
+ */
+bool wp_timer_is_pending(const wp_timer_t *timer);
+
+/**
+ * Create a hierarchical timing wheel driven by a single timerfd on loop.
+ * Timers are rounded up to tick_ms, so timers due in the same tick fire
+ * together in one wakeup; timers further out than 64 ticks are additionally
+ * coalesced within 1/64th of their timeout. Idle ticks never wake the loop.
+ * @param self_out will point to the new wheel, or NULL on failure.
+ * @param loop the loop to register the timerfd on.
+ * @param tick_ms the wheel's resolution in milliseconds (0 means 1).
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_timer_wheel_new(wp_timer_wheel_t **self_out, const wp_event_loop_t *loop, uint64_t tick_ms);
+
+/**
+ * Delete a wheel. Pending timers are dropped without firing.
+ * @param self the wheel to delete.
+ */
+void wp_timer_wheel_delete(wp_timer_wheel_t *self);
+
+#endif /* WP_TIMER_WHEEL__H */
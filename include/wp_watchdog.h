@@ -0,0 +1,80 @@
+/*
+ * File:   wp_watchdog.h
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:51 AM
+ */
+
+#ifndef WP_WATCHDOG__H
+#define WP_WATCHDOG__H
+
+#include <signal.h>
+#include <stdint.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+
+/* Loops a single watchdog can watch. */
+#define WP_WATCHDOG_MAX_LOOPS 64
+
+struct wp_watchdog;
+
+/* Keep the private impementation... private. */
+struct __wp_watchdog_private_t;
+typedef struct __wp_watchdog_private_t *wp_watchdog_private_t;
+
+/* Receives each line of a stall or histogram report, without the newline. */
+typedef void (*wp_watchdog_report_fn)(const char *line, void *arg);
+/* Called from the watchdog thread after each check that found no loop stalled. */
+typedef void (*wp_watchdog_healthy_fn)(void *arg);
+
+/*
+ * A thread that checks the event loops it watches every quarter budget. A
+ * loop whose current handler has run for longer than the budget is stalled:
+ * the watchdog reports the handler, interrupts the loop's thread with
+ * WP_WATCHDOG_SIGNAL to capture its stack, and reports that too. Each stall
+ * is reported once, then again with its length when the handler returns.
+ * The capture signal is installed with SA_RESTART, but calls the kernel
+ * never restarts (sleeps, epoll_wait) return early with EINTR.
+ *
+ * Watched loops are instrumented (see wp_event_loop_t::set_instrumented), so
+ * report can also give each loop's lag and per-handler runtime histograms.
+ */
+typedef struct wp_watchdog {
+  /* Watch loop, naming it name in reports. The loop must outlive the watch. */
+  wp_status_t (*watch)(const struct wp_watchdog *self, const wp_event_loop_t *loop, const char *name);
+  void (*unwatch)(const struct wp_watchdog *self, const wp_event_loop_t *loop);
+
+  /* Start and stop the watchdog thread. */
+  wp_status_t (*start)(const struct wp_watchdog *self);
+  void (*stop)(const struct wp_watchdog *self);
+
+  /* Call fn whenever a check passes, e.g. to send WATCHDOG=1 to systemd. */
+  void (*set_healthy_method)(const struct wp_watchdog *self, wp_watchdog_healthy_fn fn, void *arg);
+
+  uint64_t (*get_stall_count)(const struct wp_watchdog *self);
+  /* Report each watched loop's lag and per-handler runtime histograms. */
+  void (*report)(const struct wp_watchdog *self, wp_watchdog_report_fn fn, void *arg);
+
+  wp_watchdog_private_t data;
+} wp_watchdog_t;
+
+/* The signal used to capture a stalled thread's stack. */
+#define WP_WATCHDOG_SIGNAL (SIGRTMIN + 2)
+
+/**
+ * Create a watchdog; it does nothing until started.
+ * @param self_out will point to the new watchdog, or NULL on failure.
+ * @param budget_ms how long a handler may run before its loop counts as stalled.
+ * @param fn receives stall reports, from the watchdog thread.
+ * @param arg passed through to fn.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+wp_status_t wp_watchdog_new(wp_watchdog_t **self_out, unsigned budget_ms, wp_watchdog_report_fn fn, void *arg);
+
+/**
+ * Stop and delete a watchdog. Watched loops stay instrumented.
+ * @param self the watchdog to delete.
+ */
+void wp_watchdog_delete(wp_watchdog_t *self);
+
+#endif /* WP_WATCHDOG__H */
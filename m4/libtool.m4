@@ -1 +0,0 @@
-/usr/share/aclocal/libtool.m4
\ No newline at end of file
@@ -1 +0,0 @@
-/usr/share/aclocal/ltoptions.m4
\ No newline at end of file
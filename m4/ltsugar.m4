@@ -1 +0,0 @@
-/usr/share/aclocal/ltsugar.m4
\ No newline at end of file
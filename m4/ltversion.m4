@@ -1 +0,0 @@
-/usr/share/aclocal/ltversion.m4
\ No newline at end of file
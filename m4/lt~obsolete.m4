@@ -1 +0,0 @@
-/usr/share/aclocal/lt~obsolete.m4
\ No newline at end of file
@@ -1,5 +1,1482 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
 #include <libwpd.h>
 #include <libwpd_tests.h>
+#include <wp_pool.h>
+#include <wp_string.h>
+
+typedef struct wp_test_entry {
+  const char *name;
+  wp_test_fn fn;
+} wp_test_entry_t;
+
+static uint64_t wp_test_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* Dispatch until *count reaches want, giving up after timeout_ms. */
+static bool wp_test_run_until(const wp_event_loop_t *loop, const int *count, int want, uint64_t timeout_ms) {
+  uint64_t deadline = wp_test_now_ms() + timeout_ms;
+
+  while(*count < want && wp_test_now_ms() < deadline) {
+    if(loop->run_once(loop, 10) != WP_SUCCESS) {
+      return false;
+    }
+  }
+  return *count >= want;
+}
+
+static void wp_test_count_event(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  char buf[16];
+  (void)loop; (void)events;
+
+  if(read(fd, buf, sizeof(buf)) > 0) {
+    (*(int *)arg)++;
+  }
+}
+
+static void wp_test_stop_event(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  (void)fd; (void)events;
+  (*(int *)arg)++;
+  loop->stop(loop);
+}
+
+static wp_status_t wp_test_event_loop(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  int fds[2], count = 0;
+  (void)t;
+
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+  WP_TEST_CHECK(loop->add(loop, fds[0], EPOLLIN, &wp_test_count_event, &count) == WP_SUCCESS);
+  WP_TEST_CHECK(loop->run_once(loop, 0) == WP_SUCCESS && count == 0);
+  WP_TEST_CHECK(write(fds[1], "x", 1) == 1);
+  WP_TEST_CHECK(loop->run_once(loop, 100) == WP_SUCCESS && count == 1);
+
+  /* A removed fd isn't dispatched, ready or not. */
+  WP_TEST_CHECK(loop->remove(loop, fds[0]) == WP_SUCCESS);
+  WP_TEST_CHECK(write(fds[1], "x", 1) == 1);
+  WP_TEST_CHECK(loop->run_once(loop, 0) == WP_SUCCESS && count == 1);
+
+  /* run returns once a handler stops the loop. */
+  WP_TEST_CHECK(loop->add(loop, fds[0], EPOLLIN, &wp_test_stop_event, &count) == WP_SUCCESS);
+  WP_TEST_CHECK(loop->run(loop) == WP_SUCCESS);
+  WP_TEST_CHECK(count == 2 && !loop->is_running(loop));
+
+  loop->remove(loop, fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+typedef struct wp_test_timer_log {
+  int fired;
+  uint64_t at_ms;
+} wp_test_timer_log_t;
+
+static void wp_test_timer_fired(wp_timer_t *timer, void *arg) {
+  wp_test_timer_log_t *log = arg;
+  (void)timer;
+
+  log->fired++;
+  log->at_ms = wp_test_now_ms();
+}
+
+static wp_status_t wp_test_timer_wheel(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  wp_timer_wheel_t *wheel = NULL;
+  wp_timer_t soon, cancelled, cascaded, far;
+  wp_test_timer_log_t soon_log, cancelled_log, cascaded_log, far_log;
+  uint64_t start;
+  (void)t;
+
+  memset(&soon_log, 0, sizeof(soon_log));
+  memset(&cancelled_log, 0, sizeof(cancelled_log));
+  memset(&cascaded_log, 0, sizeof(cascaded_log));
+  memset(&far_log, 0, sizeof(far_log));
+  wp_timer_init(&soon);
+  wp_timer_init(&cancelled);
+  wp_timer_init(&cascaded);
+  wp_timer_init(&far);
+
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_timer_wheel_new(&wheel, loop, 1) == WP_SUCCESS);
+  start = wp_test_now_ms();
+  WP_TEST_CHECK(wheel->schedule(wheel, &soon, 20, &wp_test_timer_fired, &soon_log) == WP_SUCCESS);
+  WP_TEST_CHECK(wheel->schedule(wheel, &cancelled, 30, &wp_test_timer_fired, &cancelled_log) == WP_SUCCESS);
+  /* Past level 0's 64 ticks, so it's cascaded down before it fires. */
+  WP_TEST_CHECK(wheel->schedule(wheel, &cascaded, 300, &wp_test_timer_fired, &cascaded_log) == WP_SUCCESS);
+  WP_TEST_CHECK(wheel->schedule(wheel, &far, 10000, &wp_test_timer_fired, &far_log) == WP_SUCCESS);
+  WP_TEST_CHECK(wheel->get_count(wheel) == 4);
+
+  /* Far timers are rounded up to 1/64th of their level, 64 ticks here. */
+  WP_TEST_CHECK(far.expires % 64 == 0 && far.expires >= 10000 && far.expires < 10000 + 64 + 100);
+
+  wheel->cancel(wheel, &cancelled);
+  wheel->cancel(wheel, &cancelled);
+  wheel->cancel(wheel, &far);
+  WP_TEST_CHECK(!wp_timer_is_pending(&cancelled) && !wp_timer_is_pending(&far));
+  WP_TEST_CHECK(wheel->get_count(wheel) == 2);
+
+  WP_TEST_CHECK(wp_test_run_until(loop, &cascaded_log.fired, 1, 2000));
+  WP_TEST_CHECK(soon_log.fired == 1 && soon_log.at_ms - start >= 19);
+  WP_TEST_CHECK(cascaded_log.fired == 1 && cascaded_log.at_ms - start >= 299);
+  WP_TEST_CHECK(cancelled_log.fired == 0 && far_log.fired == 0);
+  WP_TEST_CHECK(wheel->get_count(wheel) == 0 && !wp_timer_is_pending(&soon));
+
+  wp_timer_wheel_delete(wheel);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_timer_wheel_idle(const wp_test_t *t) {
+  /* Idle for more than 4096 ticks, where a stale next would coalesce by 64. */
+  const struct timespec idle = { 4, 200000000 };
+  wp_event_loop_t *loop = NULL;
+  wp_timer_wheel_t *wheel = NULL;
+  wp_timer_t first, second;
+  wp_test_timer_log_t first_log, second_log;
+  (void)t;
+
+  memset(&first_log, 0, sizeof(first_log));
+  memset(&second_log, 0, sizeof(second_log));
+  wp_timer_init(&first);
+  wp_timer_init(&second);
+
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_timer_wheel_new(&wheel, loop, 1) == WP_SUCCESS);
+  nanosleep(&idle, NULL);
+
+  /* Short timers keep their own expiries instead of sharing a rounded one. */
+  WP_TEST_CHECK(wheel->schedule(wheel, &first, 10, &wp_test_timer_fired, &first_log) == WP_SUCCESS);
+  WP_TEST_CHECK(wheel->schedule(wheel, &second, 20, &wp_test_timer_fired, &second_log) == WP_SUCCESS);
+  WP_TEST_CHECK(second.expires - first.expires >= 9 && second.expires - first.expires <= 11);
+  WP_TEST_CHECK(wp_test_run_until(loop, &second_log.fired, 1, 1000));
+  WP_TEST_CHECK(first_log.fired == 1 && first_log.at_ms < second_log.at_ms);
+
+  wp_timer_wheel_delete(wheel);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+typedef struct wp_test_reuse {
+  int fds[2];
+  int replacement;
+  int first;
+  int fresh;
+} wp_test_reuse_t;
+
+static void wp_test_reuse_fresh(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  (void)loop; (void)fd; (void)events;
+  ((wp_test_reuse_t *)arg)->fresh++;
+}
+
+/* Whichever fd comes first hands the other's number to a new pipe, as accept would. */
+static void wp_test_reuse_first(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  wp_test_reuse_t *reuse = arg;
+  int other = fd == reuse->fds[0] ? reuse->fds[1] : reuse->fds[0];
+  (void)events;
+
+  if(reuse->first++ == 0) {
+    loop->remove(loop, other);
+    dup2(reuse->replacement, other);
+    loop->add(loop, other, EPOLLIN, &wp_test_reuse_fresh, reuse);
+  }
+}
+
+static wp_status_t wp_test_event_loop_reuse(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  wp_test_reuse_t reuse;
+  int a[2], b[2], c[2];
+  (void)t;
+
+  memset(&reuse, 0, sizeof(reuse));
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(pipe(a) == 0 && pipe(b) == 0 && pipe(c) == 0);
+  reuse.fds[0] = a[0];
+  reuse.fds[1] = b[0];
+  reuse.replacement = c[0];
+  WP_TEST_CHECK(loop->add(loop, a[0], EPOLLIN, &wp_test_reuse_first, &reuse) == WP_SUCCESS);
+  WP_TEST_CHECK(loop->add(loop, b[0], EPOLLIN, &wp_test_reuse_first, &reuse) == WP_SUCCESS);
+  WP_TEST_CHECK(write(a[1], "x", 1) == 1 && write(b[1], "x", 1) == 1 && write(c[1], "x", 1) == 1);
+
+  /* Both are in the batch; the one whose number was reused is skipped, not handed to the new handler. */
+  WP_TEST_CHECK(loop->run_once(loop, 100) == WP_SUCCESS);
+  WP_TEST_CHECK(reuse.first == 1 && reuse.fresh == 0);
+  /* The new registration gets its own events from the next batch. */
+  WP_TEST_CHECK(loop->run_once(loop, 100) == WP_SUCCESS);
+  WP_TEST_CHECK(reuse.fresh == 1);
+
+  loop->remove(loop, a[0]);
+  loop->remove(loop, b[0]);
+  wp_event_loop_delete(loop);
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+  close(c[0]);
+  close(c[1]);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_event_loop_readd(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  const wp_pool_t *arena = NULL;
+  int fds[2], first = 0, second = 0;
+  (void)t;
+
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+  WP_TEST_CHECK(loop->add(loop, fds[0], EPOLLIN, &wp_test_count_event, &first) == WP_SUCCESS);
+  WP_TEST_CHECK((arena = loop->get_arena(loop, fds[0])) != NULL);
+
+  /* Adding an fd twice fails and leaves the live registration and its arena as they were. */
+  WP_TEST_CHECK(loop->add(loop, fds[0], EPOLLIN, &wp_test_count_event, &second) == WP_FAILURE && errno == EEXIST);
+  WP_TEST_CHECK(loop->get_arena(loop, fds[0]) == arena);
+  WP_TEST_CHECK(write(fds[1], "x", 1) == 1);
+  WP_TEST_CHECK(loop->run_once(loop, 100) == WP_SUCCESS);
+  WP_TEST_CHECK(first == 1 && second == 0);
+
+  loop->remove(loop, fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+static void wp_test_accept(const wp_listener_t *listener, int client_fd, const struct sockaddr *addr, socklen_t addr_len, void *arg) {
+  (void)listener; (void)addr; (void)addr_len;
+  close(client_fd);
+  (*(int *)arg)++;
+}
+
+/* Connect a blocking client to addr, closing it straight away. */
+static bool wp_test_connect(int family, const struct sockaddr *addr, socklen_t addr_len) {
+  int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  bool connected = fd > -1 && connect(fd, addr, addr_len) == 0;
+
+  if(fd > -1) {
+    close(fd);
+  }
+  return connected;
+}
+
+static wp_status_t wp_test_listener(const wp_test_t *t) {
+  char dir[] = "/tmp/libwpd_tests.XXXXXX";
+  char address[128];
+  wp_configuration_t *config = NULL;
+  wp_event_loop_t *loop = NULL;
+  wp_listener_t *listener = NULL;
+  struct sockaddr_in in, in_other;
+  struct sockaddr_un un;
+  socklen_t len;
+  int accepted = 0, on = 0;
+  (void)t;
+
+  WP_TEST_CHECK(mkdtemp(dir) != NULL);
+  memset(&un, 0, sizeof(un));
+  un.sun_family = AF_UNIX;
+  snprintf(un.sun_path, sizeof(un.sun_path), "%s/sock", dir);
+  snprintf(address, sizeof(address), "unix:%s", un.sun_path);
+
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_configuration_new(&config) == WP_SUCCESS);
+  config->set_worker_count(config, 1);
+  WP_TEST_CHECK(config->add_listen_address(config, "tcp://127.0.0.1:0") == WP_SUCCESS);
+  WP_TEST_CHECK(config->add_listen_address(config, address) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_listener_new(&listener, config) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->bind(listener) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->get_endpoint_count(listener) == 2 && listener->get_worker_count(listener) == 1);
+
+  /* The kernel picked the port. */
+  len = sizeof(in);
+  WP_TEST_CHECK(getsockname(listener->get_fd(listener, 0, 0), (struct sockaddr *)&in, &len) == 0 && in.sin_port != 0);
+  WP_TEST_CHECK(listener->attach(listener, loop, 0, &wp_test_accept, &accepted) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_connect(AF_INET, (struct sockaddr *)&in, sizeof(in)));
+  WP_TEST_CHECK(wp_test_connect(AF_UNIX, (struct sockaddr *)&un, sizeof(un)));
+  WP_TEST_CHECK(wp_test_run_until(loop, &accepted, 2, 2000));
+  listener->detach(listener, loop, 0);
+  wp_listener_delete(listener);
+  WP_TEST_CHECK(access(un.sun_path, F_OK) != 0);
+  wp_configuration_delete(config);
+
+  /* Two workers share that port through SO_REUSEPORT, each with a socket of its own. */
+  snprintf(address, sizeof(address), "tcp://127.0.0.1:%u", (unsigned)ntohs(in.sin_port));
+  WP_TEST_CHECK(wp_configuration_new(&config) == WP_SUCCESS);
+  config->set_worker_count(config, 2);
+  WP_TEST_CHECK(config->add_listen_address(config, address) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_listener_new(&listener, config) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->bind(listener) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->get_worker_count(listener) == 2);
+  WP_TEST_CHECK(listener->get_fd(listener, 0, 0) != listener->get_fd(listener, 0, 1));
+  len = sizeof(in_other);
+  WP_TEST_CHECK(getsockname(listener->get_fd(listener, 0, 1), (struct sockaddr *)&in_other, &len) == 0);
+  WP_TEST_CHECK(in_other.sin_port == in.sin_port);
+  len = sizeof(on);
+  WP_TEST_CHECK(getsockopt(listener->get_fd(listener, 0, 1), SOL_SOCKET, SO_REUSEPORT, &on, &len) == 0 && on);
+  WP_TEST_CHECK(listener->attach(listener, loop, 0, &wp_test_accept, &accepted) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->attach(listener, loop, 1, &wp_test_accept, &accepted) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_connect(AF_INET, (struct sockaddr *)&in, sizeof(in)));
+  WP_TEST_CHECK(wp_test_run_until(loop, &accepted, 3, 2000));
+  listener->detach(listener, loop, 0);
+  listener->detach(listener, loop, 1);
+  wp_listener_delete(listener);
+  wp_configuration_delete(config);
+
+  wp_event_loop_delete(loop);
+  rmdir(dir);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_listener_unix_owner(const wp_test_t *t) {
+  char dir[] = "/tmp/libwpd_tests.XXXXXX";
+  char address[128];
+  wp_configuration_t *config = NULL;
+  wp_listener_t *listener = NULL, *other = NULL;
+  struct sockaddr_un un;
+  int fd, status = 0;
+  pid_t pid;
+  (void)t;
+
+  WP_TEST_CHECK(mkdtemp(dir) != NULL);
+  memset(&un, 0, sizeof(un));
+  un.sun_family = AF_UNIX;
+  snprintf(un.sun_path, sizeof(un.sun_path), "%s/sock", dir);
+  snprintf(address, sizeof(address), "unix:%s", un.sun_path);
+
+  /* What a crashed instance leaves: a socket file nobody listens on. */
+  WP_TEST_CHECK((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) > -1);
+  WP_TEST_CHECK(bind(fd, (struct sockaddr *)&un, sizeof(un)) == 0);
+  close(fd);
+
+  WP_TEST_CHECK(wp_configuration_new(&config) == WP_SUCCESS);
+  config->set_worker_count(config, 1);
+  WP_TEST_CHECK(config->add_listen_address(config, address) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_listener_new(&listener, config) == WP_SUCCESS);
+  WP_TEST_CHECK(listener->bind(listener) == WP_SUCCESS);
+
+  /* A live path isn't taken over, and the one that failed to bind doesn't remove it. */
+  WP_TEST_CHECK(wp_listener_new(&other, config) == WP_SUCCESS);
+  WP_TEST_CHECK(other->bind(other) == WP_FAILURE);
+  wp_listener_delete(other);
+  WP_TEST_CHECK(access(un.sun_path, F_OK) == 0);
+
+  /* A forked child closing its copies leaves the path to the process that bound it. */
+  fflush(stdout);
+  if((pid = fork()) == 0) {
+    listener->close(listener);
+    _exit(EXIT_SUCCESS);
+  }
+  WP_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  WP_TEST_CHECK(access(un.sun_path, F_OK) == 0);
+  WP_TEST_CHECK(wp_test_connect(AF_UNIX, (struct sockaddr *)&un, sizeof(un)));
+
+  wp_listener_delete(listener);
+  WP_TEST_CHECK(access(un.sun_path, F_OK) != 0);
+  wp_configuration_delete(config);
+  rmdir(dir);
+  return WP_SUCCESS;
+}
+
+static void wp_test_release(const void *data, void *arg) {
+  (void)data;
+  (*(int *)arg)++;
+}
+
+static wp_status_t wp_test_buffer_chain(const wp_test_t *t) {
+  wp_pool_t *pool = NULL;
+  wp_buffer_chain_t *chain = NULL, *other = NULL, *head = NULL;
+  static const char ref[] = "referenced ";
+  char out[64];
+  int fds[2], released = 0;
+  ssize_t n;
+  (void)t;
+
+  WP_TEST_CHECK(wp_pool_new(&pool, 1 << 16) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_buffer_chain_new(&chain, pool) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_buffer_chain_new(&other, pool) == WP_SUCCESS);
+  WP_TEST_CHECK(chain->is_empty(chain));
+
+  WP_TEST_CHECK(chain->append(chain, "copied ", 7) == WP_SUCCESS);
+  WP_TEST_CHECK(chain->append_ref(chain, ref, sizeof(ref) - 1, &wp_test_release, &released) == WP_SUCCESS);
+  WP_TEST_CHECK(other->append(other, "moved", 5) == WP_SUCCESS);
+  WP_TEST_CHECK(chain->append_chain(chain, other) == WP_SUCCESS);
+  WP_TEST_CHECK(other->is_empty(other));
+  WP_TEST_CHECK(chain->get_length(chain) == 23);
+  WP_TEST_CHECK(chain->copy_out(chain, out, sizeof(out)) == 23);
+  WP_TEST_CHECK(memcmp(out, "copied referenced moved", 23) == 0);
+
+  /* Splitting across a segment boundary. */
+  WP_TEST_CHECK(chain->split(chain, 10, &head) == WP_SUCCESS);
+  WP_TEST_CHECK(head->get_length(head) == 10);
+  WP_TEST_CHECK(head->copy_out(head, out, sizeof(out)) == 10);
+  WP_TEST_CHECK(memcmp(out, "copied ref", 10) == 0);
+  WP_TEST_CHECK(chain->get_length(chain) == 13);
+
+  chain->consume(chain, 3);
+  WP_TEST_CHECK(chain->copy_out(chain, out, sizeof(out)) == 10);
+  WP_TEST_CHECK(memcmp(out, "nced moved", 10) == 0);
+
+  WP_TEST_CHECK(pipe(fds) == 0);
+  WP_TEST_CHECK(chain->flush(chain, fds[1]) == 10);
+  WP_TEST_CHECK(chain->is_empty(chain));
+  n = read(fds[0], out, sizeof(out));
+  WP_TEST_CHECK(n == 10 && memcmp(out, "nced moved", 10) == 0);
+  close(fds[0]);
+  close(fds[1]);
+
+  /* The reference is released once both halves are done with it. */
+  head->consume(head, 10);
+  WP_TEST_CHECK(released == 1);
+
+  wp_buffer_chain_delete(head);
+  wp_buffer_chain_delete(other);
+  wp_buffer_chain_delete(chain);
+  wp_pool_delete(pool);
+  return WP_SUCCESS;
+}
+
+#define WP_TEST_QUEUE_ITEMS 100000
+
+static void *wp_test_queue_producer(void *arg) {
+  const wp_mpmc_queue_t *queue = arg;
+  uintptr_t i;
+
+  for(i = 1; i <= WP_TEST_QUEUE_ITEMS; i++) {
+    while(!queue->push(queue, (void *)i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *wp_test_queue_consumer(void *arg) {
+  const wp_mpmc_queue_t *queue = arg;
+  uint64_t sum = 0;
+  void *item;
+  int taken = 0;
+
+  while(taken < WP_TEST_QUEUE_ITEMS) {
+    if(queue->pop(queue, &item)) {
+      sum += (uintptr_t)item;
+      taken++;
+    } else {
+      sched_yield();
+    }
+  }
+  return (void *)(uintptr_t)sum;
+}
+
+static wp_status_t wp_test_mpmc_queue(const wp_test_t *t) {
+  wp_mpmc_queue_t *queue = NULL;
+  pthread_t producers[2], consumers[2];
+  void *item = NULL, *sum;
+  uint64_t total = 0;
+  uintptr_t i;
+  (void)t;
+
+  WP_TEST_CHECK(wp_mpmc_queue_new(&queue, 6) == WP_SUCCESS);
+  WP_TEST_CHECK(queue->get_capacity(queue) == 8);
+  WP_TEST_CHECK(!queue->pop(queue, &item));
+  for(i = 1; i <= 8; i++) {
+    WP_TEST_CHECK(queue->push(queue, (void *)i));
+  }
+  WP_TEST_CHECK(!queue->push(queue, (void *)9));
+  for(i = 1; i <= 8; i++) {
+    WP_TEST_CHECK(queue->pop(queue, &item) && item == (void *)i);
+  }
+  WP_TEST_CHECK(!queue->pop(queue, &item));
+
+  /* Every item pushed by two producers is popped exactly once by two consumers. */
+  for(i = 0; i < 2; i++) {
+    WP_TEST_CHECK(pthread_create(&producers[i], NULL, &wp_test_queue_producer, queue) == 0);
+    WP_TEST_CHECK(pthread_create(&consumers[i], NULL, &wp_test_queue_consumer, queue) == 0);
+  }
+  for(i = 0; i < 2; i++) {
+    pthread_join(producers[i], NULL);
+    pthread_join(consumers[i], &sum);
+    total += (uintptr_t)sum;
+  }
+  WP_TEST_CHECK(total == 2 * ((uint64_t)WP_TEST_QUEUE_ITEMS * (WP_TEST_QUEUE_ITEMS + 1) / 2));
+
+  wp_mpmc_queue_delete(queue);
+  return WP_SUCCESS;
+}
+
+#define WP_TEST_MAILBOX_THREADS 4
+#define WP_TEST_MAILBOX_ITEMS 50000
+
+typedef struct wp_test_message {
+  wp_mailbox_node_t node;
+  uint32_t id;
+} wp_test_message_t;
+
+typedef struct wp_test_mailbox_producer {
+  const wp_mailbox_t *mailbox;
+  wp_test_message_t *messages;
+} wp_test_mailbox_producer_t;
+
+typedef struct wp_test_mailbox_consumer {
+  unsigned char *seen;
+  int delivered;
+  int duplicates;
+} wp_test_mailbox_consumer_t;
+
+static void *wp_test_mailbox_producer(void *arg) {
+  wp_test_mailbox_producer_t *producer = arg;
+
+  for(int i = 0; i < WP_TEST_MAILBOX_ITEMS; i++) {
+    producer->mailbox->post(producer->mailbox, &producer->messages[i].node);
+    /* Let the consumer catch up and go idle now and then, so wakeups are needed. */
+    if(i % 256 == 0) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void wp_test_mailbox_deliver(const wp_mailbox_t *mailbox, wp_mailbox_node_t *node, void *arg) {
+  wp_test_mailbox_consumer_t *consumer = arg;
+  wp_test_message_t *message = (wp_test_message_t *)node;
+  (void)mailbox;
+
+  if(consumer->seen[message->id]++) {
+    consumer->duplicates++;
+  }
+  consumer->delivered++;
+}
+
+static wp_status_t wp_test_mailbox(const wp_test_t *t) {
+  const int total = WP_TEST_MAILBOX_THREADS * WP_TEST_MAILBOX_ITEMS;
+  wp_mailbox_t *mailbox = NULL;
+  wp_event_loop_t *loop = NULL;
+  wp_test_message_t *messages = NULL;
+  wp_test_mailbox_producer_t producers[WP_TEST_MAILBOX_THREADS];
+  wp_test_mailbox_consumer_t consumer;
+  pthread_t threads[WP_TEST_MAILBOX_THREADS];
+  bool stalled = false;
+  int i;
+  (void)t;
+
+  memset(&consumer, 0, sizeof(consumer));
+  WP_TEST_CHECK((messages = calloc((size_t)total, sizeof(*messages))) != NULL);
+  WP_TEST_CHECK((consumer.seen = calloc((size_t)total, 1)) != NULL);
+  for(i = 0; i < total; i++) {
+    messages[i].id = (uint32_t)i;
+  }
+
+  WP_TEST_CHECK(wp_mailbox_new(&mailbox) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(mailbox->is_empty(mailbox) && mailbox->take(mailbox) == NULL);
+  WP_TEST_CHECK(mailbox->attach(mailbox, loop, &wp_test_mailbox_deliver, &consumer) == WP_SUCCESS);
+  for(i = 0; i < WP_TEST_MAILBOX_THREADS; i++) {
+    producers[i].mailbox = mailbox;
+    producers[i].messages = messages + i * WP_TEST_MAILBOX_ITEMS;
+    WP_TEST_CHECK(pthread_create(&threads[i], NULL, &wp_test_mailbox_producer, &producers[i]) == 0);
+  }
+
+  /*
+   * The loop only wakes on the eventfd. A wakeup may find its messages already
+   * taken, but a lost one leaves them queued until run_once times out.
+   */
+  while(consumer.delivered < total && !stalled) {
+    int before = consumer.delivered;
+    uint64_t start = wp_test_now_ms();
+    if(loop->run_once(loop, 2000) != WP_SUCCESS
+       || (consumer.delivered == before && wp_test_now_ms() - start >= 1000)) {
+      stalled = true;
+    }
+  }
+  for(i = 0; i < WP_TEST_MAILBOX_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  WP_TEST_CHECK(!stalled);
+
+  /* Every node was delivered exactly once. */
+  WP_TEST_CHECK(consumer.delivered == total && consumer.duplicates == 0);
+  for(i = 0; i < total; i++) {
+    WP_TEST_CHECK(consumer.seen[i] == 1);
+  }
+  WP_TEST_CHECK(mailbox->is_empty(mailbox));
+
+  mailbox->detach(mailbox, loop);
+  wp_mailbox_delete(mailbox);
+  wp_event_loop_delete(loop);
+  free(consumer.seen);
+  free(messages);
+  return WP_SUCCESS;
+}
+
+#define WP_TEST_FIBER_STACK (64 * 1024)
+
+typedef struct wp_test_fibers {
+  char log[8];
+  size_t log_len;
+  bool in_fiber;
+  int fds[2];
+  char got[8];
+  ssize_t got_len;
+  int got_errno;
+  int closed;
+  void *marks[2];
+  int mark_count;
+} wp_test_fibers_t;
+
+/* Run the loop until every fiber has finished, giving up after timeout_ms. */
+static bool wp_test_run_fibers(const wp_event_loop_t *loop, const wp_fiber_scheduler_t *scheduler, uint64_t timeout_ms) {
+  uint64_t deadline = wp_test_now_ms() + timeout_ms;
+
+  while(scheduler->get_fiber_count(scheduler) > 0 && wp_test_now_ms() < deadline) {
+    if(loop->run_once(loop, 10) != WP_SUCCESS) {
+      return false;
+    }
+  }
+  return scheduler->get_fiber_count(scheduler) == 0;
+}
+
+static void wp_test_fiber_first(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  wp_test_fibers_t *state = arg;
+
+  state->in_fiber = scheduler->in_fiber(scheduler);
+  state->log[state->log_len++] = 'a';
+  scheduler->yield(scheduler);
+  state->log[state->log_len++] = 'c';
+}
+
+static void wp_test_fiber_second(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  wp_test_fibers_t *state = arg;
+
+  state->log[state->log_len++] = 'b';
+  scheduler->yield(scheduler);
+  state->log[state->log_len++] = 'd';
+}
+
+static void wp_test_fiber_reader(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  wp_test_fibers_t *state = arg;
+
+  state->got_len = scheduler->read(scheduler, state->fds[0], state->got, sizeof(state->got));
+  state->got_errno = errno;
+}
+
+static void wp_test_fiber_mark(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  wp_test_fibers_t *state = arg;
+  volatile char mark = 0;
+  (void)scheduler;
+
+  state->marks[state->mark_count++] = (void *)&mark;
+}
+
+static wp_status_t wp_test_fibers(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  wp_fiber_scheduler_t *scheduler = NULL;
+  wp_test_fibers_t state;
+  int i;
+  (void)t;
+
+  memset(&state, 0, sizeof(state));
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_fiber_scheduler_new(&scheduler, loop, WP_TEST_FIBER_STACK) == WP_SUCCESS);
+  WP_TEST_CHECK(!scheduler->in_fiber(scheduler));
+
+  /* Spawned fibers wait for the loop, then take turns at each yield. */
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_first, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_second, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(scheduler->get_fiber_count(scheduler) == 2 && state.log_len == 0);
+  WP_TEST_CHECK(wp_test_run_fibers(loop, scheduler, 1000));
+  WP_TEST_CHECK(state.log_len == 4 && memcmp(state.log, "abcd", 4) == 0 && state.in_fiber);
+
+  /* A read with nothing to read parks the fiber until the fd is ready. */
+  WP_TEST_CHECK(pipe2(state.fds, O_NONBLOCK | O_CLOEXEC) == 0);
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_reader, &state) == WP_SUCCESS);
+  for(i = 0; i < 3; i++) {
+    WP_TEST_CHECK(loop->run_once(loop, 10) == WP_SUCCESS);
+  }
+  WP_TEST_CHECK(scheduler->get_fiber_count(scheduler) == 1 && state.got_len == 0);
+  WP_TEST_CHECK(write(state.fds[1], "ping", 4) == 4);
+  WP_TEST_CHECK(wp_test_run_fibers(loop, scheduler, 1000));
+  WP_TEST_CHECK(state.got_len == 4 && memcmp(state.got, "ping", 4) == 0);
+  WP_TEST_CHECK(scheduler->close(scheduler, state.fds[0]) == 0);
+  close(state.fds[1]);
+
+  /* A finished fiber's stack goes to the next one spawned. */
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_mark, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_run_fibers(loop, scheduler, 1000));
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_mark, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_run_fibers(loop, scheduler, 1000));
+  WP_TEST_CHECK(state.mark_count == 2 && state.marks[0] == state.marks[1]);
+
+  wp_fiber_scheduler_delete(scheduler);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+/* Walk down the stack a page at a time, noting how far each write got, until one faults. */
+static void wp_test_fiber_overflow(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  volatile size_t *walked = arg;
+  volatile char top = 0;
+  volatile char *p = &top;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  (void)scheduler;
+
+  for(;;) {
+    *p = 1;
+    *walked = (size_t)(&top - p);
+    p -= page;
+  }
+}
+
+static wp_status_t wp_test_fiber_guard(const wp_test_t *t) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  volatile size_t *walked = NULL;
+  int status = 0;
+  pid_t pid;
+  (void)t;
+
+  walked = mmap(NULL, sizeof(*walked), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  WP_TEST_CHECK(walked != MAP_FAILED);
+  fflush(stdout);
+  if((pid = fork()) == 0) {
+    wp_event_loop_t *loop = NULL;
+    wp_fiber_scheduler_t *scheduler = NULL;
+    if(wp_event_loop_new(&loop) == WP_SUCCESS
+       && wp_fiber_scheduler_new(&scheduler, loop, WP_TEST_FIBER_STACK) == WP_SUCCESS
+       && scheduler->spawn(scheduler, &wp_test_fiber_overflow, (void *)walked) == WP_SUCCESS) {
+      wp_test_run_fibers(loop, scheduler, 1000);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+
+  /* The whole stack was usable, and the first page past it faulted. */
+  WP_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+  WP_TEST_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+  WP_TEST_CHECK(*walked + 2 * page >= WP_TEST_FIBER_STACK && *walked < WP_TEST_FIBER_STACK + 2 * page);
+  munmap((void *)walked, sizeof(*walked));
+  return WP_SUCCESS;
+}
+
+static void wp_test_fiber_closer(const wp_fiber_scheduler_t *scheduler, void *arg) {
+  wp_test_fibers_t *state = arg;
+
+  state->closed = scheduler->close(scheduler, state->fds[0]);
+}
+
+static wp_status_t wp_test_fiber_close(const wp_test_t *t) {
+  wp_event_loop_t *loop = NULL;
+  wp_fiber_scheduler_t *scheduler = NULL;
+  wp_test_fibers_t state;
+  (void)t;
+
+  memset(&state, 0, sizeof(state));
+  WP_TEST_CHECK(wp_event_loop_new(&loop) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_fiber_scheduler_new(&scheduler, loop, WP_TEST_FIBER_STACK) == WP_SUCCESS);
+  WP_TEST_CHECK(pipe2(state.fds, O_NONBLOCK | O_CLOEXEC) == 0);
+
+  /* Closing an fd another fiber is parked on wakes it with EBADF. */
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_reader, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(loop->run_once(loop, 10) == WP_SUCCESS);
+  WP_TEST_CHECK(scheduler->get_fiber_count(scheduler) == 1);
+  WP_TEST_CHECK(scheduler->spawn(scheduler, &wp_test_fiber_closer, &state) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_run_fibers(loop, scheduler, 1000));
+  WP_TEST_CHECK(state.closed == 0 && state.got_len == -1 && state.got_errno == EBADF);
+
+  close(state.fds[1]);
+  wp_fiber_scheduler_delete(scheduler);
+  wp_event_loop_delete(loop);
+  return WP_SUCCESS;
+}
+
+static void wp_test_count_entry(const wp_string_t *key, void *value, void *arg) {
+  (void)key;
+  *(size_t *)arg += (size_t)(uintptr_t)value;
+}
+
+static wp_status_t wp_test_hash_map(const wp_test_t *t) {
+  wp_pool_t *pool = NULL;
+  wp_hash_map_t *map = NULL;
+  wp_string_t *keys[200];
+  char name[16];
+  void *value = NULL;
+  size_t i, sum = 0;
+  (void)t;
+
+  WP_TEST_CHECK(wp_pool_new(&pool, 1 << 16) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_hash_map_new(&map, pool, 0) == WP_SUCCESS);
+  /* Enough keys to grow the table a few times. */
+  for(i = 0; i < 200; i++) {
+    snprintf(name, sizeof(name), "key-%zu", i);
+    WP_TEST_CHECK(wp_string_new(&keys[i], pool, name) == WP_SUCCESS);
+    WP_TEST_CHECK(map->put(map, keys[i], (void *)(uintptr_t)(i + 1)) == WP_SUCCESS);
+  }
+  WP_TEST_CHECK(map->get_size(map) == 200);
+  WP_TEST_CHECK(map->get(map, keys[42]) == (void *)43);
+  WP_TEST_CHECK(map->get_bytes(map, "key-199", 7) == (void *)200);
+  WP_TEST_CHECK(map->get_bytes(map, "key-200", 7) == NULL);
+
+  /* Replacing keeps the size; a NULL value is still found. */
+  WP_TEST_CHECK(map->put(map, keys[7], NULL) == WP_SUCCESS);
+  WP_TEST_CHECK(map->get_size(map) == 200);
+  WP_TEST_CHECK(map->find_bytes(map, "key-7", 5, &value) && value == NULL);
+  WP_TEST_CHECK(!map->find_bytes(map, "key-", 4, &value));
+
+  WP_TEST_CHECK(map->remove(map, keys[0]));
+  WP_TEST_CHECK(!map->remove(map, keys[0]));
+  WP_TEST_CHECK(map->remove_bytes(map, "key-1", 5));
+  WP_TEST_CHECK(map->get_size(map) == 198);
+  WP_TEST_CHECK(map->get(map, keys[0]) == NULL);
+  WP_TEST_CHECK(map->get(map, keys[10]) == (void *)11);
+
+  /* 1 to 200, less 1 and 2 removed and 8 replaced by NULL. */
+  map->for_each(map, &wp_test_count_entry, &sum);
+  WP_TEST_CHECK(sum == 200 * 201 / 2 - 1 - 2 - 8);
+
+  map->clear(map);
+  WP_TEST_CHECK(map->get_size(map) == 0);
+  WP_TEST_CHECK(map->get(map, keys[42]) == NULL);
+  WP_TEST_CHECK(map->reserve(map, 1000) == WP_SUCCESS);
+  WP_TEST_CHECK(map->put(map, keys[42], (void *)1) == WP_SUCCESS);
+  WP_TEST_CHECK(map->get(map, keys[42]) == (void *)1);
+
+  wp_hash_map_delete(map);
+  wp_pool_delete(pool);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_cache(const wp_test_t *t) {
+  wp_cache_t *cache = NULL;
+  wp_cache_stats_t stats;
+  char key[16], value[64];
+  int i;
+  (void)t;
+
+  WP_TEST_CHECK(wp_cache_new(&cache, 64 * 1024, 1) == WP_SUCCESS);
+  WP_TEST_CHECK(cache->get_bytes(cache, "missing", 7, value, sizeof(value)) == -1);
+  WP_TEST_CHECK(cache->put_bytes(cache, "alpha", 5, "one", 3) == WP_SUCCESS);
+  WP_TEST_CHECK(cache->get_bytes(cache, "alpha", 5, value, sizeof(value)) == 3);
+  WP_TEST_CHECK(memcmp(value, "one", 3) == 0);
+
+  /* A short buffer still reports the full length. */
+  WP_TEST_CHECK(cache->put_bytes(cache, "alpha", 5, "replaced", 8) == WP_SUCCESS);
+  WP_TEST_CHECK(cache->get_bytes(cache, "alpha", 5, value, 4) == 8);
+  WP_TEST_CHECK(memcmp(value, "repl", 4) == 0);
+
+  WP_TEST_CHECK(cache->remove_bytes(cache, "alpha", 5));
+  WP_TEST_CHECK(!cache->remove_bytes(cache, "alpha", 5));
+  WP_TEST_CHECK(cache->get_bytes(cache, "alpha", 5, value, sizeof(value)) == -1);
+
+  /* Far more than the budget holds: the cache evicts and stays within it. */
+  WP_TEST_CHECK(cache->put_bytes(cache, "hot", 3, "kept", 4) == WP_SUCCESS);
+  memset(value, 'x', sizeof(value));
+  for(i = 0; i < 10000; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    WP_TEST_CHECK(cache->put_bytes(cache, key, strlen(key), value, sizeof(value)) == WP_SUCCESS);
+    cache->get_bytes(cache, "hot", 3, value, 0);
+  }
+  cache->get_stats(cache, &stats);
+  WP_TEST_CHECK(stats.evictions > 0);
+  WP_TEST_CHECK(stats.bytes <= stats.budget);
+  WP_TEST_CHECK(stats.entries < 10000);
+  WP_TEST_CHECK(stats.hits >= 10000);
+  /* Read on every insertion, so S3-FIFO keeps it in main. */
+  WP_TEST_CHECK(cache->get_bytes(cache, "hot", 3, value, sizeof(value)) == 4);
+  WP_TEST_CHECK(memcmp(value, "kept", 4) == 0);
+
+  wp_cache_delete(cache);
+  return WP_SUCCESS;
+}
+
+/* Open path's pool, expecting it started empty. */
+static wp_status_t wp_test_pool_starts_empty(const char *path, uint32_t layout) {
+  wp_pool_t *pool = NULL;
+  wp_pool_stats_t stats;
+  bool reattached = true;
+
+  WP_TEST_CHECK(wp_pool_new_persistent(&pool, path, 1 << 16, layout, &reattached) == WP_SUCCESS);
+  pool->get_stats(pool, &stats);
+  WP_TEST_CHECK(!reattached && wp_pool_get_root(pool) == NULL && stats.live == 0);
+  wp_pool_delete(pool);
+  return WP_SUCCESS;
+}
+
+/* Keep a string as path's root, sealing the pool unless it dies first. */
+static wp_status_t wp_test_pool_store(const char *path, uint32_t layout, bool seal, wp_pool_offset_t *offset_out) {
+  wp_pool_t *pool = NULL;
+  char *value = NULL;
+
+  WP_TEST_CHECK(wp_pool_new_persistent(&pool, path, 1 << 16, layout, NULL) == WP_SUCCESS);
+  WP_TEST_CHECK((value = pool->palloc(pool, 16)) != NULL);
+  strcpy(value, "kept across runs");
+  wp_pool_set_root(pool, value);
+  if(offset_out) {
+    *offset_out = wp_pool_offset_of(pool, value);
+  }
+  if(!seal) {
+    /* Killed while attached: nothing unmaps or seals the region. */
+    _exit(EXIT_SUCCESS);
+  }
+  wp_pool_delete(pool);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_persistent_pool(const wp_test_t *t) {
+  char path[] = "/tmp/libwpd_tests.XXXXXX";
+  wp_pool_t *pool = NULL;
+  wp_pool_offset_t offset = 0;
+  bool reattached = false;
+  char byte = 0;
+  int fd, status = 0;
+  pid_t pid;
+  (void)t;
+
+  WP_TEST_CHECK((fd = mkstemp(path)) != -1);
+  close(fd);
+  WP_TEST_CHECK(wp_test_pool_starts_empty(path, 1) == WP_SUCCESS);
+
+  /* A sealed pool comes back as it was. */
+  WP_TEST_CHECK(wp_test_pool_store(path, 1, true, &offset) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_pool_new_persistent(&pool, path, 1 << 16, 1, &reattached) == WP_SUCCESS);
+  WP_TEST_CHECK(reattached && wp_pool_get_root(pool) != NULL);
+  WP_TEST_CHECK(strcmp(wp_pool_get_root(pool), "kept across runs") == 0);
+  wp_pool_delete(pool);
+
+  /* A damaged byte fails the checksum. */
+  WP_TEST_CHECK((fd = open(path, O_RDWR)) > -1);
+  WP_TEST_CHECK(pread(fd, &byte, 1, (off_t)offset) == 1);
+  byte ^= 0x20;
+  WP_TEST_CHECK(pwrite(fd, &byte, 1, (off_t)offset) == 1);
+  close(fd);
+  WP_TEST_CHECK(wp_test_pool_starts_empty(path, 1) == WP_SUCCESS);
+
+  /* Another layout is someone else's contents. */
+  WP_TEST_CHECK(wp_test_pool_store(path, 1, true, NULL) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_pool_starts_empty(path, 2) == WP_SUCCESS);
+
+  /* A run that died with the pool attached never sealed it. */
+  WP_TEST_CHECK(wp_test_pool_store(path, 2, true, NULL) == WP_SUCCESS);
+  fflush(stdout);
+  if((pid = fork()) == 0) {
+    wp_test_pool_store(path, 2, false, NULL);
+    _exit(EXIT_FAILURE);
+  }
+  WP_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  WP_TEST_CHECK(wp_test_pool_starts_empty(path, 2) == WP_SUCCESS);
+
+  unlink(path);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_state_images(const wp_test_t *t) {
+  char path[] = "/tmp/libwpd_tests.XXXXXX";
+  wp_pool_t *state = NULL, *keys = NULL;
+  wp_cache_t *cache = NULL;
+  wp_hash_map_t *map = NULL;
+  wp_string_t *key = NULL;
+  wp_pool_offset_t cache_image, map_image;
+  char value[16];
+  int *counter;
+  int fd;
+  (void)t;
+
+  WP_TEST_CHECK((fd = mkstemp(path)) != -1);
+  close(fd);
+  WP_TEST_CHECK(wp_pool_new_persistent(&state, path, 1 << 20, 1, NULL) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_pool_new(&keys, 4096) == WP_SUCCESS);
+
+  WP_TEST_CHECK(wp_cache_new(&cache, 64 * 1024, 2) == WP_SUCCESS);
+  WP_TEST_CHECK(cache->put_bytes(cache, "a", 1, "first", 5) == WP_SUCCESS);
+  WP_TEST_CHECK(cache->put_bytes(cache, "b", 1, "second", 6) == WP_SUCCESS);
+  WP_TEST_CHECK((cache_image = wp_cache_save(cache, state)) != 0);
+  wp_cache_delete(cache);
+
+  WP_TEST_CHECK(wp_hash_map_new(&map, keys, 0) == WP_SUCCESS);
+  WP_TEST_CHECK((counter = state->palloc(state, sizeof(int))) != NULL);
+  *counter = 7;
+  WP_TEST_CHECK(wp_string_new(&key, keys, "counter") == WP_SUCCESS);
+  WP_TEST_CHECK(map->put(map, key, counter) == WP_SUCCESS);
+  WP_TEST_CHECK((map_image = wp_hash_map_save(map, state)) != 0);
+  wp_hash_map_delete(map);
+
+  /* A fresh cache and map get the entries back. */
+  WP_TEST_CHECK(wp_cache_new(&cache, 64 * 1024, 4) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_cache_load(cache, state, cache_image) == 2);
+  WP_TEST_CHECK(cache->get_bytes(cache, "b", 1, value, sizeof(value)) == 6);
+  WP_TEST_CHECK(memcmp(value, "second", 6) == 0);
+  WP_TEST_CHECK(wp_cache_load(cache, state, map_image) == -1);
+  wp_cache_delete(cache);
+
+  WP_TEST_CHECK(wp_hash_map_new(&map, keys, 0) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_hash_map_load(map, state, map_image, keys) == 1);
+  WP_TEST_CHECK(map->get_bytes(map, "counter", 7) == counter);
+  wp_hash_map_delete(map);
+
+  /* Rewinding to the first image gives its space back for the next save. */
+  WP_TEST_CHECK(wp_pool_contains(state, counter));
+  wp_pool_rewind(state, wp_pool_pointer_at(state, cache_image));
+  WP_TEST_CHECK(wp_pool_pointer_at(state, wp_pool_offset_of(state, state->palloc(state, 1))) ==
+                wp_pool_pointer_at(state, cache_image));
+
+  wp_pool_delete(keys);
+  wp_pool_delete(state);
+  unlink(path);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_format(const wp_test_t *t) {
+  wp_pool_t *pool = NULL;
+  wp_fmt_t fmt;
+  char small[8], buf[128];
+  int i;
+  (void)t;
+
+  wp_fmt_init(&fmt, buf, sizeof(buf));
+  wp_fmt_str(&fmt, "n=");
+  wp_fmt_u64(&fmt, 18446744073709551615ULL);
+  wp_fmt_char(&fmt, ' ');
+  wp_fmt_i64(&fmt, INT64_MIN);
+  wp_fmt_char(&fmt, ' ');
+  wp_fmt_hex(&fmt, 0xbeef, 8);
+  WP_TEST_CHECK(strcmp(buf, "n=18446744073709551615 -9223372036854775808 0000beef") == 0);
+  WP_TEST_CHECK(fmt.len == strlen(buf) && !fmt.truncated);
+
+  wp_fmt_reset(&fmt);
+  wp_fmt_double(&fmt, 0.1);
+  wp_fmt_char(&fmt, ' ');
+  wp_fmt_double(&fmt, 1.0);
+  wp_fmt_char(&fmt, ' ');
+  wp_fmt_double(&fmt, 1e21);
+  wp_fmt_char(&fmt, ' ');
+  wp_fmt_double(&fmt, -1.0 / 0.0);
+  WP_TEST_CHECK(strcmp(buf, "0.1 1.0 1e+21 -inf") == 0);
+
+  /* Every double read back is the one written. */
+  for(i = 0; i < 1000; i++) {
+    double value = (double)rand() / RAND_MAX * 1e6 - 5e5;
+    wp_fmt_reset(&fmt);
+    wp_fmt_double(&fmt, value);
+    WP_TEST_CHECK(fmt.len <= WP_FMT_DOUBLE_MAX);
+    WP_TEST_CHECK(strtod(buf, NULL) == value);
+  }
+
+  wp_fmt_reset(&fmt);
+  wp_fmt_escaped(&fmt, "a\"b\\c\n\x01", 7);
+  WP_TEST_CHECK(strcmp(buf, "\"a\\\"b\\\\c\\n\\u0001\"") == 0);
+
+  /* A fixed buffer keeps what fits and says so. */
+  wp_fmt_init(&fmt, small, sizeof(small));
+  wp_fmt_str(&fmt, "truncated");
+  WP_TEST_CHECK(fmt.truncated && fmt.len == 7 && strcmp(small, "truncat") == 0);
+
+  /* A pool backed one grows instead. */
+  WP_TEST_CHECK(wp_pool_new(&pool, 4096) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_fmt_init_pool(&fmt, pool, 4) == WP_SUCCESS);
+  for(i = 0; i < 100; i++) {
+    wp_fmt_u64(&fmt, 7);
+  }
+  WP_TEST_CHECK(!fmt.truncated && fmt.len == 100 && fmt.buf[99] == '7' && fmt.buf[100] == '\0');
+  wp_pool_delete(pool);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_text(const wp_test_t *t) {
+  char upper[32];
+  char lower[32];
+  (void)t;
+
+  WP_TEST_CHECK(wp_utf8_validate("", 0));
+  WP_TEST_CHECK(wp_utf8_validate("plain ascii, long enough for the fast path", 42));
+  WP_TEST_CHECK(wp_utf8_validate("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 14));
+  /* Truncated, overlong, surrogate, past U+10FFFF, stray continuation. */
+  WP_TEST_CHECK(!wp_utf8_validate("caf\xc3", 4));
+  WP_TEST_CHECK(!wp_utf8_validate("\xc0\xaf", 2));
+  WP_TEST_CHECK(!wp_utf8_validate("\xed\xa0\x80", 3));
+  WP_TEST_CHECK(!wp_utf8_validate("\xf4\x90\x80\x80", 4));
+  WP_TEST_CHECK(!wp_utf8_validate("0123456789abcdef0123456789abcdef\x80", 33));
+
+  wp_ascii_upper(upper, "Mixed Case 123 \xc3\xa9", 18);
+  WP_TEST_CHECK(memcmp(upper, "MIXED CASE 123 \xc3\xa9", 18) == 0);
+  wp_ascii_lower(lower, upper, 18);
+  WP_TEST_CHECK(memcmp(lower, "mixed case 123 \xc3\xa9", 18) == 0);
+  WP_TEST_CHECK(wp_ascii_equals_ignore_case(upper, lower, 18));
+  WP_TEST_CHECK(!wp_ascii_equals_ignore_case("[", "{", 1));
+  return WP_SUCCESS;
+}
+
+typedef enum wp_test_drain_mode {
+  /* The item in flight finishes 200ms into the drain. */
+  WP_TEST_DRAIN_COMPLETES = 0,
+  /* It never does; a second SIGTERM cuts the drain short. */
+  WP_TEST_DRAIN_SECOND_SIGNAL,
+  /* It never does; the drain deadline passes. */
+  WP_TEST_DRAIN_DEADLINE
+} wp_test_drain_mode_t;
+
+typedef struct wp_test_drain {
+  wp_test_drain_mode_t mode;
+  wp_timer_wheel_t *wheel;
+  wp_timer_t item;
+  bool started;
+  bool done;
+} wp_test_drain_t;
+
+static char wp_test_daemon_dir[64];
+static wp_test_drain_t wp_test_drain_state;
+
+static void wp_test_daemon_path(char *path, size_t size, const char *name) {
+  snprintf(path, size, "%s/%s", wp_test_daemon_dir, name);
+}
+
+static void wp_test_daemon_on_start(const wp_daemonizer_t *daemon) {
+  const wp_event_loop_t *loop = daemon->get_event_loop(daemon);
+  loop->run(loop);
+}
+
+static void wp_test_daemon_reconfigure(const wp_daemonizer_t *daemon, wp_configuration_pt config) {
+  char path[128];
+  FILE *file = NULL;
+  (void)daemon;
+
+  wp_test_daemon_path(path, sizeof(path), "wpd.conf");
+  if((file = fopen(path, "w"))) {
+    fprintf(file, "run_path=%s;\n", wp_test_daemon_dir);
+    fclose(file);
+    config->populate_from_file(config, path);
+  }
+  wp_test_daemon_path(path, sizeof(path), "wpd.pid");
+  config->set_lock_file_path(config, path);
+  config->set_enable_daemon(config, true);
+  config->set_enable_ready_on_start(config, true);
+  config->set_shutdown_drain_timeout_ms(config, wp_test_drain_state.mode == WP_TEST_DRAIN_DEADLINE ? 300 : 30000);
+  config->set_daemon_on_start_method(config, &wp_test_daemon_on_start);
+}
+
+static void wp_test_drain_item_done(wp_timer_t *timer, void *arg) {
+  (void)timer;
+  ((wp_test_drain_t *)arg)->done = true;
+}
+
+/* The first poll starts the item's last 200ms; the drain is over once it's done. */
+static bool wp_test_drain(const wp_daemonizer_t *daemon, void *arg) {
+  wp_test_drain_t *drain = arg;
+  char path[128];
+  FILE *file = NULL;
+  (void)daemon;
+
+  if(!drain->started && drain->mode == WP_TEST_DRAIN_COMPLETES) {
+    drain->wheel->schedule(drain->wheel, &drain->item, 200, &wp_test_drain_item_done, drain);
+  }
+  drain->started = true;
+  if(drain->done) {
+    wp_test_daemon_path(path, sizeof(path), "drained");
+    if((file = fopen(path, "w"))) {
+      fclose(file);
+    }
+  }
+  return drain->done;
+}
+
+/* In the forked child: daemonize, leaving this process once the daemon is ready. */
+static void wp_test_daemon_run(void) {
+  wp_daemonizer_t *daemon = NULL;
+
+  if(wp_daemonizer_initialize(&daemon, &wp_test_daemon_reconfigure) != WP_SUCCESS) {
+    _exit(EXIT_FAILURE);
+  }
+  atexit(daemon->shutdown);
+  if(daemon->daemonize(daemon) != WP_SUCCESS) {
+    _exit(EXIT_FAILURE);
+  }
+  /* Only the daemon gets here. */
+  wp_timer_init(&wp_test_drain_state.item);
+  if(wp_timer_wheel_new(&wp_test_drain_state.wheel, daemon->get_event_loop(daemon), 1) != WP_SUCCESS) {
+    _exit(EXIT_FAILURE);
+  }
+  daemon->set_drain_method(daemon, &wp_test_drain, &wp_test_drain_state);
+  exit(daemon->start(daemon) == WP_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static wp_status_t wp_test_daemon_drain_mode(wp_test_drain_mode_t mode) {
+  const struct timespec pause = { 0, 200000000 };
+  char lock_path[128], drained_path[128], pid_text[24];
+  FILE *file = NULL;
+  uint64_t start;
+  int status = 0;
+  pid_t pid, daemon_pid = 0;
+
+  memset(&wp_test_drain_state, 0, sizeof(wp_test_drain_state));
+  wp_test_drain_state.mode = mode;
+  wp_test_daemon_path(lock_path, sizeof(lock_path), "wpd.pid");
+  wp_test_daemon_path(drained_path, sizeof(drained_path), "drained");
+  unlink(drained_path);
+
+  fflush(stdout);
+  fflush(stderr);
+  if((pid = fork()) == 0) {
+    wp_test_daemon_run();
+    _exit(EXIT_FAILURE);
+  }
+  /* The original parent exits once the daemon is serving. */
+  WP_TEST_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  WP_TEST_CHECK((file = fopen(lock_path, "r")) != NULL);
+  WP_TEST_CHECK(fgets(pid_text, sizeof(pid_text), file) != NULL);
+  fclose(file);
+  WP_TEST_CHECK((daemon_pid = (pid_t)atoi(pid_text)) > 0);
+
+  start = wp_test_now_ms();
+  WP_TEST_CHECK(kill(daemon_pid, SIGTERM) == 0);
+  if(mode == WP_TEST_DRAIN_SECOND_SIGNAL) {
+    nanosleep(&pause, NULL);
+    WP_TEST_CHECK(kill(daemon_pid, SIGTERM) == 0);
+  }
+
+  /* Shutdown runs at exit and removes the pid lock last. */
+  while(access(lock_path, F_OK) == 0 && wp_test_now_ms() - start < 10000) {
+    nanosleep(&pause, NULL);
+  }
+  WP_TEST_CHECK(access(lock_path, F_OK) != 0);
+  WP_TEST_CHECK((access(drained_path, F_OK) == 0) == (mode == WP_TEST_DRAIN_COMPLETES));
+  if(mode == WP_TEST_DRAIN_COMPLETES) {
+    WP_TEST_CHECK(wp_test_now_ms() - start >= 200);
+  }
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_daemon_drain(const wp_test_t *t) {
+  char path[128];
+  (void)t;
+
+  snprintf(wp_test_daemon_dir, sizeof(wp_test_daemon_dir), "/tmp/libwpd_tests.XXXXXX");
+  WP_TEST_CHECK(mkdtemp(wp_test_daemon_dir) != NULL);
+  /* As root, the daemon drops to the daemon user before writing its pid. */
+  WP_TEST_CHECK(chmod(wp_test_daemon_dir, 01777) == 0);
+
+  WP_TEST_CHECK(wp_test_daemon_drain_mode(WP_TEST_DRAIN_COMPLETES) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_daemon_drain_mode(WP_TEST_DRAIN_SECOND_SIGNAL) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_daemon_drain_mode(WP_TEST_DRAIN_DEADLINE) == WP_SUCCESS);
+
+  wp_test_daemon_path(path, sizeof(path), "wpd.conf");
+  unlink(path);
+  wp_test_daemon_path(path, sizeof(path), "drained");
+  unlink(path);
+  rmdir(wp_test_daemon_dir);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_limiters(const wp_test_t *t) {
+  wp_token_bucket_t bucket;
+  wp_rate_limiter_t *rate = NULL;
+  wp_concurrency_limiter_t *concurrency = NULL;
+  const uint64_t now = 1000000000000ULL;
+  unsigned i, limit;
+  (void)t;
+
+  /* 10 a second with a burst of 5: five at once, then one per 100ms. */
+  wp_token_bucket_init(&bucket, 10, 5);
+  for(i = 0; i < 5; i++) {
+    WP_TEST_CHECK(wp_token_bucket_take_at(&bucket, 1, now));
+  }
+  WP_TEST_CHECK(!wp_token_bucket_take_at(&bucket, 1, now));
+  WP_TEST_CHECK(!wp_token_bucket_take_at(&bucket, 1, now + 50000000));
+  WP_TEST_CHECK(wp_token_bucket_take_at(&bucket, 1, now + 100000000));
+  WP_TEST_CHECK(!wp_token_bucket_take_at(&bucket, 6, now + 10000000000ULL));
+  WP_TEST_CHECK(wp_token_bucket_take_at(&bucket, 5, now + 10000000000ULL));
+  wp_token_bucket_init(&bucket, 0, 0);
+  WP_TEST_CHECK(wp_token_bucket_take(&bucket, 1000000));
+
+  /* Keys are limited separately. */
+  WP_TEST_CHECK(wp_rate_limiter_new(&rate, 64, 1, 2) == WP_SUCCESS);
+  WP_TEST_CHECK(rate->take(rate, "10.0.0.1", 8, 1));
+  WP_TEST_CHECK(rate->take(rate, "10.0.0.1", 8, 1));
+  WP_TEST_CHECK(!rate->take(rate, "10.0.0.1", 8, 1));
+  WP_TEST_CHECK(rate->take(rate, "10.0.0.2", 8, 2));
+  WP_TEST_CHECK(rate->get_refused(rate) == 1);
+  rate->set_rate(rate, 0, 0);
+  WP_TEST_CHECK(rate->take(rate, "10.0.0.1", 8, 1));
+  wp_rate_limiter_delete(rate);
+
+  /* Admit up to the limit, then shed until a release. */
+  WP_TEST_CHECK(wp_concurrency_limiter_new(&concurrency, 4, 100) == WP_SUCCESS);
+  limit = concurrency->get_limit(concurrency);
+  WP_TEST_CHECK(limit >= 4 && limit <= 100);
+  for(i = 0; i < limit; i++) {
+    WP_TEST_CHECK(concurrency->acquire(concurrency));
+  }
+  WP_TEST_CHECK(concurrency->get_in_flight(concurrency) == limit);
+  WP_TEST_CHECK(!concurrency->acquire(concurrency));
+  WP_TEST_CHECK(concurrency->get_shed(concurrency) == 1);
+  concurrency->release(concurrency, 1000000, false);
+  WP_TEST_CHECK(concurrency->acquire(concurrency));
+  for(i = 0; i < limit; i++) {
+    concurrency->release(concurrency, 1000000, true);
+  }
+  WP_TEST_CHECK(concurrency->get_in_flight(concurrency) == 0);
+
+  /* New bounds clamp the current limit. */
+  concurrency->set_bounds(concurrency, 2, 3);
+  limit = concurrency->get_limit(concurrency);
+  WP_TEST_CHECK(limit >= 2 && limit <= 3);
+  wp_concurrency_limiter_delete(concurrency);
+  return WP_SUCCESS;
+}
+
+/* Rewrite path's text in place, keeping its inode, and set its mtime. */
+static wp_status_t wp_test_rewrite_config(const char *path, const char *text, const struct timespec *mtime) {
+  struct timespec times[2];
+  int fd;
+
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1] = *mtime;
+  WP_TEST_CHECK((fd = open(path, O_WRONLY | O_CREAT, 0600)) > -1);
+  WP_TEST_CHECK(ftruncate(fd, 0) == 0 && write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+  WP_TEST_CHECK(futimens(fd, times) == 0);
+  close(fd);
+  return WP_SUCCESS;
+}
+
+/* Load path into a fresh config, expecting the worker count it gives. */
+static wp_status_t wp_test_load_workers(const char *path, unsigned workers) {
+  wp_configuration_t *config = NULL;
+
+  WP_TEST_CHECK(wp_configuration_new(&config) == WP_SUCCESS);
+  WP_TEST_CHECK(config->populate_from_file(config, path) == WP_SUCCESS);
+  WP_TEST_CHECK(config->get_worker_count(config) == workers);
+  wp_configuration_delete(config);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_config_snapshot(const wp_test_t *t) {
+  char path[] = "/tmp/libwpd_tests.XXXXXX";
+  char snapshot_path[64];
+  struct timespec mtime = { 1000000000, 0 };
+  struct stat st;
+  char byte = 0;
+  int fd;
+  (void)t;
+
+  WP_TEST_CHECK((fd = mkstemp(path)) != -1);
+  close(fd);
+  snprintf(snapshot_path, sizeof(snapshot_path), "%s.snap", path);
+
+  /* The first parse writes the snapshot. */
+  WP_TEST_CHECK(wp_test_rewrite_config(path, "config_snapshot=true;\nworkers=3;\n", &mtime) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_load_workers(path, 3) == WP_SUCCESS);
+  WP_TEST_CHECK(stat(snapshot_path, &st) == 0);
+
+  /* While the source looks unchanged, the snapshot is used instead of the text. */
+  WP_TEST_CHECK(wp_test_rewrite_config(path, "config_snapshot=true;\nworkers=5;\n", &mtime) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_load_workers(path, 3) == WP_SUCCESS);
+
+  /* A damaged snapshot fails its checksum, so the text is parsed. */
+  WP_TEST_CHECK((fd = open(snapshot_path, O_RDWR)) > -1);
+  WP_TEST_CHECK(pread(fd, &byte, 1, st.st_size - 2) == 1);
+  byte ^= 0x01;
+  WP_TEST_CHECK(pwrite(fd, &byte, 1, st.st_size - 2) == 1);
+  close(fd);
+  WP_TEST_CHECK(wp_test_load_workers(path, 5) == WP_SUCCESS);
+
+  /* Modifying the source makes the snapshot stale. */
+  mtime.tv_sec += 10;
+  WP_TEST_CHECK(wp_test_rewrite_config(path, "config_snapshot=true;\nworkers=7;\n", &mtime) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_load_workers(path, 7) == WP_SUCCESS);
+
+  /* Turning snapshots off stops using them, but doesn't remove one it didn't write. */
+  mtime.tv_sec += 10;
+  WP_TEST_CHECK(wp_test_rewrite_config(path, "config_snapshot=false;\nworkers=8;\n", &mtime) == WP_SUCCESS);
+  WP_TEST_CHECK(wp_test_load_workers(path, 8) == WP_SUCCESS);
+  WP_TEST_CHECK(access(snapshot_path, F_OK) == 0);
+
+  unlink(snapshot_path);
+  unlink(path);
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_test_config_keys(const wp_test_t *t) {
+  char path[] = "/tmp/libwpd_tests.XXXXXX";
+  wp_configuration_t *config = NULL;
+  FILE *file = NULL;
+  int fd;
+  (void)t;
+
+  WP_TEST_CHECK((fd = mkstemp(path)) != -1);
+  WP_TEST_CHECK((file = fdopen(fd, "w")) != NULL);
+  /* Full names, older spellings matched by their first letter, and misspelt newer keys. */
+  fputs("run_folder=/srv/wpd;\nlockfile=/tmp/wpd.lock;\ndaemonize=true;\n", file);
+  fputs("workers=2;\nworkers_max=9;\nconcurrency_limit=9;\n", file);
+  fclose(file);
+
+  WP_TEST_CHECK(wp_configuration_new(&config) == WP_SUCCESS);
+  WP_TEST_CHECK(config->populate_from_file(config, path) == WP_SUCCESS);
+  WP_TEST_CHECK(strcmp(config->get_run_folder_path(config), "/srv/wpd") == 0);
+  WP_TEST_CHECK(strcmp(config->get_lock_file_path(config), "/tmp/wpd.lock") == 0);
+  WP_TEST_CHECK(config->get_enable_daemon(config));
+  WP_TEST_CHECK(config->get_worker_count(config) == 2);
+  WP_TEST_CHECK(config->get_concurrency_limit_max(config) == 0 && config->get_concurrency_limit_min(config) == 0);
+  wp_configuration_delete(config);
+
+  unlink(path);
+  return WP_SUCCESS;
+}
 
+static const wp_test_entry_t wp_tests[] = {
+  { "event_loop", &wp_test_event_loop },
+  { "timer_wheel", &wp_test_timer_wheel },
+  { "timer_wheel_idle", &wp_test_timer_wheel_idle },
+  { "event_loop_reuse", &wp_test_event_loop_reuse },
+  { "event_loop_readd", &wp_test_event_loop_readd },
+  { "listener", &wp_test_listener },
+  { "listener_unix_owner", &wp_test_listener_unix_owner },
+  { "buffer_chain", &wp_test_buffer_chain },
+  { "mpmc_queue", &wp_test_mpmc_queue },
+  { "mailbox", &wp_test_mailbox },
+  { "fibers", &wp_test_fibers },
+  { "fiber_guard", &wp_test_fiber_guard },
+  { "fiber_close", &wp_test_fiber_close },
+  { "hash_map", &wp_test_hash_map },
+  { "cache", &wp_test_cache },
+  { "persistent_pool", &wp_test_persistent_pool },
+  { "state_images", &wp_test_state_images },
+  { "format", &wp_test_format },
+  { "text", &wp_test_text },
+  { "daemon_drain", &wp_test_daemon_drain },
+  { "limiters", &wp_test_limiters },
+  { "config_snapshot", &wp_test_config_snapshot },
+  { "config_keys", &wp_test_config_keys },
+};
 
+int main(int argc, char **argv) {
+  wp_test_t t = { argc, argv };
+  size_t i;
+  int failed = 0;
 
+  for(i = 0; i < sizeof(wp_tests) / sizeof(wp_tests[0]); i++) {
+    if(argc > 1 && strcmp(argv[1], wp_tests[i].name) != 0) {
+      continue;
+    }
+    if(wp_tests[i].fn(&t) == WP_SUCCESS) {
+      printf("PASS: %s\n", wp_tests[i].name);
+    } else {
+      printf("FAIL: %s\n", wp_tests[i].name);
+      failed++;
+    }
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
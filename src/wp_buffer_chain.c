@@ -0,0 +1,529 @@
+/*
+ * File:   wp_buffer_chain.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:23 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <wp_common.h>
+#include <wp_pool.h>
+#include <wp_buffer_chain.h>
+
+/* Copied bytes are packed into chunks of this size; larger appends get their own slice. */
+#define WP_BUFFER_CHUNK   4096
+/* iovecs gathered per writev. */
+#define WP_BUFFER_IOV_MAX 64
+
+typedef enum wp_buffer_slice_kind {
+  WP_BUFFER_SLICE_CHUNK,   /* recycled WP_BUFFER_CHUNK bytes of pool memory */
+  WP_BUFFER_SLICE_LARGE,   /* pool memory sized for one large append */
+  WP_BUFFER_SLICE_REF,     /* caller memory */
+  WP_BUFFER_SLICE_FILE     /* a file, pipe or socket */
+} wp_buffer_slice_kind_t;
+
+typedef struct wp_buffer_slice {
+  struct wp_buffer_slice *next_free;
+  int ref_count;
+  wp_buffer_slice_kind_t kind;
+
+  /* Memory slices. */
+  char *base;
+  size_t capacity;
+  size_t used;
+  wp_buffer_release_fn release;
+  void *arg;
+
+  /* File slices. */
+  int fd;
+  bool seekable;
+} wp_buffer_slice_t;
+
+typedef struct wp_buffer_segment {
+  struct wp_buffer_segment *next;
+  wp_buffer_slice_t *slice;
+  /* Offset into base, or into the file for seekable file slices. */
+  size_t offset;
+  size_t len;
+} wp_buffer_segment_t;
+
+/* State shared by a chain and every chain split from it. */
+typedef struct wp_buffer_shared {
+  const wp_pool_t *pool;
+  int chain_count;
+  wp_buffer_segment_t *free_segments;
+  wp_buffer_slice_t *free_chunks;
+  wp_buffer_slice_t *free_refs;
+} wp_buffer_shared_t;
+
+typedef struct __wp_buffer_chain_private_t {
+  wp_buffer_shared_t *shared;
+  wp_buffer_segment_t *head;
+  wp_buffer_segment_t *tail;
+  size_t length;
+} __wp_buffer_chain_private_t;
+
+#define WP_BUFFER_SLICE_HEADER ((sizeof(wp_buffer_slice_t) + 15) & ~(size_t)15)
+
+static wp_buffer_slice_t *wp_buffer_slice_new(wp_buffer_shared_t *shared, wp_buffer_slice_kind_t kind, size_t capacity) {
+  wp_buffer_slice_t *slice = NULL;
+  const wp_pool_t *pool = shared->pool;
+
+  if(kind == WP_BUFFER_SLICE_CHUNK && shared->free_chunks) {
+    slice = shared->free_chunks;
+    shared->free_chunks = slice->next_free;
+  } else if((kind == WP_BUFFER_SLICE_REF || kind == WP_BUFFER_SLICE_FILE) && shared->free_refs) {
+    slice = shared->free_refs;
+    shared->free_refs = slice->next_free;
+  } else if(kind == WP_BUFFER_SLICE_CHUNK || kind == WP_BUFFER_SLICE_LARGE) {
+    if((slice = pool->palloc(pool, WP_BUFFER_SLICE_HEADER + capacity)) == NULL) {
+      return NULL;
+    }
+    slice->base = (char *)slice + WP_BUFFER_SLICE_HEADER;
+    slice->capacity = capacity;
+  } else if((slice = pool->palloc(pool, sizeof(*slice))) == NULL) {
+    return NULL;
+  }
+
+  slice->next_free = NULL;
+  slice->ref_count = 1;
+  slice->kind = kind;
+  slice->used = 0;
+  slice->release = NULL;
+  slice->arg = NULL;
+  slice->fd = -1;
+  slice->seekable = true;
+  return slice;
+}
+
+static void wp_buffer_slice_unref(wp_buffer_shared_t *shared, wp_buffer_slice_t *slice) {
+  if(--slice->ref_count > 0) {
+    return;
+  }
+
+  switch(slice->kind) {
+    case WP_BUFFER_SLICE_CHUNK:
+      slice->next_free = shared->free_chunks;
+      shared->free_chunks = slice;
+      break;
+    case WP_BUFFER_SLICE_REF:
+      if(slice->release) {
+        slice->release(slice->base, slice->arg);
+      }
+      /* fall through */
+    case WP_BUFFER_SLICE_FILE:
+      slice->next_free = shared->free_refs;
+      shared->free_refs = slice;
+      break;
+    case WP_BUFFER_SLICE_LARGE:
+      shared->pool->pfree(shared->pool, slice);
+      break;
+  }
+}
+
+static wp_buffer_segment_t *wp_buffer_segment_new(wp_buffer_shared_t *shared, wp_buffer_slice_t *slice, size_t offset, size_t len) {
+  wp_buffer_segment_t *segment = shared->free_segments;
+
+  if(segment) {
+    shared->free_segments = segment->next;
+  } else if((segment = shared->pool->palloc(shared->pool, sizeof(*segment))) == NULL) {
+    return NULL;
+  }
+
+  segment->next = NULL;
+  segment->slice = slice;
+  segment->offset = offset;
+  segment->len = len;
+  return segment;
+}
+
+static void wp_buffer_segment_free(wp_buffer_shared_t *shared, wp_buffer_segment_t *segment) {
+  segment->next = shared->free_segments;
+  shared->free_segments = segment;
+}
+
+static void wp_buffer_chain_link(const wp_buffer_chain_t *self, wp_buffer_segment_t *segment) {
+  if(self->data->tail) {
+    self->data->tail->next = segment;
+  } else {
+    self->data->head = segment;
+  }
+  self->data->tail = segment;
+  self->data->length += segment->len;
+}
+
+static bool wp_buffer_segment_is_memory(const wp_buffer_segment_t *segment) {
+  return segment->slice->kind != WP_BUFFER_SLICE_FILE;
+}
+
+/**
+ * Drop len bytes from the front of the chain.
+ * @param self pointer to an instance of the chain.
+ * @param len the number of bytes to drop.
+ * @param drain_pipes read and discard dropped bytes of pipes; false when the
+ *        bytes were already taken from the pipe by splice.
+ */
+static void wp_buffer_chain_drop(const wp_buffer_chain_t *self, size_t len, bool drain_pipes) {
+  wp_buffer_shared_t *shared = self->data->shared;
+
+  /* Empty segments at the head are dropped too. */
+  while(self->data->head && (len || self->data->head->len == 0)) {
+    wp_buffer_segment_t *head = self->data->head;
+    size_t n = len < head->len ? len : head->len;
+
+    if(drain_pipes && !head->slice->seekable) {
+      char scratch[WP_BUFFER_CHUNK];
+      size_t left = n;
+      while(left) {
+        ssize_t r = read(head->slice->fd, scratch, left < sizeof(scratch) ? left : sizeof(scratch));
+        if(r <= 0 && !(r < 0 && errno == EINTR)) {
+          break;
+        }
+        left -= r > 0 ? (size_t)r : 0;
+      }
+    }
+
+    head->offset += n;
+    head->len -= n;
+    self->data->length -= n;
+    len -= n;
+
+    if(head->len == 0) {
+      self->data->head = head->next;
+      if(self->data->head == NULL) {
+        self->data->tail = NULL;
+      }
+      wp_buffer_slice_unref(shared, head->slice);
+      wp_buffer_segment_free(shared, head);
+    }
+  }
+}
+
+static wp_status_t wp_buffer_chain_append(const wp_buffer_chain_t *self, const void *data, size_t len) {
+  assert(self && self->data && (data || len == 0));
+  wp_buffer_shared_t *shared = self->data->shared;
+  const char *src = data;
+
+  while(len) {
+    wp_buffer_segment_t *tail = self->data->tail;
+    wp_buffer_slice_t *slice = tail ? tail->slice : NULL;
+
+    /* Bytes past a slice's used mark belong to no view, so the tail may grow into them. */
+    if(slice == NULL || !(slice->kind == WP_BUFFER_SLICE_CHUNK || slice->kind == WP_BUFFER_SLICE_LARGE)
+       || tail->offset + tail->len != slice->used || slice->used == slice->capacity) {
+      wp_buffer_slice_kind_t kind = len > WP_BUFFER_CHUNK ? WP_BUFFER_SLICE_LARGE : WP_BUFFER_SLICE_CHUNK;
+      if((slice = wp_buffer_slice_new(shared, kind, kind == WP_BUFFER_SLICE_LARGE ? len : WP_BUFFER_CHUNK)) == NULL) {
+        return WP_FAILURE;
+      }
+      if((tail = wp_buffer_segment_new(shared, slice, 0, 0)) == NULL) {
+        wp_buffer_slice_unref(shared, slice);
+        return WP_FAILURE;
+      }
+      wp_buffer_chain_link(self, tail);
+    }
+
+    size_t n = slice->capacity - slice->used;
+    n = n < len ? n : len;
+    memcpy(slice->base + slice->used, src, n);
+    slice->used += n;
+    tail->len += n;
+    self->data->length += n;
+    src += n;
+    len -= n;
+  }
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_buffer_chain_append_ref(const wp_buffer_chain_t *self, const void *data, size_t len,
+                                              wp_buffer_release_fn release, void *arg) {
+  assert(self && self->data && data);
+  wp_buffer_shared_t *shared = self->data->shared;
+  wp_buffer_slice_t *slice = NULL;
+  wp_buffer_segment_t *segment = NULL;
+
+  if((slice = wp_buffer_slice_new(shared, WP_BUFFER_SLICE_REF, 0)) == NULL) {
+    return WP_FAILURE;
+  }
+  slice->base = (char *)data;
+  slice->capacity = slice->used = len;
+  slice->release = release;
+  slice->arg = arg;
+
+  if((segment = wp_buffer_segment_new(shared, slice, 0, len)) == NULL) {
+    slice->release = NULL;
+    wp_buffer_slice_unref(shared, slice);
+    return WP_FAILURE;
+  }
+  wp_buffer_chain_link(self, segment);
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_buffer_chain_append_file(const wp_buffer_chain_t *self, int fd, off_t offset, size_t len) {
+  assert(self && self->data && fd > -1);
+  wp_buffer_shared_t *shared = self->data->shared;
+  wp_buffer_slice_t *slice = NULL;
+  wp_buffer_segment_t *segment = NULL;
+
+  if((slice = wp_buffer_slice_new(shared, WP_BUFFER_SLICE_FILE, 0)) == NULL) {
+    return WP_FAILURE;
+  }
+  slice->fd = fd;
+  slice->seekable = offset >= 0;
+
+  if((segment = wp_buffer_segment_new(shared, slice, offset >= 0 ? (size_t)offset : 0, len)) == NULL) {
+    wp_buffer_slice_unref(shared, slice);
+    return WP_FAILURE;
+  }
+  wp_buffer_chain_link(self, segment);
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_buffer_chain_append_chain(const wp_buffer_chain_t *self, const wp_buffer_chain_t *other) {
+  assert(self && self->data && other && other->data && self != other);
+
+  /* Slices are recycled into whichever chain drops them last. */
+  if(self->data->shared->pool != other->data->shared->pool) {
+    return WP_FAILURE;
+  }
+
+  if(other->data->head) {
+    if(self->data->tail) {
+      self->data->tail->next = other->data->head;
+    } else {
+      self->data->head = other->data->head;
+    }
+    self->data->tail = other->data->tail;
+    self->data->length += other->data->length;
+
+    other->data->head = other->data->tail = NULL;
+    other->data->length = 0;
+  }
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_buffer_chain_new_shared(wp_buffer_chain_t **self_out, wp_buffer_shared_t *shared);
+
+static wp_status_t wp_buffer_chain_split(const wp_buffer_chain_t *self, size_t len, wp_buffer_chain_t **out) {
+  assert(self && self->data && out);
+  wp_buffer_shared_t *shared = self->data->shared;
+  wp_buffer_chain_t *front = NULL;
+
+  if(len > self->data->length || wp_buffer_chain_new_shared(&front, shared) != WP_SUCCESS) {
+    *out = NULL;
+    return WP_FAILURE;
+  }
+
+  /* Whole segments move across. */
+  while(self->data->head && self->data->head->len <= len) {
+    wp_buffer_segment_t *head = self->data->head;
+    self->data->head = head->next;
+    if(self->data->head == NULL) {
+      self->data->tail = NULL;
+    }
+    self->data->length -= head->len;
+    len -= head->len;
+    head->next = NULL;
+    wp_buffer_chain_link(front, head);
+  }
+
+  /* The segment straddling the split point is shared by both chains. */
+  if(len) {
+    wp_buffer_segment_t *head = self->data->head;
+    wp_buffer_segment_t *part = wp_buffer_segment_new(shared, head->slice, head->offset, len);
+    if(part == NULL) {
+      /* Undo: hand everything moved so far back. */
+      wp_buffer_chain_append_chain(front, self);
+      wp_buffer_chain_append_chain(self, front);
+      wp_buffer_chain_delete(front);
+      *out = NULL;
+      return WP_FAILURE;
+    }
+    head->slice->ref_count++;
+    head->offset += len;
+    head->len -= len;
+    self->data->length -= len;
+    wp_buffer_chain_link(front, part);
+  }
+
+  *out = front;
+  return WP_SUCCESS;
+}
+
+static void wp_buffer_chain_consume(const wp_buffer_chain_t *self, size_t len) {
+  assert(self && self->data);
+  wp_buffer_chain_drop(self, len, true);
+}
+
+static size_t wp_buffer_chain_copy_out(const wp_buffer_chain_t *self, void *dest, size_t len) {
+  assert(self && self->data && (dest || len == 0));
+  char *out = dest;
+  size_t copied = 0;
+
+  for(wp_buffer_segment_t *s = self->data->head; s && copied < len && wp_buffer_segment_is_memory(s); s = s->next) {
+    size_t n = s->len < len - copied ? s->len : len - copied;
+    memcpy(out + copied, s->slice->base + s->offset, n);
+    copied += n;
+  }
+
+  return copied;
+}
+
+/**
+ * Send the file segment at the head of the chain.
+ * @return bytes sent, 0 at end of file, or -1 with errno set.
+ */
+static ssize_t wp_buffer_chain_flush_file(const wp_buffer_segment_t *head, int fd) {
+  wp_buffer_slice_t *slice = head->slice;
+  ssize_t n;
+
+  if(!slice->seekable) {
+    return splice(slice->fd, NULL, fd, NULL, head->len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  }
+
+  off_t offset = (off_t)head->offset;
+  n = sendfile(fd, slice->fd, &offset, head->len);
+  if(n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+    /* Destinations sendfile can't write to, e.g. pipes on older kernels. */
+    offset = (off_t)head->offset;
+    n = splice(slice->fd, &offset, fd, NULL, head->len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  }
+
+  return n;
+}
+
+static ssize_t wp_buffer_chain_flush(const wp_buffer_chain_t *self, int fd) {
+  assert(self && self->data);
+  size_t total = 0;
+  int err = 0;
+
+  while(self->data->head) {
+    wp_buffer_segment_t *head = self->data->head;
+    size_t wanted = 0;
+    ssize_t n;
+
+    if(wp_buffer_segment_is_memory(head)) {
+      struct iovec iov[WP_BUFFER_IOV_MAX];
+      int count = 0;
+      for(wp_buffer_segment_t *s = head; s && count < WP_BUFFER_IOV_MAX && wp_buffer_segment_is_memory(s); s = s->next) {
+        iov[count].iov_base = s->slice->base + s->offset;
+        iov[count].iov_len = s->len;
+        wanted += s->len;
+        count++;
+      }
+      n = writev(fd, iov, count);
+    } else {
+      wanted = head->len;
+      n = wp_buffer_chain_flush_file(head, fd);
+      if(n == 0) {
+        /* The file or pipe ended early; drop what can never be sent. */
+        wp_buffer_chain_drop(self, head->len, false);
+        continue;
+      }
+    }
+
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      err = errno;
+      break;
+    }
+
+    total += (size_t)n;
+    wp_buffer_chain_drop(self, (size_t)n, false);
+    if((size_t)n < wanted) {
+      /* fd is full. */
+      break;
+    }
+  }
+
+  if(total == 0 && err) {
+    errno = err;
+    return -1;
+  }
+  return (ssize_t)total;
+}
+
+static size_t wp_buffer_chain_get_length(const wp_buffer_chain_t *self) {
+  assert(self && self->data);
+  return self->data->length;
+}
+
+static bool wp_buffer_chain_is_empty(const wp_buffer_chain_t *self) {
+  assert(self && self->data);
+  return self->data->length == 0;
+}
+
+static wp_status_t wp_buffer_chain_new_shared(wp_buffer_chain_t **self_out, wp_buffer_shared_t *shared) {
+  wp_status_t ret = WP_FAILURE;
+  wp_buffer_chain_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = malloc(sizeof(*(self->data))))) {
+      self->data->shared = shared;
+      self->data->head = self->data->tail = NULL;
+      self->data->length = 0;
+      shared->chain_count++;
+
+      self->append = &wp_buffer_chain_append;
+      self->append_ref = &wp_buffer_chain_append_ref;
+      self->append_file = &wp_buffer_chain_append_file;
+      self->append_chain = &wp_buffer_chain_append_chain;
+      self->split = &wp_buffer_chain_split;
+      self->consume = &wp_buffer_chain_consume;
+      self->copy_out = &wp_buffer_chain_copy_out;
+      self->flush = &wp_buffer_chain_flush;
+      self->get_length = &wp_buffer_chain_get_length;
+      self->is_empty = &wp_buffer_chain_is_empty;
+      ret = WP_SUCCESS;
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+wp_status_t wp_buffer_chain_new(wp_buffer_chain_t **self_out, const wp_pool_t *pool) {
+  assert(pool);
+  wp_status_t ret = WP_FAILURE;
+  wp_buffer_shared_t *shared = NULL;
+
+  *self_out = NULL;
+  if((shared = calloc(1, sizeof(*shared)))) {
+    shared->pool = pool;
+    if((ret = wp_buffer_chain_new_shared(self_out, shared)) != WP_SUCCESS) {
+      free(shared);
+    }
+  }
+
+  return ret;
+}
+
+void wp_buffer_chain_delete(wp_buffer_chain_t *self) {
+  assert(self);
+  if(self->data) {
+    wp_buffer_shared_t *shared = self->data->shared;
+    wp_buffer_chain_drop(self, self->data->length, false);
+    if(--shared->chain_count == 0) {
+      /* Recycled slices and segments stay in the pool until it's deleted. */
+      free(shared);
+    }
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
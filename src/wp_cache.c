@@ -0,0 +1,774 @@
+/*
+ * File:   wp_cache.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:40 AM
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wp_common.h>
+#include <wp_cache.h>
+
+/* Entries are allocated in power of two classes from 64 bytes up. */
+#define WP_CACHE_MIN_CLASS_SHIFT 6
+#define WP_CACHE_CLASSES 40
+#define WP_CACHE_INITIAL_SLOTS 64
+/* The small FIFO's share of a shard's budget, as a divisor. */
+#define WP_CACHE_SMALL_DIVISOR 10
+#define WP_CACHE_MAX_FREQ 3
+/* Dropped entries kept per class for reuse; the rest go back to the allocator. */
+#define WP_CACHE_SPARES_PER_CLASS 8
+/* Reader counters and hit/miss counts are split this many ways, by CPU. */
+#define WP_CACHE_STRIPES 16
+
+enum {
+  WP_CACHE_QUEUE_SMALL = 0,
+  WP_CACHE_QUEUE_MAIN
+};
+
+typedef struct wp_cache_entry {
+  /* Queue links; only touched under the shard lock. */
+  struct wp_cache_entry *prev;
+  struct wp_cache_entry *next;
+  uint64_t hash;
+  uint32_t key_len;
+  uint32_t value_len;
+  /* Bumped by readers without the lock; a hint, so lost updates are fine. */
+  uint8_t freq;
+  uint8_t queue;
+  /* Fixed for the life of the allocation; free lists are per class. */
+  uint8_t size_class;
+  /* The key, then the value. */
+  char bytes[];
+} wp_cache_entry_t;
+
+typedef struct wp_cache_slot {
+  uint64_t hash;
+  wp_cache_entry_t *entry;
+} wp_cache_slot_t;
+
+/* A linear probing index. Replaced ones wait in limbo, since readers may still be in them. */
+typedef struct wp_cache_index {
+  size_t mask;
+  struct wp_cache_index *retired;
+  wp_cache_slot_t slots[];
+} wp_cache_index_t;
+
+typedef struct wp_cache_stripe {
+  /* Readers inside a lookup, by the parity of the epoch they entered in. */
+  unsigned readers[2];
+  uint64_t hits;
+  uint64_t misses;
+} WP_CACHE_ALIGNED wp_cache_stripe_t;
+
+typedef struct wp_cache_queue {
+  wp_cache_entry_t *head;
+  wp_cache_entry_t *tail;
+  size_t bytes;
+} wp_cache_queue_t;
+
+typedef struct wp_cache_shard {
+  /* Odd while a writer is changing the index or an entry. */
+  unsigned sequence WP_CACHE_ALIGNED;
+  /* Flipped by writers to start a grace period. */
+  unsigned epoch;
+  wp_cache_index_t *index;
+
+  pthread_mutex_t lock WP_CACHE_ALIGNED;
+  wp_cache_queue_t small;
+  wp_cache_queue_t main;
+  size_t budget;
+  size_t used;
+  size_t entries;
+  /* Direct mapped hashes of keys recently evicted from the small FIFO. */
+  uint64_t *ghosts;
+  size_t ghost_mask;
+  wp_cache_entry_t *free[WP_CACHE_CLASSES];
+  unsigned spares[WP_CACHE_CLASSES];
+  /* Unreachable, but not yet safe to free; indexed by epoch parity. */
+  wp_cache_entry_t *limbo[2];
+  wp_cache_index_t *limbo_index[2];
+  uint64_t insertions;
+  uint64_t evictions;
+
+  /* Written by readers. */
+  wp_cache_stripe_t stripes[WP_CACHE_STRIPES];
+} WP_CACHE_ALIGNED wp_cache_shard_t;
+
+typedef struct __wp_cache_private_t {
+  wp_cache_shard_t *shards;
+  unsigned shard_mask;
+  size_t budget;
+} __wp_cache_private_t;
+
+static inline size_t wp_cache_class_size(unsigned size_class) {
+  return (size_t)1 << (size_class + WP_CACHE_MIN_CLASS_SHIFT);
+}
+
+/**
+ * The smallest class that holds an entry for the given key and value.
+ * @return the class, or WP_CACHE_CLASSES if it's too big for any.
+ */
+static unsigned wp_cache_class_for(size_t key_len, size_t value_len) {
+  size_t size = sizeof(wp_cache_entry_t) + key_len + value_len;
+  unsigned size_class = 0;
+
+  while(size_class < WP_CACHE_CLASSES && wp_cache_class_size(size_class) < size) {
+    size_class++;
+  }
+  return size_class;
+}
+
+static inline wp_cache_shard_t *wp_cache_shard_for(const __wp_cache_private_t *d, uint64_t hash) {
+  /* The index uses the low bits; pick shards with the high ones. */
+  return &d->shards[(hash >> 40) & d->shard_mask];
+}
+
+static inline wp_cache_stripe_t *wp_cache_stripe_for(wp_cache_shard_t *shard) {
+  int cpu = sched_getcpu();
+  return &shard->stripes[(cpu < 0 ? 0 : (unsigned)cpu) % WP_CACHE_STRIPES];
+}
+
+static inline void wp_cache_write_begin(wp_cache_shard_t *shard) {
+  __atomic_store_n(&shard->sequence, shard->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void wp_cache_write_end(wp_cache_shard_t *shard) {
+  __atomic_store_n(&shard->sequence, shard->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void wp_cache_queue_push(wp_cache_queue_t *queue, wp_cache_entry_t *entry, uint8_t which) {
+  entry->queue = which;
+  entry->prev = NULL;
+  entry->next = queue->head;
+  if(queue->head) {
+    queue->head->prev = entry;
+  } else {
+    queue->tail = entry;
+  }
+  queue->head = entry;
+  queue->bytes += wp_cache_class_size(entry->size_class);
+}
+
+static void wp_cache_queue_unlink(wp_cache_queue_t *queue, wp_cache_entry_t *entry) {
+  if(entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    queue->head = entry->next;
+  }
+  if(entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    queue->tail = entry->prev;
+  }
+  entry->prev = entry->next = NULL;
+  queue->bytes -= wp_cache_class_size(entry->size_class);
+}
+
+static inline wp_cache_queue_t *wp_cache_queue_of(wp_cache_shard_t *shard, const wp_cache_entry_t *entry) {
+  return entry->queue == WP_CACHE_QUEUE_SMALL ? &shard->small : &shard->main;
+}
+
+/**
+ * Find key's slot in the current index. Call with the shard lock held.
+ * @return the slot index, or -1.
+ */
+static ssize_t wp_cache_index_find(const wp_cache_shard_t *shard, const char *key, size_t key_len, uint64_t hash) {
+  const wp_cache_index_t *index = shard->index;
+  wp_cache_entry_t *entry = NULL;
+
+  for(size_t i = hash & index->mask; (entry = index->slots[i].entry); i = (i + 1) & index->mask) {
+    if(index->slots[i].hash == hash && entry->key_len == key_len && memcmp(entry->bytes, key, key_len) == 0) {
+      return (ssize_t)i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Empty a slot, shifting later entries of the probe run back so lookups
+ * never need tombstones. Call inside a write section.
+ * @param index the index.
+ * @param pos the slot to empty.
+ */
+static void wp_cache_index_erase(wp_cache_index_t *index, size_t pos) {
+  size_t mask = index->mask;
+  size_t i = pos, j = pos;
+
+  for(;;) {
+    j = (j + 1) & mask;
+    if(index->slots[j].entry == NULL) {
+      break;
+    }
+    /* Move j back to i unless its home lies cyclically in (i, j]. */
+    size_t home = index->slots[j].hash & mask;
+    if(((j - home) & mask) >= ((j - i) & mask)) {
+      __atomic_store_n(&index->slots[i].hash, index->slots[j].hash, __ATOMIC_RELAXED);
+      __atomic_store_n(&index->slots[i].entry, index->slots[j].entry, __ATOMIC_RELAXED);
+      i = j;
+    }
+  }
+  __atomic_store_n(&index->slots[i].entry, NULL, __ATOMIC_RELAXED);
+  __atomic_store_n(&index->slots[i].hash, 0, __ATOMIC_RELAXED);
+}
+
+static void wp_cache_index_insert(wp_cache_index_t *index, uint64_t hash, wp_cache_entry_t *entry) {
+  size_t i = hash & index->mask;
+  while(index->slots[i].entry) {
+    i = (i + 1) & index->mask;
+  }
+  __atomic_store_n(&index->slots[i].hash, hash, __ATOMIC_RELAXED);
+  __atomic_store_n(&index->slots[i].entry, entry, __ATOMIC_RELAXED);
+}
+
+/**
+ * Double the index and the ghost table once the index is half full. Call
+ * inside a write section.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_cache_grow(wp_cache_shard_t *shard) {
+  wp_cache_index_t *old = shard->index;
+  wp_cache_index_t *index = NULL;
+  uint64_t *ghosts = NULL;
+  size_t slots = (old->mask + 1) * 2;
+
+  if(shard->entries + 1 <= (old->mask + 1) / 2) {
+    return WP_SUCCESS;
+  }
+
+  if((index = calloc(1, sizeof(*index) + slots * sizeof(wp_cache_slot_t))) == NULL) {
+    return WP_FAILURE;
+  }
+  if((ghosts = calloc(slots, sizeof(*ghosts))) == NULL) {
+    free(index);
+    return WP_FAILURE;
+  }
+
+  index->mask = slots - 1;
+  for(size_t i = 0; i <= old->mask; i++) {
+    if(old->slots[i].entry) {
+      wp_cache_index_insert(index, old->slots[i].hash, old->slots[i].entry);
+    }
+  }
+  __atomic_store_n(&shard->index, index, __ATOMIC_RELEASE);
+  old->retired = shard->limbo_index[shard->epoch & 1];
+  shard->limbo_index[shard->epoch & 1] = old;
+
+  /* Ghosts are a hint; start the bigger table empty. */
+  free(shard->ghosts);
+  shard->ghosts = ghosts;
+  shard->ghost_mask = slots - 1;
+  return WP_SUCCESS;
+}
+
+/**
+ * Unindex and free an entry. Call inside a write section.
+ * @param shard the entry's shard.
+ * @param entry the entry.
+ * @param pos its slot in the index.
+ */
+static void wp_cache_drop(wp_cache_shard_t *shard, wp_cache_entry_t *entry, size_t pos) {
+  wp_cache_index_erase(shard->index, pos);
+  wp_cache_queue_unlink(wp_cache_queue_of(shard, entry), entry);
+  shard->used -= wp_cache_class_size(entry->size_class);
+  shard->entries--;
+
+  /* A reader may still be copying from it: reusing it is caught by the
+   * sequence check, but freeing it has to wait out the grace period. */
+  if(shard->spares[entry->size_class] < WP_CACHE_SPARES_PER_CLASS) {
+    entry->next = shard->free[entry->size_class];
+    shard->free[entry->size_class] = entry;
+    shard->spares[entry->size_class]++;
+  } else {
+    entry->next = shard->limbo[shard->epoch & 1];
+    shard->limbo[shard->epoch & 1] = entry;
+  }
+}
+
+static void wp_cache_free_limbo(wp_cache_shard_t *shard, unsigned parity) {
+  wp_cache_entry_t *entry = NULL;
+  wp_cache_index_t *index = NULL;
+
+  while((entry = shard->limbo[parity])) {
+    shard->limbo[parity] = entry->next;
+    free(entry);
+  }
+  while((index = shard->limbo_index[parity])) {
+    shard->limbo_index[parity] = index->retired;
+    free(index);
+  }
+}
+
+/**
+ * Free what was retired before the last epoch flip once no reader from that
+ * epoch is left, then flip again if more has been retired since. Readers that
+ * start after a flip count against the other parity, so the old one drains
+ * even under constant load. Call with the shard lock held, outside a write
+ * section.
+ * @param shard the shard.
+ */
+static void wp_cache_reclaim(wp_cache_shard_t *shard) {
+  unsigned current = shard->epoch & 1, previous = current ^ 1;
+  unsigned readers = 0;
+
+  if(shard->limbo[previous] || shard->limbo_index[previous]) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(unsigned i = 0; i < WP_CACHE_STRIPES; i++) {
+      readers += __atomic_load_n(&shard->stripes[i].readers[previous], __ATOMIC_SEQ_CST);
+    }
+    if(readers > 0) {
+      return;
+    }
+    wp_cache_free_limbo(shard, previous);
+  }
+
+  if(shard->limbo[current] || shard->limbo_index[current]) {
+    __atomic_store_n(&shard->epoch, shard->epoch + 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+static void wp_cache_drop_entry(wp_cache_shard_t *shard, wp_cache_entry_t *entry) {
+  ssize_t pos = wp_cache_index_find(shard, entry->bytes, entry->key_len, entry->hash);
+  assert(pos > -1);
+  wp_cache_drop(shard, entry, (size_t)pos);
+}
+
+/**
+ * Evict one entry, S3-FIFO style. Call inside a write section.
+ * @param shard the shard to evict from; it must not be empty.
+ */
+static void wp_cache_evict(wp_cache_shard_t *shard) {
+  wp_cache_entry_t *entry = NULL;
+
+  if(shard->small.bytes > shard->budget / WP_CACHE_SMALL_DIVISOR || shard->main.tail == NULL) {
+    while((entry = shard->small.tail)) {
+      if(__atomic_load_n(&entry->freq, __ATOMIC_RELAXED) > 1) {
+        /* Read again while on probation: promote it. */
+        wp_cache_queue_unlink(&shard->small, entry);
+        __atomic_store_n(&entry->freq, 0, __ATOMIC_RELAXED);
+        wp_cache_queue_push(&shard->main, entry, WP_CACHE_QUEUE_MAIN);
+        continue;
+      }
+      shard->ghosts[entry->hash & shard->ghost_mask] = entry->hash;
+      wp_cache_drop_entry(shard, entry);
+      shard->evictions++;
+      return;
+    }
+  }
+
+  while((entry = shard->main.tail)) {
+    uint8_t freq = __atomic_load_n(&entry->freq, __ATOMIC_RELAXED);
+    if(freq > 0) {
+      /* Second chance: back to the head with one less credit. */
+      __atomic_store_n(&entry->freq, freq - 1, __ATOMIC_RELAXED);
+      wp_cache_queue_unlink(&shard->main, entry);
+      wp_cache_queue_push(&shard->main, entry, WP_CACHE_QUEUE_MAIN);
+      continue;
+    }
+    wp_cache_drop_entry(shard, entry);
+    shard->evictions++;
+    return;
+  }
+}
+
+static wp_status_t wp_cache_put_bytes(const wp_cache_t *self, const char *key, size_t key_len, const void *value, size_t len) {
+  assert(self && self->data && (key || key_len == 0) && (value || len == 0));
+  uint64_t hash = wp_string_hash_bytes(key, key_len);
+  wp_cache_shard_t *shard = wp_cache_shard_for(self->data, hash);
+  unsigned size_class = wp_cache_class_for(key_len, len);
+  wp_cache_entry_t *entry = NULL;
+  wp_status_t ret = WP_FAILURE;
+  ssize_t pos = -1;
+
+  if(size_class >= WP_CACHE_CLASSES || wp_cache_class_size(size_class) > shard->budget ||
+     key_len > UINT32_MAX || len > UINT32_MAX) {
+    return WP_FAILURE;
+  }
+
+  pthread_mutex_lock(&shard->lock);
+  wp_cache_write_begin(shard);
+
+  if((pos = wp_cache_index_find(shard, key, key_len, hash)) > -1) {
+    wp_cache_drop(shard, shard->index->slots[pos].entry, (size_t)pos);
+  }
+
+  while(shard->used + wp_cache_class_size(size_class) > shard->budget) {
+    wp_cache_evict(shard);
+  }
+
+  if(wp_cache_grow(shard) == WP_SUCCESS) {
+    if((entry = shard->free[size_class])) {
+      shard->free[size_class] = entry->next;
+      shard->spares[size_class]--;
+    } else {
+      entry = malloc(wp_cache_class_size(size_class));
+    }
+  }
+
+  if(entry) {
+    entry->hash = hash;
+    entry->key_len = (uint32_t)key_len;
+    entry->value_len = (uint32_t)len;
+    entry->size_class = (uint8_t)size_class;
+    __atomic_store_n(&entry->freq, 0, __ATOMIC_RELAXED);
+    memcpy(entry->bytes, key, key_len);
+    memcpy(entry->bytes + key_len, value, len);
+
+    if(shard->ghosts[hash & shard->ghost_mask] == hash) {
+      /* Evicted from probation recently and wanted again. */
+      shard->ghosts[hash & shard->ghost_mask] = 0;
+      wp_cache_queue_push(&shard->main, entry, WP_CACHE_QUEUE_MAIN);
+    } else {
+      wp_cache_queue_push(&shard->small, entry, WP_CACHE_QUEUE_SMALL);
+    }
+    wp_cache_index_insert(shard->index, hash, entry);
+    shard->used += wp_cache_class_size(size_class);
+    shard->entries++;
+    shard->insertions++;
+    ret = WP_SUCCESS;
+  }
+
+  wp_cache_write_end(shard);
+  wp_cache_reclaim(shard);
+  pthread_mutex_unlock(&shard->lock);
+  return ret;
+}
+
+static wp_status_t wp_cache_put(const wp_cache_t *self, const wp_string_t *key, const void *value, size_t len) {
+  assert(key);
+  return wp_cache_put_bytes(self, key->get_str(key), key->get_length(key), value, len);
+}
+
+static ssize_t wp_cache_get_bytes(const wp_cache_t *self, const char *key, size_t key_len, void *dest, size_t size) {
+  assert(self && self->data && (key || key_len == 0) && (dest || size == 0));
+  uint64_t hash = wp_string_hash_bytes(key, key_len);
+  wp_cache_shard_t *shard = wp_cache_shard_for(self->data, hash);
+  wp_cache_stripe_t *stripe = wp_cache_stripe_for(shard);
+  wp_cache_entry_t *found = NULL;
+  ssize_t ret = -1;
+  unsigned parity = __atomic_load_n(&shard->epoch, __ATOMIC_ACQUIRE) & 1;
+
+  /* Writers don't free anything a reader counted here could reach. */
+  __atomic_fetch_add(&stripe->readers[parity], 1, __ATOMIC_SEQ_CST);
+  for(;;) {
+    unsigned sequence = __atomic_load_n(&shard->sequence, __ATOMIC_ACQUIRE);
+    const wp_cache_index_t *index = NULL;
+    wp_cache_entry_t *entry = NULL;
+    bool torn = false;
+
+    if(sequence & 1) {
+      continue;
+    }
+
+    found = NULL;
+    ret = -1;
+    index = __atomic_load_n(&shard->index, __ATOMIC_ACQUIRE);
+    for(size_t i = hash & index->mask, probes = 0; probes <= index->mask; i = (i + 1) & index->mask, probes++) {
+      if((entry = __atomic_load_n(&index->slots[i].entry, __ATOMIC_RELAXED)) == NULL) {
+        break;
+      }
+      if(__atomic_load_n(&index->slots[i].hash, __ATOMIC_RELAXED) != hash) {
+        continue;
+      }
+
+      uint32_t entry_key_len = __atomic_load_n(&entry->key_len, __ATOMIC_RELAXED);
+      uint32_t value_len = __atomic_load_n(&entry->value_len, __ATOMIC_RELAXED);
+      /* Lengths from two different lives of the entry; don't read past it. */
+      if(sizeof(*entry) + (size_t)entry_key_len + value_len > wp_cache_class_size(entry->size_class)) {
+        torn = true;
+        break;
+      }
+      if(entry_key_len == key_len && memcmp(entry->bytes, key, key_len) == 0) {
+        memcpy(dest, entry->bytes + key_len, value_len < size ? value_len : size);
+        ret = (ssize_t)value_len;
+        found = entry;
+        break;
+      }
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(!torn && __atomic_load_n(&shard->sequence, __ATOMIC_RELAXED) == sequence) {
+      break;
+    }
+  }
+
+  if(found) {
+    uint8_t freq = __atomic_load_n(&found->freq, __ATOMIC_RELAXED);
+    if(freq < WP_CACHE_MAX_FREQ) {
+      __atomic_store_n(&found->freq, freq + 1, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_fetch_sub(&stripe->readers[parity], 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(found ? &stripe->hits : &stripe->misses, 1, __ATOMIC_RELAXED);
+
+  return ret;
+}
+
+static ssize_t wp_cache_get(const wp_cache_t *self, const wp_string_t *key, void *dest, size_t size) {
+  assert(key);
+  return wp_cache_get_bytes(self, key->get_str(key), key->get_length(key), dest, size);
+}
+
+static bool wp_cache_remove_bytes(const wp_cache_t *self, const char *key, size_t key_len) {
+  assert(self && self->data && (key || key_len == 0));
+  uint64_t hash = wp_string_hash_bytes(key, key_len);
+  wp_cache_shard_t *shard = wp_cache_shard_for(self->data, hash);
+  ssize_t pos = -1;
+
+  pthread_mutex_lock(&shard->lock);
+  if((pos = wp_cache_index_find(shard, key, key_len, hash)) > -1) {
+    wp_cache_write_begin(shard);
+    wp_cache_drop(shard, shard->index->slots[pos].entry, (size_t)pos);
+    wp_cache_write_end(shard);
+    wp_cache_reclaim(shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return pos > -1;
+}
+
+static bool wp_cache_remove(const wp_cache_t *self, const wp_string_t *key) {
+  assert(key);
+  return wp_cache_remove_bytes(self, key->get_str(key), key->get_length(key));
+}
+
+static void wp_cache_get_stats(const wp_cache_t *self, wp_cache_stats_t *stats) {
+  assert(self && self->data && stats);
+  memset(stats, 0, sizeof(*stats));
+  stats->budget = self->data->budget;
+
+  for(unsigned i = 0; i <= self->data->shard_mask; i++) {
+    wp_cache_shard_t *shard = &self->data->shards[i];
+    for(unsigned s = 0; s < WP_CACHE_STRIPES; s++) {
+      stats->hits += __atomic_load_n(&shard->stripes[s].hits, __ATOMIC_RELAXED);
+      stats->misses += __atomic_load_n(&shard->stripes[s].misses, __ATOMIC_RELAXED);
+    }
+    stats->insertions += __atomic_load_n(&shard->insertions, __ATOMIC_RELAXED);
+    stats->evictions += __atomic_load_n(&shard->evictions, __ATOMIC_RELAXED);
+    stats->entries += __atomic_load_n(&shard->entries, __ATOMIC_RELAXED);
+    stats->bytes += __atomic_load_n(&shard->used, __ATOMIC_RELAXED);
+  }
+}
+
+/* An image from wp_cache_save: a header, then length bytes of records. */
+typedef struct wp_cache_image {
+  uint64_t magic;
+  uint64_t count;
+  uint64_t length;
+} wp_cache_image_t;
+
+/* A saved entry: the key, then the value, padded to 8 bytes. */
+typedef struct wp_cache_record {
+  uint32_t key_len;
+  uint32_t value_len;
+  char bytes[];
+} wp_cache_record_t;
+
+#define WP_CACHE_IMAGE_MAGIC 0x31474d4948434157ULL
+#define WP_CACHE_RECORD_SIZE(key_len, value_len) (((sizeof(wp_cache_record_t) + (key_len) + (value_len)) + 7) & ~(size_t)7)
+
+/**
+ * Append a queue's entries to an image, oldest first.
+ * @param queue the queue.
+ * @param out where the next record goes; advanced past what's written.
+ * @return the records written.
+ */
+static uint64_t wp_cache_save_queue(const wp_cache_queue_t *queue, char **out) {
+  uint64_t count = 0;
+
+  for(const wp_cache_entry_t *entry = queue->tail; entry; entry = entry->prev) {
+    wp_cache_record_t *record = (wp_cache_record_t *)*out;
+    record->key_len = entry->key_len;
+    record->value_len = entry->value_len;
+    memcpy(record->bytes, entry->bytes, (size_t)entry->key_len + entry->value_len);
+    *out += WP_CACHE_RECORD_SIZE(entry->key_len, entry->value_len);
+    count++;
+  }
+  return count;
+}
+
+wp_pool_offset_t wp_cache_save(const wp_cache_t *self, const wp_pool_t *state) {
+  assert(self && self->data && state);
+  __wp_cache_private_t *d = self->data;
+  wp_cache_image_t *image = NULL;
+  size_t length = 0;
+  char *out = NULL;
+
+  for(unsigned i = 0; i <= d->shard_mask; i++) {
+    pthread_mutex_lock(&d->shards[i].lock);
+  }
+
+  for(unsigned i = 0; i <= d->shard_mask; i++) {
+    const wp_cache_queue_t *queues[] = { &d->shards[i].main, &d->shards[i].small };
+    for(size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+      for(const wp_cache_entry_t *entry = queues[q]->tail; entry; entry = entry->prev) {
+        length += WP_CACHE_RECORD_SIZE(entry->key_len, entry->value_len);
+      }
+    }
+  }
+
+  if((image = state->palloc(state, sizeof(*image) + length))) {
+    image->magic = WP_CACHE_IMAGE_MAGIC;
+    image->count = 0;
+    image->length = length;
+    out = (char *)(image + 1);
+    /* Main before small: small holds the newest entries, and loading keeps the last ones. */
+    for(unsigned i = 0; i <= d->shard_mask; i++) {
+      image->count += wp_cache_save_queue(&d->shards[i].main, &out);
+    }
+    for(unsigned i = 0; i <= d->shard_mask; i++) {
+      image->count += wp_cache_save_queue(&d->shards[i].small, &out);
+    }
+  }
+
+  for(unsigned i = d->shard_mask + 1; i-- > 0; ) {
+    pthread_mutex_unlock(&d->shards[i].lock);
+  }
+
+  return image ? wp_pool_offset_of(state, image) : 0;
+}
+
+ssize_t wp_cache_load(const wp_cache_t *self, const wp_pool_t *state, wp_pool_offset_t image_offset) {
+  assert(self && self->data && state);
+  const wp_cache_image_t *image = wp_pool_pointer_at(state, image_offset);
+  const char *in = NULL, *end = NULL;
+  ssize_t loaded = 0;
+
+  if(image == NULL || !wp_pool_contains(state, (const char *)(image + 1) - 1) || image->magic != WP_CACHE_IMAGE_MAGIC) {
+    return -1;
+  }
+  in = (const char *)(image + 1);
+  end = in + image->length;
+  if(image->length > 0 && !wp_pool_contains(state, end - 1)) {
+    return -1;
+  }
+
+  for(uint64_t n = 0; n < image->count; n++) {
+    const wp_cache_record_t *record = (const wp_cache_record_t *)in;
+    if((size_t)(end - in) < sizeof(*record) ||
+       (size_t)(end - in) < WP_CACHE_RECORD_SIZE(record->key_len, record->value_len)) {
+      return -1;
+    }
+    if(wp_cache_put_bytes(self, record->bytes, record->key_len, record->bytes + record->key_len, record->value_len) == WP_SUCCESS) {
+      loaded++;
+    }
+    in += WP_CACHE_RECORD_SIZE(record->key_len, record->value_len);
+  }
+
+  return loaded;
+}
+
+/**
+ * Free everything a shard owns.
+ * @param shard the shard.
+ */
+static void wp_cache_shard_release(wp_cache_shard_t *shard) {
+  wp_cache_entry_t *entry = NULL;
+
+  while((entry = shard->small.head)) {
+    shard->small.head = entry->next;
+    free(entry);
+  }
+  while((entry = shard->main.head)) {
+    shard->main.head = entry->next;
+    free(entry);
+  }
+  for(unsigned c = 0; c < WP_CACHE_CLASSES; c++) {
+    while((entry = shard->free[c])) {
+      shard->free[c] = entry->next;
+      free(entry);
+    }
+  }
+  wp_cache_free_limbo(shard, 0);
+  wp_cache_free_limbo(shard, 1);
+  free(shard->index);
+  free(shard->ghosts);
+  pthread_mutex_destroy(&shard->lock);
+}
+
+wp_status_t wp_cache_new(wp_cache_t **self_out, size_t budget, unsigned shards) {
+  wp_status_t ret = WP_FAILURE;
+  wp_cache_t *self = NULL;
+  void *mem = NULL;
+  unsigned count = 1, ready = 0;
+
+  shards = shards ? shards : WP_CACHE_DEFAULT_SHARDS;
+  while(count < shards) {
+    count <<= 1;
+  }
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = malloc(sizeof(*(self->data))))) {
+      if(posix_memalign(&mem, WP_CACHE_LINE_SIZE, count * sizeof(wp_cache_shard_t)) == 0) {
+        memset(mem, 0, count * sizeof(wp_cache_shard_t));
+        self->data->shards = mem;
+        self->data->shard_mask = count - 1;
+        self->data->budget = budget;
+
+        for(ready = 0; ready < count; ready++) {
+          wp_cache_shard_t *shard = &self->data->shards[ready];
+          shard->budget = budget / count;
+          shard->index = calloc(1, sizeof(wp_cache_index_t) + WP_CACHE_INITIAL_SLOTS * sizeof(wp_cache_slot_t));
+          shard->ghosts = calloc(WP_CACHE_INITIAL_SLOTS, sizeof(uint64_t));
+          if(shard->index == NULL || shard->ghosts == NULL || pthread_mutex_init(&shard->lock, NULL) != 0) {
+            free(shard->index);
+            free(shard->ghosts);
+            break;
+          }
+          shard->index->mask = WP_CACHE_INITIAL_SLOTS - 1;
+          shard->ghost_mask = WP_CACHE_INITIAL_SLOTS - 1;
+        }
+
+        if(ready == count) {
+          self->put = &wp_cache_put;
+          self->put_bytes = &wp_cache_put_bytes;
+          self->get = &wp_cache_get;
+          self->get_bytes = &wp_cache_get_bytes;
+          self->remove = &wp_cache_remove;
+          self->remove_bytes = &wp_cache_remove_bytes;
+          self->get_stats = &wp_cache_get_stats;
+          ret = WP_SUCCESS;
+        } else {
+          while(ready-- > 0) {
+            wp_cache_shard_release(&self->data->shards[ready]);
+          }
+          free(self->data->shards);
+          free(self->data);
+          self->data = NULL;
+          free(self);
+          self = NULL;
+        }
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_cache_delete(wp_cache_t *self) {
+  assert(self);
+  if(self->data) {
+    for(unsigned i = 0; i <= self->data->shard_mask; i++) {
+      wp_cache_shard_release(&self->data->shards[i]);
+    }
+    free(self->data->shards);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
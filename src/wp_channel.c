@@ -0,0 +1,342 @@
+/*
+ * File:   wp_channel.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:29 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <wp_common.h>
+#include <wp_channel.h>
+#include <wp_cpu.h>
+
+#define WP_CHANNEL_MAGIC 0x6c6e6863u /* "chnl" */
+#define WP_CHANNEL_MIN_CAPACITY 4096
+#define WP_CHANNEL_ALIGN 8
+/* A record header whose length says "skip to the start of the ring". */
+#define WP_CHANNEL_WRAP UINT32_MAX
+/* Polls of the head before wait commits to sleeping. */
+#define WP_CHANNEL_SPIN 1024
+
+/* Lives at the start of the shared mapping. */
+typedef struct wp_channel_shared {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t capacity;
+
+  /* Written by the writer only. */
+  uint64_t head WP_CACHE_ALIGNED;
+  /* Written by the reader only. */
+  uint64_t tail WP_CACHE_ALIGNED;
+  /* Futex word: 1 while the reader sleeps or is about to. */
+  int32_t reader_waiting;
+} wp_channel_shared_t;
+
+typedef struct wp_channel_record {
+  uint32_t len;
+  uint32_t reserved;
+} wp_channel_record_t;
+
+typedef struct __wp_channel_private_t {
+  int fd;
+  wp_channel_shared_t *shared;
+  unsigned char *ring;
+  size_t map_len;
+  uint64_t mask;
+  /* Each side's last look at the other's index, to stay off its cache line. */
+  uint64_t cached_tail;
+  uint64_t cached_head;
+  /* WP_CHANNEL_SPIN on SMP; spinning on one CPU only delays the writer. */
+  int spin;
+} __wp_channel_private_t;
+
+/**
+ * Round len up to the record alignment.
+ * @param len the length to round.
+ * @return the rounded length.
+ */
+static inline uint64_t wp_channel_align(uint64_t len) {
+  return (len + WP_CHANNEL_ALIGN - 1) & ~(uint64_t)(WP_CHANNEL_ALIGN - 1);
+}
+
+/**
+ * The offset of the ring within the mapping.
+ * @return a multiple of the cache line size.
+ */
+static inline size_t wp_channel_ring_offset(void) {
+  return (sizeof(wp_channel_shared_t) + WP_CACHE_LINE_SIZE - 1) & ~(size_t)(WP_CACHE_LINE_SIZE - 1);
+}
+
+static long wp_channel_futex(int32_t *addr, int op, int32_t val, const struct timespec *timeout) {
+  /* Not FUTEX_PRIVATE_FLAG: the word is shared between processes. */
+  return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static wp_status_t wp_channel_send(const wp_channel_t *self, const void *data, size_t len) {
+  assert(self && self->data && (data || len == 0));
+  __wp_channel_private_t *d = self->data;
+  wp_channel_shared_t *shared = d->shared;
+  uint64_t capacity = d->mask + 1;
+  uint64_t head = shared->head;
+  uint64_t offset = head & d->mask;
+  uint64_t size = sizeof(wp_channel_record_t) + wp_channel_align(len);
+  uint64_t skip = 0;
+  wp_channel_record_t *record = NULL;
+
+  if(len > self->get_max_message(self)) {
+    return WP_FAILURE;
+  }
+
+  /* Records never straddle the end; pad to the start instead. */
+  if(offset + size > capacity) {
+    skip = capacity - offset;
+  }
+
+  if(head + skip + size - d->cached_tail > capacity) {
+    d->cached_tail = __atomic_load_n(&shared->tail, __ATOMIC_ACQUIRE);
+    if(head + skip + size - d->cached_tail > capacity) {
+      return WP_FAILURE;
+    }
+  }
+
+  if(skip) {
+    record = (wp_channel_record_t *)(d->ring + offset);
+    record->len = WP_CHANNEL_WRAP;
+    head += skip;
+    offset = 0;
+  }
+
+  record = (wp_channel_record_t *)(d->ring + offset);
+  record->len = (uint32_t)len;
+  memcpy(record + 1, data, len);
+  __atomic_store_n(&shared->head, head + size, __ATOMIC_RELEASE);
+
+  /* Pairs with the fence in wait: either we see the flag or it sees head. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&shared->reader_waiting, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&shared->reader_waiting, 0, __ATOMIC_RELAXED);
+    wp_channel_futex(&shared->reader_waiting, FUTEX_WAKE, 1, NULL);
+  }
+
+  return WP_SUCCESS;
+}
+
+static ssize_t wp_channel_receive(const wp_channel_t *self, void *dest, size_t size) {
+  assert(self && self->data && (dest || size == 0));
+  __wp_channel_private_t *d = self->data;
+  wp_channel_shared_t *shared = d->shared;
+  uint64_t tail = shared->tail;
+  wp_channel_record_t *record = NULL;
+
+  if(tail == d->cached_head) {
+    d->cached_head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+    if(tail == d->cached_head) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  record = (wp_channel_record_t *)(d->ring + (tail & d->mask));
+  if(record->len == WP_CHANNEL_WRAP) {
+    tail += (d->mask + 1) - (tail & d->mask);
+    record = (wp_channel_record_t *)d->ring;
+  }
+
+  if(record->len > size) {
+    /* Publish the skipped padding so the writer can reuse it. */
+    __atomic_store_n(&shared->tail, tail, __ATOMIC_RELEASE);
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  size = record->len;
+  memcpy(dest, record + 1, size);
+  __atomic_store_n(&shared->tail, tail + sizeof(*record) + wp_channel_align(size), __ATOMIC_RELEASE);
+
+  return (ssize_t)size;
+}
+
+static bool wp_channel_is_empty(const wp_channel_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->shared->head, __ATOMIC_ACQUIRE) ==
+         __atomic_load_n(&self->data->shared->tail, __ATOMIC_RELAXED);
+}
+
+static wp_status_t wp_channel_wait(const wp_channel_t *self, int timeout_ms) {
+  assert(self && self->data);
+  wp_channel_shared_t *shared = self->data->shared;
+  struct timespec deadline, now, timeout;
+
+  /* A busy writer usually delivers within a few hundred cycles; don't sleep for that. */
+  for(int i = 0; i < self->data->spin; i++) {
+    if(!wp_channel_is_empty(self)) {
+      return WP_SUCCESS;
+    }
+  }
+
+  if(timeout_ms >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  for(;;) {
+    __atomic_store_n(&shared->reader_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(!wp_channel_is_empty(self)) {
+      __atomic_store_n(&shared->reader_waiting, 0, __ATOMIC_RELAXED);
+      return WP_SUCCESS;
+    }
+
+    if(timeout_ms >= 0) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+      timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if(timeout.tv_nsec < 0) {
+        timeout.tv_sec--;
+        timeout.tv_nsec += 1000000000L;
+      }
+      if(timeout.tv_sec < 0) {
+        __atomic_store_n(&shared->reader_waiting, 0, __ATOMIC_RELAXED);
+        return WP_FAILURE;
+      }
+    }
+
+    /* Returns at once if the writer already cleared the flag. */
+    if(wp_channel_futex(&shared->reader_waiting, FUTEX_WAIT, 1, timeout_ms >= 0 ? &timeout : NULL) != 0 &&
+       errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+      __atomic_store_n(&shared->reader_waiting, 0, __ATOMIC_RELAXED);
+      return WP_FAILURE;
+    }
+  }
+}
+
+static size_t wp_channel_get_max_message(const wp_channel_t *self) {
+  assert(self && self->data);
+  /* Half the ring, so a message fits whatever the wrap padding. */
+  size_t max = (size_t)((self->data->mask + 1) / 2 - sizeof(wp_channel_record_t));
+  return max < UINT32_MAX ? max : UINT32_MAX - 1;
+}
+
+static int wp_channel_get_fd(const wp_channel_t *self) {
+  assert(self && self->data);
+  return self->data->fd;
+}
+
+/**
+ * Map fd and fill in a channel around it.
+ * @param self_out will point to the new channel, or NULL on failure.
+ * @param fd the memfd to map.
+ * @param map_len the size of the mapping.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_channel_map(wp_channel_t **self_out, int fd, size_t map_len) {
+  wp_status_t ret = WP_FAILURE;
+  wp_channel_t *self = NULL;
+  void *map = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = malloc(sizeof(*(self->data))))) {
+      if((map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+        self->data->fd = fd;
+        self->data->shared = map;
+        self->data->ring = (unsigned char *)map + wp_channel_ring_offset();
+        self->data->map_len = map_len;
+        self->data->mask = map_len - wp_channel_ring_offset() - 1;
+        self->data->cached_tail = __atomic_load_n(&self->data->shared->tail, __ATOMIC_ACQUIRE);
+        self->data->cached_head = __atomic_load_n(&self->data->shared->head, __ATOMIC_ACQUIRE);
+        self->data->spin = wp_cpu_count_available(NULL) > 1 ? WP_CHANNEL_SPIN : 0;
+
+        self->send = &wp_channel_send;
+        self->receive = &wp_channel_receive;
+        self->wait = &wp_channel_wait;
+        self->is_empty = &wp_channel_is_empty;
+        self->get_max_message = &wp_channel_get_max_message;
+        self->get_fd = &wp_channel_get_fd;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+wp_status_t wp_channel_new(wp_channel_t **self_out, size_t capacity) {
+  size_t ring = WP_CHANNEL_MIN_CAPACITY;
+  size_t map_len = 0;
+  int fd = -1;
+
+  *self_out = NULL;
+  while(ring < capacity) {
+    ring <<= 1;
+  }
+  map_len = wp_channel_ring_offset() + ring;
+
+  if((fd = memfd_create("wp_channel", MFD_CLOEXEC)) < 0) {
+    return WP_FAILURE;
+  }
+
+  /* A fresh memfd reads as zeros, so head, tail and the futex start at 0. */
+  if(ftruncate(fd, (off_t)map_len) != 0 || wp_channel_map(self_out, fd, map_len) != WP_SUCCESS) {
+    close(fd);
+    return WP_FAILURE;
+  }
+
+  (*self_out)->data->shared->magic = WP_CHANNEL_MAGIC;
+  (*self_out)->data->shared->capacity = ring;
+  return WP_SUCCESS;
+}
+
+wp_status_t wp_channel_open(wp_channel_t **self_out, int fd) {
+  wp_channel_shared_t header;
+  struct stat st;
+  uint64_t ring = 0;
+
+  *self_out = NULL;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < wp_channel_ring_offset() + WP_CHANNEL_MIN_CAPACITY ||
+     pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != WP_CHANNEL_MAGIC) {
+    return WP_FAILURE;
+  }
+
+  ring = header.capacity;
+  if((ring & (ring - 1)) != 0 || wp_channel_ring_offset() + ring != (uint64_t)st.st_size) {
+    return WP_FAILURE;
+  }
+
+  return wp_channel_map(self_out, fd, (size_t)st.st_size);
+}
+
+void wp_channel_delete(wp_channel_t *self) {
+  assert(self);
+  if(self->data) {
+    munmap(self->data->shared, self->data->map_len);
+    close(self->data->fd);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
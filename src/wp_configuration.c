@@ -5,6 +5,7 @@
  * Created on November 28, 2012, 6:10 AM
  */
 
+#include <fcntl.h>
 #include <limits.h>
 #include <unistd.h>
 #include <string.h>
@@ -12,20 +13,90 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <ctype.h>
 #include <assert.h>
-#include <obstack.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <wp_common.h>
 #include <wp_configuration.h>
+#include <wp_string.h>
+#include <wp_text.h>
 
 #define DEFAULT_UID               "daemon"
 #define DEFAULT_CONFIG_FILE_PATH  "/etc/libwpd.conf"
 #define DEFAULT_LOCK_FILE_NAME    "/tmp/libwpd.lock"
 #define DEFAULT_RUN_PATH          "/"
+#define DEFAULT_LISTEN_BACKLOG    511
+#define DEFAULT_CACHE_MEMORY_BUDGET (64 * 1024 * 1024)
+
+/* "WPDCSNP1" read as a native word, so a snapshot from another byte order doesn't match. */
+#define WP_CONFIG_SNAPSHOT_MAGIC  0x31504e5343445057ull
+#define WP_CONFIG_SNAPSHOT_FORMAT 4
+#define WP_CONFIG_SNAPSHOT_SUFFIX ".snap"
+
 #define PACKAGE_BUGREPORT         "ctor@wordptr.com"
 #define GITHUB_PROJECT_PATH       "https://github.com/jgshort/wordptr.libwpd"
 
-typedef void(*exec_config_switch_fn)(wp_configuration_pt, char *, char);
+typedef void(*exec_config_switch_fn)(wp_configuration_pt, const char *, char *);
+
+/* The offset of a missing string in a snapshot's string table. */
+#define WP_CONFIG_SNAPSHOT_NO_STRING UINT64_MAX
+
+/*
+ * A parsed config file, kept in <config>.snap: this header, then a table of
+ * NUL terminated strings that the string fields index. The settings are the
+ * ones the parse left in the configuration, copied in as they are; the
+ * source's identity, size and mtime say when it's stale, and a checksum
+ * catches one that was torn or damaged.
+ */
+typedef struct wp_config_snapshot {
+  uint64_t magic;
+  uint32_t format;
+  /* sizeof(wp_config_snapshot_t) when written, so a build with other fields won't trust it. */
+  uint32_t header_size;
+  uint64_t source_dev;
+  uint64_t source_ino;
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  uint64_t table_length;
+  /* Over this header, with checksum zeroed, and the table. */
+  uint64_t checksum;
+
+  bool enable_daemon;
+  bool enable_pid_lock;
+  bool enable_verbose_logging;
+  bool print_arguments;
+  bool print_config_options;
+  bool enable_ready_on_start;
+  bool enable_config_snapshot;
+  bool pool_prefault;
+  bool profiler_dump;
+  /* Offsets into the string table, or WP_CONFIG_SNAPSHOT_NO_STRING. */
+  uint64_t config_file_path;
+  uint64_t run_folder_path;
+  uint64_t lock_file_path;
+  uint64_t uid;
+  /* listen_address_count strings, one after another. */
+  uint64_t listen_addresses;
+  uint64_t listen_address_count;
+  int32_t listen_backlog;
+  int32_t listen_defer_accept;
+  uint32_t worker_count;
+  uint32_t watchdog_budget_ms;
+  uint32_t profiler_hz;
+  uint32_t shutdown_drain_timeout_ms;
+  uint32_t accept_rate_limit;
+  uint32_t accept_rate_burst;
+  uint32_t client_rate_limit;
+  uint32_t client_rate_burst;
+  uint32_t concurrency_limit_min;
+  uint32_t concurrency_limit_max;
+  uint64_t cache_memory_budget;
+  uint64_t state_pool_size;
+  int32_t pool_hugepages;
+  int32_t pool_numa_node;
+  cpu_set_t cpu_affinity[WP_CPU_ROLE_COUNT];
+} wp_config_snapshot_t;
 
 typedef struct __wp_configuration_private_t {
   /* TODO: Incorporate additional state as needed. */
@@ -34,11 +105,37 @@ typedef struct __wp_configuration_private_t {
   bool enable_verbose_logging;
   bool print_arguments;
   bool print_config_options;
+  bool enable_ready_on_start;
+  bool enable_config_snapshot;
 
   char *config_file_path;
   char *run_folder_path;
   char *lock_file_path;
   char *uid;
+
+  char **listen_addresses;
+  size_t listen_address_count;
+  int listen_backlog;
+  int listen_defer_accept;
+  /* 0 for one per available CPU, worked out on first use. */
+  unsigned worker_count;
+  unsigned auto_worker_count;
+  cpu_set_t cpu_affinity[WP_CPU_ROLE_COUNT];
+  unsigned watchdog_budget_ms;
+  unsigned profiler_hz;
+  bool profiler_dump;
+  unsigned shutdown_drain_timeout_ms;
+  unsigned accept_rate_limit;
+  unsigned accept_rate_burst;
+  unsigned client_rate_limit;
+  unsigned client_rate_burst;
+  unsigned concurrency_limit_min;
+  unsigned concurrency_limit_max;
+  size_t cache_memory_budget;
+  size_t state_pool_size;
+  wp_pool_hugepages_t pool_hugepages;
+  bool pool_prefault;
+  int pool_numa_node;
   
   wp_daemon_on_start_method_fn daemon_on_start_method;
 } __wp_configuration_private_t;
@@ -119,6 +216,38 @@ static void wp_config_set_print_config_options(const wp_configuration_t *self, b
   self->data->print_config_options = value;
 }
 
+/**
+ * Gets the value indicating whether the daemonizer reports readiness itself
+ * right before handing control to the on start method.
+ * @param self pointer to an instance of a configuration object.
+ * @return true if readiness is reported on start, otherwise false.
+ */
+static bool wp_config_get_enable_ready_on_start(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->enable_ready_on_start;
+}
+
+/**
+ * Sets the value indicating whether the daemonizer reports readiness on start.
+ * Provide false when the on start method calls notify_ready once it's serving.
+ * @param self pointer to an instance of a configuration object.
+ * @param value provide true to report readiness on start, otherwise false.
+ */
+static void wp_config_set_enable_ready_on_start(const wp_configuration_t *self, bool value) {
+  assert(self && self->data);
+  self->data->enable_ready_on_start = value;
+}
+
+static bool wp_config_get_enable_config_snapshot(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->enable_config_snapshot;
+}
+
+static void wp_config_set_enable_config_snapshot(const wp_configuration_t *self, bool value) {
+  assert(self && self->data);
+  self->data->enable_config_snapshot = value;
+}
+
 static char *wp_config_get_config_file_path(const wp_configuration_t *self) {
   assert(self && self->data);
   return self->data->config_file_path;
@@ -127,6 +256,9 @@ static char *wp_config_get_config_file_path(const wp_configuration_t *self) {
 static void wp_config_set_config_file_path(const wp_configuration_t *self, const char *value) {
   assert(self && value);
   
+  if(value == self->data->config_file_path) {
+    return;
+  }
   if(self->data->config_file_path) {
     free(self->data->config_file_path);
   }
@@ -156,7 +288,274 @@ static void wp_config_set_lock_file_path(const wp_configuration_t *self, const c
 
 static char *wp_config_get_uid(const wp_configuration_t *self) {
   assert(self && self->data);
-  return self->data->uid;
+  /* Nothing sets it yet; without it a root daemonize can't drop privileges. */
+  return self->data->uid ? self->data->uid : DEFAULT_UID;
+}
+
+static size_t wp_config_get_listen_address_count(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->listen_address_count;
+}
+
+static const char *wp_config_get_listen_address(const wp_configuration_t *self, size_t index) {
+  assert(self && self->data && index < self->data->listen_address_count);
+  return self->data->listen_addresses[index];
+}
+
+/**
+ * Append a listen address. Every listen= line in the configuration file adds one.
+ * @param self pointer to an instance of a configuration object.
+ * @param value the address, e.g. "tcp://0.0.0.0:80" or "unix:/run/wpd.sock".
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_config_add_listen_address(const wp_configuration_t *self, const char *value) {
+  assert(self && self->data && value);
+  char **addresses = NULL;
+  size_t count = self->data->listen_address_count;
+
+  if((addresses = realloc(self->data->listen_addresses, (count + 1) * sizeof(*addresses))) == NULL) {
+    return WP_FAILURE;
+  }
+  self->data->listen_addresses = addresses;
+
+  if(wp_safe_strcpy(&addresses[count], value) == NULL) {
+    return WP_FAILURE;
+  }
+  self->data->listen_address_count = count + 1;
+
+  return WP_SUCCESS;
+}
+
+static int wp_config_get_listen_backlog(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->listen_backlog;
+}
+
+static void wp_config_set_listen_backlog(const wp_configuration_t *self, int value) {
+  assert(self && self->data);
+  self->data->listen_backlog = value > 0 ? value : DEFAULT_LISTEN_BACKLOG;
+}
+
+static int wp_config_get_listen_defer_accept(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->listen_defer_accept;
+}
+
+static void wp_config_set_listen_defer_accept(const wp_configuration_t *self, int value) {
+  assert(self && self->data);
+  self->data->listen_defer_accept = value > 0 ? value : 0;
+}
+
+static unsigned wp_config_get_worker_count(const wp_configuration_t *self) {
+  assert(self && self->data);
+  if(self->data->worker_count) {
+    return self->data->worker_count;
+  }
+  if(self->data->auto_worker_count == 0) {
+    self->data->auto_worker_count = wp_cpu_count_available(self->get_cpu_affinity(self, WP_CPU_ROLE_WORKERS));
+  }
+  return self->data->auto_worker_count;
+}
+
+static void wp_config_set_worker_count(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->worker_count = value;
+  self->data->auto_worker_count = 0;
+}
+
+static const cpu_set_t *wp_config_get_cpu_affinity(const wp_configuration_t *self, wp_cpu_role_t role) {
+  assert(self && self->data && role < WP_CPU_ROLE_COUNT);
+  return CPU_COUNT(&self->data->cpu_affinity[role]) ? &self->data->cpu_affinity[role] : NULL;
+}
+
+static void wp_config_set_cpu_affinity(const wp_configuration_t *self, wp_cpu_role_t role, const cpu_set_t *value) {
+  assert(self && self->data && role < WP_CPU_ROLE_COUNT);
+  if(value) {
+    self->data->cpu_affinity[role] = *value;
+  } else {
+    CPU_ZERO(&self->data->cpu_affinity[role]);
+  }
+  if(role == WP_CPU_ROLE_WORKERS) {
+    self->data->auto_worker_count = 0;
+  }
+}
+
+static unsigned wp_config_get_watchdog_budget_ms(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->watchdog_budget_ms;
+}
+
+static void wp_config_set_watchdog_budget_ms(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->watchdog_budget_ms = value;
+}
+
+static unsigned wp_config_get_profiler_hz(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->profiler_hz;
+}
+
+static void wp_config_set_profiler_hz(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->profiler_hz = value;
+}
+
+static bool wp_config_get_profiler_dump(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->profiler_dump;
+}
+
+static void wp_config_set_profiler_dump(const wp_configuration_t *self, bool value) {
+  assert(self && self->data);
+  self->data->profiler_dump = value;
+}
+
+static unsigned wp_config_get_shutdown_drain_timeout_ms(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->shutdown_drain_timeout_ms;
+}
+
+static void wp_config_set_shutdown_drain_timeout_ms(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->shutdown_drain_timeout_ms = value;
+}
+
+static unsigned wp_config_get_accept_rate_limit(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->accept_rate_limit;
+}
+
+static void wp_config_set_accept_rate_limit(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->accept_rate_limit = value;
+}
+
+static unsigned wp_config_get_accept_rate_burst(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->accept_rate_burst;
+}
+
+static void wp_config_set_accept_rate_burst(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->accept_rate_burst = value;
+}
+
+static unsigned wp_config_get_client_rate_limit(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->client_rate_limit;
+}
+
+static void wp_config_set_client_rate_limit(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->client_rate_limit = value;
+}
+
+static unsigned wp_config_get_client_rate_burst(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->client_rate_burst;
+}
+
+static void wp_config_set_client_rate_burst(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->client_rate_burst = value;
+}
+
+static unsigned wp_config_get_concurrency_limit_max(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->concurrency_limit_max;
+}
+
+static void wp_config_set_concurrency_limit_max(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->concurrency_limit_max = value;
+}
+
+static unsigned wp_config_get_concurrency_limit_min(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->concurrency_limit_min;
+}
+
+static void wp_config_set_concurrency_limit_min(const wp_configuration_t *self, unsigned value) {
+  assert(self && self->data);
+  self->data->concurrency_limit_min = value;
+}
+
+static size_t wp_config_get_state_pool_size(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->state_pool_size;
+}
+
+static void wp_config_set_state_pool_size(const wp_configuration_t *self, size_t value) {
+  assert(self && self->data);
+  self->data->state_pool_size = value;
+}
+
+static size_t wp_config_get_cache_memory_budget(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->cache_memory_budget;
+}
+
+static void wp_config_set_cache_memory_budget(const wp_configuration_t *self, size_t value) {
+  assert(self && self->data);
+  self->data->cache_memory_budget = value ? value : DEFAULT_CACHE_MEMORY_BUDGET;
+}
+
+static wp_pool_hugepages_t wp_config_get_pool_hugepages(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->pool_hugepages;
+}
+
+static void wp_config_set_pool_hugepages(const wp_configuration_t *self, wp_pool_hugepages_t value) {
+  assert(self && self->data);
+  self->data->pool_hugepages = value;
+}
+
+static bool wp_config_get_pool_prefault(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->pool_prefault;
+}
+
+static void wp_config_set_pool_prefault(const wp_configuration_t *self, bool value) {
+  assert(self && self->data);
+  self->data->pool_prefault = value;
+}
+
+static int wp_config_get_pool_numa_node(const wp_configuration_t *self) {
+  assert(self && self->data);
+  return self->data->pool_numa_node;
+}
+
+static void wp_config_set_pool_numa_node(const wp_configuration_t *self, int value) {
+  assert(self && self->data);
+  self->data->pool_numa_node = value >= 0 ? value : -1;
+}
+
+/**
+ * Parse a byte count with an optional k, m or g (binary) suffix.
+ * @param value the text to parse.
+ * @return the number of bytes, or 0 if value isn't a size.
+ */
+static size_t wp_config_parse_size(const char *value) {
+  char *end = NULL;
+  unsigned long long size = strtoull(value, &end, 10);
+
+  if(end == value) {
+    return 0;
+  }
+  switch(wp_ascii_tolower(*end)) {
+    case 'g':
+      size <<= 10;
+      /* fall through */
+    case 'm':
+      size <<= 10;
+      /* fall through */
+    case 'k':
+      size <<= 10;
+      break;
+    default:
+      break;
+  }
+  return (size_t)size;
 }
 
 /* TODO: Remove, keeping while I make some configuration changes */
@@ -188,32 +587,422 @@ static void wp_config_print_usage(wp_configuration_pt self, FILE *stream, int ec
 }
 */
 
-static void wp_config_load_helper(const wp_configuration_pt config, char *pch, char w) {
-  switch(w) {
+/**
+ * The original settings used to be matched by their first letter alone, so
+ * older config files spell them in other ways ("run=", "lockfile="). Keep
+ * taking those, and say what to rename them to. Keys of the newer settings
+ * never did, so a misspelling of one of those is ignored, not mistaken for
+ * an original setting.
+ * @param config self
+ * @param name the key, which matched no setting by its full name.
+ * @param pch the value, without its newline.
+ */
+static void wp_config_load_legacy_key(const wp_configuration_pt config, const char *name, char *pch) {
+  static const char *const newer[] = {
+    "listen", "workers", "cpu_", "watchdog_", "profiler_", "shutdown_", "accept_", "client_",
+    "concurrency_", "state_", "cache_", "pool_", "config_snapshot"
+  };
+  static const char *const legacy[] = {
+    "verbose", "daemon", "options", "arguments", "config", "run_path", "lock_file"
+  };
+  const char *full = NULL;
+
+  for(size_t i = 0; i < sizeof(newer) / sizeof(newer[0]); i++) {
+    if(strncmp(name, newer[i], strlen(newer[i])) == 0) {
+      wp_log(stderr, config, LOG_WARNING, "Ignoring unknown configuration key \"%s\"", name);
+      return;
+    }
+  }
+  for(size_t i = 0; i < sizeof(legacy) / sizeof(legacy[0]) && full == NULL; i++) {
+    if(name[0] == legacy[i][0]) {
+      full = legacy[i];
+    }
+  }
+  if(full == NULL) {
+    wp_log(stderr, config, LOG_WARNING, "Ignoring unknown configuration key \"%s\"", name);
+    return;
+  }
+
+  wp_log(stderr, config, LOG_WARNING, "Configuration key \"%s\" is taken as \"%s\"; rename it, as a later release will only match full names", name, full);
+  switch(name[0]) {
     case 'v':
-      config->set_enable_verbose_logging(config, tolower(pch[0]) == 't');
+      config->set_enable_verbose_logging(config, wp_ascii_tolower(pch[0]) == 't');
       break;
     case 'd':
-      config->set_enable_daemon(config, tolower(pch[0]) == 't');
+      config->set_enable_daemon(config, wp_ascii_tolower(pch[0]) == 't');
       break;
     case 'o':
-      config->set_print_config_options(config, tolower(pch[0]) == 't');
+      config->set_print_config_options(config, wp_ascii_tolower(pch[0]) == 't');
       break;
     case 'a':
-      config->set_print_arguments(config, tolower(pch[0]) == 't');
+      config->set_print_arguments(config, wp_ascii_tolower(pch[0]) == 't');
       break;
     case 'c':
-      wp_safe_strcpy(&config->data->config_file_path, pch);
+      config->set_config_file_path(config, pch);
       break;
     case 'r':
+      free(config->data->run_folder_path);
       wp_safe_strcpy(&config->data->run_folder_path, pch);
       break;
     case 'l':
-      wp_safe_strcpy(&config->data->lock_file_path, pch);
+      config->set_lock_file_path(config, pch);
       break;
   }
 }
 
+static void wp_config_load_helper(const wp_configuration_pt config, const char *name, char *pch) {
+  if(strcmp(name, "listen") == 0) {
+    config->add_listen_address(config, pch);
+    return;
+  } else if(strcmp(name, "listen_backlog") == 0) {
+    config->set_listen_backlog(config, atoi(pch));
+    return;
+  } else if(strcmp(name, "listen_defer_accept") == 0) {
+    config->set_listen_defer_accept(config, atoi(pch));
+    return;
+  } else if(strcmp(name, "workers") == 0) {
+    /* "auto", like 0, sizes to the CPUs available. */
+    config->set_worker_count(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strncmp(name, "cpu_affinity_", 13) == 0) {
+    static const char *const roles[WP_CPU_ROLE_COUNT] = { "main", "workers", "logger" };
+    cpu_set_t set;
+    for(int role = 0; role < WP_CPU_ROLE_COUNT; role++) {
+      if(strcmp(name + 13, roles[role]) == 0 && wp_cpu_parse_list(pch, &set) == WP_SUCCESS) {
+        config->set_cpu_affinity(config, (wp_cpu_role_t)role, &set);
+      }
+    }
+    return;
+  } else if(strcmp(name, "watchdog_budget_ms") == 0) {
+    config->set_watchdog_budget_ms(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "profiler_hz") == 0) {
+    config->set_profiler_hz(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "profiler_dump") == 0) {
+    config->set_profiler_dump(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "shutdown_drain_timeout_ms") == 0) {
+    config->set_shutdown_drain_timeout_ms(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "accept_rate_limit") == 0) {
+    config->set_accept_rate_limit(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "accept_rate_burst") == 0) {
+    config->set_accept_rate_burst(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "client_rate_limit") == 0) {
+    config->set_client_rate_limit(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "client_rate_burst") == 0) {
+    config->set_client_rate_burst(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "concurrency_limit_min") == 0) {
+    config->set_concurrency_limit_min(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "concurrency_limit_max") == 0) {
+    config->set_concurrency_limit_max(config, (unsigned)strtoul(pch, NULL, 10));
+    return;
+  } else if(strcmp(name, "state_pool_size") == 0) {
+    config->set_state_pool_size(config, wp_config_parse_size(pch));
+    return;
+  } else if(strcmp(name, "cache_memory_budget") == 0) {
+    config->set_cache_memory_budget(config, wp_config_parse_size(pch));
+    return;
+  } else if(strcmp(name, "pool_hugepages") == 0) {
+    /* off, transparent, or explicit (reserved hugetlbfs pages) */
+    switch(wp_ascii_tolower(pch[0])) {
+      case 't':
+        config->set_pool_hugepages(config, WP_POOL_HUGEPAGES_TRANSPARENT);
+        break;
+      case 'e':
+        config->set_pool_hugepages(config, WP_POOL_HUGEPAGES_EXPLICIT);
+        break;
+      default:
+        config->set_pool_hugepages(config, WP_POOL_HUGEPAGES_OFF);
+        break;
+    }
+    return;
+  } else if(strcmp(name, "pool_prefault") == 0) {
+    config->set_pool_prefault(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "pool_numa_node") == 0) {
+    config->set_pool_numa_node(config, atoi(pch));
+    return;
+  } else if(strcmp(name, "config_snapshot") == 0) {
+    config->set_enable_config_snapshot(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "verbose") == 0) {
+    config->set_enable_verbose_logging(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "daemon") == 0) {
+    config->set_enable_daemon(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "options") == 0) {
+    config->set_print_config_options(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  } else if(strcmp(name, "arguments") == 0) {
+    config->set_print_arguments(config, wp_ascii_tolower(pch[0]) == 't');
+    return;
+  }
+
+  /* Paths are taken whole, so drop the line's newline. */
+  pch[strcspn(pch, "\n")] = '\0';
+  if(strcmp(name, "config") == 0) {
+    config->set_config_file_path(config, pch);
+  } else if(strcmp(name, "run_path") == 0) {
+    free(config->data->run_folder_path);
+    wp_safe_strcpy(&config->data->run_folder_path, pch);
+  } else if(strcmp(name, "lock_file") == 0) {
+    config->set_lock_file_path(config, pch);
+  } else {
+    wp_config_load_legacy_key(config, name, pch);
+  }
+}
+
+/**
+ * Replace a string setting with one from a snapshot's string table.
+ * @param dest the setting.
+ * @param table the string table.
+ * @param offset the string's offset, or WP_CONFIG_SNAPSHOT_NO_STRING.
+ */
+static void wp_config_snapshot_string(char **dest, const char *table, uint64_t offset) {
+  free(*dest);
+  *dest = NULL;
+  if(offset != WP_CONFIG_SNAPSHOT_NO_STRING) {
+    wp_safe_strcpy(dest, table + offset);
+  }
+}
+
+/**
+ * Checksum a snapshot: its header, with the checksum field zeroed, then its table.
+ * @param snapshot the header.
+ * @param table the string table.
+ * @param length the table's length.
+ * @return the checksum.
+ */
+static uint64_t wp_config_snapshot_checksum(const wp_config_snapshot_t *snapshot, const char *table, size_t length) {
+  wp_config_snapshot_t header;
+
+  memcpy(&header, snapshot, sizeof(header));
+  header.checksum = 0;
+  return wp_string_hash_bytes((const char *)&header, sizeof(header)) ^ wp_string_hash_bytes(table, length);
+}
+
+/**
+ * Apply a snapshot to the config, if it's there and still matches the source.
+ * The header, the string offsets and the checksum are checked: a snapshot is
+ * written whole by rename, and the source's stat says whether it's current.
+ * @param config self
+ * @param snapshot_path the snapshot.
+ * @param source the source config file's stat.
+ * @param reload apply only what a reload may change.
+ * @return true if the snapshot was applied, false to parse the text instead.
+ */
+static bool wp_config_apply_snapshot(wp_configuration_pt config, const char *snapshot_path, const struct stat *source, bool reload) {
+  const wp_config_snapshot_t *snapshot = MAP_FAILED;
+  __wp_configuration_private_t *d = config->data;
+  struct stat st;
+  bool valid = false;
+  int fd = -1;
+
+  if((fd = open(snapshot_path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(*snapshot)) {
+    snapshot = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if(snapshot == MAP_FAILED) {
+    return false;
+  }
+
+  const char *table = (const char *)(snapshot + 1);
+  uint64_t length = snapshot->table_length;
+  valid = snapshot->magic == WP_CONFIG_SNAPSHOT_MAGIC
+       && snapshot->format == WP_CONFIG_SNAPSHOT_FORMAT
+       && snapshot->header_size == sizeof(*snapshot)
+       && snapshot->source_dev == (uint64_t)source->st_dev
+       && snapshot->source_ino == (uint64_t)source->st_ino
+       && snapshot->source_size == (uint64_t)source->st_size
+       && snapshot->source_mtime_sec == (int64_t)source->st_mtim.tv_sec
+       && snapshot->source_mtime_nsec == (int64_t)source->st_mtim.tv_nsec
+       && length == (uint64_t)st.st_size - sizeof(*snapshot)
+       && (length == 0 || table[length - 1] == '\0')
+       && snapshot->checksum == wp_config_snapshot_checksum(snapshot, table, (size_t)length);
+  /* The table ends in a NUL, so any string starting inside it is terminated. */
+  valid = valid
+       && (snapshot->config_file_path == WP_CONFIG_SNAPSHOT_NO_STRING || snapshot->config_file_path < length)
+       && (snapshot->run_folder_path == WP_CONFIG_SNAPSHOT_NO_STRING || snapshot->run_folder_path < length)
+       && (snapshot->lock_file_path == WP_CONFIG_SNAPSHOT_NO_STRING || snapshot->lock_file_path < length)
+       && (snapshot->uid == WP_CONFIG_SNAPSHOT_NO_STRING || snapshot->uid < length)
+       && (snapshot->listen_address_count == 0 || snapshot->listen_addresses < length)
+       && snapshot->listen_address_count <= length;
+
+  if(valid) {
+    d->accept_rate_limit = snapshot->accept_rate_limit;
+    d->accept_rate_burst = snapshot->accept_rate_burst;
+    d->client_rate_limit = snapshot->client_rate_limit;
+    d->client_rate_burst = snapshot->client_rate_burst;
+    d->concurrency_limit_min = snapshot->concurrency_limit_min;
+    d->concurrency_limit_max = snapshot->concurrency_limit_max;
+  }
+  if(valid && !reload) {
+    const char *address = table + snapshot->listen_addresses;
+    for(size_t i = 0; i < d->listen_address_count; i++) {
+      free(d->listen_addresses[i]);
+    }
+    d->listen_address_count = 0;
+    for(uint64_t i = 0; i < snapshot->listen_address_count && address < table + length; i++) {
+      config->add_listen_address(config, address);
+      address += strlen(address) + 1;
+    }
+
+    d->enable_daemon = snapshot->enable_daemon;
+    d->enable_pid_lock = snapshot->enable_pid_lock;
+    d->enable_verbose_logging = snapshot->enable_verbose_logging;
+    d->print_arguments = snapshot->print_arguments;
+    d->print_config_options = snapshot->print_config_options;
+    d->enable_ready_on_start = snapshot->enable_ready_on_start;
+    d->enable_config_snapshot = snapshot->enable_config_snapshot;
+    d->pool_prefault = snapshot->pool_prefault;
+    wp_config_snapshot_string(&d->config_file_path, table, snapshot->config_file_path);
+    wp_config_snapshot_string(&d->run_folder_path, table, snapshot->run_folder_path);
+    wp_config_snapshot_string(&d->lock_file_path, table, snapshot->lock_file_path);
+    wp_config_snapshot_string(&d->uid, table, snapshot->uid);
+    d->listen_backlog = snapshot->listen_backlog;
+    d->listen_defer_accept = snapshot->listen_defer_accept;
+    d->worker_count = snapshot->worker_count;
+    d->auto_worker_count = 0;
+    d->watchdog_budget_ms = snapshot->watchdog_budget_ms;
+    d->profiler_hz = snapshot->profiler_hz;
+    d->profiler_dump = snapshot->profiler_dump;
+    d->shutdown_drain_timeout_ms = snapshot->shutdown_drain_timeout_ms;
+    d->cache_memory_budget = (size_t)snapshot->cache_memory_budget;
+    d->state_pool_size = (size_t)snapshot->state_pool_size;
+    d->pool_hugepages = (wp_pool_hugepages_t)snapshot->pool_hugepages;
+    d->pool_numa_node = snapshot->pool_numa_node;
+    memcpy(d->cpu_affinity, snapshot->cpu_affinity, sizeof(d->cpu_affinity));
+  }
+
+  munmap((void *)snapshot, (size_t)st.st_size);
+  return valid;
+}
+
+/**
+ * Append a string to a snapshot's string table.
+ * @param table the table, grown as needed.
+ * @param length bytes used; advanced past the string.
+ * @param str the string, or NULL.
+ * @return its offset, WP_CONFIG_SNAPSHOT_NO_STRING for NULL, or UINT64_MAX - 1 if out of memory.
+ */
+static uint64_t wp_config_snapshot_add_string(char **table, size_t *length, const char *str) {
+  size_t len = 0;
+  char *grown = NULL;
+  uint64_t offset = *length;
+
+  if(str == NULL) {
+    return WP_CONFIG_SNAPSHOT_NO_STRING;
+  }
+  len = strlen(str) + 1;
+  if((grown = realloc(*table, *length + len)) == NULL) {
+    return UINT64_MAX - 1;
+  }
+  memcpy(grown + *length, str, len);
+  *table = grown;
+  *length += len;
+  return offset;
+}
+
+/**
+ * Write a snapshot of the settings a parse left in the config, replacing any
+ * older one in a single rename so a reader never sees half of it. Failure
+ * only costs the next start a text parse, so it's not reported.
+ * @param config self
+ * @param snapshot_path the snapshot.
+ * @param source the source config file's stat.
+ */
+static void wp_config_write_snapshot(const wp_configuration_t *config, const char *snapshot_path, const struct stat *source) {
+  const __wp_configuration_private_t *d = config->data;
+  wp_config_snapshot_t snapshot;
+  char tmp_path[PATH_MAX];
+  char *table = NULL;
+  size_t length = 0;
+  bool written = false;
+  int fd = -1;
+
+  if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", snapshot_path) >= (int)sizeof(tmp_path)) {
+    return;
+  }
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.magic = WP_CONFIG_SNAPSHOT_MAGIC;
+  snapshot.format = WP_CONFIG_SNAPSHOT_FORMAT;
+  snapshot.header_size = sizeof(snapshot);
+  snapshot.source_dev = (uint64_t)source->st_dev;
+  snapshot.source_ino = (uint64_t)source->st_ino;
+  snapshot.source_size = (uint64_t)source->st_size;
+  snapshot.source_mtime_sec = (int64_t)source->st_mtim.tv_sec;
+  snapshot.source_mtime_nsec = (int64_t)source->st_mtim.tv_nsec;
+
+  snapshot.enable_daemon = d->enable_daemon;
+  snapshot.enable_pid_lock = d->enable_pid_lock;
+  snapshot.enable_verbose_logging = d->enable_verbose_logging;
+  snapshot.print_arguments = d->print_arguments;
+  snapshot.print_config_options = d->print_config_options;
+  snapshot.enable_ready_on_start = d->enable_ready_on_start;
+  snapshot.enable_config_snapshot = d->enable_config_snapshot;
+  snapshot.pool_prefault = d->pool_prefault;
+  snapshot.config_file_path = wp_config_snapshot_add_string(&table, &length, d->config_file_path);
+  snapshot.run_folder_path = wp_config_snapshot_add_string(&table, &length, d->run_folder_path);
+  snapshot.lock_file_path = wp_config_snapshot_add_string(&table, &length, d->lock_file_path);
+  snapshot.uid = wp_config_snapshot_add_string(&table, &length, d->uid);
+  snapshot.listen_addresses = length;
+  snapshot.listen_address_count = d->listen_address_count;
+  for(size_t i = 0; i < d->listen_address_count; i++) {
+    if(wp_config_snapshot_add_string(&table, &length, d->listen_addresses[i]) == UINT64_MAX - 1) {
+      free(table);
+      return;
+    }
+  }
+  snapshot.listen_backlog = d->listen_backlog;
+  snapshot.listen_defer_accept = d->listen_defer_accept;
+  snapshot.worker_count = d->worker_count;
+  snapshot.watchdog_budget_ms = d->watchdog_budget_ms;
+  snapshot.profiler_hz = d->profiler_hz;
+  snapshot.profiler_dump = d->profiler_dump;
+  snapshot.shutdown_drain_timeout_ms = d->shutdown_drain_timeout_ms;
+  snapshot.accept_rate_limit = d->accept_rate_limit;
+  snapshot.accept_rate_burst = d->accept_rate_burst;
+  snapshot.client_rate_limit = d->client_rate_limit;
+  snapshot.client_rate_burst = d->client_rate_burst;
+  snapshot.concurrency_limit_min = d->concurrency_limit_min;
+  snapshot.concurrency_limit_max = d->concurrency_limit_max;
+  snapshot.cache_memory_budget = d->cache_memory_budget;
+  snapshot.state_pool_size = d->state_pool_size;
+  snapshot.pool_hugepages = (int32_t)d->pool_hugepages;
+  snapshot.pool_numa_node = d->pool_numa_node;
+  memcpy(snapshot.cpu_affinity, d->cpu_affinity, sizeof(snapshot.cpu_affinity));
+  snapshot.table_length = length;
+  snapshot.checksum = wp_config_snapshot_checksum(&snapshot, table, length);
+
+  if(snapshot.config_file_path == UINT64_MAX - 1 || snapshot.run_folder_path == UINT64_MAX - 1
+     || snapshot.lock_file_path == UINT64_MAX - 1 || snapshot.uid == UINT64_MAX - 1) {
+    free(table);
+    return;
+  }
+
+  /* The config may hold secrets; so does its snapshot. */
+  if((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) > -1) {
+    written = write(fd, &snapshot, sizeof(snapshot)) == (ssize_t)sizeof(snapshot)
+           && (length == 0 || write(fd, table, length) == (ssize_t)length);
+    if(close(fd) != 0 || !written || rename(tmp_path, snapshot_path) != 0) {
+      unlink(tmp_path);
+    }
+  }
+  free(table);
+}
+
 /**
  *  Reads a configuration file from the default configuration path and populates
  * the provided config object.
@@ -223,33 +1012,50 @@ static void wp_config_load_helper(const wp_configuration_pt config, char *pch, c
  *
  * NOTES: Extraneous white space not permitted. Comments must appear at the
  * beginning of the line. Only \n supported for newlines.
+ *
+ * A valid <file>.snap is used in place of the text. With config_snapshot set,
+ * parsing the text writes one. One left by an earlier setting is never
+ * removed here: it may not be ours, and once the text changes it's stale.
  * @param config self
  * @param fn
  * @return
  */
 static wp_status_t wp_config_update_from_configuration_file(wp_configuration_pt config, exec_config_switch_fn fn, const char *file_path) {
 
-  const char tok[2] = { '=', ';' };
+  const char tok[] = "=;";
   wp_status_t ret = WP_FAILURE;
   char line[WP_MAX_LINE];
+  char snapshot_path[PATH_MAX];
+  struct stat source;
+  bool have_snapshot_path = false;
+  /* The reload helper takes only what's safe to change while running. */
+  bool reload = fn != &wp_config_load_helper;
   char *pch;
-  char w;
+  char *name;
 
   /* let's try the command line arguments first: */
   /* TODO: Fix, this is currently broken as we will not (yet) have a path populated
    * from the command line... */
   FILE *file = NULL;
+  const char *path = NULL;
   if(file_path != NULL) {
-    file = fopen(file_path, "r");
+    file = fopen(path = file_path, "r");
   } else if(config->get_config_file_path(config) != NULL) {
-    file = fopen(config->get_config_file_path(config), "r");
+    file = fopen(path = config->get_config_file_path(config), "r");
   }
   if(file == NULL) {
     /* maybe we weren't provided a file, let's try the default location: */
-    file = fopen(DEFAULT_CONFIG_FILE_PATH, "r");
+    file = fopen(path = DEFAULT_CONFIG_FILE_PATH, "r");
   }
   /* If we have a file, we'll try to load/read it: */
   if(file != NULL) {
+    have_snapshot_path = fstat(fileno(file), &source) == 0
+      && snprintf(snapshot_path, sizeof(snapshot_path), "%s" WP_CONFIG_SNAPSHOT_SUFFIX, path) < (int)sizeof(snapshot_path);
+    if(have_snapshot_path && wp_config_apply_snapshot(config, snapshot_path, &source, reload)) {
+      fclose(file);
+      return WP_SUCCESS;
+    }
+
     while(fgets(line, WP_MAX_LINE, file) != NULL) {
       /* TODO: Ignore spaces. */
       if(line[0] == '#') {
@@ -257,15 +1063,20 @@ static wp_status_t wp_config_update_from_configuration_file(wp_configuration_pt
       }
       pch = strtok(line, tok);
       while(pch != NULL) {
-        w = pch[0];
+        name = pch;
         if(((pch = strtok(NULL, tok)) == NULL) || pch[0] == '\n') {
           break;
         }
         /* helper function to populate the config. */
-        fn(config, pch, w);
+        fn(config, name, pch);
       }
     }
 
+    /* A reload leaves most settings as they were, so only a full parse describes the file. */
+    if(have_snapshot_path && !reload && config->get_enable_config_snapshot(config)) {
+      wp_config_write_snapshot(config, snapshot_path, &source);
+    }
+
     fclose(file);
     ret = WP_SUCCESS;
   }
@@ -274,7 +1085,24 @@ static wp_status_t wp_config_update_from_configuration_file(wp_configuration_pt
 }
 
 static wp_status_t wp_config_populate_from_file(wp_configuration_pt self, const char *file_path) {
-  return wp_config_update_from_configuration_file(self, &wp_config_load_helper, file_path);
+  wp_status_t ret = wp_config_update_from_configuration_file(self, &wp_config_load_helper, file_path);
+  /* Remember the file, so that reload reads it again. */
+  if(ret == WP_SUCCESS && file_path != NULL) {
+    self->set_config_file_path(self, file_path);
+  }
+  return ret;
+}
+
+/* Apply only the settings that are safe to change while running. */
+static void wp_config_reload_helper(const wp_configuration_pt config, const char *name, char *pch) {
+  if(strncmp(name, "accept_rate_", 12) == 0 || strncmp(name, "client_rate_", 12) == 0
+     || strncmp(name, "concurrency_limit_", 18) == 0) {
+    wp_config_load_helper(config, name, pch);
+  }
+}
+
+static wp_status_t wp_config_reload(wp_configuration_pt self) {
+  return wp_config_update_from_configuration_file(self, &wp_config_reload_helper, NULL);
 }
 
 static void wp_config_print_configuration(const wp_configuration_t *config) {
@@ -284,10 +1112,41 @@ static void wp_config_print_configuration(const wp_configuration_t *config) {
   fprintf(stdout, "    enable print args            : \"%s\"\n", (config->get_print_arguments(config) ? "true" : "false"));
   fprintf(stdout, "    enable print config options  : \"%s\"\n", (config->get_print_config_options(config) ? "true" : "false"));
   fprintf(stdout, "    enable daemon                : \"%s\"\n", (config->get_enable_daemon(config) ? "true" : "false"));
+  fprintf(stdout, "    enable ready on start        : \"%s\"\n", (config->get_enable_ready_on_start(config) ? "true" : "false"));
   fprintf(stdout, "    uid                          : \"%s\"\n", config->get_uid(config));
   fprintf(stdout, "    run path                     : \"%s\"\n", config->get_run_folder_path(config));
   fprintf(stdout, "    lock file                    : \"%s\"\n", config->get_lock_file_path(config));
   fprintf(stdout, "    config file path             : \"%s\"\n", config->get_config_file_path(config));
+  fprintf(stdout, "    config snapshot              : \"%s\"\n", (config->get_enable_config_snapshot(config) ? "true" : "false"));
+  for(size_t i = 0; i < config->get_listen_address_count(config); i++) {
+    fprintf(stdout, "    listen                       : \"%s\"\n", config->get_listen_address(config, i));
+  }
+  fprintf(stdout, "    listen backlog               : \"%d\"\n", config->get_listen_backlog(config));
+  fprintf(stdout, "    listen defer accept          : \"%d\"\n", config->get_listen_defer_accept(config));
+  fprintf(stdout, "    workers                      : \"%u\"\n", config->get_worker_count(config));
+  for(int role = 0; role < WP_CPU_ROLE_COUNT; role++) {
+    static const char *const labels[WP_CPU_ROLE_COUNT] = { "main   ", "workers", "logger " };
+    const cpu_set_t *set = config->get_cpu_affinity(config, (wp_cpu_role_t)role);
+    char list[256];
+    fprintf(stdout, "    cpu affinity %s         : \"%s\"\n", labels[role], set ? wp_cpu_format_list(set, list, sizeof(list)) : "");
+  }
+  fprintf(stdout, "    watchdog budget ms           : \"%u\"\n", config->get_watchdog_budget_ms(config));
+  fprintf(stdout, "    profiler hz                  : \"%u\"\n", config->get_profiler_hz(config));
+  fprintf(stdout, "    profiler dump                : \"%s\"\n", (config->get_profiler_dump(config) ? "true" : "false"));
+  fprintf(stdout, "    shutdown drain timeout ms    : \"%u\"\n", config->get_shutdown_drain_timeout_ms(config));
+  fprintf(stdout, "    accept rate limit            : \"%u\"\n", config->get_accept_rate_limit(config));
+  fprintf(stdout, "    accept rate burst            : \"%u\"\n", config->get_accept_rate_burst(config));
+  fprintf(stdout, "    client rate limit            : \"%u\"\n", config->get_client_rate_limit(config));
+  fprintf(stdout, "    client rate burst            : \"%u\"\n", config->get_client_rate_burst(config));
+  fprintf(stdout, "    concurrency limit min        : \"%u\"\n", config->get_concurrency_limit_min(config));
+  fprintf(stdout, "    concurrency limit max        : \"%u\"\n", config->get_concurrency_limit_max(config));
+  fprintf(stdout, "    state pool size              : \"%zu\"\n", config->get_state_pool_size(config));
+  fprintf(stdout, "    cache memory budget          : \"%zu\"\n", config->get_cache_memory_budget(config));
+  fprintf(stdout, "    pool hugepages               : \"%s\"\n",
+          config->get_pool_hugepages(config) == WP_POOL_HUGEPAGES_EXPLICIT ? "explicit" :
+          config->get_pool_hugepages(config) == WP_POOL_HUGEPAGES_TRANSPARENT ? "transparent" : "off");
+  fprintf(stdout, "    pool prefault                : \"%s\"\n", (config->get_pool_prefault(config) ? "true" : "false"));
+  fprintf(stdout, "    pool numa node               : \"%d\"\n", config->get_pool_numa_node(config));
 }
 
 static void wp_config_set_daemon_on_start_method(const struct wp_configuration *self, wp_daemon_on_start_method_fn fn) {
@@ -296,7 +1155,7 @@ static void wp_config_set_daemon_on_start_method(const struct wp_configuration *
 }
 
 static wp_daemon_on_start_method_fn wp_config_get_daemon_on_start_method(const struct wp_configuration *self) {
-  assert(self && self->data && self->data->daemon_on_start_method);
+  assert(self && self->data);
   return self->data->daemon_on_start_method;
 }
 
@@ -316,6 +1175,7 @@ wp_status_t wp_configuration_new(wp_configuration_pt *self_out) {
       self->get_enable_pid_lock = &wp_config_get_enable_pid_lock;
       self->set_enable_pid_lock = &wp_config_set_enable_pid_lock;
       self->populate_from_file = &wp_config_populate_from_file;
+      self->reload = &wp_config_reload;
       self->set_enable_pid_lock = &wp_config_set_enable_pid_lock;
       self->get_enable_pid_lock = &wp_config_get_enable_pid_lock;
       self->get_enable_verbose_logging = &wp_config_get_enable_verbose_logging;
@@ -324,6 +1184,8 @@ wp_status_t wp_configuration_new(wp_configuration_pt *self_out) {
       self->set_print_arguments = &wp_config_set_print_arguments;
       self->get_print_config_options = &wp_config_get_print_config_options;
       self->set_print_config_options = &wp_config_set_print_config_options;
+      self->get_enable_ready_on_start = &wp_config_get_enable_ready_on_start;
+      self->set_enable_ready_on_start = &wp_config_set_enable_ready_on_start;
       self->get_enable_daemon = &wp_config_get_enable_daemon;
       self->set_enable_daemon = &wp_config_set_enable_daemon;
       self->get_config_file_path = &wp_config_get_config_file_path;
@@ -332,6 +1194,49 @@ wp_status_t wp_configuration_new(wp_configuration_pt *self_out) {
       self->get_lock_file_path = &wp_config_get_lock_file_path;
       self->set_lock_file_path = &wp_config_set_lock_file_path;
       self->get_uid = &wp_config_get_uid;
+      self->get_listen_address_count = &wp_config_get_listen_address_count;
+      self->get_listen_address = &wp_config_get_listen_address;
+      self->add_listen_address = &wp_config_add_listen_address;
+      self->get_listen_backlog = &wp_config_get_listen_backlog;
+      self->set_listen_backlog = &wp_config_set_listen_backlog;
+      self->get_listen_defer_accept = &wp_config_get_listen_defer_accept;
+      self->set_listen_defer_accept = &wp_config_set_listen_defer_accept;
+      self->get_worker_count = &wp_config_get_worker_count;
+      self->set_worker_count = &wp_config_set_worker_count;
+      self->get_cpu_affinity = &wp_config_get_cpu_affinity;
+      self->get_watchdog_budget_ms = &wp_config_get_watchdog_budget_ms;
+      self->set_watchdog_budget_ms = &wp_config_set_watchdog_budget_ms;
+      self->get_profiler_hz = &wp_config_get_profiler_hz;
+      self->set_profiler_hz = &wp_config_set_profiler_hz;
+      self->get_profiler_dump = &wp_config_get_profiler_dump;
+      self->set_profiler_dump = &wp_config_set_profiler_dump;
+      self->get_shutdown_drain_timeout_ms = &wp_config_get_shutdown_drain_timeout_ms;
+      self->set_shutdown_drain_timeout_ms = &wp_config_set_shutdown_drain_timeout_ms;
+      self->get_accept_rate_limit = &wp_config_get_accept_rate_limit;
+      self->set_accept_rate_limit = &wp_config_set_accept_rate_limit;
+      self->get_accept_rate_burst = &wp_config_get_accept_rate_burst;
+      self->set_accept_rate_burst = &wp_config_set_accept_rate_burst;
+      self->get_client_rate_limit = &wp_config_get_client_rate_limit;
+      self->set_client_rate_limit = &wp_config_set_client_rate_limit;
+      self->get_client_rate_burst = &wp_config_get_client_rate_burst;
+      self->set_client_rate_burst = &wp_config_set_client_rate_burst;
+      self->get_concurrency_limit_min = &wp_config_get_concurrency_limit_min;
+      self->set_concurrency_limit_min = &wp_config_set_concurrency_limit_min;
+      self->get_concurrency_limit_max = &wp_config_get_concurrency_limit_max;
+      self->set_concurrency_limit_max = &wp_config_set_concurrency_limit_max;
+      self->set_cpu_affinity = &wp_config_set_cpu_affinity;
+      self->get_state_pool_size = &wp_config_get_state_pool_size;
+      self->set_state_pool_size = &wp_config_set_state_pool_size;
+      self->get_cache_memory_budget = &wp_config_get_cache_memory_budget;
+      self->set_cache_memory_budget = &wp_config_set_cache_memory_budget;
+      self->get_pool_hugepages = &wp_config_get_pool_hugepages;
+      self->set_pool_hugepages = &wp_config_set_pool_hugepages;
+      self->get_pool_prefault = &wp_config_get_pool_prefault;
+      self->set_pool_prefault = &wp_config_set_pool_prefault;
+      self->get_pool_numa_node = &wp_config_get_pool_numa_node;
+      self->set_pool_numa_node = &wp_config_set_pool_numa_node;
+      self->get_enable_config_snapshot = &wp_config_get_enable_config_snapshot;
+      self->set_enable_config_snapshot = &wp_config_set_enable_config_snapshot;
 
       self->configuration_print = &wp_config_print_configuration;
 
@@ -340,12 +1245,41 @@ wp_status_t wp_configuration_new(wp_configuration_pt *self_out) {
       self->data->enable_pid_lock = true;
       self->data->enable_daemon = false; /* no deamon by default.*/
       self->data->enable_verbose_logging = true;
+      self->data->enable_ready_on_start = true;
+      self->data->enable_config_snapshot = false;
+      self->data->print_arguments = false;
+      self->data->print_config_options = false;
 
       self->data->config_file_path = NULL;
       self->data->lock_file_path = NULL;
       self->data->run_folder_path = NULL;
       self->data->uid = NULL;
 
+      self->data->listen_addresses = NULL;
+      self->data->listen_address_count = 0;
+      self->data->listen_backlog = DEFAULT_LISTEN_BACKLOG;
+      self->data->listen_defer_accept = 0;
+      self->data->worker_count = 1;
+      self->data->auto_worker_count = 0;
+      self->data->watchdog_budget_ms = 0;
+      self->data->profiler_hz = 0;
+      self->data->profiler_dump = false;
+      self->data->shutdown_drain_timeout_ms = 10000;
+      self->data->accept_rate_limit = 0;
+      self->data->accept_rate_burst = 0;
+      self->data->client_rate_limit = 0;
+      self->data->client_rate_burst = 0;
+      self->data->concurrency_limit_min = 0;
+      self->data->concurrency_limit_max = 0;
+      for(int role = 0; role < WP_CPU_ROLE_COUNT; role++) {
+        CPU_ZERO(&self->data->cpu_affinity[role]);
+      }
+      self->data->cache_memory_budget = DEFAULT_CACHE_MEMORY_BUDGET;
+      self->data->state_pool_size = 0;
+      self->data->pool_hugepages = WP_POOL_HUGEPAGES_OFF;
+      self->data->pool_prefault = false;
+      self->data->pool_numa_node = -1;
+
       ret = WP_SUCCESS;
     } else {
       free(self);
@@ -378,6 +1312,10 @@ void wp_configuration_delete(wp_configuration_pt self) {
     if(self->data->uid) { 
       free(self->data->uid);
     }
+    for(size_t i = 0; i < self->data->listen_address_count; i++) {
+      free(self->data->listen_addresses[i]);
+    }
+    free(self->data->listen_addresses);
 
     free(self->data);
     self->data = NULL;
@@ -0,0 +1,210 @@
+/*
+ * File:   wp_cpu.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:47 AM
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wp_cpu.h>
+
+#define WP_CPU_CGROUP_ROOT "/sys/fs/cgroup"
+
+wp_status_t wp_cpu_parse_list(const char *list, cpu_set_t *set) {
+  assert(list && set);
+  const char *p = list;
+
+  CPU_ZERO(set);
+  while(*p) {
+    char *end = NULL;
+    unsigned long first = 0, last = 0;
+
+    while(isspace((unsigned char)*p) || *p == ',') {
+      p++;
+    }
+    if(*p == '\0') {
+      break;
+    }
+    if(!isdigit((unsigned char)*p)) {
+      return WP_FAILURE;
+    }
+    first = last = strtoul(p, &end, 10);
+    p = end;
+    if(*p == '-') {
+      p++;
+      if(!isdigit((unsigned char)*p)) {
+        return WP_FAILURE;
+      }
+      last = strtoul(p, &end, 10);
+      p = end;
+    }
+    if(first > last || last >= CPU_SETSIZE) {
+      return WP_FAILURE;
+    }
+    for(unsigned long cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, set);
+    }
+    while(isspace((unsigned char)*p)) {
+      p++;
+    }
+    if(*p && *p != ',') {
+      return WP_FAILURE;
+    }
+  }
+
+  return WP_SUCCESS;
+}
+
+char *wp_cpu_format_list(const cpu_set_t *set, char *buf, size_t size) {
+  assert(set && buf && size);
+  size_t len = 0;
+
+  buf[0] = '\0';
+  for(int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+    int last = cpu;
+    int n = 0;
+    if(!CPU_ISSET(cpu, set)) {
+      continue;
+    }
+    while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+      last++;
+    }
+    if(last > cpu) {
+      n = snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last);
+    } else {
+      n = snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpu);
+    }
+    len += n > 0 ? (size_t)n : 0;
+    cpu = last;
+  }
+
+  return buf;
+}
+
+/**
+ * Read the CPU limit from one cgroup's cpu.max ("max 100000" or "quota period").
+ * @param dir the cgroup's directory.
+ * @return the quota in CPUs, rounded up, or 0 if unlimited or unreadable.
+ */
+static unsigned wp_cpu_read_cpu_max(const char *dir) {
+  char path[PATH_MAX];
+  char quota[32];
+  unsigned long long period = 0;
+  unsigned cpus = 0;
+  FILE *file = NULL;
+
+  if(snprintf(path, sizeof(path), "%s/cpu.max", dir) >= (int)sizeof(path)) {
+    return 0;
+  }
+  if((file = fopen(path, "re")) == NULL) {
+    return 0;
+  }
+  if(fscanf(file, "%31s %llu", quota, &period) == 2 && strcmp(quota, "max") != 0 && period > 0) {
+    unsigned long long q = strtoull(quota, NULL, 10);
+    cpus = (unsigned)((q + period - 1) / period);
+    cpus = cpus ? cpus : 1;
+  }
+  fclose(file);
+
+  return cpus;
+}
+
+/**
+ * Find the tightest cpu.max quota between our cgroup v2 cgroup and the root.
+ * @return the quota in CPUs, or 0 if there is none (or no cgroup v2).
+ */
+static unsigned wp_cpu_cgroup_quota() {
+  char line[PATH_MAX];
+  char dir[PATH_MAX];
+  unsigned limit = 0;
+  FILE *file = NULL;
+
+  if((file = fopen("/proc/self/cgroup", "re")) == NULL) {
+    return 0;
+  }
+  dir[0] = '\0';
+  while(fgets(line, sizeof(line), file)) {
+    /* The unified hierarchy's line is "0::/path". */
+    if(strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(dir, sizeof(dir), "%s%s", WP_CPU_CGROUP_ROOT, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+      break;
+    }
+  }
+  fclose(file);
+  if(dir[0] == '\0') {
+    return 0;
+  }
+
+  /* A parent's quota binds its children too. */
+  for(;;) {
+    unsigned cpus = wp_cpu_read_cpu_max(dir);
+    char *slash = NULL;
+    if(cpus && (limit == 0 || cpus < limit)) {
+      limit = cpus;
+    }
+    if(strcmp(dir, WP_CPU_CGROUP_ROOT) == 0 || (slash = strrchr(dir, '/')) == NULL) {
+      break;
+    }
+    *slash = '\0';
+  }
+
+  return limit;
+}
+
+unsigned wp_cpu_count_available(const cpu_set_t *within) {
+  cpu_set_t allowed;
+  unsigned count = 0;
+  unsigned quota = 0;
+
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    if(within) {
+      CPU_AND(&allowed, &allowed, within);
+    }
+    count = (unsigned)CPU_COUNT(&allowed);
+  } else if(within) {
+    count = (unsigned)CPU_COUNT(within);
+  } else {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    count = online > 0 ? (unsigned)online : 1;
+  }
+
+  if((quota = wp_cpu_cgroup_quota()) && quota < count) {
+    count = quota;
+  }
+
+  return count ? count : 1;
+}
+
+wp_status_t wp_cpu_pin_thread(const cpu_set_t *set) {
+  assert(set);
+  return sched_setaffinity(0, sizeof(*set), set) == 0 ? WP_SUCCESS : WP_FAILURE;
+}
+
+wp_status_t wp_cpu_pin_thread_to_nth(const cpu_set_t *set, unsigned index) {
+  assert(set);
+  int count = CPU_COUNT(set);
+  cpu_set_t one;
+
+  if(count == 0) {
+    return WP_FAILURE;
+  }
+  index %= (unsigned)count;
+  for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if(CPU_ISSET(cpu, set) && index-- == 0) {
+      CPU_ZERO(&one);
+      CPU_SET(cpu, &one);
+      return wp_cpu_pin_thread(&one);
+    }
+  }
+
+  return WP_FAILURE;
+}
@@ -1,10 +1,16 @@
+#include <limits.h>
 #include <pwd.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <syslog.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -13,20 +19,102 @@
 #include <assert.h>
 #include <wp_common.h>
 #include <wp_configuration.h>
+#include <wp_cpu.h>
 #include <wp_daemonizer.h>
+#include <wp_event_loop.h>
+#include <wp_fiber.h>
+#include <wp_format.h>
+#include <wp_limiter.h>
+#include <wp_listener.h>
+#include <wp_pool.h>
+#include <wp_profiler.h>
+#include <wp_supervisor.h>
+#include <wp_timer_wheel.h>
+#include <wp_watchdog.h>
 
 const size_t DEFAULT_BUFFER_SIZE = 16384;
 
+/* How often a draining shutdown asks whether the work in flight is done. */
+#define WP_DAEMONIZER_DRAIN_POLL_MS 10
+/* Buckets in the client rate limiter, about 256 KB. */
+#define WP_DAEMONIZER_CLIENT_SLOTS 16384
+
 static wp_daemonizer_t *instance = NULL;
 
+/*
+ * The signal handler writes each signal number here, and the main loop reads
+ * them back, so that signals are handled as ordinary events.
+ */
+static int signal_pipe[2] = { -1, -1 };
+
 typedef struct __wp_daemonizer_private_t {
   /* TODO: Incorporate additional state as needed. */
   wp_configuration_t *config;
+  wp_event_loop_t *loop;
+  wp_listener_t *listener;
+  wp_fiber_scheduler_t *fibers;
+  wp_supervisor_t *supervisor;
+  wp_pool_t *state_pool;
+  bool state_pool_reattached;
+  wp_watchdog_t *watchdog;
+  wp_profiler_t *profiler;
+  wp_rate_limiter_t *client_limiter;
+  wp_concurrency_limiter_t *concurrency_limiter;
+  /* When WATCHDOG=1 was last sent, and how often the service manager wants it. */
+  uint64_t watchdog_pinged_at;
+  uint64_t watchdog_interval_ns;
+
+  /* Draining shutdown: polled from a timer on the main loop until the deadline. */
+  bool shutting_down;
+  wp_drain_method_fn drain_method;
+  void *drain_arg;
+  wp_timer_wheel_t *wheel;
+  wp_timer_t drain_timer;
+  uint64_t drain_started_at;
+  uint64_t drain_deadline;
   
   wp_reconfigure_method_fn reconfigure_method;
   int created_pid_lock_file;
+
+  /* Write end of the readiness pipe back to the original parent, or -1. */
+  int ready_fd;
+  bool notified_ready;
+
+  struct {
+    uint64_t begin;
+    uint64_t end;
+  } phases[WP_STARTUP_PHASE_COUNT];
 } __wp_daemonizer_private_t;
 
+static const char *const startup_phase_names[WP_STARTUP_PHASE_COUNT] = {
+  "config load",
+  "bind",
+  "setuid",
+  "fork",
+  "chdir",
+  "pid lock",
+  "redirect fds",
+  "ready"
+};
+
+/**
+ * Read the monotonic clock.
+ * @return the current monotonic time in nanoseconds.
+ */
+static uint64_t wp_daemonizer_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void wp_daemonizer_phase_begin(const wp_daemonizer_t *self, wp_startup_phase_t phase) {
+  self->data->phases[phase].begin = wp_daemonizer_now_ns();
+}
+
+static void wp_daemonizer_phase_end(const wp_daemonizer_t *self, wp_startup_phase_t phase) {
+  self->data->phases[phase].end = wp_daemonizer_now_ns();
+}
+
 
 /* sed-begin-null-file-descriptors */
 /**
@@ -68,10 +156,11 @@ static wp_status_t wp_daemonizer_set_pid_lock(const wp_daemonizer_t *self) {
     int lfp = open(lock_file_name, O_WRONLY | O_CREAT | O_EXCL, 0640);
     if(lfp > -1) {
       if(ftruncate(lfp, 0) == 0) {
-        char pidtext[WP_MAX_LINE];
-        snprintf(pidtext, sizeof(pidtext), "%ld\n", (long)getpid());
-        int r = write(lfp, pidtext, strlen(pidtext));
-        if(r > 0) {
+        char pidtext[24];
+        wp_fmt_t fmt;
+        wp_fmt_init(&fmt, pidtext, sizeof(pidtext));
+        wp_fmt_i64(&fmt, (int64_t)getpid());
+        if(wp_fmt_write_line(&fmt, lfp) == WP_SUCCESS) {
           self->data->created_pid_lock_file = 1;
           res = WP_SUCCESS;
         }
@@ -129,6 +218,189 @@ static wp_status_t wp_daemonizer_set_uid(const wp_daemonizer_t *self) {
   return WP_SUCCESS;
 }
 
+/**
+ * Block in the original parent until the daemon reports readiness.
+ * @param fd read end of the readiness pipe.
+ * @return WP_SUCCESS if the daemon reported ready, WP_FAILURE if every write
+ *         end closed first (i.e. the daemon died during startup).
+ */
+static wp_status_t wp_daemonizer_wait_for_ready(int fd) {
+  char status = 0;
+  ssize_t r;
+
+  do {
+    r = read(fd, &status, 1);
+  } while(r < 0 && errno == EINTR);
+  close(fd);
+
+  return (r == 1 && status == '1') ? WP_SUCCESS : WP_FAILURE;
+}
+
+/**
+ * Send a state string to the service manager over the $NOTIFY_SOCKET datagram
+ * protocol. Both filesystem and abstract ('@' prefixed) sockets are supported.
+ * @param self pointer to an instance of the daemonizer; its configuration is used for logging.
+ * @param state newline separated assignments, e.g. "READY=1".
+ * @return WP_SUCCESS if sent or no service manager is listening, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_daemonizer_notify(const wp_daemonizer_t *self, const char *state) {
+  assert(self && state);
+  wp_status_t res = WP_FAILURE;
+  struct sockaddr_un addr;
+  const char *path = getenv("NOTIFY_SOCKET");
+  size_t path_len;
+
+  if(path == NULL || path[0] == '\0') {
+    return WP_SUCCESS;
+  }
+
+  path_len = strlen(path);
+  if((path[0] != '/' && path[0] != '@') || path_len >= sizeof(addr.sun_path)) {
+    return WP_FAILURE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, path_len);
+  if(addr.sun_path[0] == '@') {
+    addr.sun_path[0] = '\0';
+  }
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if(fd > -1) {
+    socklen_t addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len);
+    if(sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *)&addr, addr_len) > -1) {
+      res = WP_SUCCESS;
+    }
+    close(fd);
+  }
+
+  if(res != WP_SUCCESS) {
+    wp_log(stderr, self->data->config, LOG_ERR, "Could not notify %s: %m", path);
+  }
+
+  return res;
+}
+
+/**
+ * Report readiness: release the original parent blocked in daemonize and send
+ * READY=1 to the service manager. Only the first call has any effect.
+ * @param self pointer to an instance of the daemonizer.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_daemonizer_notify_ready(const wp_daemonizer_t *self) {
+  wp_status_t res = WP_SUCCESS;
+  char state[WP_MAX_LINE];
+  wp_fmt_t fmt;
+
+  if(self->data->notified_ready) {
+    return WP_SUCCESS;
+  }
+  self->data->notified_ready = true;
+  wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_READY);
+
+  if(self->data->ready_fd > -1) {
+    const char status = '1';
+    ssize_t r;
+    do {
+      r = write(self->data->ready_fd, &status, 1);
+    } while(r < 0 && errno == EINTR);
+    if(r != 1) {
+      res = WP_FAILURE;
+    }
+    close(self->data->ready_fd);
+    self->data->ready_fd = -1;
+  }
+
+  wp_fmt_init(&fmt, state, sizeof(state));
+  wp_fmt_str(&fmt, "READY=1\nMAINPID=");
+  wp_fmt_i64(&fmt, (int64_t)getpid());
+  if(wp_daemonizer_notify(self, state) != WP_SUCCESS) {
+    res = WP_FAILURE;
+  }
+
+  self->log_startup_timeline(self);
+  return res;
+}
+
+static uint64_t wp_daemonizer_get_startup_phase_ns(const wp_daemonizer_t *self, wp_startup_phase_t phase) {
+  assert(self && self->data && phase < WP_STARTUP_PHASE_COUNT);
+  uint64_t begin = self->data->phases[phase].begin;
+  uint64_t end = self->data->phases[phase].end;
+  return (begin && end > begin) ? end - begin : 0;
+}
+
+static void wp_daemonizer_log_startup_timeline(const wp_daemonizer_t *self) {
+  for(int i = 0; i < WP_STARTUP_PHASE_COUNT; i++) {
+    uint64_t ns = wp_daemonizer_get_startup_phase_ns(self, (wp_startup_phase_t)i);
+    wp_log(stdout, self->data->config, LOG_INFO, "startup %-12s: %llu.%03llu ms", startup_phase_names[i],
+           (unsigned long long)(ns / 1000000), (unsigned long long)((ns / 1000) % 1000));
+  }
+}
+
+static void wp_daemonizer_log_pool_line(const char *line, void *arg) {
+  const wp_configuration_t *config = arg;
+  wp_log(stdout, config, LOG_INFO, "%s", line);
+}
+
+static void wp_daemonizer_log_watchdog_line(const char *line, void *arg) {
+  const wp_configuration_t *config = arg;
+  wp_log(stderr, config, LOG_WARNING, "%s", line);
+}
+
+static void wp_daemonizer_log_pool_report(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  if(wp_pool_report_all(&wp_daemonizer_log_pool_line, self->data->config) == 0) {
+    wp_log(stdout, self->data->config, LOG_INFO, "no pools allocated");
+  }
+}
+
+/**
+ * Bind the configured listen addresses. Runs before the UID is dropped so
+ * that privileged ports can be bound.
+ * @param self pointer to an instance of the daemonizer.
+ * @return WP_SUCCESS on success or when nothing is configured, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_daemonizer_bind_listeners(const wp_daemonizer_t *self) {
+  wp_status_t res = WP_SUCCESS;
+  wp_configuration_t *config = self->data->config;
+
+  if(self->data->listener || config->get_listen_address_count(config) == 0) {
+    return WP_SUCCESS;
+  }
+
+  wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_BIND);
+  if((res = wp_listener_new(&self->data->listener, config)) == WP_SUCCESS) {
+    if((res = self->data->listener->bind(self->data->listener)) != WP_SUCCESS) {
+      wp_listener_delete(self->data->listener);
+      self->data->listener = NULL;
+    }
+  }
+  wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_BIND);
+
+  return res;
+}
+
+/**
+ * Return the listener bound from the listen configuration.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The listener, or NULL if nothing is configured or bound yet.
+ */
+static const wp_listener_t *wp_daemonizer_get_listener(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return self->data->listener;
+}
+
+static wp_status_t wp_daemonizer_pin_thread(const wp_daemonizer_t *self, wp_cpu_role_t role, unsigned index) {
+  assert(self && self->data && role < WP_CPU_ROLE_COUNT);
+  const cpu_set_t *set = self->data->config->get_cpu_affinity(self->data->config, role);
+
+  if(set == NULL) {
+    return WP_SUCCESS;
+  }
+  return role == WP_CPU_ROLE_WORKERS ? wp_cpu_pin_thread_to_nth(set, index) : wp_cpu_pin_thread(set);
+}
+
 /* sed-begin-daemonize */
 static wp_status_t wp_daemonizer_daemonize(const wp_daemonizer_t *self) {
   wp_status_t res = WP_FAILURE;
@@ -137,21 +409,52 @@ static wp_status_t wp_daemonizer_daemonize(const wp_daemonizer_t *self) {
 
   config = self->data->config;
 
+  /* Size the workers from the whole process's CPUs, before pinning narrows them. */
+  wp_log(stdout, config, LOG_INFO, "workers: %u", config->get_worker_count(config));
+  if(self->pin_thread(self, WP_CPU_ROLE_MAIN, 0) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't pin the main thread: %m");
+  }
+
+  if(wp_daemonizer_bind_listeners(self) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "FATAL: Couldn't bind listeners: %m");
+    if(!config->get_enable_daemon(config)) {
+      return WP_FAILURE;
+    }
+    exit(EXIT_FAILURE);
+  }
+
   if(!config->get_enable_daemon(config)) {
     wp_log(stdout, config, LOG_INFO, "Daemon option not enabled, starting main loop: %m");
     return WP_SUCCESS;
   }
 
-  if((res = wp_daemonizer_set_uid(self)) == WP_SUCCESS) {
+  wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_SETUID);
+  res = wp_daemonizer_set_uid(self);
+  wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_SETUID);
+
+  if(res == WP_SUCCESS) {
+    /* The original parent waits on this pipe until the daemon is serving. */
+    int ready_pipe[2];
+    if(pipe2(ready_pipe, O_CLOEXEC) != 0) {
+      wp_log(stderr, self->data->config, LOG_ERR, "FATAL: pipe: %m");
+      exit(EXIT_FAILURE);
+    }
+
+    wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_FORK);
     /* Forking. Opening syslog for exsvcd. */
     if((pid = fork()) < 0) {
       /* fork error */
       /* FATAL: fork: %m */
       exit(EXIT_FAILURE);
     } else if(pid != 0) {
-      exit(EXIT_SUCCESS);
+      /* Skip atexit handlers; the daemon owns the shared state from here on. */
+      close(ready_pipe[1]);
+      _exit(wp_daemonizer_wait_for_ready(ready_pipe[0]) == WP_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
     }
 
+    close(ready_pipe[0]);
+    self->data->ready_fd = ready_pipe[1];
+
     umask(027);
 
     sid = setsid(); /* get a new process group. */
@@ -178,22 +481,34 @@ static wp_status_t wp_daemonizer_daemonize(const wp_daemonizer_t *self) {
       wp_log(stderr, self->data->config, LOG_ERR, "FATAL: fork: %m");
       exit(EXIT_FAILURE);
     } else if(pid != 0) {
-      /* parent */
-      exit(EXIT_SUCCESS);
+      /* parent: like the original parent, skip atexit so shutdown can't tear down the daemon's sockets. */
+      _exit(EXIT_SUCCESS);
     }
 
+    wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_FORK);
+
+    /* Clear of the terminal now, so SIGHUP can go back to reloading. */
+    self->install_signal_handlers();
+
     char *run_path = config->get_run_folder_path(config);
-    if(chdir(run_path) == 0) {
+    wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_CHDIR);
+    int chdir_res = chdir(run_path);
+    wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_CHDIR);
+    if(chdir_res == 0) {
+      wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_PID_LOCK);
       if(wp_daemonizer_set_pid_lock(self) != WP_SUCCESS) {
         exit(EXIT_FAILURE);
       }
+      wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_PID_LOCK);
     } else { 
       wp_log(stderr, self->data->config, LOG_ERR, "FATAL: chdir: %m");
       exit(EXIT_FAILURE);
     }
     
     /* redirect stdin, out, err to NULL */
+    wp_daemonizer_phase_begin(self, WP_STARTUP_PHASE_REDIRECT_FDS);
     wp_daemonizer_null_file_descriptors(self);
+    wp_daemonizer_phase_end(self, WP_STARTUP_PHASE_REDIRECT_FDS);
 
     return WP_SUCCESS;
   } else {
@@ -205,47 +520,342 @@ static wp_status_t wp_daemonizer_daemonize(const wp_daemonizer_t *self) {
 }
 /* sed-end-daemonize */
 
+/**
+ * Release everything the daemon holds, the pid lock last so that a
+ * replacement can't start while the state pool is still locked. Runs at exit,
+ * after start has returned.
+ */
 static void wp_daemonizer_shutdown() {
   /* Perform cleanup here */
   if(instance) {
     if(instance->data) {
+      wp_configuration_t *config = instance->data->config;
+
+      if(instance->data->watchdog) {
+        instance->data->watchdog->stop(instance->data->watchdog);
+        instance->data->watchdog->report(instance->data->watchdog, &wp_daemonizer_log_watchdog_line, config);
+        wp_watchdog_delete(instance->data->watchdog);
+        instance->data->watchdog = NULL;
+      }
+
+      if(instance->data->profiler) {
+        instance->data->profiler->stop(instance->data->profiler);
+        if(config->get_profiler_dump(config) && config->get_run_folder_path(config) == NULL) {
+          wp_log(stderr, config, LOG_WARNING, "profiler_dump is set but there is no run folder; the profile isn't written");
+        } else if(config->get_profiler_dump(config)) {
+          char path[PATH_MAX];
+          wp_fmt_t fmt;
+          wp_fmt_init(&fmt, path, sizeof(path));
+          wp_fmt_str(&fmt, config->get_run_folder_path(config));
+          wp_fmt_str(&fmt, "/profile.");
+          wp_fmt_i64(&fmt, (int64_t)getpid());
+          wp_fmt_str(&fmt, ".folded");
+          if(fmt.truncated) {
+            wp_log(stderr, config, LOG_ERR, "The profile path is too long");
+          } else {
+            instance->dump_profile(instance, path);
+          }
+        }
+        wp_profiler_delete(instance->data->profiler);
+        instance->data->profiler = NULL;
+      }
+
+      /* Whatever is still allocated now was leaked or is about to be. */
+      instance->log_pool_report(instance);
+
+      if(instance->data->listener) {
+        wp_listener_delete(instance->data->listener);
+        instance->data->listener = NULL;
+      }
+      if(instance->data->state_pool) {
+        wp_pool_delete(instance->data->state_pool);
+        instance->data->state_pool = NULL;
+      }
+      if(instance->data->supervisor) {
+        wp_supervisor_delete(instance->data->supervisor);
+        instance->data->supervisor = NULL;
+      }
+      if(instance->data->client_limiter) {
+        wp_rate_limiter_delete(instance->data->client_limiter);
+        instance->data->client_limiter = NULL;
+      }
+      if(instance->data->concurrency_limiter) {
+        wp_concurrency_limiter_delete(instance->data->concurrency_limiter);
+        instance->data->concurrency_limiter = NULL;
+      }
+      if(instance->data->fibers) {
+        wp_fiber_scheduler_delete(instance->data->fibers);
+        instance->data->fibers = NULL;
+      }
+      if(instance->data->wheel) {
+        wp_timer_wheel_delete(instance->data->wheel);
+        instance->data->wheel = NULL;
+      }
+      if(instance->data->loop) {
+        if(signal_pipe[0] > -1) {
+          instance->data->loop->remove(instance->data->loop, signal_pipe[0]);
+        }
+        wp_event_loop_delete(instance->data->loop);
+        instance->data->loop = NULL;
+      }
+
       /* Naive removal of the pid lock. */
-      wp_configuration_t *config = NULL;
-      config = instance->data->config;
       if(config && config->get_enable_daemon(config) && instance->data->created_pid_lock_file > 0) {
         /* only need to remove the lock file if we're daemonized... */
         char *lock_file_name = NULL;
         lock_file_name = config->get_lock_file_path(config);
         remove(lock_file_name);
-        wp_log(stderr, instance->data->config, LOG_ERR, "Removed lock file: %s: %m", lock_file_name);
+        wp_log(stderr, config, LOG_ERR, "Removed lock file: %s: %m", lock_file_name);
 
         /* TODO: Revise the removal of the configuration instance... */
-        wp_configuration_delete(instance->data->config);
+        wp_configuration_delete(config);
       }
+
+      fflush(stdout);
+      fflush(stderr);
+      closelog();
       free(instance->data);
       instance->data = NULL;
     }
     free(instance);
     instance = NULL;
   }
-  exit(EXIT_SUCCESS);
 }
 
 /**
- * Handle signals from the OS.
+ * Handle signals from the OS. Only async-signal-safe work happens here: the
+ * signal is queued for the main loop, which acts on it in
+ * wp_daemonizer_on_signal.
  * @param sig The signal to process.
  */
 static void wp_daemonizer_signal_handler(int sig) {
-  switch(sig) {
-    case SIGHUP:
-      /* reload configuration, for example */
-      break;
-    case SIGINT:
-    case SIGTERM:
-      /* perform shutdown work */
-      wp_daemonizer_shutdown();
-      break;
+  int saved_errno = errno;
+  unsigned char byte = (unsigned char)sig;
+
+  if(signal_pipe[1] > -1) {
+    /* A full pipe already holds plenty of signals; dropping this one is fine. */
+    ssize_t r = write(signal_pipe[1], &byte, 1);
+    (void)r;
   }
+  errno = saved_errno;
+}
+
+/**
+ * Stop the main loop once the drain is over, so that start returns.
+ * @param self pointer to an instance of the daemonizer.
+ * @param drained whether the work in flight finished, rather than timing out.
+ */
+static void wp_daemonizer_finish_drain(const wp_daemonizer_t *self, bool drained) {
+  uint64_t ms = (wp_daemonizer_now_ns() - self->data->drain_started_at) / 1000000;
+
+  if(self->data->wheel) {
+    self->data->wheel->cancel(self->data->wheel, &self->data->drain_timer);
+  }
+  if(drained) {
+    wp_log(stdout, self->data->config, LOG_INFO, "Drained in %llu ms", (unsigned long long)ms);
+  } else {
+    wp_log(stderr, self->data->config, LOG_WARNING, "Gave up draining after %llu ms", (unsigned long long)ms);
+  }
+  self->data->loop->stop(self->data->loop);
+}
+
+static void wp_daemonizer_on_drain_timer(wp_timer_t *timer, void *arg);
+
+/**
+ * Ask the drain method whether the work in flight is done, and look again
+ * shortly if it isn't and there's time left.
+ * @param self pointer to an instance of the daemonizer.
+ */
+static void wp_daemonizer_check_drain(const wp_daemonizer_t *self) {
+  if(self->data->drain_method == NULL || self->data->drain_method(self, self->data->drain_arg)) {
+    wp_daemonizer_finish_drain(self, true);
+  } else if(wp_daemonizer_now_ns() >= self->data->drain_deadline) {
+    wp_daemonizer_finish_drain(self, false);
+  } else if(self->data->wheel->schedule(self->data->wheel, &self->data->drain_timer, WP_DAEMONIZER_DRAIN_POLL_MS,
+                                        &wp_daemonizer_on_drain_timer, (void *)self) != WP_SUCCESS) {
+    wp_daemonizer_finish_drain(self, false);
+  }
+}
+
+static void wp_daemonizer_on_drain_timer(wp_timer_t *timer, void *arg) {
+  (void)timer;
+  wp_daemonizer_check_drain(arg);
+}
+
+static void wp_daemonizer_begin_shutdown(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  wp_configuration_t *config = self->data->config;
+  unsigned timeout_ms = config->get_shutdown_drain_timeout_ms(config);
+
+  if(self->data->shutting_down) {
+    return;
+  }
+  self->data->shutting_down = true;
+  self->data->drain_started_at = wp_daemonizer_now_ns();
+  self->data->drain_deadline = self->data->drain_started_at + (uint64_t)timeout_ms * 1000000ull;
+  wp_log(stdout, config, LOG_INFO, "Shutting down, draining for up to %u ms", timeout_ms);
+  wp_daemonizer_notify(self, "STOPPING=1");
+
+  /*
+   * Stop accepting. Closed sockets drop out of every loop watching them, and
+   * the kernel sends new connections to whichever instance still has the
+   * port, e.g. our replacement in a rolling deploy.
+   */
+  if(self->data->listener) {
+    for(unsigned w = 0; w < self->data->listener->get_worker_count(self->data->listener); w++) {
+      self->data->listener->detach(self->data->listener, self->data->loop, w);
+    }
+    self->data->listener->close(self->data->listener);
+  }
+
+  if(self->data->wheel == NULL && wp_timer_wheel_new(&self->data->wheel, self->data->loop, WP_DAEMONIZER_DRAIN_POLL_MS) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't create the drain timer: %m");
+    self->data->wheel = NULL;
+    wp_daemonizer_finish_drain(self, false);
+    return;
+  }
+  wp_daemonizer_check_drain(self);
+}
+
+static bool wp_daemonizer_is_shutting_down(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return self->data->shutting_down;
+}
+
+static void wp_daemonizer_handle_signals(const wp_daemonizer_t *self, int fd);
+
+/**
+ * For on start methods that don't run the main loop: act on any queued
+ * signals, then say whether shutdown has begun.
+ * @param self pointer to an instance of the daemonizer.
+ * @return true once SIGTERM or SIGINT arrived, or begin_shutdown was called.
+ */
+static bool wp_daemonizer_should_stop(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  if(signal_pipe[0] > -1) {
+    wp_daemonizer_handle_signals(self, signal_pipe[0]);
+  }
+  return self->data->shutting_down;
+}
+
+static int wp_daemonizer_get_signal_fd(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return signal_pipe[0];
+}
+
+static void wp_daemonizer_set_drain_method(const wp_daemonizer_t *self, wp_drain_method_fn fn, void *arg) {
+  assert(self && self->data);
+  self->data->drain_method = fn;
+  self->data->drain_arg = arg;
+}
+
+/**
+ * Apply the configured limits to the listener and limiters in use.
+ * @param self pointer to an instance of the daemonizer.
+ */
+static void wp_daemonizer_apply_limits(const wp_daemonizer_t *self) {
+  wp_configuration_t *config = self->data->config;
+  unsigned min = config->get_concurrency_limit_min(config);
+  unsigned max = config->get_concurrency_limit_max(config);
+
+  if(self->data->listener) {
+    self->data->listener->set_accept_rate(self->data->listener, config->get_accept_rate_limit(config), config->get_accept_rate_burst(config));
+  }
+  if(self->data->client_limiter) {
+    self->data->client_limiter->set_rate(self->data->client_limiter, config->get_client_rate_limit(config), config->get_client_rate_burst(config));
+  }
+  if(self->data->concurrency_limiter) {
+    /* Off again: a limit nothing reaches. */
+    self->data->concurrency_limiter->set_bounds(self->data->concurrency_limiter, max ? min : UINT_MAX, max ? max : UINT_MAX);
+  }
+}
+
+static wp_status_t wp_daemonizer_reload(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  wp_configuration_t *config = self->data->config;
+
+  if(config->reload(config) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't reload the configuration: %m");
+    return WP_FAILURE;
+  }
+  wp_daemonizer_apply_limits(self);
+  wp_log(stdout, config, LOG_INFO, "Reloaded limits: accept %u/s, client %u/s, concurrency %u to %u",
+         config->get_accept_rate_limit(config), config->get_client_rate_limit(config),
+         config->get_concurrency_limit_min(config), config->get_concurrency_limit_max(config));
+  if(self->data->reconfigure_method) {
+    self->data->reconfigure_method(self, config);
+  }
+  return WP_SUCCESS;
+}
+
+/**
+ * Return the per client rate limiter, creating it on first use.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The limiter, or NULL if client_rate_limit is 0 or it couldn't be created.
+ */
+static const wp_rate_limiter_t *wp_daemonizer_get_client_limiter(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  wp_configuration_t *config = self->data->config;
+
+  if(self->data->client_limiter == NULL && config->get_client_rate_limit(config) > 0
+     && wp_rate_limiter_new(&self->data->client_limiter, WP_DAEMONIZER_CLIENT_SLOTS,
+                            config->get_client_rate_limit(config), config->get_client_rate_burst(config)) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't create the client rate limiter: %m");
+  }
+  return self->data->client_limiter;
+}
+
+/**
+ * Return the adaptive concurrency limiter, creating it on first use.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The limiter, or NULL if concurrency_limit_max is 0 or it couldn't be created.
+ */
+static const wp_concurrency_limiter_t *wp_daemonizer_get_concurrency_limiter(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  wp_configuration_t *config = self->data->config;
+
+  if(self->data->concurrency_limiter == NULL && config->get_concurrency_limit_max(config) > 0
+     && wp_concurrency_limiter_new(&self->data->concurrency_limiter, config->get_concurrency_limit_min(config),
+                                   config->get_concurrency_limit_max(config)) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't create the concurrency limiter: %m");
+  }
+  return self->data->concurrency_limiter;
+}
+
+/**
+ * Act on the signals queued by wp_daemonizer_signal_handler: SIGHUP reloads,
+ * SIGTERM and SIGINT shut down.
+ * @param self pointer to an instance of the daemonizer.
+ * @param fd the read end of the signal pipe.
+ */
+static void wp_daemonizer_handle_signals(const wp_daemonizer_t *self, int fd) {
+  unsigned char sigs[64];
+  ssize_t r;
+
+  while((r = read(fd, sigs, sizeof(sigs))) > 0) {
+    for(ssize_t i = 0; i < r; i++) {
+      switch(sigs[i]) {
+        case SIGHUP:
+          wp_daemonizer_reload(self);
+          break;
+        case SIGINT:
+        case SIGTERM:
+          if(self->data->shutting_down) {
+            /* Asked twice: stop waiting for the drain. */
+            wp_daemonizer_finish_drain(self, false);
+          } else {
+            wp_daemonizer_begin_shutdown(self);
+          }
+          break;
+      }
+    }
+  }
+}
+
+/* Event loop handler for the signal pipe. */
+static void wp_daemonizer_on_signal(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  (void)loop; (void)events;
+  wp_daemonizer_handle_signals(arg, fd);
 }
 
 /**
@@ -257,45 +867,225 @@ static wp_daemonizer_t *wp_daemonizer_get_instance() {
 }
 
 /**
- * Signup for signal events. Right now, we are interested in child, hang up,
- * terminate and interrupt.
+ * Signup for signal events. Right now, we are interested in hang up,
+ * terminate and interrupt, which are queued on the signal pipe for the main
+ * loop. SIGCHLD keeps its default disposition so that exited children stay
+ * waitable: the supervisor reaps its own helpers, and ignoring it would have
+ * the kernel reap them before their status is read.
  */
 static void wp_daemonizer_install_signal_handlers() {
-  signal(SIGCHLD, wp_daemonizer_signal_handler);
+  struct sigaction sa;
+
+  if(signal_pipe[0] < 0 && pipe2(signal_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+    signal_pipe[0] = signal_pipe[1] = -1;
+  }
+
+  signal(SIGCHLD, SIG_DFL);
   signal(SIGTSTP, SIG_IGN);
   signal(SIGTTOU, SIG_IGN);
   signal(SIGTTIN, SIG_IGN);
-  signal(SIGHUP,  wp_daemonizer_signal_handler);
-  signal(SIGTERM, wp_daemonizer_signal_handler);
-  signal(SIGINT, wp_daemonizer_signal_handler);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = wp_daemonizer_signal_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
 }
 
 /**
- * The main daemon loop. Eventually we will delegate responsibility to a method
- * for processing messages. For now, we just loop.
- * @param self pointer to an instance of the daemonizer. Not utilized at this time.
- * @return WP_SUCCESS
+ * Return the daemon's main event loop.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The event loop.
+ */
+static const wp_event_loop_t *wp_daemonizer_get_event_loop(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return self->data->loop;
+}
+
+/**
+ * Return the fiber scheduler attached to the main loop, creating it on first use.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The scheduler, or NULL if it couldn't be created.
+ */
+static const wp_fiber_scheduler_t *wp_daemonizer_get_fiber_scheduler(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  if(self->data->fibers == NULL && wp_fiber_scheduler_new(&self->data->fibers, self->data->loop, 0) != WP_SUCCESS) {
+    wp_log(stderr, self->data->config, LOG_ERR, "Couldn't create the fiber scheduler: %m");
+  }
+  return self->data->fibers;
+}
+
+/**
+ * Return the persistent state pool, opening it on first use.
+ * @param self pointer to an instance of the daemonizer.
+ * @param layout the caller's version of what it keeps in the pool.
+ * @param reattached_out set to whether the last run's contents were kept; may be NULL.
+ * @return The pool, or NULL if it's off or couldn't be opened.
+ */
+static const wp_pool_t *wp_daemonizer_get_state_pool(const wp_daemonizer_t *self, uint32_t layout, bool *reattached_out) {
+  assert(self && self->data);
+  wp_configuration_t *config = self->data->config;
+  size_t size = config->get_state_pool_size(config);
+  char path[PATH_MAX];
+  wp_fmt_t fmt;
+
+  if(self->data->state_pool == NULL && size > 0 && config->get_run_folder_path(config) == NULL) {
+    wp_log(stderr, config, LOG_WARNING, "state_pool_size is set but there is no run folder; the state pool is off");
+  } else if(self->data->state_pool == NULL && size > 0) {
+    wp_fmt_init(&fmt, path, sizeof(path));
+    wp_fmt_str(&fmt, config->get_run_folder_path(config));
+    wp_fmt_str(&fmt, "/wpd.state");
+    if(fmt.truncated) {
+      wp_log(stderr, config, LOG_ERR, "The state pool path is too long");
+    } else if(wp_pool_new_persistent(&self->data->state_pool, path, size, layout, &self->data->state_pool_reattached) != WP_SUCCESS) {
+      wp_log(stderr, config, LOG_ERR, "Couldn't open the state pool %s: %m", path);
+      self->data->state_pool = NULL;
+    } else {
+      self->data->state_pool->set_name(self->data->state_pool, "state");
+      wp_log(stdout, config, LOG_INFO, "state pool %s: %s", path, self->data->state_pool_reattached ? "reattached" : "started empty");
+    }
+  }
+  if(reattached_out) {
+    *reattached_out = self->data->state_pool && self->data->state_pool_reattached;
+  }
+  return self->data->state_pool;
+}
+
+/**
+ * Return the helper process supervisor on the main loop, creating it on first use.
+ * @param self pointer to an instance of the daemonizer.
+ * @return The supervisor, or NULL if it couldn't be created.
+ */
+static const wp_supervisor_t *wp_daemonizer_get_supervisor(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  if(self->data->supervisor == NULL && wp_supervisor_new(&self->data->supervisor, self->data->loop) != WP_SUCCESS) {
+    wp_log(stderr, self->data->config, LOG_ERR, "Couldn't create the supervisor: %m");
+  }
+  return self->data->supervisor;
+}
+
+/**
+ * Ping the service manager's watchdog while the loops are healthy: at half
+ * the interval it asked for in $WATCHDOG_USEC. Runs on the watchdog thread.
+ * @param arg the daemonizer.
+ */
+static void wp_daemonizer_watchdog_healthy(void *arg) {
+  const wp_daemonizer_t *self = arg;
+  uint64_t now = wp_daemonizer_now_ns();
+
+  if(self->data->watchdog_interval_ns && now - self->data->watchdog_pinged_at >= self->data->watchdog_interval_ns / 2) {
+    self->data->watchdog_pinged_at = now;
+    wp_daemonizer_notify(self, "WATCHDOG=1");
+  }
+}
+
+/**
+ * Start the watchdog on the main loop, if one is configured.
+ * @param self pointer to an instance of the daemonizer.
+ */
+static void wp_daemonizer_start_watchdog(const wp_daemonizer_t *self) {
+  wp_configuration_t *config = self->data->config;
+  unsigned budget_ms = config->get_watchdog_budget_ms(config);
+  const char *usec = getenv("WATCHDOG_USEC");
+
+  if(budget_ms == 0 || self->data->watchdog) {
+    return;
+  }
+  if(wp_watchdog_new(&self->data->watchdog, budget_ms, &wp_daemonizer_log_watchdog_line, config) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't create the watchdog: %m");
+    return;
+  }
+
+  self->data->watchdog_interval_ns = usec ? strtoull(usec, NULL, 10) * 1000ull : 0;
+  self->data->watchdog_pinged_at = wp_daemonizer_now_ns();
+  self->data->watchdog->set_healthy_method(self->data->watchdog, &wp_daemonizer_watchdog_healthy, (void *)self);
+  if(self->data->watchdog->watch(self->data->watchdog, self->data->loop, "main") != WP_SUCCESS
+     || self->data->watchdog->start(self->data->watchdog) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't start the watchdog: %m");
+    wp_watchdog_delete(self->data->watchdog);
+    self->data->watchdog = NULL;
+  }
+}
+
+/**
+ * Start the profiler on the main thread, if one is configured.
+ * @param self pointer to an instance of the daemonizer.
+ */
+static void wp_daemonizer_start_profiler(const wp_daemonizer_t *self) {
+  wp_configuration_t *config = self->data->config;
+  unsigned hz = config->get_profiler_hz(config);
+
+  if(hz == 0 || self->data->profiler) {
+    return;
+  }
+  if(wp_profiler_new(&self->data->profiler, hz) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't create the profiler: %m");
+    return;
+  }
+  if(self->data->profiler->register_thread(self->data->profiler, "main") != WP_SUCCESS
+     || self->data->profiler->start(self->data->profiler) != WP_SUCCESS) {
+    wp_log(stderr, config, LOG_ERR, "Couldn't start the profiler: %m");
+    wp_profiler_delete(self->data->profiler);
+    self->data->profiler = NULL;
+  }
+}
+
+static const wp_profiler_t *wp_daemonizer_get_profiler(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return self->data->profiler;
+}
+
+static wp_status_t wp_daemonizer_dump_profile(const wp_daemonizer_t *self, const char *path) {
+  assert(self && self->data && path);
+  wp_status_t res = WP_FAILURE;
+  FILE *out = NULL;
+
+  if(self->data->profiler == NULL) {
+    return WP_FAILURE;
+  }
+  if((out = fopen(path, "we"))) {
+    res = self->data->profiler->dump(self->data->profiler, out);
+    if(fclose(out) != 0) {
+      res = WP_FAILURE;
+    }
+  }
+  if(res != WP_SUCCESS) {
+    wp_log(stderr, self->data->config, LOG_ERR, "Couldn't write the profile to %s: %m", path);
+  }
+  return res;
+}
+
+static const wp_watchdog_t *wp_daemonizer_get_watchdog(const wp_daemonizer_t *self) {
+  assert(self && self->data);
+  return self->data->watchdog;
+}
+
+/**
+ * The main daemon loop. Delegates to the configured on start method, or runs
+ * the event loop when there isn't one.
+ * @param self pointer to an instance of the daemonizer.
+ * @return WP_SUCCESS, or WP_FAILURE if the event loop failed.
  */
 static wp_status_t wp_daemonizer_on_start(const wp_daemonizer_t *self) {
   assert(self); /* make compiler happy */
-  sigset_t mask, oldmask;  
+  wp_status_t res = WP_SUCCESS;
   wp_daemon_on_start_method_fn start_fn = self->data->config->get_daemon_on_start_method(self->data->config);
   
+  wp_daemonizer_start_watchdog(self);
+  wp_daemonizer_start_profiler(self);
+
+  if(self->data->config->get_enable_ready_on_start(self->data->config)) {
+    self->notify_ready(self);
+  }
   
   if(start_fn != NULL) {
     start_fn(self);
   } else {
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGUSR1);
-    sigprocmask(SIG_BLOCK, &mask, &oldmask);
-
-    while(true) {
-      sigsuspend(&oldmask);
-    }
-    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    res = self->data->loop->run(self->data->loop);
   }
   
-  return WP_SUCCESS;
+  return res;
 }
 
 /* sed-begin-daemonizer-initialize */
@@ -308,16 +1098,19 @@ wp_status_t wp_daemonizer_initialize(wp_daemonizer_t **out, wp_reconfigure_metho
   wp_status_t ret = WP_FAILURE;
   wp_configuration_pt config = NULL;
   wp_daemonizer_pt self = NULL;
+  uint64_t started_at = 0, config_loaded_at = 0;
   
   if(instance) {
     ret = WP_SUCCESS;
   } else {
+    started_at = wp_daemonizer_now_ns();
     
     if((ret = wp_configuration_new(&config)) != WP_SUCCESS) {
       /* TODO: Print out some help. */
       wp_configuration_delete(config);
     } else {
       config->populate_from_file(config, NULL);
+      config_loaded_at = wp_daemonizer_now_ns();
       /* config->populate_from_args(config, argc, argv); 
       if(config->get_print_arguments(config) || config->get_print_config_options(config)) {
         config->configuration_print(config);
@@ -325,28 +1118,78 @@ wp_status_t wp_daemonizer_initialize(wp_daemonizer_t **out, wp_reconfigure_metho
       */
       
       if((self = malloc(sizeof(*self)))) {
-        if((self->data = malloc(sizeof(*(self->data))))) {
+        if((self->data = malloc(sizeof(*(self->data)))) && wp_event_loop_new(&self->data->loop) == WP_SUCCESS) {
           /* TODO: Load from the command line or config file. */
           self->data->config = config;
           self->data->created_pid_lock_file = 0;
           self->data->reconfigure_method = on_reconfigure;
+          self->data->listener = NULL;
+          self->data->fibers = NULL;
+          self->data->supervisor = NULL;
+          self->data->state_pool = NULL;
+          self->data->state_pool_reattached = false;
+          self->data->watchdog = NULL;
+          self->data->profiler = NULL;
+          self->data->client_limiter = NULL;
+          self->data->concurrency_limiter = NULL;
+          self->data->watchdog_pinged_at = 0;
+          self->data->watchdog_interval_ns = 0;
+          self->data->shutting_down = false;
+          self->data->drain_method = NULL;
+          self->data->drain_arg = NULL;
+          self->data->wheel = NULL;
+          wp_timer_init(&self->data->drain_timer);
+          self->data->drain_started_at = 0;
+          self->data->drain_deadline = 0;
+          self->data->ready_fd = -1;
+          self->data->notified_ready = false;
+          memset(self->data->phases, 0, sizeof(self->data->phases));
+          self->data->phases[WP_STARTUP_PHASE_CONFIG_LOAD].begin = started_at;
+          self->data->phases[WP_STARTUP_PHASE_CONFIG_LOAD].end = config_loaded_at;
+          self->data->phases[WP_STARTUP_PHASE_READY].begin = started_at;
           
           /* Setup some static and instance methods... */
           self->daemonize = &wp_daemonizer_daemonize;
           self->signal_handler = &wp_daemonizer_signal_handler;
           self->shutdown = &wp_daemonizer_shutdown;
+          self->begin_shutdown = &wp_daemonizer_begin_shutdown;
+          self->is_shutting_down = &wp_daemonizer_is_shutting_down;
+          self->should_stop = &wp_daemonizer_should_stop;
+          self->get_signal_fd = &wp_daemonizer_get_signal_fd;
+          self->set_drain_method = &wp_daemonizer_set_drain_method;
+          self->reload = &wp_daemonizer_reload;
+          self->get_client_limiter = &wp_daemonizer_get_client_limiter;
+          self->get_concurrency_limiter = &wp_daemonizer_get_concurrency_limiter;
           self->install_signal_handlers = &wp_daemonizer_install_signal_handlers;
           self->get_instance = &wp_daemonizer_get_instance;
           self->start = &wp_daemonizer_on_start;
+          self->get_event_loop = &wp_daemonizer_get_event_loop;
+          self->get_listener = &wp_daemonizer_get_listener;
+          self->get_fiber_scheduler = &wp_daemonizer_get_fiber_scheduler;
+          self->get_supervisor = &wp_daemonizer_get_supervisor;
+          self->get_state_pool = &wp_daemonizer_get_state_pool;
+          self->get_watchdog = &wp_daemonizer_get_watchdog;
+          self->get_profiler = &wp_daemonizer_get_profiler;
+          self->dump_profile = &wp_daemonizer_dump_profile;
+          self->notify_ready = &wp_daemonizer_notify_ready;
+          self->notify = &wp_daemonizer_notify;
+          self->get_startup_phase_ns = &wp_daemonizer_get_startup_phase_ns;
+          self->log_startup_timeline = &wp_daemonizer_log_startup_timeline;
+          self->log_pool_report = &wp_daemonizer_log_pool_report;
+          self->pin_thread = &wp_daemonizer_pin_thread;
           
           /* Let's try to reconfigure ourselves.*/
           on_reconfigure(self, config);
 
           /* By default, install the signal handlers. Will probably change. */
           self->install_signal_handlers();
+          if(signal_pipe[0] < 0 || self->data->loop->add(self->data->loop, signal_pipe[0], EPOLLIN, &wp_daemonizer_on_signal, self) != WP_SUCCESS) {
+            wp_log(stderr, config, LOG_ERR, "Couldn't watch for signals, so they won't shut down gracefully: %m");
+          }
           instance = self;
           ret = WP_SUCCESS;
         } else {
+          free(self->data);
           free(self);
           self = NULL;
         }
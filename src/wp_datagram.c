@@ -0,0 +1,366 @@
+/*
+ * File:   wp_datagram.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:36 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_pool.h>
+#include <wp_datagram.h>
+
+/* Older headers predate UDP segmentation offload. */
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+/* recvmmsg calls per wakeup before yielding back to the loop. */
+#define WP_DATAGRAM_MAX_ROUNDS 16
+/* The kernel refuses a UDP_SEGMENT send of more segments than this (UDP_MAX_SEGMENTS). */
+#define WP_DATAGRAM_MAX_SEGMENTS 64
+
+typedef struct wp_datagram_registration {
+  struct wp_datagram_registration *next;
+  const wp_datagram_batch_t *batch;
+  int fd;
+  wp_datagram_batch_fn fn;
+  void *arg;
+} wp_datagram_registration_t;
+
+typedef struct __wp_datagram_batch_private_t {
+  /* A child of the caller's pool holding everything below, handed back on delete. */
+  wp_pool_t *pool;
+  size_t capacity;
+  size_t buffer_size;
+  bool enable_gro;
+
+  /* Receive side. */
+  char *buffers;
+  char *control;
+  struct iovec *iovs;
+  struct mmsghdr *msgs;
+  wp_datagram_t *datagrams;
+
+  /* Send side is separate so received datagrams can be echoed back. */
+  char *send_control;
+  struct iovec *send_iovs;
+  struct mmsghdr *send_msgs;
+
+  wp_datagram_registration_t *registrations;
+} __wp_datagram_batch_private_t;
+
+#define WP_DATAGRAM_RECV_CONTROL CMSG_SPACE(sizeof(int))
+#define WP_DATAGRAM_SEND_CONTROL CMSG_SPACE(sizeof(uint16_t))
+
+static int wp_datagram_batch_recv(const wp_datagram_batch_t *self, int fd) {
+  assert(self && self->data);
+  __wp_datagram_batch_private_t *d = self->data;
+  int n;
+
+  for(size_t i = 0; i < d->capacity; i++) {
+    d->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    d->msgs[i].msg_hdr.msg_controllen = d->enable_gro ? WP_DATAGRAM_RECV_CONTROL : 0;
+    d->msgs[i].msg_hdr.msg_flags = 0;
+  }
+
+  do {
+    n = recvmmsg(fd, d->msgs, (unsigned)d->capacity, MSG_DONTWAIT, NULL);
+  } while(n < 0 && errno == EINTR);
+
+  for(int i = 0; i < n; i++) {
+    wp_datagram_t *dg = &d->datagrams[i];
+    struct msghdr *hdr = &d->msgs[i].msg_hdr;
+
+    dg->data = d->buffers + (size_t)i * d->buffer_size;
+    dg->len = d->msgs[i].msg_len;
+    dg->addr_len = hdr->msg_namelen;
+    dg->segment_size = 0;
+
+    if(d->enable_gro) {
+      for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int segment_size;
+          memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+          if(segment_size > 0 && (size_t)segment_size < dg->len) {
+            dg->segment_size = (size_t)segment_size;
+          }
+        }
+      }
+    }
+  }
+
+  return n;
+}
+
+static wp_datagram_t *wp_datagram_batch_get(const wp_datagram_batch_t *self, size_t index) {
+  assert(self && self->data && index < self->data->capacity);
+  return &self->data->datagrams[index];
+}
+
+/**
+ * The bytes of a datagram that go in its next message, starting offset bytes
+ * in. A GSO send larger than the kernel takes in one message is split.
+ * @param dg the datagram.
+ * @param offset the bytes of it already sent.
+ * @return the length of the next message.
+ */
+static size_t wp_datagram_next_piece(const wp_datagram_t *dg, size_t offset) {
+  size_t piece = dg->len - offset;
+  if(dg->segment_size && piece > WP_DATAGRAM_MAX_SEGMENTS * dg->segment_size) {
+    piece = WP_DATAGRAM_MAX_SEGMENTS * dg->segment_size;
+  }
+  return piece;
+}
+
+static int wp_datagram_batch_send(const wp_datagram_batch_t *self, int fd, const wp_datagram_t *datagrams, size_t count) {
+  assert(self && self->data && (datagrams || count == 0));
+  __wp_datagram_batch_private_t *d = self->data;
+  size_t sent = 0;
+  /* Bytes of datagrams[sent] already out, when it's split over several messages. */
+  size_t offset = 0;
+
+  while(sent < count) {
+    size_t chunk = 0;
+
+    for(size_t index = sent, off = offset; chunk < d->capacity && index < count; chunk++) {
+      const wp_datagram_t *dg = &datagrams[index];
+      struct msghdr *hdr = &d->send_msgs[chunk].msg_hdr;
+      size_t piece = wp_datagram_next_piece(dg, off);
+
+      d->send_iovs[chunk].iov_base = dg->data + off;
+      d->send_iovs[chunk].iov_len = piece;
+      hdr->msg_name = (void *)&dg->addr;
+      hdr->msg_namelen = dg->addr_len;
+      hdr->msg_iov = &d->send_iovs[chunk];
+      hdr->msg_iovlen = 1;
+      hdr->msg_flags = 0;
+      hdr->msg_control = NULL;
+      hdr->msg_controllen = 0;
+
+      if(dg->segment_size && dg->segment_size < piece) {
+        /* UDP GSO: the kernel (or NIC) splits the buffer into segments. */
+        uint16_t segment_size = (uint16_t)dg->segment_size;
+        hdr->msg_control = d->send_control + chunk * WP_DATAGRAM_SEND_CONTROL;
+        hdr->msg_controllen = WP_DATAGRAM_SEND_CONTROL;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+      }
+
+      if((off += piece) == dg->len) {
+        index++;
+        off = 0;
+      }
+    }
+
+    int r = sendmmsg(fd, d->send_msgs, (unsigned)chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(r < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    /* Walk the messages that went out again to see how far they got. */
+    for(int i = 0; i < r; i++) {
+      if((offset += wp_datagram_next_piece(&datagrams[sent], offset)) == datagrams[sent].len) {
+        sent++;
+        offset = 0;
+      }
+    }
+    if((size_t)r < chunk) {
+      break;
+    }
+  }
+
+  return (int)sent;
+}
+
+static wp_status_t wp_datagram_batch_send_segmented(const wp_datagram_batch_t *self, int fd, const void *data, size_t len,
+                                                    size_t segment_size, const struct sockaddr *addr, socklen_t addr_len) {
+  assert(self && self->data && data);
+  wp_datagram_t dg;
+
+  if(addr_len > sizeof(dg.addr) || segment_size > UINT16_MAX) {
+    return WP_FAILURE;
+  }
+
+  dg.data = (char *)data;
+  dg.len = len;
+  dg.segment_size = segment_size;
+  memcpy(&dg.addr, addr, addr_len);
+  dg.addr_len = addr_len;
+
+  return wp_datagram_batch_send(self, fd, &dg, 1) == 1 ? WP_SUCCESS : WP_FAILURE;
+}
+
+/**
+ * Event loop handler: receive batches until the socket is empty or the round
+ * budget is used up; the socket is level triggered.
+ */
+static void wp_datagram_batch_on_readable(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_datagram_registration_t *reg = arg;
+  const wp_datagram_batch_t *self = reg->batch;
+  (void)loop; (void)events;
+
+  for(int round = 0; round < WP_DATAGRAM_MAX_ROUNDS; round++) {
+    int n = wp_datagram_batch_recv(self, fd);
+    if(n <= 0) {
+      break;
+    }
+    reg->fn(self, fd, self->data->datagrams, (size_t)n, reg->arg);
+    if((size_t)n < self->data->capacity) {
+      break;
+    }
+  }
+}
+
+static wp_status_t wp_datagram_batch_attach(const wp_datagram_batch_t *self, const wp_event_loop_t *loop, int fd,
+                                            wp_datagram_batch_fn fn, void *arg) {
+  assert(self && self->data && loop && fn);
+  wp_datagram_registration_t *reg = NULL;
+
+  if(self->data->enable_gro) {
+    /* Falls back to one datagram per buffer where GRO isn't supported. */
+    int on = 1;
+    setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+  }
+
+  if((reg = malloc(sizeof(*reg))) == NULL) {
+    return WP_FAILURE;
+  }
+  reg->batch = self;
+  reg->fd = fd;
+  reg->fn = fn;
+  reg->arg = arg;
+
+  if(loop->add(loop, fd, EPOLLIN, &wp_datagram_batch_on_readable, reg) != WP_SUCCESS) {
+    free(reg);
+    return WP_FAILURE;
+  }
+
+  reg->next = self->data->registrations;
+  self->data->registrations = reg;
+  return WP_SUCCESS;
+}
+
+static void wp_datagram_batch_detach(const wp_datagram_batch_t *self, const wp_event_loop_t *loop, int fd) {
+  assert(self && self->data && loop);
+  wp_datagram_registration_t **link = &self->data->registrations;
+
+  while(*link) {
+    wp_datagram_registration_t *reg = *link;
+    if(reg->fd == fd) {
+      loop->remove(loop, fd);
+      *link = reg->next;
+      free(reg);
+    } else {
+      link = &reg->next;
+    }
+  }
+}
+
+static size_t wp_datagram_batch_get_capacity(const wp_datagram_batch_t *self) {
+  assert(self && self->data);
+  return self->data->capacity;
+}
+
+wp_status_t wp_datagram_batch_new(wp_datagram_batch_t **self_out, const wp_pool_t *pool,
+                                  size_t capacity, size_t buffer_size, bool enable_gro) {
+  assert(pool && capacity && buffer_size);
+  wp_status_t ret = WP_FAILURE;
+  wp_datagram_batch_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      __wp_datagram_batch_private_t *d = self->data;
+      d->capacity = capacity;
+      d->buffer_size = buffer_size;
+      d->enable_gro = enable_gro;
+
+      if(wp_pool_new_child(&d->pool, pool) == WP_SUCCESS) {
+        d->buffers = d->pool->palloc(d->pool, capacity * buffer_size);
+        d->control = d->pool->palloc(d->pool, capacity * WP_DATAGRAM_RECV_CONTROL);
+        d->iovs = d->pool->palloc(d->pool, capacity * sizeof(*d->iovs));
+        d->msgs = d->pool->palloc(d->pool, capacity * sizeof(*d->msgs));
+        d->datagrams = d->pool->palloc(d->pool, capacity * sizeof(*d->datagrams));
+        d->send_control = d->pool->palloc(d->pool, capacity * WP_DATAGRAM_SEND_CONTROL);
+        d->send_iovs = d->pool->palloc(d->pool, capacity * sizeof(*d->send_iovs));
+        d->send_msgs = d->pool->palloc(d->pool, capacity * sizeof(*d->send_msgs));
+      }
+
+      if(d->pool && d->buffers && d->control && d->iovs && d->msgs && d->datagrams && d->send_control && d->send_iovs && d->send_msgs) {
+        memset(d->msgs, 0, capacity * sizeof(*d->msgs));
+        memset(d->send_msgs, 0, capacity * sizeof(*d->send_msgs));
+        memset(d->send_control, 0, capacity * WP_DATAGRAM_SEND_CONTROL);
+        for(size_t i = 0; i < capacity; i++) {
+          d->iovs[i].iov_base = d->buffers + i * buffer_size;
+          d->iovs[i].iov_len = buffer_size;
+          d->msgs[i].msg_hdr.msg_name = &d->datagrams[i].addr;
+          d->msgs[i].msg_hdr.msg_iov = &d->iovs[i];
+          d->msgs[i].msg_hdr.msg_iovlen = 1;
+          d->msgs[i].msg_hdr.msg_control = d->control + i * WP_DATAGRAM_RECV_CONTROL;
+          d->datagrams[i].data = d->buffers + i * buffer_size;
+          d->datagrams[i].len = 0;
+        }
+
+        self->recv = &wp_datagram_batch_recv;
+        self->get = &wp_datagram_batch_get;
+        self->send = &wp_datagram_batch_send;
+        self->send_segmented = &wp_datagram_batch_send_segmented;
+        self->attach = &wp_datagram_batch_attach;
+        self->detach = &wp_datagram_batch_detach;
+        self->get_capacity = &wp_datagram_batch_get_capacity;
+        ret = WP_SUCCESS;
+      } else {
+        if(d->pool) {
+          wp_pool_delete(d->pool);
+        }
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_datagram_batch_delete(wp_datagram_batch_t *self) {
+  assert(self);
+  if(self->data) {
+    /* Registrations still on a loop are the caller's to detach first. */
+    wp_datagram_registration_t *reg = self->data->registrations;
+    while(reg) {
+      wp_datagram_registration_t *next = reg->next;
+      free(reg);
+      reg = next;
+    }
+    wp_pool_delete(self->data->pool);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
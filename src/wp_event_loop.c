@@ -0,0 +1,491 @@
+/*
+ * File:   wp_event_loop.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:17 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_pool.h>
+
+#define WP_EVENT_LOOP_BATCH 64
+/* Distinct handler functions timed per loop; the rest share the last entry. */
+#define WP_EVENT_LOOP_CALLBACKS 32
+/* Block size of request arenas, and how many idle ones a loop keeps. */
+#define WP_EVENT_LOOP_ARENA_SIZE 16384
+#define WP_EVENT_LOOP_IDLE_ARENAS 1024
+
+typedef struct wp_event_handler {
+  wp_event_handler_fn fn;
+  void *arg;
+  /* Bumped by every add and remove; events carry the one they were registered under. */
+  uint32_t generation;
+  /* The fd's request arena, if get_arena made one. */
+  wp_pool_t *arena;
+} wp_event_handler_t;
+
+typedef struct __wp_event_loop_private_t {
+  int epoll_fd;
+  volatile sig_atomic_t running;
+
+  /* Handlers are indexed by fd; fds are small and dense. */
+  wp_event_handler_t *handlers;
+  size_t handlers_len;
+
+  bool instrumented;
+  wp_event_loop_heartbeat_t heartbeat;
+  wp_latency_histogram_t lag;
+  /* WP_EVENT_LOOP_CALLBACKS + 1 entries, made when instrumentation is first turned on. */
+  wp_callback_histogram_t *callbacks;
+
+  /* Parent of the request arenas, made by the first get_arena, and the reset arenas waiting for reuse. */
+  wp_pool_t *arenas;
+  wp_pool_t **idle;
+  size_t idle_len;
+} __wp_event_loop_private_t;
+
+/* The calling thread's id, cached: instrumented batches publish it for signals. */
+static __thread pid_t wp_event_loop_tid = 0;
+
+static uint64_t wp_event_loop_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void wp_latency_histogram_record(wp_latency_histogram_t *histogram, uint64_t ns) {
+  uint64_t us = ns / 1000;
+  unsigned bucket = us ? (unsigned)(64 - __builtin_clzll(us)) : 0;
+
+  if(bucket >= WP_LATENCY_BUCKETS) {
+    bucket = WP_LATENCY_BUCKETS - 1;
+  }
+  /* Single writer: plain read-modify-write, kept atomic for readers. */
+  __atomic_store_n(&histogram->buckets[bucket], histogram->buckets[bucket] + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&histogram->total_ns, histogram->total_ns + ns, __ATOMIC_RELAXED);
+  if(ns > histogram->max_ns) {
+    __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+  }
+}
+
+uint64_t wp_latency_histogram_percentile_us(const wp_latency_histogram_t *histogram, double percentile) {
+  uint64_t count = 0;
+  uint64_t rank = 0;
+  uint64_t seen = 0;
+
+  for(int i = 0; i < WP_LATENCY_BUCKETS; i++) {
+    count += __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+  }
+  if(count == 0) {
+    return 0;
+  }
+  rank = (uint64_t)((double)count * percentile / 100.0);
+  rank = rank ? rank : 1;
+  for(int i = 0; i < WP_LATENCY_BUCKETS; i++) {
+    seen += __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+    if(seen >= rank) {
+      return 1ull << i;
+    }
+  }
+  return 1ull << (WP_LATENCY_BUCKETS - 1);
+}
+
+/**
+ * Find the histogram for a handler function, claiming a free entry if it's new.
+ * @param self pointer to an instance of the event loop.
+ * @param fn the handler.
+ * @return the histogram entry.
+ */
+static wp_callback_histogram_t *wp_event_loop_callback_histogram(const wp_event_loop_t *self, wp_event_handler_fn fn) {
+  wp_callback_histogram_t *callbacks = self->data->callbacks;
+  size_t i = ((uintptr_t)fn >> 4) % WP_EVENT_LOOP_CALLBACKS;
+
+  for(size_t n = 0; n < WP_EVENT_LOOP_CALLBACKS; n++, i = (i + 1) % WP_EVENT_LOOP_CALLBACKS) {
+    if(callbacks[i].fn == fn) {
+      return &callbacks[i];
+    } else if(callbacks[i].fn == NULL) {
+      __atomic_store_n(&callbacks[i].fn, fn, __ATOMIC_RELEASE);
+      return &callbacks[i];
+    }
+  }
+  return &callbacks[WP_EVENT_LOOP_CALLBACKS];
+}
+
+/* What epoll hands back for fd: the fd and its slot's generation. */
+static uint64_t wp_event_loop_tag(const wp_event_loop_t *self, int fd) {
+  return ((uint64_t)self->data->handlers[fd].generation << 32) | (uint32_t)fd;
+}
+
+/**
+ * Find the handler an event is for, if it's still the one it was registered
+ * for. A remove, close and accept within one batch can hand the fd number to
+ * a new connection while the old one's events are still queued.
+ * @param self pointer to an instance of the event loop.
+ * @param ev the event.
+ * @param fd_out set to the event's fd.
+ * @return the handler, or NULL to skip the event.
+ */
+static wp_event_handler_t *wp_event_loop_handler(const wp_event_loop_t *self, const struct epoll_event *ev, int *fd_out) {
+  int fd = (int)(uint32_t)ev->data.u64;
+  wp_event_handler_t *h = NULL;
+
+  *fd_out = fd;
+  if((size_t)fd >= self->data->handlers_len) {
+    return NULL;
+  }
+  h = &self->data->handlers[fd];
+  return h->fn && h->generation == (uint32_t)(ev->data.u64 >> 32) ? h : NULL;
+}
+
+/**
+ * Make sure the handler table has a slot for fd.
+ * @param self pointer to an instance of the event loop.
+ * @param fd the file descriptor to make room for.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_event_loop_reserve(const wp_event_loop_t *self, int fd) {
+  size_t len = self->data->handlers_len;
+  wp_event_handler_t *handlers = NULL;
+
+  if((size_t)fd < len) {
+    return WP_SUCCESS;
+  }
+
+  len = len ? len : 64;
+  while(len <= (size_t)fd) {
+    len *= 2;
+  }
+
+  if((handlers = realloc(self->data->handlers, len * sizeof(*handlers))) == NULL) {
+    return WP_FAILURE;
+  }
+  memset(handlers + self->data->handlers_len, 0, (len - self->data->handlers_len) * sizeof(*handlers));
+  self->data->handlers = handlers;
+  self->data->handlers_len = len;
+
+  return WP_SUCCESS;
+}
+
+/**
+ * Reset fd's request arena, if it has one, and keep it for another fd.
+ * @param self pointer to an instance of the event loop.
+ * @param fd the file descriptor, within the handler table.
+ */
+static void wp_event_loop_recycle_arena(const wp_event_loop_t *self, int fd) {
+  wp_pool_t *arena = self->data->handlers[fd].arena;
+
+  if(arena == NULL) {
+    return;
+  }
+  self->data->handlers[fd].arena = NULL;
+  if(self->data->idle_len < WP_EVENT_LOOP_IDLE_ARENAS) {
+    arena->reset(arena);
+    self->data->idle[self->data->idle_len++] = arena;
+  } else {
+    wp_pool_delete(arena);
+  }
+}
+
+static wp_status_t wp_event_loop_add(const wp_event_loop_t *self, int fd, uint32_t events, wp_event_handler_fn fn, void *arg) {
+  assert(self && self->data && fn && fd > -1);
+  struct epoll_event ev;
+
+  if(wp_event_loop_reserve(self, fd) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+
+  /* Register under the next generation, and only take it once epoll has the fd. */
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.u64 = wp_event_loop_tag(self, fd) + (1ull << 32);
+  if(epoll_ctl(self->data->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    /* EEXIST leaves the live registration, its generation and its arena alone. */
+    return WP_FAILURE;
+  }
+
+  /* An fd closed without remove left its arena behind; don't hand it to the new one. */
+  wp_event_loop_recycle_arena(self, fd);
+  self->data->handlers[fd].generation++;
+  self->data->handlers[fd].fn = fn;
+  self->data->handlers[fd].arg = arg;
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_event_loop_modify(const wp_event_loop_t *self, int fd, uint32_t events) {
+  assert(self && self->data && fd > -1);
+  struct epoll_event ev;
+
+  if((size_t)fd >= self->data->handlers_len) {
+    errno = ENOENT;
+    return WP_FAILURE;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.u64 = wp_event_loop_tag(self, fd);
+  return epoll_ctl(self->data->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0 ? WP_SUCCESS : WP_FAILURE;
+}
+
+static wp_status_t wp_event_loop_remove(const wp_event_loop_t *self, int fd) {
+  assert(self && self->data && fd > -1);
+
+  if((size_t)fd < self->data->handlers_len) {
+    /* Events already collected for fd in this batch are skipped, even if the fd number is reused. */
+    self->data->handlers[fd].fn = NULL;
+    self->data->handlers[fd].arg = NULL;
+    self->data->handlers[fd].generation++;
+    wp_event_loop_recycle_arena(self, fd);
+  }
+
+  return epoll_ctl(self->data->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == 0 ? WP_SUCCESS : WP_FAILURE;
+}
+
+static const wp_pool_t *wp_event_loop_get_arena(const wp_event_loop_t *self, int fd) {
+  assert(self && self->data && fd > -1);
+  wp_pool_t *arena = NULL;
+
+  if((size_t)fd < self->data->handlers_len && self->data->handlers[fd].arena) {
+    return self->data->handlers[fd].arena;
+  }
+  if(wp_event_loop_reserve(self, fd) != WP_SUCCESS) {
+    return NULL;
+  }
+
+  if(self->data->arenas == NULL) {
+    if((self->data->idle = malloc(WP_EVENT_LOOP_IDLE_ARENAS * sizeof(*self->data->idle))) == NULL) {
+      return NULL;
+    }
+    if(wp_pool_new(&self->data->arenas, WP_EVENT_LOOP_ARENA_SIZE) != WP_SUCCESS) {
+      free(self->data->idle);
+      self->data->idle = NULL;
+      return NULL;
+    }
+    self->data->arenas->set_name(self->data->arenas, "request arenas");
+  }
+
+  if(self->data->idle_len) {
+    arena = self->data->idle[--self->data->idle_len];
+  } else if(wp_pool_new_child(&arena, self->data->arenas) == WP_SUCCESS) {
+    arena->set_name(arena, "request");
+  } else {
+    return NULL;
+  }
+  self->data->handlers[fd].arena = arena;
+  return arena;
+}
+
+static wp_status_t wp_event_loop_run_once(const wp_event_loop_t *self, int timeout_ms) {
+  assert(self && self->data);
+  struct epoll_event events[WP_EVENT_LOOP_BATCH];
+
+  int n = epoll_wait(self->data->epoll_fd, events, WP_EVENT_LOOP_BATCH, timeout_ms);
+  if(n < 0) {
+    /* Signals interrupt the wait; that's not an error. */
+    return errno == EINTR ? WP_SUCCESS : WP_FAILURE;
+  }
+
+  if(!self->data->instrumented) {
+    for(int i = 0; i < n; i++) {
+      int fd = -1;
+      wp_event_handler_t *h = wp_event_loop_handler(self, &events[i], &fd);
+      if(h) {
+        h->fn(self, fd, events[i].events, h->arg);
+      }
+    }
+    __atomic_store_n(&self->data->heartbeat.progress, self->data->heartbeat.progress + (uint64_t)n, __ATOMIC_RELAXED);
+    return WP_SUCCESS;
+  }
+
+  wp_event_loop_heartbeat_t *heartbeat = &self->data->heartbeat;
+  uint64_t batch_start = wp_event_loop_now_ns();
+  if(wp_event_loop_tid == 0) {
+    wp_event_loop_tid = (pid_t)syscall(SYS_gettid);
+  }
+  __atomic_store_n(&heartbeat->tid, wp_event_loop_tid, __ATOMIC_RELAXED);
+  uint64_t start = batch_start;
+  for(int i = 0; i < n; i++) {
+    int fd = -1;
+    wp_event_handler_t *h = wp_event_loop_handler(self, &events[i], &fd);
+    if(h) {
+      wp_event_handler_fn fn = h->fn;
+      uint64_t end = 0;
+
+      __atomic_store_n(&heartbeat->handler, fn, __ATOMIC_RELAXED);
+      __atomic_store_n(&heartbeat->busy_since_ns, start, __ATOMIC_RELEASE);
+      fn(self, fd, events[i].events, h->arg);
+      end = wp_event_loop_now_ns();
+      __atomic_store_n(&heartbeat->busy_since_ns, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&heartbeat->handler, NULL, __ATOMIC_RELAXED);
+      __atomic_store_n(&heartbeat->progress, heartbeat->progress + 1, __ATOMIC_RELEASE);
+
+      /* A handler may have turned instrumentation off, but the table stays. */
+      wp_latency_histogram_record(&wp_event_loop_callback_histogram(self, fn)->histogram, end - start);
+      start = end;
+    }
+  }
+  wp_latency_histogram_record(&self->data->lag, start - batch_start);
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_event_loop_set_instrumented(const wp_event_loop_t *self, bool value) {
+  assert(self && self->data);
+
+  if(value && self->data->callbacks == NULL) {
+    wp_callback_histogram_t *callbacks = calloc(WP_EVENT_LOOP_CALLBACKS + 1, sizeof(*callbacks));
+    if(callbacks == NULL) {
+      return WP_FAILURE;
+    }
+    __atomic_store_n(&self->data->callbacks, callbacks, __ATOMIC_RELEASE);
+  }
+  self->data->instrumented = value;
+
+  return WP_SUCCESS;
+}
+
+static void wp_event_loop_get_heartbeat(const wp_event_loop_t *self, wp_event_loop_heartbeat_t *heartbeat) {
+  assert(self && self->data && heartbeat);
+  heartbeat->progress = __atomic_load_n(&self->data->heartbeat.progress, __ATOMIC_ACQUIRE);
+  heartbeat->busy_since_ns = __atomic_load_n(&self->data->heartbeat.busy_since_ns, __ATOMIC_ACQUIRE);
+  heartbeat->handler = __atomic_load_n(&self->data->heartbeat.handler, __ATOMIC_RELAXED);
+  heartbeat->tid = __atomic_load_n(&self->data->heartbeat.tid, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copy a histogram another thread may be recording into.
+ * @param dest the copy.
+ * @param src the histogram.
+ */
+static void wp_event_loop_copy_histogram(wp_latency_histogram_t *dest, const wp_latency_histogram_t *src) {
+  for(int i = 0; i < WP_LATENCY_BUCKETS; i++) {
+    dest->buckets[i] = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+  }
+  dest->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+  dest->total_ns = __atomic_load_n(&src->total_ns, __ATOMIC_RELAXED);
+  dest->max_ns = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+}
+
+static void wp_event_loop_get_lag_histogram(const wp_event_loop_t *self, wp_latency_histogram_t *histogram) {
+  assert(self && self->data && histogram);
+  wp_event_loop_copy_histogram(histogram, &self->data->lag);
+}
+
+static size_t wp_event_loop_get_callback_histograms(const wp_event_loop_t *self, wp_callback_histogram_t *out, size_t max) {
+  assert(self && self->data);
+  const wp_callback_histogram_t *callbacks = __atomic_load_n(&self->data->callbacks, __ATOMIC_ACQUIRE);
+  size_t count = 0;
+
+  if(callbacks == NULL) {
+    return 0;
+  }
+  for(size_t i = 0; i <= WP_EVENT_LOOP_CALLBACKS; i++) {
+    wp_event_handler_fn fn = __atomic_load_n(&callbacks[i].fn, __ATOMIC_ACQUIRE);
+    /* The overflow entry has no single function; report it only if used. */
+    if(fn || (i == WP_EVENT_LOOP_CALLBACKS && __atomic_load_n(&callbacks[i].histogram.count, __ATOMIC_RELAXED))) {
+      if(count < max) {
+        out[count].fn = fn;
+        wp_event_loop_copy_histogram(&out[count].histogram, &callbacks[i].histogram);
+      }
+      count++;
+    }
+  }
+
+  return count;
+}
+
+static wp_status_t wp_event_loop_run(const wp_event_loop_t *self) {
+  assert(self && self->data);
+  wp_status_t res = WP_SUCCESS;
+
+  self->data->running = 1;
+  while(self->data->running && res == WP_SUCCESS) {
+    res = wp_event_loop_run_once(self, -1);
+  }
+  self->data->running = 0;
+
+  return res;
+}
+
+static void wp_event_loop_stop(const wp_event_loop_t *self) {
+  assert(self && self->data);
+  self->data->running = 0;
+}
+
+static bool wp_event_loop_is_running(const wp_event_loop_t *self) {
+  assert(self && self->data);
+  return self->data->running != 0;
+}
+
+wp_status_t wp_event_loop_new(wp_event_loop_t **self_out) {
+  wp_status_t ret = WP_FAILURE;
+  wp_event_loop_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      if((self->data->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) > -1) {
+        self->data->running = 0;
+        self->data->handlers = NULL;
+        self->data->handlers_len = 0;
+
+        self->add = &wp_event_loop_add;
+        self->modify = &wp_event_loop_modify;
+        self->remove = &wp_event_loop_remove;
+        self->run = &wp_event_loop_run;
+        self->run_once = &wp_event_loop_run_once;
+        self->stop = &wp_event_loop_stop;
+        self->is_running = &wp_event_loop_is_running;
+        self->set_instrumented = &wp_event_loop_set_instrumented;
+        self->get_heartbeat = &wp_event_loop_get_heartbeat;
+        self->get_lag_histogram = &wp_event_loop_get_lag_histogram;
+        self->get_callback_histograms = &wp_event_loop_get_callback_histograms;
+        self->get_arena = &wp_event_loop_get_arena;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_event_loop_delete(wp_event_loop_t *self) {
+  assert(self);
+  if(self->data) {
+    close(self->data->epoll_fd);
+    for(size_t fd = 0; fd < self->data->handlers_len; fd++) {
+      if(self->data->handlers[fd].arena) {
+        wp_pool_delete(self->data->handlers[fd].arena);
+      }
+    }
+    while(self->data->idle_len) {
+      wp_pool_delete(self->data->idle[--self->data->idle_len]);
+    }
+    if(self->data->arenas) {
+      wp_pool_delete(self->data->arenas);
+    }
+    free(self->data->idle);
+    free(self->data->handlers);
+    free(self->data->callbacks);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
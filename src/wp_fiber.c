@@ -0,0 +1,672 @@
+/*
+ * File:   wp_fiber.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:34 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <wp_common.h>
+#include <wp_fiber.h>
+
+/* WP_FIBER_NO_ASM forces the ucontext switch, so it can be tested on these too. */
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(WP_FIBER_NO_ASM)
+  #define WP_FIBER_ASM_SWITCH 1
+#else
+  #include <ucontext.h>
+#endif
+
+/* The events every watched fd is registered for. */
+#define WP_FIBER_WATCH_EVENTS (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+/* Passes over the ready queue before the loop gets to poll again. */
+#define WP_FIBER_READY_PASSES 64
+
+struct __wp_fiber_scheduler_private_t;
+
+typedef struct wp_fiber_context {
+#ifdef WP_FIBER_ASM_SWITCH
+  /* Saved stack pointer; the callee-saved registers sit on the stack. */
+  void *sp;
+#else
+  ucontext_t uc;
+#endif
+} wp_fiber_context_t;
+
+/* Lives at the top of its own stack mapping. */
+typedef struct wp_fiber {
+  wp_fiber_context_t context;
+  const wp_fiber_scheduler_t *scheduler;
+  wp_fiber_fn fn;
+  void *arg;
+  bool finished;
+  /* Woken from wait_fd because the fd was closed, not because it's ready. */
+  bool fd_closed;
+
+  /* The ready queue or the free list. */
+  struct wp_fiber *next;
+  /* Every unfinished fiber, so delete can unmap abandoned stacks. */
+  struct wp_fiber *live_prev;
+  struct wp_fiber *live_next;
+
+  /* The start of the mapping, guard page included. */
+  void *map;
+} wp_fiber_t;
+
+typedef struct wp_fiber_watch {
+  wp_fiber_t *reader;
+  wp_fiber_t *writer;
+  bool watched;
+} wp_fiber_watch_t;
+
+typedef struct __wp_fiber_scheduler_private_t {
+  const wp_event_loop_t *loop;
+  size_t stack_size;
+  size_t map_size;
+  size_t page_size;
+
+  /* The loop's context while a fiber runs. */
+  wp_fiber_context_t main_context;
+  wp_fiber_t *current;
+
+  wp_fiber_t *ready_head;
+  wp_fiber_t *ready_tail;
+  wp_fiber_t *live;
+  wp_fiber_t *free;
+  size_t fiber_count;
+
+  /* Written once to get the loop to run ready fibers. */
+  int kick_fd;
+  bool kicked;
+
+  /* Parked fibers, indexed by fd. */
+  wp_fiber_watch_t *watches;
+  size_t watches_len;
+} __wp_fiber_scheduler_private_t;
+
+#ifdef WP_FIBER_ASM_SWITCH
+
+/**
+ * Save the callee-saved registers on the current stack, store the stack
+ * pointer in *from_sp, then restore the registers saved on to_sp and return
+ * on that stack.
+ */
+extern void wp_fiber_switch_stack(void **from_sp, void *to_sp) __attribute__((visibility("hidden")));
+
+/* First "return" of a new fiber: calls entry(fiber) from the saved registers. */
+extern void wp_fiber_trampoline(void) __attribute__((visibility("hidden")));
+
+#if defined(__x86_64__)
+/* Frame, low to high: r15 r14 r13 r12 rbx rbp, return address. */
+#define WP_FIBER_FRAME_WORDS 7
+#define WP_FIBER_FRAME_ARG 3   /* r12 */
+#define WP_FIBER_FRAME_ENTRY 2 /* r13 */
+#define WP_FIBER_FRAME_RETURN 6
+
+__asm__(
+  ".text\n"
+  ".p2align 4\n"
+  ".globl wp_fiber_switch_stack\n"
+  ".hidden wp_fiber_switch_stack\n"
+  ".type wp_fiber_switch_stack, @function\n"
+  "wp_fiber_switch_stack:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size wp_fiber_switch_stack, .-wp_fiber_switch_stack\n"
+  "\n"
+  ".p2align 4\n"
+  ".globl wp_fiber_trampoline\n"
+  ".hidden wp_fiber_trampoline\n"
+  ".type wp_fiber_trampoline, @function\n"
+  "wp_fiber_trampoline:\n"
+  "  movq %r12, %rdi\n"
+  "  callq *%r13\n"
+  "  ud2\n"
+  ".size wp_fiber_trampoline, .-wp_fiber_trampoline\n"
+);
+
+#elif defined(__aarch64__)
+/* Frame, low to high: x19-x28, x29 (fp), x30 (lr), d8-d15. */
+#define WP_FIBER_FRAME_WORDS 20
+#define WP_FIBER_FRAME_ARG 0   /* x19 */
+#define WP_FIBER_FRAME_ENTRY 1 /* x20 */
+#define WP_FIBER_FRAME_RETURN 11
+
+__asm__(
+  ".text\n"
+  ".p2align 4\n"
+  ".globl wp_fiber_switch_stack\n"
+  ".hidden wp_fiber_switch_stack\n"
+  ".type wp_fiber_switch_stack, %function\n"
+  "wp_fiber_switch_stack:\n"
+  "  sub sp, sp, #160\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mov x2, sp\n"
+  "  str x2, [x0]\n"
+  "  mov sp, x1\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8, d9, [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #160\n"
+  "  ret\n"
+  ".size wp_fiber_switch_stack, .-wp_fiber_switch_stack\n"
+  "\n"
+  ".p2align 4\n"
+  ".globl wp_fiber_trampoline\n"
+  ".hidden wp_fiber_trampoline\n"
+  ".type wp_fiber_trampoline, %function\n"
+  "wp_fiber_trampoline:\n"
+  "  mov x0, x19\n"
+  "  blr x20\n"
+  "  brk #0\n"
+  ".size wp_fiber_trampoline, .-wp_fiber_trampoline\n"
+);
+#endif
+
+#else
+
+/* makecontext can only pass ints, so the starting fiber is handed over here. */
+static __thread wp_fiber_t *wp_fiber_starting = NULL;
+
+#endif /* WP_FIBER_ASM_SWITCH */
+
+/**
+ * Run a fiber's body, then switch away for good.
+ * @param fiber the fiber being started.
+ */
+static void wp_fiber_entry(wp_fiber_t *fiber) {
+  __wp_fiber_scheduler_private_t *d = fiber->scheduler->data;
+
+  fiber->fn(fiber->scheduler, fiber->arg);
+  fiber->finished = true;
+
+#ifdef WP_FIBER_ASM_SWITCH
+  wp_fiber_switch_stack(&fiber->context.sp, d->main_context.sp);
+#else
+  swapcontext(&fiber->context.uc, &d->main_context.uc);
+#endif
+  abort();
+}
+
+#ifndef WP_FIBER_ASM_SWITCH
+static void wp_fiber_ucontext_entry(void) {
+  wp_fiber_entry(wp_fiber_starting);
+}
+#endif
+
+/**
+ * Point a fiber's context at the start of wp_fiber_entry on its own stack.
+ * @param fiber the fiber to prepare.
+ * @param stack_low the lowest usable stack address.
+ * @param stack_size the usable stack size.
+ */
+static void wp_fiber_prepare(wp_fiber_t *fiber, void *stack_low, size_t stack_size) {
+#ifdef WP_FIBER_ASM_SWITCH
+  uintptr_t top = ((uintptr_t)stack_low + stack_size) & ~(uintptr_t)15;
+  void **frame = (void **)(top - WP_FIBER_FRAME_WORDS * sizeof(void *));
+
+  /* After the switch pops the frame, sp is 16 byte aligned at the trampoline. */
+  memset(frame, 0, WP_FIBER_FRAME_WORDS * sizeof(void *));
+  frame[WP_FIBER_FRAME_ARG] = fiber;
+  frame[WP_FIBER_FRAME_ENTRY] = (void *)&wp_fiber_entry;
+  frame[WP_FIBER_FRAME_RETURN] = (void *)&wp_fiber_trampoline;
+  fiber->context.sp = frame;
+#else
+  getcontext(&fiber->context.uc);
+  fiber->context.uc.uc_stack.ss_sp = stack_low;
+  fiber->context.uc.uc_stack.ss_size = stack_size;
+  fiber->context.uc.uc_link = NULL;
+  makecontext(&fiber->context.uc, &wp_fiber_ucontext_entry, 0);
+#endif
+}
+
+/**
+ * Switch from the loop into fiber until it parks or finishes.
+ * @param d the scheduler's private data.
+ * @param fiber the fiber to run.
+ */
+static void wp_fiber_resume(__wp_fiber_scheduler_private_t *d, wp_fiber_t *fiber) {
+  d->current = fiber;
+#ifdef WP_FIBER_ASM_SWITCH
+  wp_fiber_switch_stack(&d->main_context.sp, fiber->context.sp);
+#else
+  wp_fiber_starting = fiber;
+  swapcontext(&d->main_context.uc, &fiber->context.uc);
+#endif
+  d->current = NULL;
+
+  if(fiber->finished) {
+    if(fiber->live_prev) {
+      fiber->live_prev->live_next = fiber->live_next;
+    } else {
+      d->live = fiber->live_next;
+    }
+    if(fiber->live_next) {
+      fiber->live_next->live_prev = fiber->live_prev;
+    }
+    d->fiber_count--;
+
+    /* Keep the mapping for the next spawn. */
+    fiber->next = d->free;
+    d->free = fiber;
+  }
+}
+
+/**
+ * Switch from the running fiber back to the loop.
+ * @param d the scheduler's private data.
+ */
+static void wp_fiber_suspend(__wp_fiber_scheduler_private_t *d) {
+  wp_fiber_t *fiber = d->current;
+#ifdef WP_FIBER_ASM_SWITCH
+  wp_fiber_switch_stack(&fiber->context.sp, d->main_context.sp);
+#else
+  swapcontext(&fiber->context.uc, &d->main_context.uc);
+#endif
+}
+
+static void wp_fiber_kick(__wp_fiber_scheduler_private_t *d) {
+  uint64_t one = 1;
+  if(!d->kicked) {
+    d->kicked = true;
+    while(write(d->kick_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+  }
+}
+
+static void wp_fiber_make_ready(__wp_fiber_scheduler_private_t *d, wp_fiber_t *fiber) {
+  fiber->next = NULL;
+  if(d->ready_tail) {
+    d->ready_tail->next = fiber;
+  } else {
+    d->ready_head = fiber;
+  }
+  d->ready_tail = fiber;
+
+  /* Fibers made ready from the loop's own code need the loop to come back. */
+  if(d->current == NULL) {
+    wp_fiber_kick(d);
+  }
+}
+
+/**
+ * Run the fibers that are ready. Each pass runs only the fibers ready when it
+ * began; after WP_FIBER_READY_PASSES the loop polls again, so fibers yielding
+ * in a loop can't starve I/O.
+ * @param d the scheduler's private data.
+ */
+static void wp_fiber_run_ready(__wp_fiber_scheduler_private_t *d) {
+  wp_fiber_t *batch = NULL;
+  wp_fiber_t *fiber = NULL;
+
+  for(int pass = 0; pass < WP_FIBER_READY_PASSES && (batch = d->ready_head); pass++) {
+    d->ready_head = d->ready_tail = NULL;
+    while((fiber = batch)) {
+      batch = fiber->next;
+      wp_fiber_resume(d, fiber);
+    }
+  }
+
+  if(d->ready_head) {
+    wp_fiber_kick(d);
+  }
+}
+
+static void wp_fiber_on_kick(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_fiber_scheduler_t *self = arg;
+  uint64_t count = 0;
+  (void)loop;
+  (void)events;
+
+  while(read(fd, &count, sizeof(count)) < 0 && errno == EINTR);
+  self->data->kicked = false;
+  wp_fiber_run_ready(self->data);
+}
+
+static void wp_fiber_on_fd(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_fiber_scheduler_t *self = arg;
+  __wp_fiber_scheduler_private_t *d = self->data;
+  wp_fiber_t *fiber = NULL;
+  (void)loop;
+
+  if((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && (fiber = d->watches[fd].reader)) {
+    /* A fiber waiting for both directions is woken once. */
+    d->watches[fd].reader = NULL;
+    if(d->watches[fd].writer == fiber) {
+      d->watches[fd].writer = NULL;
+    }
+    wp_fiber_resume(d, fiber);
+  }
+
+  /* The reader may have grown the table, closed fd or parked on it again. */
+  if((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && (size_t)fd < d->watches_len && (fiber = d->watches[fd].writer)) {
+    d->watches[fd].writer = NULL;
+    if(d->watches[fd].reader == fiber) {
+      d->watches[fd].reader = NULL;
+    }
+    wp_fiber_resume(d, fiber);
+  }
+
+  wp_fiber_run_ready(d);
+}
+
+/**
+ * Make sure the watch table has a slot for fd.
+ * @param d the scheduler's private data.
+ * @param fd the file descriptor to make room for.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_fiber_reserve(__wp_fiber_scheduler_private_t *d, int fd) {
+  size_t len = d->watches_len;
+  wp_fiber_watch_t *watches = NULL;
+
+  if((size_t)fd < len) {
+    return WP_SUCCESS;
+  }
+
+  len = len ? len : 64;
+  while(len <= (size_t)fd) {
+    len *= 2;
+  }
+
+  if((watches = realloc(d->watches, len * sizeof(*watches))) == NULL) {
+    return WP_FAILURE;
+  }
+  memset(watches + d->watches_len, 0, (len - d->watches_len) * sizeof(*watches));
+  d->watches = watches;
+  d->watches_len = len;
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_fiber_spawn(const wp_fiber_scheduler_t *self, wp_fiber_fn fn, void *arg) {
+  assert(self && self->data && fn);
+  __wp_fiber_scheduler_private_t *d = self->data;
+  wp_fiber_t *fiber = NULL;
+  void *map = NULL;
+
+  if((fiber = d->free)) {
+    d->free = fiber->next;
+    map = fiber->map;
+  } else {
+    map = mmap(NULL, d->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(map == MAP_FAILED) {
+      return WP_FAILURE;
+    }
+    /* Overflowing the stack faults on the guard page instead of corrupting a neighbour. */
+    if(mprotect(map, d->page_size, PROT_NONE) != 0) {
+      munmap(map, d->map_size);
+      return WP_FAILURE;
+    }
+    fiber = (wp_fiber_t *)((char *)map + d->map_size - sizeof(wp_fiber_t));
+    fiber = (wp_fiber_t *)((uintptr_t)fiber & ~(uintptr_t)(WP_CACHE_LINE_SIZE - 1));
+  }
+
+  fiber->map = map;
+  fiber->scheduler = self;
+  fiber->fn = fn;
+  fiber->arg = arg;
+  fiber->finished = false;
+  fiber->fd_closed = false;
+  wp_fiber_prepare(fiber, (char *)map + d->page_size, (size_t)((char *)fiber - (char *)map) - d->page_size);
+
+  fiber->live_prev = NULL;
+  fiber->live_next = d->live;
+  if(d->live) {
+    d->live->live_prev = fiber;
+  }
+  d->live = fiber;
+  d->fiber_count++;
+
+  wp_fiber_make_ready(d, fiber);
+  return WP_SUCCESS;
+}
+
+static void wp_fiber_yield(const wp_fiber_scheduler_t *self) {
+  assert(self && self->data && self->data->current);
+  wp_fiber_make_ready(self->data, self->data->current);
+  wp_fiber_suspend(self->data);
+}
+
+static wp_status_t wp_fiber_wait_fd(const wp_fiber_scheduler_t *self, int fd, uint32_t events) {
+  assert(self && self->data && fd > -1);
+  __wp_fiber_scheduler_private_t *d = self->data;
+  wp_fiber_watch_t *watch = NULL;
+
+  if(d->current == NULL || (events & (EPOLLIN | EPOLLOUT)) == 0 || wp_fiber_reserve(d, fd) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+
+  watch = &d->watches[fd];
+  if(((events & EPOLLIN) && watch->reader) || ((events & EPOLLOUT) && watch->writer)) {
+    /* One reader and one writer per fd. */
+    errno = EBUSY;
+    return WP_FAILURE;
+  }
+
+  if(!watch->watched) {
+    if(d->loop->add(d->loop, fd, WP_FIBER_WATCH_EVENTS, &wp_fiber_on_fd, (void *)self) != WP_SUCCESS) {
+      return WP_FAILURE;
+    }
+    watch->watched = true;
+  }
+
+  if(events & EPOLLIN) {
+    watch->reader = d->current;
+  }
+  if(events & EPOLLOUT) {
+    watch->writer = d->current;
+  }
+
+  wp_fiber_suspend(d);
+  if(d->current->fd_closed) {
+    /* Don't retry: the fd number may already belong to something else. */
+    d->current->fd_closed = false;
+    errno = EBADF;
+    return WP_FAILURE;
+  }
+  return WP_SUCCESS;
+}
+
+static ssize_t wp_fiber_read(const wp_fiber_scheduler_t *self, int fd, void *buf, size_t len) {
+  assert(self && self->data);
+  ssize_t n = 0;
+
+  for(;;) {
+    if((n = read(fd, buf, len)) >= 0) {
+      return n;
+    }
+    if(errno == EINTR) {
+      continue;
+    }
+    if((errno != EAGAIN && errno != EWOULDBLOCK) || wp_fiber_wait_fd(self, fd, EPOLLIN) != WP_SUCCESS) {
+      return -1;
+    }
+  }
+}
+
+static ssize_t wp_fiber_write(const wp_fiber_scheduler_t *self, int fd, const void *buf, size_t len) {
+  assert(self && self->data);
+  const char *p = buf;
+  size_t done = 0;
+  ssize_t n = 0;
+
+  while(done < len) {
+    if((n = write(fd, p + done, len - done)) >= 0) {
+      done += (size_t)n;
+      continue;
+    }
+    if(errno == EINTR) {
+      continue;
+    }
+    if((errno != EAGAIN && errno != EWOULDBLOCK) || wp_fiber_wait_fd(self, fd, EPOLLOUT) != WP_SUCCESS) {
+      return done ? (ssize_t)done : -1;
+    }
+  }
+
+  return (ssize_t)done;
+}
+
+static int wp_fiber_accept(const wp_fiber_scheduler_t *self, int fd, struct sockaddr *addr, socklen_t *addr_len) {
+  assert(self && self->data);
+  int client = -1;
+
+  for(;;) {
+    if((client = accept4(fd, addr, addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC)) > -1) {
+      return client;
+    }
+    if(errno == EINTR || errno == ECONNABORTED) {
+      continue;
+    }
+    if((errno != EAGAIN && errno != EWOULDBLOCK) || wp_fiber_wait_fd(self, fd, EPOLLIN) != WP_SUCCESS) {
+      return -1;
+    }
+  }
+}
+
+static int wp_fiber_close(const wp_fiber_scheduler_t *self, int fd) {
+  assert(self && self->data);
+  __wp_fiber_scheduler_private_t *d = self->data;
+  wp_fiber_watch_t *watch = NULL;
+
+  if((size_t)fd < d->watches_len && (watch = &d->watches[fd])->watched) {
+    d->loop->remove(d->loop, fd);
+    /* Anyone still parked on fd fails with EBADF rather than retrying on a reused number. */
+    if(watch->reader) {
+      watch->reader->fd_closed = true;
+      wp_fiber_make_ready(d, watch->reader);
+    }
+    if(watch->writer && watch->writer != watch->reader) {
+      watch->writer->fd_closed = true;
+      wp_fiber_make_ready(d, watch->writer);
+    }
+    memset(watch, 0, sizeof(*watch));
+  }
+
+  return close(fd);
+}
+
+static bool wp_fiber_in_fiber(const wp_fiber_scheduler_t *self) {
+  assert(self && self->data);
+  return self->data->current != NULL;
+}
+
+static size_t wp_fiber_get_fiber_count(const wp_fiber_scheduler_t *self) {
+  assert(self && self->data);
+  return self->data->fiber_count;
+}
+
+wp_status_t wp_fiber_scheduler_new(wp_fiber_scheduler_t **self_out, const wp_event_loop_t *loop, size_t stack_size) {
+  wp_status_t ret = WP_FAILURE;
+  wp_fiber_scheduler_t *self = NULL;
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  assert(loop);
+  stack_size = stack_size ? stack_size : WP_FIBER_DEFAULT_STACK_SIZE;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = malloc(sizeof(*(self->data))))) {
+      memset(self->data, 0, sizeof(*(self->data)));
+      self->data->loop = loop;
+      self->data->page_size = page_size;
+      self->data->stack_size = stack_size;
+      /* Guard page + stack + the fiber itself, in whole pages. */
+      self->data->map_size = page_size + ((stack_size + sizeof(wp_fiber_t) + WP_CACHE_LINE_SIZE + page_size - 1) & ~(page_size - 1));
+
+      if((self->data->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) > -1 &&
+         loop->add(loop, self->data->kick_fd, EPOLLIN, &wp_fiber_on_kick, self) == WP_SUCCESS) {
+        self->spawn = &wp_fiber_spawn;
+        self->yield = &wp_fiber_yield;
+        self->wait_fd = &wp_fiber_wait_fd;
+        self->read = &wp_fiber_read;
+        self->write = &wp_fiber_write;
+        self->accept = &wp_fiber_accept;
+        self->close = &wp_fiber_close;
+        self->in_fiber = &wp_fiber_in_fiber;
+        self->get_fiber_count = &wp_fiber_get_fiber_count;
+        ret = WP_SUCCESS;
+      } else {
+        if(self->data->kick_fd > -1) {
+          close(self->data->kick_fd);
+        }
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_fiber_scheduler_delete(wp_fiber_scheduler_t *self) {
+  assert(self);
+  __wp_fiber_scheduler_private_t *d = self->data;
+  wp_fiber_t *fiber = NULL;
+
+  if(d) {
+    assert(d->current == NULL);
+    for(size_t fd = 0; fd < d->watches_len; fd++) {
+      if(d->watches[fd].watched) {
+        d->loop->remove(d->loop, (int)fd);
+      }
+    }
+    d->loop->remove(d->loop, d->kick_fd);
+    close(d->kick_fd);
+
+    while((fiber = d->live)) {
+      d->live = fiber->live_next;
+      munmap(fiber->map, d->map_size);
+    }
+    while((fiber = d->free)) {
+      d->free = fiber->next;
+      munmap(fiber->map, d->map_size);
+    }
+
+    free(d->watches);
+    free(d);
+    self->data = NULL;
+  }
+  free(self);
+}
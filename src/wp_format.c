@@ -0,0 +1,568 @@
+/*
+ * File:   wp_format.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:07 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <wp_common.h>
+#include <wp_format.h>
+#include <wp_pool.h>
+#include <wp_string.h>
+
+#define WP_FMT_DEFAULT_POOL_SIZE 128
+
+static const char wp_fmt_digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char wp_fmt_hex_digits[] = "0123456789abcdef";
+
+/**
+ * Make room for len more bytes and the terminator, growing a pool buffer.
+ * @param fmt the formatter.
+ * @param len the bytes about to be appended.
+ * @return how many of them fit.
+ */
+static size_t wp_fmt_reserve(wp_fmt_t *fmt, size_t len) {
+  size_t cap = fmt->cap;
+  char *buf = NULL;
+
+  if(fmt->cap - fmt->len > len) {
+    return len;
+  }
+  if(fmt->pool && !fmt->truncated) {
+    while(cap - fmt->len <= len && cap <= SIZE_MAX / 2) {
+      cap *= 2;
+    }
+    if(cap - fmt->len > len && (buf = fmt->pool->palloc(fmt->pool, cap))) {
+      /* The outgrown buffer stays in the pool. */
+      memcpy(buf, fmt->buf, fmt->len + 1);
+      fmt->buf = buf;
+      fmt->cap = cap;
+      return len;
+    }
+  }
+  fmt->truncated = true;
+  return fmt->cap - fmt->len - 1;
+}
+
+void wp_fmt_init(wp_fmt_t *fmt, char *buf, size_t cap) {
+  assert(fmt && buf && cap > 0);
+  fmt->buf = buf;
+  fmt->len = 0;
+  fmt->cap = cap;
+  fmt->pool = NULL;
+  fmt->truncated = false;
+  buf[0] = '\0';
+}
+
+wp_status_t wp_fmt_init_pool(wp_fmt_t *fmt, const wp_pool_t *pool, size_t initial) {
+  assert(fmt && pool);
+  size_t cap = initial ? initial : WP_FMT_DEFAULT_POOL_SIZE;
+  char *buf = NULL;
+
+  if((buf = pool->palloc(pool, cap)) == NULL) {
+    return WP_FAILURE;
+  }
+  wp_fmt_init(fmt, buf, cap);
+  fmt->pool = pool;
+  return WP_SUCCESS;
+}
+
+void wp_fmt_reset(wp_fmt_t *fmt) {
+  assert(fmt);
+  fmt->len = 0;
+  fmt->truncated = false;
+  fmt->buf[0] = '\0';
+}
+
+void wp_fmt_bytes(wp_fmt_t *fmt, const char *bytes, size_t len) {
+  assert(fmt && (bytes || len == 0));
+  size_t n = wp_fmt_reserve(fmt, len);
+
+  memcpy(fmt->buf + fmt->len, bytes, n);
+  fmt->len += n;
+  fmt->buf[fmt->len] = '\0';
+}
+
+void wp_fmt_str(wp_fmt_t *fmt, const char *str) {
+  wp_fmt_bytes(fmt, str ? str : "(null)", strlen(str ? str : "(null)"));
+}
+
+void wp_fmt_char(wp_fmt_t *fmt, char c) {
+  wp_fmt_bytes(fmt, &c, 1);
+}
+
+/**
+ * Write value in decimal, ending just before end.
+ * @param end one past where the last digit goes.
+ * @param value the value.
+ * @return where the first digit went.
+ */
+static char *wp_fmt_u64_backwards(char *end, uint64_t value) {
+  char *p = end;
+
+  while(value >= 100) {
+    unsigned pair = (unsigned)(value % 100) * 2;
+    value /= 100;
+    *--p = wp_fmt_digit_pairs[pair + 1];
+    *--p = wp_fmt_digit_pairs[pair];
+  }
+  if(value >= 10) {
+    *--p = wp_fmt_digit_pairs[value * 2 + 1];
+    *--p = wp_fmt_digit_pairs[value * 2];
+  } else {
+    *--p = (char)('0' + value);
+  }
+  return p;
+}
+
+void wp_fmt_u64(wp_fmt_t *fmt, uint64_t value) {
+  char digits[20];
+  char *start = wp_fmt_u64_backwards(digits + sizeof(digits), value);
+
+  wp_fmt_bytes(fmt, start, (size_t)(digits + sizeof(digits) - start));
+}
+
+void wp_fmt_i64(wp_fmt_t *fmt, int64_t value) {
+  char digits[20];
+  /* Negate as unsigned, so INT64_MIN works. */
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  char *start = wp_fmt_u64_backwards(digits + sizeof(digits), magnitude);
+
+  if(value < 0) {
+    *--start = '-';
+  }
+  wp_fmt_bytes(fmt, start, (size_t)(digits + sizeof(digits) - start));
+}
+
+void wp_fmt_hex(wp_fmt_t *fmt, uint64_t value, unsigned digits) {
+  char out[16];
+  char *p = out + sizeof(out);
+
+  if(digits > sizeof(out)) {
+    digits = sizeof(out);
+  }
+  do {
+    *--p = wp_fmt_hex_digits[value & 0xf];
+    value >>= 4;
+  } while(value);
+  while(p > out + sizeof(out) - digits) {
+    *--p = '0';
+  }
+  wp_fmt_bytes(fmt, p, (size_t)(out + sizeof(out) - p));
+}
+
+void wp_fmt_escaped(wp_fmt_t *fmt, const char *bytes, size_t len) {
+  assert(fmt && (bytes || len == 0));
+  size_t run = 0, i;
+
+  wp_fmt_char(fmt, '"');
+  for(i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)bytes[i];
+    const char *escape = NULL;
+
+    if(c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    /* Copy the plain run before this byte in one go. */
+    wp_fmt_bytes(fmt, bytes + run, i - run);
+    run = i + 1;
+    switch(c) {
+      case '"': escape = "\\\""; break;
+      case '\\': escape = "\\\\"; break;
+      case '\n': escape = "\\n"; break;
+      case '\r': escape = "\\r"; break;
+      case '\t': escape = "\\t"; break;
+      case '\b': escape = "\\b"; break;
+      case '\f': escape = "\\f"; break;
+    }
+    if(escape) {
+      wp_fmt_bytes(fmt, escape, 2);
+    } else {
+      wp_fmt_bytes(fmt, "\\u00", 4);
+      wp_fmt_hex(fmt, c, 2);
+    }
+  }
+  wp_fmt_bytes(fmt, bytes + run, len - run);
+  wp_fmt_char(fmt, '"');
+}
+
+/*
+ * Doubles are printed with Grisu2 (Loitsch, "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers", PLDI 2010): scale the value and its
+ * rounding boundaries by a cached power of ten into 64 bit fixed point, then
+ * generate digits until they pin down the value. The layout of the output
+ * follows ECMAScript's Number::toString.
+ */
+typedef struct wp_fmt_diyfp {
+  uint64_t f;
+  int e;
+} wp_fmt_diyfp_t;
+
+typedef struct wp_fmt_cached_power {
+  uint64_t f;
+  int e;
+  int k;
+} wp_fmt_cached_power_t;
+
+/* The scaled value's binary exponent is kept within [alpha, gamma]. */
+#define WP_FMT_ALPHA -60
+#define WP_FMT_GAMMA -32
+
+#define WP_FMT_CACHED_POWERS_MIN_DEC_EXP -300
+#define WP_FMT_CACHED_POWERS_DEC_STEP    8
+
+/* 10^k for k = -300, -292, ... 324, normalized and rounded to nearest. */
+static const wp_fmt_cached_power_t wp_fmt_cached_powers[] = {
+  { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+  { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+  { 0xBE5691EF416BD60CULL, -1007, -284 },
+  { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+  { 0xD3515C2831559A83ULL,  -954, -268 },
+  { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+  { 0xEA9C227723EE8BCBULL,  -901, -252 },
+  { 0xAECC49914078536DULL,  -874, -244 },
+  { 0x823C12795DB6CE57ULL,  -847, -236 },
+  { 0xC21094364DFB5637ULL,  -821, -228 },
+  { 0x9096EA6F3848984FULL,  -794, -220 },
+  { 0xD77485CB25823AC7ULL,  -768, -212 },
+  { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+  { 0xEF340A98172AACE5ULL,  -715, -196 },
+  { 0xB23867FB2A35B28EULL,  -688, -188 },
+  { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+  { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+  { 0x936B9FCEBB25C996ULL,  -608, -164 },
+  { 0xDBAC6C247D62A584ULL,  -582, -156 },
+  { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+  { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+  { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+  { 0x87625F056C7C4A8BULL,  -475, -124 },
+  { 0xC9BCFF6034C13053ULL,  -449, -116 },
+  { 0x964E858C91BA2655ULL,  -422, -108 },
+  { 0xDFF9772470297EBDULL,  -396, -100 },
+  { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+  { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+  { 0xB94470938FA89BCFULL,  -316,  -76 },
+  { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+  { 0xCDB02555653131B6ULL,  -263,  -60 },
+  { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+  { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+  { 0xAA242499697392D3ULL,  -183,  -36 },
+  { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+  { 0xBCE5086492111AEBULL,  -130,  -20 },
+  { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+  { 0xD1B71758E219652CULL,   -77,   -4 },
+  { 0x9C40000000000000ULL,   -50,    4 },
+  { 0xE8D4A51000000000ULL,   -24,   12 },
+  { 0xAD78EBC5AC620000ULL,     3,   20 },
+  { 0x813F3978F8940984ULL,    30,   28 },
+  { 0xC097CE7BC90715B3ULL,    56,   36 },
+  { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+  { 0xD5D238A4ABE98068ULL,   109,   52 },
+  { 0x9F4F2726179A2245ULL,   136,   60 },
+  { 0xED63A231D4C4FB27ULL,   162,   68 },
+  { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+  { 0x83C7088E1AAB65DBULL,   216,   84 },
+  { 0xC45D1DF942711D9AULL,   242,   92 },
+  { 0x924D692CA61BE758ULL,   269,  100 },
+  { 0xDA01EE641A708DEAULL,   295,  108 },
+  { 0xA26DA3999AEF774AULL,   322,  116 },
+  { 0xF209787BB47D6B85ULL,   348,  124 },
+  { 0xB454E4A179DD1877ULL,   375,  132 },
+  { 0x865B86925B9BC5C2ULL,   402,  140 },
+  { 0xC83553C5C8965D3DULL,   428,  148 },
+  { 0x952AB45CFA97A0B3ULL,   455,  156 },
+  { 0xDE469FBD99A05FE3ULL,   481,  164 },
+  { 0xA59BC234DB398C25ULL,   508,  172 },
+  { 0xF6C69A72A3989F5CULL,   534,  180 },
+  { 0xB7DCBF5354E9BECEULL,   561,  188 },
+  { 0x88FCF317F22241E2ULL,   588,  196 },
+  { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+  { 0x98165AF37B2153DFULL,   641,  212 },
+  { 0xE2A0B5DC971F303AULL,   667,  220 },
+  { 0xA8D9D1535CE3B396ULL,   694,  228 },
+  { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+  { 0xBB764C4CA7A44410ULL,   747,  244 },
+  { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+  { 0xD01FEF10A657842CULL,   800,  260 },
+  { 0x9B10A4E5E9913129ULL,   827,  268 },
+  { 0xE7109BFBA19C0C9DULL,   853,  276 },
+  { 0xAC2820D9623BF429ULL,   880,  284 },
+  { 0x80444B5E7AA7CF85ULL,   907,  292 },
+  { 0xBF21E44003ACDD2DULL,   933,  300 },
+  { 0x8E679C2F5E44FF8FULL,   960,  308 },
+  { 0xD433179D9C8CB841ULL,   986,  316 },
+  { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+static wp_fmt_diyfp_t wp_fmt_diyfp_mul(wp_fmt_diyfp_t x, wp_fmt_diyfp_t y) {
+  wp_fmt_diyfp_t r;
+#ifdef __SIZEOF_INT128__
+  __uint128_t p = (__uint128_t)x.f * y.f;
+  /* Round the low half into the high one. */
+  r.f = (uint64_t)(p >> 64) + (((uint64_t)p >> 63) & 1);
+#else
+  uint64_t u_lo = x.f & 0xffffffffu, u_hi = x.f >> 32;
+  uint64_t v_lo = y.f & 0xffffffffu, v_hi = y.f >> 32;
+  uint64_t p0 = u_lo * v_lo, p1 = u_lo * v_hi, p2 = u_hi * v_lo, p3 = u_hi * v_hi;
+  uint64_t q = (p0 >> 32) + (p1 & 0xffffffffu) + (p2 & 0xffffffffu) + (1u << 31);
+  r.f = p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32);
+#endif
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static wp_fmt_diyfp_t wp_fmt_diyfp_normalize(wp_fmt_diyfp_t x) {
+  int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+/**
+ * Split a finite, positive double into its value and the boundaries halfway
+ * to its neighbours, all three normalized to the upper boundary's exponent.
+ */
+static void wp_fmt_boundaries(double value, wp_fmt_diyfp_t *v, wp_fmt_diyfp_t *minus, wp_fmt_diyfp_t *plus) {
+  const uint64_t hidden = 1ull << 52;
+  uint64_t bits, fraction;
+  unsigned biased;
+  bool lower_closer;
+
+  memcpy(&bits, &value, sizeof(bits));
+  fraction = bits & (hidden - 1);
+  biased = (unsigned)(bits >> 52);
+  if(biased == 0) {
+    v->f = fraction;
+    v->e = 1 - 1075;
+  } else {
+    v->f = fraction + hidden;
+    v->e = (int)biased - 1075;
+  }
+  /* At a power of two the gap below is half the gap above. */
+  lower_closer = fraction == 0 && biased > 1;
+
+  plus->f = 2 * v->f + 1;
+  plus->e = v->e - 1;
+  if(lower_closer) {
+    minus->f = 4 * v->f - 1;
+    minus->e = v->e - 2;
+  } else {
+    minus->f = 2 * v->f - 1;
+    minus->e = v->e - 1;
+  }
+
+  *plus = wp_fmt_diyfp_normalize(*plus);
+  minus->f <<= minus->e - plus->e;
+  minus->e = plus->e;
+  *v = wp_fmt_diyfp_normalize(*v);
+}
+
+static wp_fmt_cached_power_t wp_fmt_cached_power(int e) {
+  /* The k with alpha <= e + e_c + 64 <= gamma, rounded up to the table's step. */
+  int f = WP_FMT_ALPHA - e - 1;
+  int k = (f * 78913) / (1 << 18) + (f > 0);
+  int index = (-WP_FMT_CACHED_POWERS_MIN_DEC_EXP + k + (WP_FMT_CACHED_POWERS_DEC_STEP - 1)) / WP_FMT_CACHED_POWERS_DEC_STEP;
+
+  assert(index >= 0 && (size_t)index < sizeof(wp_fmt_cached_powers) / sizeof(wp_fmt_cached_powers[0]));
+  return wp_fmt_cached_powers[index];
+}
+
+/**
+ * Move the last digit down while that brings it closer to the value and
+ * stays within the boundaries.
+ */
+static void wp_fmt_grisu_round(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k) {
+  while(rest < dist && delta - rest >= ten_k && (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    buf[len - 1]--;
+    rest += ten_k;
+  }
+}
+
+/**
+ * Generate the digits of a value scaled into [alpha, gamma].
+ * @param buf receives up to 17 digits.
+ * @param len_out set to the number of digits.
+ * @param exponent_io the decimal exponent, adjusted for the digits generated.
+ */
+static void wp_fmt_grisu_digits(char *buf, int *len_out, int *exponent_io, wp_fmt_diyfp_t minus, wp_fmt_diyfp_t w, wp_fmt_diyfp_t plus) {
+  uint64_t delta = plus.f - minus.f;
+  uint64_t dist = plus.f - w.f;
+  int shift = -plus.e;
+  uint64_t one = 1ull << shift;
+  uint32_t p1 = (uint32_t)(plus.f >> shift);
+  uint64_t p2 = plus.f & (one - 1);
+  uint32_t pow10 = 1;
+  int digits = 1, len = 0, n = 0, m = 0;
+
+  /* The integral part p1 has at most ten digits. */
+  while(digits < 10 && p1 >= pow10 * 10) {
+    pow10 *= 10;
+    digits++;
+  }
+
+  for(n = digits; n > 0; ) {
+    buf[len++] = (char)('0' + p1 / pow10);
+    p1 %= pow10;
+    n--;
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if(rest <= delta) {
+      *exponent_io += n;
+      wp_fmt_grisu_round(buf, len, dist, delta, rest, (uint64_t)pow10 << shift);
+      *len_out = len;
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  /* Then the fraction, one digit at a time, until within the boundaries. */
+  for(;;) {
+    p2 *= 10;
+    buf[len++] = (char)('0' + (p2 >> shift));
+    p2 &= one - 1;
+    m++;
+    delta *= 10;
+    dist *= 10;
+    if(p2 <= delta) {
+      break;
+    }
+  }
+  *exponent_io -= m;
+  wp_fmt_grisu_round(buf, len, dist, delta, p2, one);
+  *len_out = len;
+}
+
+/**
+ * Shortest digits for a finite, positive double.
+ * @param buf receives up to 17 digits.
+ * @param len_out set to the number of digits.
+ * @param exponent_out set so that value is buf * 10^exponent.
+ */
+static void wp_fmt_grisu2(char *buf, int *len_out, int *exponent_out, double value) {
+  wp_fmt_diyfp_t v, minus, plus, c, w, w_minus, w_plus;
+  wp_fmt_cached_power_t cached;
+
+  wp_fmt_boundaries(value, &v, &minus, &plus);
+  cached = wp_fmt_cached_power(plus.e);
+  c.f = cached.f;
+  c.e = cached.e;
+
+  w = wp_fmt_diyfp_mul(v, c);
+  w_minus = wp_fmt_diyfp_mul(minus, c);
+  w_plus = wp_fmt_diyfp_mul(plus, c);
+  /* Shrink the interval by the error of the products, so every digit string in it is safe. */
+  w_minus.f++;
+  w_plus.f--;
+
+  *exponent_out = -cached.k;
+  wp_fmt_grisu_digits(buf, len_out, exponent_out, w_minus, w, w_plus);
+}
+
+void wp_fmt_double(wp_fmt_t *fmt, double value) {
+  char out[WP_FMT_DOUBLE_MAX + 8];
+  char *digits = out + 1;
+  char *p = out;
+  int len = 0, exponent = 0, point = 0;
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  if(value != value) {
+    wp_fmt_bytes(fmt, "nan", 3);
+    return;
+  }
+  if(bits >> 63) {
+    *p++ = '-';
+    value = -value;
+  }
+  if(value == 0) {
+    memcpy(p, "0.0", 3);
+    wp_fmt_bytes(fmt, out, (size_t)(p + 3 - out));
+    return;
+  }
+  if(value > 1.7976931348623157e308) {
+    memcpy(p, "inf", 3);
+    wp_fmt_bytes(fmt, out, (size_t)(p + 3 - out));
+    return;
+  }
+
+  /* Digits go after room for the sign; they're moved into place below. */
+  wp_fmt_grisu2(digits + 2, &len, &exponent, value);
+  digits += 2;
+  /* The value is 0.digits * 10^point. */
+  point = len + exponent;
+
+  if(len <= point && point <= 21) {
+    /* 123000.0 */
+    memmove(p, digits, (size_t)len);
+    memset(p + len, '0', (size_t)(point - len));
+    p += point;
+    memcpy(p, ".0", 2);
+    p += 2;
+  } else if(0 < point && point <= 21) {
+    /* 123.45 */
+    memmove(p, digits, (size_t)point);
+    p[point] = '.';
+    memmove(p + point + 1, digits + point, (size_t)(len - point));
+    p += len + 1;
+  } else if(-6 < point && point <= 0) {
+    /* 0.00012345 */
+    memmove(p + 2 - point, digits, (size_t)len);
+    p[0] = '0';
+    p[1] = '.';
+    memset(p + 2, '0', (size_t)-point);
+    p += 2 - point + len;
+  } else {
+    /* 1.2345e+25 */
+    p[0] = digits[0];
+    if(len > 1) {
+      memmove(p + 2, digits + 1, (size_t)(len - 1));
+      p[1] = '.';
+      p += len + 1;
+    } else {
+      p += 1;
+    }
+    *p++ = 'e';
+    *p++ = point - 1 < 0 ? '-' : '+';
+    char exp_digits[4];
+    char *start = wp_fmt_u64_backwards(exp_digits + sizeof(exp_digits), (uint64_t)(point - 1 < 0 ? 1 - point : point - 1));
+    memcpy(p, start, (size_t)(exp_digits + sizeof(exp_digits) - start));
+    p += exp_digits + sizeof(exp_digits) - start;
+  }
+  wp_fmt_bytes(fmt, out, (size_t)(p - out));
+}
+
+wp_status_t wp_fmt_to_string(const wp_fmt_t *fmt, const wp_pool_t *pool, wp_string_t **str_out) {
+  assert(fmt && pool && str_out);
+  return wp_string_new(str_out, pool, fmt->buf);
+}
+
+wp_status_t wp_fmt_write_line(const wp_fmt_t *fmt, int fd) {
+  assert(fmt);
+  struct iovec iov[2];
+  size_t total = fmt->len + 1;
+  ssize_t n = 0;
+
+  iov[0].iov_base = fmt->buf;
+  iov[0].iov_len = fmt->len;
+  iov[1].iov_base = "\n";
+  iov[1].iov_len = 1;
+  while((n = writev(fd, iov, 2)) < 0 && errno == EINTR)
+    ;
+  return n == (ssize_t)total ? WP_SUCCESS : WP_FAILURE;
+}
@@ -0,0 +1,538 @@
+/*
+ * File:   wp_hash_map.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:37 AM
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wp_common.h>
+#include <wp_hash_map.h>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+/* Control byte values. A full slot holds the low 7 bits of its hash. */
+#define WP_HASH_MAP_EMPTY ((int8_t)-128)
+#define WP_HASH_MAP_DELETED ((int8_t)-2)
+
+/* Tables grow once 7/8 of the slots have been used. */
+#define WP_HASH_MAP_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+typedef struct wp_hash_map_slot {
+  const wp_string_t *key;
+  /* The key's bytes, so probing doesn't call through the string. */
+  const char *str;
+  size_t len;
+  void *value;
+} wp_hash_map_slot_t;
+
+typedef struct __wp_hash_map_private_t {
+  const wp_pool_t *pool;
+  /* capacity + WP_HASH_MAP_GROUP bytes: the first group is mirrored at the end. */
+  int8_t *ctrl;
+  wp_hash_map_slot_t *slots;
+  size_t capacity;
+  size_t size;
+  /* Empty slots that can still be filled before the load factor is hit. */
+  size_t growth_left;
+} __wp_hash_map_private_t;
+
+/*
+ * Group operations. A match is a bitmask with one bit (SSE2) or one byte
+ * (SWAR) per slot of the group; wp_hash_map_next takes the lowest.
+ */
+#ifdef __SSE2__
+
+#define WP_HASH_MAP_GROUP 16
+typedef uint32_t wp_hash_map_bits_t;
+
+static inline wp_hash_map_bits_t wp_hash_map_match(const int8_t *ctrl, int8_t h2) {
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (wp_hash_map_bits_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_match_empty(const int8_t *ctrl) {
+  return wp_hash_map_match(ctrl, WP_HASH_MAP_EMPTY);
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_match_free(const int8_t *ctrl) {
+  /* Empty and deleted are the only negative control bytes. */
+  return (wp_hash_map_bits_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+static inline unsigned wp_hash_map_lowest(wp_hash_map_bits_t bits) {
+  return (unsigned)__builtin_ctz(bits);
+}
+
+static inline unsigned wp_hash_map_leading(wp_hash_map_bits_t bits) {
+  return (unsigned)__builtin_clz(bits) - (32 - WP_HASH_MAP_GROUP);
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_next(wp_hash_map_bits_t bits) {
+  return bits & (bits - 1);
+}
+
+#else
+
+#define WP_HASH_MAP_GROUP 8
+typedef uint64_t wp_hash_map_bits_t;
+
+#define WP_HASH_MAP_LSBS 0x0101010101010101ULL
+#define WP_HASH_MAP_MSBS 0x8080808080808080ULL
+
+static inline uint64_t wp_hash_map_load(const int8_t *ctrl) {
+  uint64_t group;
+  memcpy(&group, ctrl, sizeof(group));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  group = __builtin_bswap64(group);
+#endif
+  return group;
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_match(const int8_t *ctrl, int8_t h2) {
+  /* Zero bytes of x are matches. This can flag a byte after a real match;
+   * the key comparison weeds those out. */
+  uint64_t x = wp_hash_map_load(ctrl) ^ (WP_HASH_MAP_LSBS * (uint8_t)h2);
+  return (x - WP_HASH_MAP_LSBS) & ~x & WP_HASH_MAP_MSBS;
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_match_empty(const int8_t *ctrl) {
+  /* Empty (0x80) is the only value with the top bit set and bit 6 clear. */
+  uint64_t group = wp_hash_map_load(ctrl);
+  return group & ~(group << 1) & WP_HASH_MAP_MSBS;
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_match_free(const int8_t *ctrl) {
+  return wp_hash_map_load(ctrl) & WP_HASH_MAP_MSBS;
+}
+
+static inline unsigned wp_hash_map_lowest(wp_hash_map_bits_t bits) {
+  return (unsigned)__builtin_ctzll(bits) >> 3;
+}
+
+static inline unsigned wp_hash_map_leading(wp_hash_map_bits_t bits) {
+  return (unsigned)__builtin_clzll(bits) >> 3;
+}
+
+static inline wp_hash_map_bits_t wp_hash_map_next(wp_hash_map_bits_t bits) {
+  return bits & (bits - 1);
+}
+
+#endif /* __SSE2__ */
+
+static inline size_t wp_hash_map_h1(uint64_t hash) {
+  return (size_t)(hash >> 7);
+}
+
+static inline int8_t wp_hash_map_h2(uint64_t hash) {
+  return (int8_t)(hash & 0x7f);
+}
+
+/**
+ * Set a control byte, keeping the mirrored first group in step.
+ * @param d the map's private data.
+ * @param index the slot.
+ * @param h the new control byte.
+ */
+static inline void wp_hash_map_set_ctrl(__wp_hash_map_private_t *d, size_t index, int8_t h) {
+  d->ctrl[index] = h;
+  d->ctrl[((index - WP_HASH_MAP_GROUP) & (d->capacity - 1)) + WP_HASH_MAP_GROUP] = h;
+}
+
+/**
+ * Find the slot holding the len bytes at key.
+ * @param d the map's private data.
+ * @param key the key bytes.
+ * @param len the key length.
+ * @param hash wp_string_hash_bytes(key, len).
+ * @return the slot, or NULL if the key is absent.
+ */
+static wp_hash_map_slot_t *wp_hash_map_lookup(const __wp_hash_map_private_t *d, const char *key, size_t len, uint64_t hash) {
+  size_t mask = d->capacity - 1;
+  size_t pos = 0, stride = 0;
+  int8_t h2 = wp_hash_map_h2(hash);
+
+  if(d->capacity == 0) {
+    return NULL;
+  }
+
+  /* Triangular probing over groups visits every group once. */
+  for(pos = wp_hash_map_h1(hash) & mask;; stride += WP_HASH_MAP_GROUP, pos = (pos + stride) & mask) {
+    const int8_t *group = d->ctrl + pos;
+    for(wp_hash_map_bits_t bits = wp_hash_map_match(group, h2); bits; bits = wp_hash_map_next(bits)) {
+      wp_hash_map_slot_t *slot = &d->slots[(pos + wp_hash_map_lowest(bits)) & mask];
+      if(slot->len == len && memcmp(slot->str, key, len) == 0) {
+        return slot;
+      }
+    }
+    if(wp_hash_map_match_empty(group)) {
+      return NULL;
+    }
+  }
+}
+
+/**
+ * The first empty or deleted slot on hash's probe sequence.
+ * @param d the map's private data; the table must have a free slot.
+ * @param hash the hash being inserted.
+ * @return the slot index.
+ */
+static size_t wp_hash_map_find_free(const __wp_hash_map_private_t *d, uint64_t hash) {
+  size_t mask = d->capacity - 1;
+  size_t pos = wp_hash_map_h1(hash) & mask, stride = 0;
+  wp_hash_map_bits_t bits = 0;
+
+  while((bits = wp_hash_map_match_free(d->ctrl + pos)) == 0) {
+    stride += WP_HASH_MAP_GROUP;
+    pos = (pos + stride) & mask;
+  }
+  return (pos + wp_hash_map_lowest(bits)) & mask;
+}
+
+/**
+ * Move every entry into a fresh table of capacity slots.
+ * @param self pointer to an instance of the map.
+ * @param capacity a power of two no smaller than WP_HASH_MAP_GROUP.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_hash_map_rehash(const wp_hash_map_t *self, size_t capacity) {
+  __wp_hash_map_private_t *d = self->data;
+  int8_t *old_ctrl = d->ctrl;
+  wp_hash_map_slot_t *old_slots = d->slots;
+  size_t old_capacity = d->capacity;
+  wp_hash_map_slot_t *slots = NULL;
+  char *mem = NULL;
+
+  if((mem = d->pool->palloc(d->pool, capacity * sizeof(*slots) + capacity + WP_HASH_MAP_GROUP)) == NULL) {
+    return WP_FAILURE;
+  }
+
+  /* Slots first keeps them aligned; the control bytes follow. */
+  d->slots = (wp_hash_map_slot_t *)mem;
+  d->ctrl = (int8_t *)(mem + capacity * sizeof(*slots));
+  d->capacity = capacity;
+  d->growth_left = WP_HASH_MAP_MAX_LOAD(capacity) - d->size;
+  memset(d->ctrl, WP_HASH_MAP_EMPTY, capacity + WP_HASH_MAP_GROUP);
+
+  for(size_t i = 0; i < old_capacity; i++) {
+    if(old_ctrl[i] >= 0) {
+      uint64_t hash = wp_string_hash(old_slots[i].key);
+      size_t index = wp_hash_map_find_free(d, hash);
+      wp_hash_map_set_ctrl(d, index, wp_hash_map_h2(hash));
+      d->slots[index] = old_slots[i];
+    }
+  }
+
+  if(old_slots) {
+    /* Only reclaimed if nothing was allocated from the pool since. */
+    d->pool->pfree(d->pool, old_slots);
+  }
+  return WP_SUCCESS;
+}
+
+/**
+ * The smallest table capacity that holds count entries under the load factor.
+ * @param count the number of entries.
+ * @return a power of two, at least WP_HASH_MAP_GROUP.
+ */
+static size_t wp_hash_map_capacity_for(size_t count) {
+  size_t capacity = WP_HASH_MAP_GROUP;
+  while(WP_HASH_MAP_MAX_LOAD(capacity) < count) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+static wp_status_t wp_hash_map_reserve(const wp_hash_map_t *self, size_t count) {
+  assert(self && self->data);
+  size_t capacity = wp_hash_map_capacity_for(count);
+
+  if(capacity <= self->data->capacity) {
+    return WP_SUCCESS;
+  }
+  return wp_hash_map_rehash(self, capacity);
+}
+
+static wp_status_t wp_hash_map_put(const wp_hash_map_t *self, const wp_string_t *key, void *value) {
+  assert(self && self->data && key);
+  __wp_hash_map_private_t *d = self->data;
+  const char *str = key->get_str(key);
+  size_t len = key->get_length(key);
+  uint64_t hash = wp_string_hash(key);
+  wp_hash_map_slot_t *slot = NULL;
+  size_t index = 0;
+
+  if((slot = wp_hash_map_lookup(d, str, len, hash))) {
+    slot->key = key;
+    slot->str = str;
+    slot->value = value;
+    return WP_SUCCESS;
+  }
+
+  if(d->growth_left == 0) {
+    /* Mostly tombstones: rehash in place. Otherwise double. */
+    size_t capacity = d->capacity == 0 ? WP_HASH_MAP_GROUP :
+                      (d->size + 1 <= WP_HASH_MAP_MAX_LOAD(d->capacity) / 2 ? d->capacity : d->capacity * 2);
+    if(wp_hash_map_rehash(self, capacity) != WP_SUCCESS) {
+      return WP_FAILURE;
+    }
+  }
+
+  index = wp_hash_map_find_free(d, hash);
+  if(d->ctrl[index] == WP_HASH_MAP_EMPTY) {
+    d->growth_left--;
+  }
+  wp_hash_map_set_ctrl(d, index, wp_hash_map_h2(hash));
+  d->slots[index].key = key;
+  d->slots[index].str = str;
+  d->slots[index].len = len;
+  d->slots[index].value = value;
+  d->size++;
+
+  return WP_SUCCESS;
+}
+
+static bool wp_hash_map_find_bytes(const wp_hash_map_t *self, const char *key, size_t len, void **value_out) {
+  assert(self && self->data && (key || len == 0));
+  wp_hash_map_slot_t *slot = wp_hash_map_lookup(self->data, key, len, wp_string_hash_bytes(key, len));
+
+  if(slot && value_out) {
+    *value_out = slot->value;
+  }
+  return slot != NULL;
+}
+
+static void *wp_hash_map_get_bytes(const wp_hash_map_t *self, const char *key, size_t len) {
+  void *value = NULL;
+  wp_hash_map_find_bytes(self, key, len, &value);
+  return value;
+}
+
+static void *wp_hash_map_get(const wp_hash_map_t *self, const wp_string_t *key) {
+  assert(self && self->data && key);
+  wp_hash_map_slot_t *slot = wp_hash_map_lookup(self->data, key->get_str(key), key->get_length(key), wp_string_hash(key));
+  return slot ? slot->value : NULL;
+}
+
+/**
+ * Remove the entry in slot.
+ * @param d the map's private data.
+ * @param slot a full slot.
+ */
+static void wp_hash_map_erase(__wp_hash_map_private_t *d, wp_hash_map_slot_t *slot) {
+  size_t mask = d->capacity - 1;
+  size_t index = (size_t)(slot - d->slots);
+  wp_hash_map_bits_t before = wp_hash_map_match_empty(d->ctrl + ((index - WP_HASH_MAP_GROUP) & mask));
+  wp_hash_map_bits_t after = wp_hash_map_match_empty(d->ctrl + index);
+
+  /*
+   * If every group window over this slot has an empty, no probe ever went
+   * past it, so it can go back to empty. Otherwise leave a tombstone.
+   */
+  if(before && after && wp_hash_map_leading(before) + wp_hash_map_lowest(after) < WP_HASH_MAP_GROUP) {
+    wp_hash_map_set_ctrl(d, index, WP_HASH_MAP_EMPTY);
+    d->growth_left++;
+  } else {
+    wp_hash_map_set_ctrl(d, index, WP_HASH_MAP_DELETED);
+  }
+  memset(slot, 0, sizeof(*slot));
+  d->size--;
+}
+
+static bool wp_hash_map_remove_bytes(const wp_hash_map_t *self, const char *key, size_t len) {
+  assert(self && self->data && (key || len == 0));
+  wp_hash_map_slot_t *slot = wp_hash_map_lookup(self->data, key, len, wp_string_hash_bytes(key, len));
+
+  if(slot) {
+    wp_hash_map_erase(self->data, slot);
+  }
+  return slot != NULL;
+}
+
+static bool wp_hash_map_remove(const wp_hash_map_t *self, const wp_string_t *key) {
+  assert(self && self->data && key);
+  wp_hash_map_slot_t *slot = wp_hash_map_lookup(self->data, key->get_str(key), key->get_length(key), wp_string_hash(key));
+
+  if(slot) {
+    wp_hash_map_erase(self->data, slot);
+  }
+  return slot != NULL;
+}
+
+static void wp_hash_map_clear(const wp_hash_map_t *self) {
+  assert(self && self->data);
+  __wp_hash_map_private_t *d = self->data;
+
+  if(d->capacity) {
+    memset(d->ctrl, WP_HASH_MAP_EMPTY, d->capacity + WP_HASH_MAP_GROUP);
+    memset(d->slots, 0, d->capacity * sizeof(*(d->slots)));
+    d->growth_left = WP_HASH_MAP_MAX_LOAD(d->capacity);
+  }
+  d->size = 0;
+}
+
+static void wp_hash_map_for_each(const wp_hash_map_t *self, wp_hash_map_fn fn, void *arg) {
+  assert(self && self->data && fn);
+  __wp_hash_map_private_t *d = self->data;
+
+  for(size_t i = 0; i < d->capacity; i++) {
+    if(d->ctrl[i] >= 0) {
+      fn(d->slots[i].key, d->slots[i].value, arg);
+    }
+  }
+}
+
+static size_t wp_hash_map_get_size(const wp_hash_map_t *self) {
+  assert(self && self->data);
+  return self->data->size;
+}
+
+/* An image from wp_hash_map_save: a header, then length bytes of records. */
+typedef struct wp_hash_map_image {
+  uint64_t magic;
+  uint64_t count;
+  uint64_t length;
+} wp_hash_map_image_t;
+
+/* A saved entry: the value's offset and the key, NUL terminated and padded to 8 bytes. */
+typedef struct wp_hash_map_record {
+  wp_pool_offset_t value;
+  uint64_t key_len;
+  char key[];
+} wp_hash_map_record_t;
+
+#define WP_HASH_MAP_IMAGE_MAGIC 0x31474d4950414d48ULL
+#define WP_HASH_MAP_RECORD_SIZE(key_len) (((sizeof(wp_hash_map_record_t) + (key_len) + 1) + 7) & ~(size_t)7)
+
+wp_pool_offset_t wp_hash_map_save(const wp_hash_map_t *self, const wp_pool_t *state) {
+  assert(self && self->data && state);
+  __wp_hash_map_private_t *d = self->data;
+  wp_hash_map_image_t *image = NULL;
+  size_t length = 0;
+  char *out = NULL;
+
+  for(size_t i = 0; i < d->capacity; i++) {
+    if(d->ctrl[i] >= 0) {
+      /* Keys come back as C strings, and values as offsets into state. */
+      if(memchr(d->slots[i].str, '\0', d->slots[i].len) ||
+         (d->slots[i].value && !wp_pool_contains(state, d->slots[i].value))) {
+        return 0;
+      }
+      length += WP_HASH_MAP_RECORD_SIZE(d->slots[i].len);
+    }
+  }
+
+  if((image = state->palloc(state, sizeof(*image) + length)) == NULL) {
+    return 0;
+  }
+  image->magic = WP_HASH_MAP_IMAGE_MAGIC;
+  image->count = d->size;
+  image->length = length;
+  out = (char *)(image + 1);
+  for(size_t i = 0; i < d->capacity; i++) {
+    if(d->ctrl[i] >= 0) {
+      wp_hash_map_record_t *record = (wp_hash_map_record_t *)out;
+      record->value = wp_pool_offset_of(state, d->slots[i].value);
+      record->key_len = d->slots[i].len;
+      memcpy(record->key, d->slots[i].str, d->slots[i].len);
+      record->key[d->slots[i].len] = '\0';
+      out += WP_HASH_MAP_RECORD_SIZE(d->slots[i].len);
+    }
+  }
+
+  return wp_pool_offset_of(state, image);
+}
+
+ssize_t wp_hash_map_load(const wp_hash_map_t *self, const wp_pool_t *state, wp_pool_offset_t image_offset, const wp_pool_t *key_pool) {
+  assert(self && self->data && state && key_pool);
+  const wp_hash_map_image_t *image = wp_pool_pointer_at(state, image_offset);
+  const char *in = NULL, *end = NULL;
+  ssize_t loaded = 0;
+
+  if(image == NULL || !wp_pool_contains(state, (const char *)(image + 1) - 1) || image->magic != WP_HASH_MAP_IMAGE_MAGIC) {
+    return -1;
+  }
+  in = (const char *)(image + 1);
+  end = in + image->length;
+  if((image->length > 0 && !wp_pool_contains(state, end - 1)) || image->count > image->length / WP_HASH_MAP_RECORD_SIZE(0)) {
+    return -1;
+  }
+  if(wp_hash_map_reserve(self, self->data->size + (size_t)image->count) != WP_SUCCESS) {
+    return -1;
+  }
+
+  for(uint64_t n = 0; n < image->count; n++) {
+    const wp_hash_map_record_t *record = (const wp_hash_map_record_t *)in;
+    wp_string_t *key = NULL;
+    void *value = NULL;
+
+    if((size_t)(end - in) < sizeof(*record) || record->key_len > (size_t)(end - in) ||
+       (size_t)(end - in) < WP_HASH_MAP_RECORD_SIZE(record->key_len) || record->key[record->key_len] != '\0') {
+      return -1;
+    }
+    if(record->value && (value = wp_pool_pointer_at(state, record->value)) && !wp_pool_contains(state, value)) {
+      return -1;
+    }
+    if(wp_string_new(&key, key_pool, record->key) != WP_SUCCESS || wp_hash_map_put(self, key, value) != WP_SUCCESS) {
+      return -1;
+    }
+    loaded++;
+    in += WP_HASH_MAP_RECORD_SIZE(record->key_len);
+  }
+
+  return loaded;
+}
+
+wp_status_t wp_hash_map_new(wp_hash_map_t **self_out, const wp_pool_t *pool, size_t capacity) {
+  assert(pool);
+  wp_status_t ret = WP_FAILURE;
+  wp_hash_map_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = malloc(sizeof(*(self->data))))) {
+      memset(self->data, 0, sizeof(*(self->data)));
+      self->data->pool = pool;
+
+      self->put = &wp_hash_map_put;
+      self->get = &wp_hash_map_get;
+      self->get_bytes = &wp_hash_map_get_bytes;
+      self->find_bytes = &wp_hash_map_find_bytes;
+      self->remove = &wp_hash_map_remove;
+      self->remove_bytes = &wp_hash_map_remove_bytes;
+      self->reserve = &wp_hash_map_reserve;
+      self->clear = &wp_hash_map_clear;
+      self->for_each = &wp_hash_map_for_each;
+      self->get_size = &wp_hash_map_get_size;
+
+      if(capacity == 0 || wp_hash_map_reserve(self, capacity) == WP_SUCCESS) {
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_hash_map_delete(wp_hash_map_t *self) {
+  assert(self);
+  if(self->data) {
+    /* The tables stay in the pool until it's deleted. */
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
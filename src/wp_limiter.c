@@ -0,0 +1,409 @@
+/*
+ * File:   wp_limiter.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:21 AM
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wp_common.h>
+#include <wp_limiter.h>
+#include <wp_string.h>
+
+/* Slots a key may live in, starting from its hash; 8 slots are two cache lines. */
+#define WP_RATE_LIMITER_PROBES 8
+
+/* Latency samples per concurrency limit update. */
+#define WP_CONCURRENCY_LIMITER_WINDOW 64
+/* Recent latency up to this multiple of the baseline still counts as no queue. */
+#define WP_CONCURRENCY_LIMITER_TOLERANCE 1.5
+/* Where an unbounded limiter starts. */
+#define WP_CONCURRENCY_LIMITER_INITIAL 16
+/* How often the baseline is measured afresh. */
+#define WP_CONCURRENCY_LIMITER_PROBE_NS (30 * 1000000000ull)
+
+typedef enum wp_concurrency_probe {
+  WP_CONCURRENCY_PROBE_NONE = 0,
+  /* The limit is down at min; this window still has requests admitted before. */
+  WP_CONCURRENCY_PROBE_DRAINING,
+  /* This window's latency is the new baseline. */
+  WP_CONCURRENCY_PROBE_MEASURING
+} wp_concurrency_probe_t;
+
+typedef struct wp_rate_limiter_slot {
+  /* The key's hash, 0 when the slot has never been used. */
+  uint64_t key;
+  uint64_t full_at;
+} wp_rate_limiter_slot_t;
+
+typedef struct __wp_rate_limiter_private_t {
+  wp_rate_limiter_slot_t *slots;
+  size_t mask;
+  /* The rate every slot shares; full_at is unused. */
+  wp_token_bucket_t bucket;
+  uint64_t refused;
+} __wp_rate_limiter_private_t;
+
+typedef struct __wp_concurrency_limiter_private_t {
+  unsigned in_flight;
+  /* What acquire compares against, published from estimate. */
+  unsigned limit;
+  unsigned min;
+  unsigned max;
+  uint64_t shed;
+
+  /* The window being filled. */
+  uint64_t window_ns;
+  unsigned window_count;
+  unsigned window_dropped;
+  /* Most requests in flight at once; roughly, as racing acquires may each miss the other's. */
+  unsigned window_peak;
+
+  /* Owned by whichever thread holds updating. */
+  bool updating;
+  double estimate;
+  double baseline_ns;
+  wp_concurrency_probe_t probe;
+  uint64_t next_probe_at;
+} __wp_concurrency_limiter_private_t;
+
+static uint64_t wp_limiter_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Charge cost nanoseconds of tokens to a bucket's full_at word.
+ * @return true if the bucket had them.
+ */
+static bool wp_token_bucket_charge(uint64_t *full_at, uint64_t burst_ns, uint64_t cost, uint64_t now) {
+  uint64_t current = __atomic_load_n(full_at, __ATOMIC_RELAXED);
+  uint64_t next;
+
+  do {
+    next = (current > now ? current : now) + cost;
+    if(next - now > burst_ns) {
+      return false;
+    }
+  } while(!__atomic_compare_exchange_n(full_at, &current, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return true;
+}
+
+void wp_token_bucket_set_rate(wp_token_bucket_t *bucket, double rate, unsigned burst) {
+  assert(bucket);
+  uint64_t interval = 0;
+
+  if(rate > 0) {
+    interval = rate >= 1e9 ? 1 : (uint64_t)(1e9 / rate);
+    if(burst == 0) {
+      burst = rate < 1 ? 1 : (unsigned)rate;
+    }
+  }
+  __atomic_store_n(&bucket->interval_ns, interval, __ATOMIC_RELAXED);
+  __atomic_store_n(&bucket->burst_ns, interval * burst, __ATOMIC_RELAXED);
+}
+
+void wp_token_bucket_init(wp_token_bucket_t *bucket, double rate, unsigned burst) {
+  assert(bucket);
+  bucket->full_at = 0;
+  wp_token_bucket_set_rate(bucket, rate, burst);
+}
+
+bool wp_token_bucket_take_at(wp_token_bucket_t *bucket, unsigned tokens, uint64_t now_ns) {
+  assert(bucket);
+  uint64_t interval = __atomic_load_n(&bucket->interval_ns, __ATOMIC_RELAXED);
+
+  if(interval == 0) {
+    return true;
+  }
+  return wp_token_bucket_charge(&bucket->full_at, __atomic_load_n(&bucket->burst_ns, __ATOMIC_RELAXED), interval * tokens, now_ns);
+}
+
+bool wp_token_bucket_take(wp_token_bucket_t *bucket, unsigned tokens) {
+  assert(bucket);
+  /* Unlimited buckets skip the clock. */
+  if(__atomic_load_n(&bucket->interval_ns, __ATOMIC_RELAXED) == 0) {
+    return true;
+  }
+  return wp_token_bucket_take_at(bucket, tokens, wp_limiter_now_ns());
+}
+
+static bool wp_rate_limiter_take(const wp_rate_limiter_t *self, const char *key, size_t len, unsigned tokens) {
+  assert(self && self->data && (key || len == 0));
+  uint64_t interval = __atomic_load_n(&self->data->bucket.interval_ns, __ATOMIC_RELAXED);
+  uint64_t burst = __atomic_load_n(&self->data->bucket.burst_ns, __ATOMIC_RELAXED);
+  uint64_t hash = wp_string_hash_bytes(key, len);
+  uint64_t now;
+  wp_rate_limiter_slot_t *slot = NULL;
+
+  if(interval == 0) {
+    return true;
+  }
+  now = wp_limiter_now_ns();
+  hash = hash ? hash : 1;
+
+  while(slot == NULL) {
+    wp_rate_limiter_slot_t *victim = NULL;
+    uint64_t victim_full_at = UINT64_MAX, victim_key = 0;
+
+    /* The key's own slot if it has one, else the one with the least debt, ideally none. */
+    for(size_t i = 0; i < WP_RATE_LIMITER_PROBES && slot == NULL; i++) {
+      wp_rate_limiter_slot_t *candidate = &self->data->slots[(hash + i) & self->data->mask];
+      uint64_t candidate_key = __atomic_load_n(&candidate->key, __ATOMIC_RELAXED);
+      uint64_t full_at = __atomic_load_n(&candidate->full_at, __ATOMIC_RELAXED);
+      if(candidate_key == hash) {
+        slot = candidate;
+      } else if(candidate_key == 0 || full_at < victim_full_at) {
+        victim = candidate;
+        victim_key = candidate_key;
+        victim_full_at = candidate_key == 0 ? 0 : full_at;
+      }
+    }
+    /* Losing the race for the victim means another thread took it; look again. */
+    if(slot == NULL && __atomic_compare_exchange_n(&victim->key, &victim_key, hash, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      /* A new key starts with a full bucket, not the evicted key's debt. */
+      __atomic_store_n(&victim->full_at, 0, __ATOMIC_RELAXED);
+      slot = victim;
+    }
+  }
+
+  if(wp_token_bucket_charge(&slot->full_at, burst, interval * tokens, now)) {
+    return true;
+  }
+  __atomic_fetch_add(&self->data->refused, 1, __ATOMIC_RELAXED);
+  return false;
+}
+
+static void wp_rate_limiter_set_rate(const wp_rate_limiter_t *self, double rate, unsigned burst) {
+  assert(self && self->data);
+  wp_token_bucket_set_rate(&self->data->bucket, rate, burst);
+}
+
+static uint64_t wp_rate_limiter_get_refused(const wp_rate_limiter_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->refused, __ATOMIC_RELAXED);
+}
+
+wp_status_t wp_rate_limiter_new(wp_rate_limiter_t **self_out, size_t slots, double rate, unsigned burst) {
+  assert(self_out);
+  wp_status_t ret = WP_FAILURE;
+  wp_rate_limiter_t *self = NULL;
+  size_t count = WP_RATE_LIMITER_PROBES;
+
+  while(count < slots) {
+    count <<= 1;
+  }
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      if((self->data->slots = calloc(count, sizeof(*self->data->slots)))) {
+        self->data->mask = count - 1;
+        wp_token_bucket_init(&self->data->bucket, rate, burst);
+
+        self->take = &wp_rate_limiter_take;
+        self->set_rate = &wp_rate_limiter_set_rate;
+        self->get_refused = &wp_rate_limiter_get_refused;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_rate_limiter_delete(wp_rate_limiter_t *self) {
+  assert(self);
+  if(self->data) {
+    free(self->data->slots);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
+
+static unsigned wp_concurrency_limiter_isqrt(unsigned n) {
+  unsigned x = n, y = (x + 1) / 2;
+  while(y < x) {
+    x = y;
+    y = (x + n / x) / 2;
+  }
+  return x;
+}
+
+/**
+ * Move the limit toward what the last window's latency suggests. Runs on
+ * one thread at a time, holding updating.
+ *
+ * The baseline is latency without a queue. It only ever drops between
+ * probes: letting it creep up toward loaded latency would let a standing
+ * queue pass for normal. Every WP_CONCURRENCY_LIMITER_PROBE_NS the limit
+ * goes down to min for two windows, one to drain and one to measure, so a
+ * service that really got slower gets a new baseline.
+ */
+static void wp_concurrency_limiter_update(const wp_concurrency_limiter_t *self, double recent_ns, unsigned peak, bool dropped) {
+  __wp_concurrency_limiter_private_t *data = self->data;
+  double estimate = data->estimate;
+  unsigned min = __atomic_load_n(&data->min, __ATOMIC_RELAXED);
+  unsigned max = __atomic_load_n(&data->max, __ATOMIC_RELAXED);
+  uint64_t now = wp_limiter_now_ns();
+
+  if(data->probe == WP_CONCURRENCY_PROBE_DRAINING) {
+    data->probe = WP_CONCURRENCY_PROBE_MEASURING;
+    return;
+  } else if(data->probe == WP_CONCURRENCY_PROBE_MEASURING) {
+    data->probe = WP_CONCURRENCY_PROBE_NONE;
+    data->baseline_ns = recent_ns;
+  } else if(data->baseline_ns == 0 || recent_ns < data->baseline_ns) {
+    data->baseline_ns = recent_ns;
+  }
+
+  if(dropped) {
+    estimate *= 0.9;
+  } else {
+    double gradient = WP_CONCURRENCY_LIMITER_TOLERANCE * data->baseline_ns / recent_ns;
+    double target;
+    gradient = gradient > 1.0 ? 1.0 : (gradient < 0.5 ? 0.5 : gradient);
+    target = estimate * gradient + wp_concurrency_limiter_isqrt((unsigned)estimate);
+    /* Don't grow a limit nobody is reaching. */
+    if(target > estimate && 2.0 * peak < estimate) {
+      target = estimate;
+    }
+    estimate = estimate * 0.8 + target * 0.2;
+  }
+
+  estimate = estimate < min ? min : (estimate > max ? max : estimate);
+  data->estimate = estimate;
+
+  if(data->next_probe_at == 0) {
+    data->next_probe_at = now + WP_CONCURRENCY_LIMITER_PROBE_NS;
+  } else if(now >= data->next_probe_at && min < estimate) {
+    data->next_probe_at = now + WP_CONCURRENCY_LIMITER_PROBE_NS;
+    data->probe = WP_CONCURRENCY_PROBE_DRAINING;
+    __atomic_store_n(&data->limit, min, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_store_n(&data->limit, (unsigned)estimate, __ATOMIC_RELAXED);
+}
+
+static bool wp_concurrency_limiter_acquire(const wp_concurrency_limiter_t *self) {
+  assert(self && self->data);
+  unsigned in_flight = __atomic_load_n(&self->data->in_flight, __ATOMIC_RELAXED);
+
+  do {
+    if(in_flight >= __atomic_load_n(&self->data->limit, __ATOMIC_RELAXED)) {
+      __atomic_fetch_add(&self->data->shed, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+  } while(!__atomic_compare_exchange_n(&self->data->in_flight, &in_flight, in_flight + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  if(in_flight + 1 > __atomic_load_n(&self->data->window_peak, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&self->data->window_peak, in_flight + 1, __ATOMIC_RELAXED);
+  }
+  return true;
+}
+
+static void wp_concurrency_limiter_release(const wp_concurrency_limiter_t *self, uint64_t latency_ns, bool dropped) {
+  assert(self && self->data);
+  __wp_concurrency_limiter_private_t *data = self->data;
+
+  __atomic_fetch_sub(&data->in_flight, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&data->window_ns, latency_ns, __ATOMIC_RELAXED);
+  if(dropped) {
+    __atomic_fetch_add(&data->window_dropped, 1, __ATOMIC_RELAXED);
+  }
+  if(__atomic_fetch_add(&data->window_count, 1, __ATOMIC_RELAXED) + 1 < WP_CONCURRENCY_LIMITER_WINDOW) {
+    return;
+  }
+
+  /* This release closed the window. If an update is still running, its samples just roll over. */
+  if(!__atomic_exchange_n(&data->updating, true, __ATOMIC_ACQUIRE)) {
+    unsigned count = __atomic_exchange_n(&data->window_count, 0, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_exchange_n(&data->window_ns, 0, __ATOMIC_RELAXED);
+    unsigned drops = __atomic_exchange_n(&data->window_dropped, 0, __ATOMIC_RELAXED);
+    unsigned peak = __atomic_exchange_n(&data->window_peak, __atomic_load_n(&data->in_flight, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    if(count > 0) {
+      double recent = (double)total / count;
+      wp_concurrency_limiter_update(self, recent > 1 ? recent : 1, peak, drops > 0);
+    }
+    __atomic_store_n(&data->updating, false, __ATOMIC_RELEASE);
+  }
+}
+
+static void wp_concurrency_limiter_set_bounds(const wp_concurrency_limiter_t *self, unsigned min, unsigned max) {
+  assert(self && self->data);
+  unsigned limit;
+
+  min = min ? min : 1;
+  max = max < min ? min : max;
+  __atomic_store_n(&self->data->min, min, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->data->max, max, __ATOMIC_RELAXED);
+  /* The next update clamps the estimate; clamp what acquire sees now. */
+  limit = __atomic_load_n(&self->data->limit, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->data->limit, limit < min ? min : (limit > max ? max : limit), __ATOMIC_RELAXED);
+}
+
+static unsigned wp_concurrency_limiter_get_limit(const wp_concurrency_limiter_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->limit, __ATOMIC_RELAXED);
+}
+
+static unsigned wp_concurrency_limiter_get_in_flight(const wp_concurrency_limiter_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->in_flight, __ATOMIC_RELAXED);
+}
+
+static uint64_t wp_concurrency_limiter_get_shed(const wp_concurrency_limiter_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->shed, __ATOMIC_RELAXED);
+}
+
+wp_status_t wp_concurrency_limiter_new(wp_concurrency_limiter_t **self_out, unsigned min, unsigned max) {
+  assert(self_out);
+  wp_status_t ret = WP_FAILURE;
+  wp_concurrency_limiter_t *self = NULL;
+
+  min = min ? min : 1;
+  max = max < min ? min : max;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->min = min;
+      self->data->max = max;
+      self->data->limit = WP_CONCURRENCY_LIMITER_INITIAL < min ? min : (WP_CONCURRENCY_LIMITER_INITIAL > max ? max : WP_CONCURRENCY_LIMITER_INITIAL);
+      self->data->estimate = self->data->limit;
+
+      self->acquire = &wp_concurrency_limiter_acquire;
+      self->release = &wp_concurrency_limiter_release;
+      self->set_bounds = &wp_concurrency_limiter_set_bounds;
+      self->get_limit = &wp_concurrency_limiter_get_limit;
+      self->get_in_flight = &wp_concurrency_limiter_get_in_flight;
+      self->get_shed = &wp_concurrency_limiter_get_shed;
+      ret = WP_SUCCESS;
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_concurrency_limiter_delete(wp_concurrency_limiter_t *self) {
+  assert(self);
+  free(self->data);
+  self->data = NULL;
+  free(self);
+}
@@ -0,0 +1,500 @@
+/*
+ * File:   wp_listener.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:19 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <wp_common.h>
+#include <wp_configuration.h>
+#include <wp_event_loop.h>
+#include <wp_datagram.h>
+#include <wp_limiter.h>
+#include <wp_listener.h>
+
+/* Connections accepted per wakeup before yielding back to the loop. */
+#define WP_LISTENER_ACCEPT_BATCH 64
+
+typedef enum wp_listener_endpoint_type {
+  WP_LISTENER_ENDPOINT_TCP,
+  WP_LISTENER_ENDPOINT_UDP,
+  WP_LISTENER_ENDPOINT_UNIX
+} wp_listener_endpoint_type_t;
+
+typedef struct wp_listener_endpoint {
+  wp_listener_endpoint_type_t type;
+  const char *address;
+  /* One socket per worker; Unix endpoints repeat the same one. */
+  int *fds;
+  /* The process that bound a Unix socket, the only one that may unlink its path. */
+  pid_t bound_by;
+} wp_listener_endpoint_t;
+
+typedef struct wp_listener_attachment {
+  const wp_listener_t *listener;
+  wp_listener_accept_fn fn;
+  void *arg;
+} wp_listener_attachment_t;
+
+typedef struct __wp_listener_private_t {
+  const wp_configuration_t *config;
+  wp_listener_endpoint_t *endpoints;
+  size_t endpoint_count;
+  unsigned worker_count;
+  wp_listener_attachment_t *attachments;
+  /* Connections over the accept rate are closed as soon as they're accepted. */
+  wp_token_bucket_t accept_bucket;
+  uint64_t shed;
+} __wp_listener_private_t;
+
+/**
+ * Split a "tcp://host:port" address. An empty host or "*" binds every address.
+ * @param address the address after the "tcp://" prefix.
+ * @param host receives the host, or an empty string.
+ * @param host_len size of host.
+ * @param port receives a pointer to the port within address.
+ * @return WP_SUCCESS on success, otherwise WP_FAILURE.
+ */
+static wp_status_t wp_listener_split_host_port(const char *address, char *host, size_t host_len, const char **port) {
+  const char *end = NULL;
+  const char *host_begin = address;
+
+  if(address[0] == '[') {
+    /* [v6 address]:port */
+    host_begin = address + 1;
+    if((end = strchr(host_begin, ']')) == NULL || end[1] != ':') {
+      return WP_FAILURE;
+    }
+    *port = end + 2;
+  } else {
+    if((end = strrchr(address, ':')) == NULL) {
+      return WP_FAILURE;
+    }
+    *port = end + 1;
+  }
+
+  if((size_t)(end - host_begin) >= host_len || **port == '\0') {
+    return WP_FAILURE;
+  }
+  memcpy(host, host_begin, (size_t)(end - host_begin));
+  host[end - host_begin] = '\0';
+  if(strcmp(host, "*") == 0) {
+    host[0] = '\0';
+  }
+
+  return WP_SUCCESS;
+}
+
+static int wp_listener_bind_inet(const wp_listener_t *self, const struct addrinfo *ai) {
+  const wp_configuration_t *config = self->data->config;
+  int on = 1;
+  int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if(fd < 0) {
+    return -1;
+  }
+
+  if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+     || (self->data->worker_count > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)) {
+    close(fd);
+    return -1;
+  }
+
+  if(ai->ai_socktype == SOCK_DGRAM) {
+    if(bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  int defer = config->get_listen_defer_accept(config);
+  if(defer > 0) {
+    /* Best effort; not every stack supports it. */
+    setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer));
+  }
+
+  if(bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, config->get_listen_backlog(config)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static wp_status_t wp_listener_bind_inet_endpoint(const wp_listener_t *self, wp_listener_endpoint_t *endpoint) {
+  wp_status_t res = WP_FAILURE;
+  char host[WP_MAX_LINE];
+  const char *port = NULL;
+  struct addrinfo hints, *ai = NULL;
+
+  /* "tcp://" and "udp://" are the same length. */
+  if(wp_listener_split_host_port(endpoint->address + strlen("tcp://"), host, sizeof(host), &port) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = endpoint->type == WP_LISTENER_ENDPOINT_UDP ? SOCK_DGRAM : SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  if(getaddrinfo(host[0] ? host : NULL, port, &hints, &ai) == 0) {
+    res = WP_SUCCESS;
+    for(unsigned w = 0; w < self->data->worker_count && res == WP_SUCCESS; w++) {
+      if((endpoint->fds[w] = wp_listener_bind_inet(self, ai)) < 0) {
+        res = WP_FAILURE;
+      }
+    }
+    freeaddrinfo(ai);
+  }
+
+  return res;
+}
+
+/**
+ * Clear a socket file left at path by an instance that's gone. A socket that
+ * still accepts connections belongs to a live instance and is left alone.
+ * @param addr the socket's address.
+ * @param addr_len the length of addr.
+ * @return WP_SUCCESS if path is free to bind, otherwise WP_FAILURE with errno set.
+ */
+static wp_status_t wp_listener_clear_stale_unix_path(const struct sockaddr_un *addr, socklen_t addr_len) {
+  int fd = -1;
+  int err = 0;
+
+  if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+    return WP_FAILURE;
+  }
+  if(connect(fd, (const struct sockaddr *)addr, addr_len) == 0) {
+    close(fd);
+    errno = EADDRINUSE;
+    return WP_FAILURE;
+  }
+  err = errno;
+  close(fd);
+
+  if(err == ENOENT) {
+    return WP_SUCCESS;
+  } else if(err == ECONNREFUSED) {
+    /* Nobody is listening: a socket left behind by a previous instance. */
+    return unlink(addr->sun_path) == 0 || errno == ENOENT ? WP_SUCCESS : WP_FAILURE;
+  }
+  /* Not a socket, or no permission: let bind report it. */
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_listener_bind_unix_endpoint(const wp_listener_t *self, wp_listener_endpoint_t *endpoint) {
+  const char *path = endpoint->address + strlen("unix:");
+  size_t path_len = strlen(path);
+  struct sockaddr_un addr;
+  int fd = -1;
+
+  if(path_len == 0 || path_len >= sizeof(addr.sun_path)) {
+    return WP_FAILURE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path, path_len);
+  socklen_t addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len + (path[0] == '@' ? 0 : 1));
+  if(path[0] == '@') {
+    addr.sun_path[0] = '\0';
+  } else if(wp_listener_clear_stale_unix_path(&addr, addr_len) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+
+  if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+    return WP_FAILURE;
+  }
+  if(bind(fd, (struct sockaddr *)&addr, addr_len) != 0
+     || listen(fd, self->data->config->get_listen_backlog(self->data->config)) != 0) {
+    close(fd);
+    return WP_FAILURE;
+  }
+
+  /* Unix sockets can't be sharded; every worker shares the one socket. */
+  for(unsigned w = 0; w < self->data->worker_count; w++) {
+    endpoint->fds[w] = fd;
+  }
+  endpoint->bound_by = getpid();
+
+  return WP_SUCCESS;
+}
+
+static void wp_listener_close(const wp_listener_t *self) {
+  assert(self && self->data);
+
+  for(size_t i = 0; i < self->data->endpoint_count; i++) {
+    wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+    if(endpoint->fds == NULL || endpoint->fds[0] < 0) {
+      continue;
+    }
+    if(endpoint->type == WP_LISTENER_ENDPOINT_UNIX) {
+      const char *path = endpoint->address + strlen("unix:");
+      close(endpoint->fds[0]);
+      /* A forked process closing its copy leaves the path to the one serving it. */
+      if(path[0] != '@' && endpoint->bound_by == getpid()) {
+        unlink(path);
+      }
+    } else {
+      for(unsigned w = 0; w < self->data->worker_count; w++) {
+        if(endpoint->fds[w] > -1) {
+          close(endpoint->fds[w]);
+        }
+      }
+    }
+    for(unsigned w = 0; w < self->data->worker_count; w++) {
+      endpoint->fds[w] = -1;
+    }
+  }
+}
+
+static wp_status_t wp_listener_bind(const wp_listener_t *self) {
+  assert(self && self->data);
+  wp_status_t res = WP_SUCCESS;
+
+  for(size_t i = 0; i < self->data->endpoint_count && res == WP_SUCCESS; i++) {
+    wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+    if(endpoint->type != WP_LISTENER_ENDPOINT_UNIX) {
+      res = wp_listener_bind_inet_endpoint(self, endpoint);
+    } else {
+      res = wp_listener_bind_unix_endpoint(self, endpoint);
+    }
+    if(res != WP_SUCCESS) {
+      wp_log(stderr, self->data->config, LOG_ERR, "Could not listen on %s: %m", endpoint->address);
+    }
+  }
+
+  if(res != WP_SUCCESS) {
+    wp_listener_close(self);
+  }
+
+  return res;
+}
+
+static size_t wp_listener_get_endpoint_count(const wp_listener_t *self) {
+  assert(self && self->data);
+  return self->data->endpoint_count;
+}
+
+static unsigned wp_listener_get_worker_count(const wp_listener_t *self) {
+  assert(self && self->data);
+  return self->data->worker_count;
+}
+
+static bool wp_listener_is_datagram(const wp_listener_t *self, size_t endpoint) {
+  assert(self && self->data && endpoint < self->data->endpoint_count);
+  return self->data->endpoints[endpoint].type == WP_LISTENER_ENDPOINT_UDP;
+}
+
+static int wp_listener_get_fd(const wp_listener_t *self, size_t endpoint, unsigned worker) {
+  assert(self && self->data);
+  if(endpoint >= self->data->endpoint_count || worker >= self->data->worker_count) {
+    return -1;
+  }
+  return self->data->endpoints[endpoint].fds[worker];
+}
+
+/**
+ * Event loop handler: accept until the backlog is empty or the batch is used
+ * up. The socket is level triggered, so anything left wakes us again.
+ */
+static void wp_listener_on_readable(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_listener_attachment_t *attachment = arg;
+  (void)loop; (void)events;
+
+  for(int i = 0; i < WP_LISTENER_ACCEPT_BATCH; i++) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int client_fd = accept4(fd, (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(client_fd < 0) {
+      if(errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      /* EAGAIN: drained. Anything else (EMFILE...) is retried next wakeup. */
+      break;
+    }
+    /* Over the rate: closing now is the cheapest refusal, before any read or allocation. */
+    if(!wp_token_bucket_take(&attachment->listener->data->accept_bucket, 1)) {
+      close(client_fd);
+      __atomic_fetch_add(&attachment->listener->data->shed, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    attachment->fn(attachment->listener, client_fd, (struct sockaddr *)&addr, addr_len, attachment->arg);
+  }
+}
+
+static void wp_listener_set_accept_rate(const wp_listener_t *self, double rate, unsigned burst) {
+  assert(self && self->data);
+  wp_token_bucket_set_rate(&self->data->accept_bucket, rate, burst);
+}
+
+static uint64_t wp_listener_get_shed_count(const wp_listener_t *self) {
+  assert(self && self->data);
+  return __atomic_load_n(&self->data->shed, __ATOMIC_RELAXED);
+}
+
+static void wp_listener_detach(const wp_listener_t *self, const wp_event_loop_t *loop, unsigned worker) {
+  assert(self && self->data && loop && worker < self->data->worker_count);
+  for(size_t i = 0; i < self->data->endpoint_count; i++) {
+    int fd = self->data->endpoints[i].fds[worker];
+    if(fd > -1 && self->data->endpoints[i].type != WP_LISTENER_ENDPOINT_UDP) {
+      loop->remove(loop, fd);
+    }
+  }
+}
+
+static wp_status_t wp_listener_attach(const wp_listener_t *self, const wp_event_loop_t *loop, unsigned worker,
+                                      wp_listener_accept_fn fn, void *arg) {
+  assert(self && self->data && loop && fn && worker < self->data->worker_count);
+  wp_status_t res = WP_SUCCESS;
+  wp_listener_attachment_t *attachment = &self->data->attachments[worker];
+
+  attachment->listener = self;
+  attachment->fn = fn;
+  attachment->arg = arg;
+
+  for(size_t i = 0; i < self->data->endpoint_count && res == WP_SUCCESS; i++) {
+    wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+    if(endpoint->type == WP_LISTENER_ENDPOINT_UDP) {
+      continue;
+    }
+    /* Shared sockets wake only one of the workers waiting on them. */
+    uint32_t events = EPOLLIN | (endpoint->type == WP_LISTENER_ENDPOINT_UNIX && self->data->worker_count > 1 ? EPOLLEXCLUSIVE : 0);
+    if(endpoint->fds[worker] < 0) {
+      res = WP_FAILURE;
+    } else {
+      res = loop->add(loop, endpoint->fds[worker], events, &wp_listener_on_readable, attachment);
+    }
+  }
+
+  if(res != WP_SUCCESS) {
+    wp_listener_detach(self, loop, worker);
+  }
+
+  return res;
+}
+
+static wp_status_t wp_listener_attach_datagram(const wp_listener_t *self, const wp_event_loop_t *loop, unsigned worker,
+                                               const wp_datagram_batch_t *batch, wp_datagram_batch_fn fn, void *arg) {
+  assert(self && self->data && loop && batch && fn && worker < self->data->worker_count);
+  wp_status_t res = WP_SUCCESS;
+
+  for(size_t i = 0; i < self->data->endpoint_count && res == WP_SUCCESS; i++) {
+    wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+    if(endpoint->type != WP_LISTENER_ENDPOINT_UDP) {
+      continue;
+    }
+    if(endpoint->fds[worker] < 0) {
+      res = WP_FAILURE;
+    } else {
+      res = batch->attach(batch, loop, endpoint->fds[worker], fn, arg);
+    }
+  }
+
+  if(res != WP_SUCCESS) {
+    for(size_t i = 0; i < self->data->endpoint_count; i++) {
+      wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+      if(endpoint->type == WP_LISTENER_ENDPOINT_UDP && endpoint->fds[worker] > -1) {
+        batch->detach(batch, loop, endpoint->fds[worker]);
+      }
+    }
+  }
+
+  return res;
+}
+
+wp_status_t wp_listener_new(wp_listener_t **self_out, const wp_configuration_t *config) {
+  assert(config);
+  wp_status_t ret = WP_FAILURE;
+  wp_listener_t *self = NULL;
+  size_t count = config->get_listen_address_count(config);
+  unsigned workers = config->get_worker_count(config);
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->config = config;
+      self->data->worker_count = workers;
+      self->data->endpoint_count = count;
+      wp_token_bucket_init(&self->data->accept_bucket, config->get_accept_rate_limit(config), config->get_accept_rate_burst(config));
+      self->data->endpoints = calloc(count ? count : 1, sizeof(*self->data->endpoints));
+      self->data->attachments = calloc(workers, sizeof(*self->data->attachments));
+
+      if(self->data->endpoints && self->data->attachments) {
+        ret = WP_SUCCESS;
+        for(size_t i = 0; i < count && ret == WP_SUCCESS; i++) {
+          wp_listener_endpoint_t *endpoint = &self->data->endpoints[i];
+          endpoint->address = config->get_listen_address(config, i);
+          if(strncmp(endpoint->address, "tcp://", strlen("tcp://")) == 0) {
+            endpoint->type = WP_LISTENER_ENDPOINT_TCP;
+          } else if(strncmp(endpoint->address, "udp://", strlen("udp://")) == 0) {
+            endpoint->type = WP_LISTENER_ENDPOINT_UDP;
+          } else if(strncmp(endpoint->address, "unix:", strlen("unix:")) == 0) {
+            endpoint->type = WP_LISTENER_ENDPOINT_UNIX;
+          } else {
+            wp_log(stderr, config, LOG_ERR, "Unknown listen address %s", endpoint->address);
+            ret = WP_FAILURE;
+            break;
+          }
+          if((endpoint->fds = malloc(workers * sizeof(*endpoint->fds))) == NULL) {
+            ret = WP_FAILURE;
+            break;
+          }
+          for(unsigned w = 0; w < workers; w++) {
+            endpoint->fds[w] = -1;
+          }
+        }
+      }
+
+      self->bind = &wp_listener_bind;
+      self->close = &wp_listener_close;
+      self->get_endpoint_count = &wp_listener_get_endpoint_count;
+      self->get_worker_count = &wp_listener_get_worker_count;
+      self->get_fd = &wp_listener_get_fd;
+      self->attach = &wp_listener_attach;
+      self->attach_datagram = &wp_listener_attach_datagram;
+      self->is_datagram = &wp_listener_is_datagram;
+      self->detach = &wp_listener_detach;
+      self->set_accept_rate = &wp_listener_set_accept_rate;
+      self->get_shed_count = &wp_listener_get_shed_count;
+
+      if(ret != WP_SUCCESS) {
+        wp_listener_delete(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_listener_delete(wp_listener_t *self) {
+  assert(self);
+  if(self->data) {
+    if(self->data->endpoints) {
+      wp_listener_close(self);
+      for(size_t i = 0; i < self->data->endpoint_count; i++) {
+        free(self->data->endpoints[i].fds);
+      }
+    }
+    free(self->data->endpoints);
+    free(self->data->attachments);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
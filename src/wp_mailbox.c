@@ -0,0 +1,208 @@
+/*
+ * File:   wp_mailbox.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:27 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <wp_common.h>
+#include <wp_mailbox.h>
+
+typedef struct __wp_mailbox_private_t {
+  /* Producers swing head; the consumer alone walks tail. */
+  wp_mailbox_node_t *head WP_CACHE_ALIGNED;
+  /* Set by the consumer once drained; the first post to clear it signals. */
+  int idle;
+
+  wp_mailbox_node_t *tail WP_CACHE_ALIGNED;
+  wp_mailbox_node_t stub;
+  int event_fd;
+  wp_mailbox_fn fn;
+  void *arg;
+} WP_CACHE_ALIGNED __wp_mailbox_private_t;
+
+/**
+ * Link node in as the newest entry.
+ * @param d the mailbox's private data.
+ * @param node the node to link.
+ */
+static void wp_mailbox_link(__wp_mailbox_private_t *d, wp_mailbox_node_t *node) {
+  wp_mailbox_node_t *prev = NULL;
+
+  __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&d->head, node, __ATOMIC_ACQ_REL);
+  /* Until this store the consumer sees a gap and waits for it. */
+  __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+static void wp_mailbox_post(const wp_mailbox_t *self, wp_mailbox_node_t *node) {
+  assert(self && self->data && node);
+  __wp_mailbox_private_t *d = self->data;
+  uint64_t one = 1;
+
+  wp_mailbox_link(d, node);
+  if(__atomic_exchange_n(&d->idle, 0, __ATOMIC_SEQ_CST)) {
+    while(write(d->event_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+  }
+}
+
+static wp_mailbox_node_t *wp_mailbox_take(const wp_mailbox_t *self) {
+  assert(self && self->data);
+  __wp_mailbox_private_t *d = self->data;
+  wp_mailbox_node_t *tail = d->tail;
+  wp_mailbox_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+  if(tail == &d->stub) {
+    if(next == NULL) {
+      return NULL;
+    }
+    d->tail = next;
+    tail = next;
+    next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+  }
+
+  if(next) {
+    d->tail = next;
+    return tail;
+  }
+
+  if(tail != __atomic_load_n(&d->head, __ATOMIC_ACQUIRE)) {
+    /* A producer has swung head but not linked yet. */
+    return NULL;
+  }
+
+  /* tail is the last node; park the stub behind it so it can be handed out. */
+  wp_mailbox_link(d, &d->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if(next) {
+    d->tail = next;
+    return tail;
+  }
+
+  return NULL;
+}
+
+static bool wp_mailbox_is_empty(const wp_mailbox_t *self) {
+  assert(self && self->data);
+  __wp_mailbox_private_t *d = self->data;
+
+  return __atomic_load_n(&d->head, __ATOMIC_ACQUIRE) == d->tail &&
+         __atomic_load_n(&d->tail->next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+/**
+ * Drain the mailbox into the attached callback, then mark the consumer idle.
+ * @param loop the loop the eventfd is registered on.
+ * @param fd the mailbox's eventfd.
+ * @param events the ready events.
+ * @param arg the mailbox.
+ */
+static void wp_mailbox_on_event(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_mailbox_t *self = arg;
+  __wp_mailbox_private_t *d = self->data;
+  wp_mailbox_node_t *node = NULL;
+  uint64_t count = 0;
+  (void)loop;
+  (void)events;
+
+  while(read(fd, &count, sizeof(count)) < 0 && errno == EINTR);
+
+  for(;;) {
+    while((node = wp_mailbox_take(self))) {
+      d->fn(self, node, d->arg);
+    }
+
+    __atomic_store_n(&d->idle, 1, __ATOMIC_SEQ_CST);
+    if(wp_mailbox_is_empty(self)) {
+      break;
+    }
+    /* Something slipped in before idle was set. If a producer already cleared
+     * idle it has written the eventfd, and we will be called again. */
+    if(!__atomic_exchange_n(&d->idle, 0, __ATOMIC_SEQ_CST)) {
+      break;
+    }
+  }
+}
+
+static wp_status_t wp_mailbox_attach(const wp_mailbox_t *self, const wp_event_loop_t *loop, wp_mailbox_fn fn, void *arg) {
+  assert(self && self->data && loop && fn);
+
+  self->data->fn = fn;
+  self->data->arg = arg;
+  if(loop->add(loop, self->data->event_fd, EPOLLIN, &wp_mailbox_on_event, (void *)self) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+
+  /* Pick up anything posted before the handler existed. */
+  if(!wp_mailbox_is_empty(self)) {
+    uint64_t one = 1;
+    __atomic_store_n(&self->data->idle, 0, __ATOMIC_SEQ_CST);
+    while(write(self->data->event_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+  }
+  return WP_SUCCESS;
+}
+
+static void wp_mailbox_detach(const wp_mailbox_t *self, const wp_event_loop_t *loop) {
+  assert(self && self->data && loop);
+  loop->remove(loop, self->data->event_fd);
+}
+
+static int wp_mailbox_get_fd(const wp_mailbox_t *self) {
+  assert(self && self->data);
+  return self->data->event_fd;
+}
+
+wp_status_t wp_mailbox_new(wp_mailbox_t **self_out) {
+  wp_status_t ret = WP_FAILURE;
+  wp_mailbox_t *self = NULL;
+  void *mem = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if(posix_memalign(&mem, WP_CACHE_LINE_SIZE, sizeof(*(self->data))) == 0) {
+      self->data = mem;
+      if((self->data->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) > -1) {
+        self->data->stub.next = NULL;
+        self->data->head = &self->data->stub;
+        self->data->tail = &self->data->stub;
+        self->data->idle = 1;
+        self->data->fn = NULL;
+        self->data->arg = NULL;
+
+        self->post = &wp_mailbox_post;
+        self->take = &wp_mailbox_take;
+        self->is_empty = &wp_mailbox_is_empty;
+        self->attach = &wp_mailbox_attach;
+        self->detach = &wp_mailbox_detach;
+        self->get_fd = &wp_mailbox_get_fd;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_mailbox_delete(wp_mailbox_t *self) {
+  assert(self);
+  if(self->data) {
+    close(self->data->event_fd);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
@@ -0,0 +1,139 @@
+/*
+ * File:   wp_mpmc_queue.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:27 AM
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wp_common.h>
+#include <wp_mpmc_queue.h>
+
+typedef struct wp_mpmc_cell {
+  size_t sequence;
+  void *item;
+} wp_mpmc_cell_t;
+
+typedef struct __wp_mpmc_queue_private_t {
+  wp_mpmc_cell_t *cells;
+  size_t mask;
+  /* Producers and consumers each own a cache line. */
+  size_t enqueue_pos WP_CACHE_ALIGNED;
+  size_t dequeue_pos WP_CACHE_ALIGNED;
+} WP_CACHE_ALIGNED __wp_mpmc_queue_private_t;
+
+static bool wp_mpmc_queue_push(const wp_mpmc_queue_t *self, void *item) {
+  assert(self && self->data);
+  __wp_mpmc_queue_private_t *d = self->data;
+  wp_mpmc_cell_t *cell = NULL;
+  size_t pos = __atomic_load_n(&d->enqueue_pos, __ATOMIC_RELAXED);
+
+  for(;;) {
+    cell = &d->cells[pos & d->mask];
+    size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if(diff == 0) {
+      /* The cell is free for this lap; claim it. */
+      if(__atomic_compare_exchange_n(&d->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if(diff < 0) {
+      /* Still holding last lap's item: full. */
+      return false;
+    } else {
+      pos = __atomic_load_n(&d->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->item = item;
+  __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool wp_mpmc_queue_pop(const wp_mpmc_queue_t *self, void **item) {
+  assert(self && self->data && item);
+  __wp_mpmc_queue_private_t *d = self->data;
+  wp_mpmc_cell_t *cell = NULL;
+  size_t pos = __atomic_load_n(&d->dequeue_pos, __ATOMIC_RELAXED);
+
+  for(;;) {
+    cell = &d->cells[pos & d->mask];
+    size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if(diff == 0) {
+      if(__atomic_compare_exchange_n(&d->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if(diff < 0) {
+      /* Not written yet: empty. */
+      return false;
+    } else {
+      pos = __atomic_load_n(&d->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  *item = cell->item;
+  /* Hand the cell to the producer one lap ahead. */
+  __atomic_store_n(&cell->sequence, pos + d->mask + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static size_t wp_mpmc_queue_get_capacity(const wp_mpmc_queue_t *self) {
+  assert(self && self->data);
+  return self->data->mask + 1;
+}
+
+wp_status_t wp_mpmc_queue_new(wp_mpmc_queue_t **self_out, size_t capacity) {
+  wp_status_t ret = WP_FAILURE;
+  wp_mpmc_queue_t *self = NULL;
+  void *mem = NULL;
+  size_t size = 2;
+
+  while(size < capacity) {
+    size <<= 1;
+  }
+
+  if((self = malloc(sizeof(*self)))) {
+    if(posix_memalign(&mem, WP_CACHE_LINE_SIZE, sizeof(*(self->data))) == 0) {
+      self->data = mem;
+      if(posix_memalign(&mem, WP_CACHE_LINE_SIZE, size * sizeof(wp_mpmc_cell_t)) == 0) {
+        self->data->cells = mem;
+        self->data->mask = size - 1;
+        self->data->enqueue_pos = 0;
+        self->data->dequeue_pos = 0;
+        for(size_t i = 0; i < size; i++) {
+          self->data->cells[i].sequence = i;
+          self->data->cells[i].item = NULL;
+        }
+
+        self->push = &wp_mpmc_queue_push;
+        self->pop = &wp_mpmc_queue_pop;
+        self->get_capacity = &wp_mpmc_queue_get_capacity;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_mpmc_queue_delete(wp_mpmc_queue_t *self) {
+  assert(self);
+  if(self->data) {
+    free(self->data->cells);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
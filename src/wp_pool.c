@@ -4,21 +4,807 @@
  *
  * Created on November 28, 2012, 6:10 AM
  */
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <wp_configuration.h>
 #include <wp_pool.h>
+#include <wp_string.h>
+
+#define WP_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#ifndef MADV_POPULATE_WRITE
+  #define MADV_POPULATE_WRITE 23
+#endif
+#ifndef MPOL_BIND
+  #define MPOL_BIND 2
+#endif
+/* The largest node a pool will bind to, plus one; sizes the mbind mask. */
+#define WP_POOL_MAX_NUMA_NODES 1024
+#define WP_POOL_MASK_BITS (8 * sizeof(unsigned long))
+
+#define WP_POOL_ALIGNMENT 16
+#define WP_POOL_ALIGN(n) (((n) + (WP_POOL_ALIGNMENT - 1)) & ~((size_t)WP_POOL_ALIGNMENT - 1))
+
+typedef struct wp_pool_block {
+  struct wp_pool_block *next;
+  size_t size;
+  size_t used;
+  /* The most recent allocation, which pfree can roll back. */
+  size_t last;
+  /* Length of the mapping for mmap'd blocks, 0 for malloc'd ones. */
+  size_t mapped;
+} wp_pool_block_t;
+
+#define WP_POOL_BLOCK_HEADER WP_POOL_ALIGN(sizeof(wp_pool_block_t))
+
+/* "WPDPOOL1" read as a native word, so a file from another byte order doesn't match. */
+#define WP_POOL_REGION_MAGIC  0x314c4f4f50445057ull
+#define WP_POOL_REGION_FORMAT 1
+
+/*
+ * A persistent pool's file: this header, then the pool's one block, whose
+ * header and allocations are kept as they are. The block's next pointer is
+ * always NULL, so nothing in the file depends on where it's mapped.
+ */
+typedef struct wp_pool_region {
+  uint64_t magic;
+  /* Changes with this header or the block header. */
+  uint32_t format;
+  /* The caller's version of what it keeps in the region. */
+  uint32_t layout;
+  uint64_t length;
+  wp_pool_offset_t root;
+  /* Over the block and root, written when sealed. */
+  uint64_t checksum;
+  /* Set by a clean delete; cleared while a process has the region attached. */
+  uint32_t sealed;
+} wp_pool_region_t;
+
+#define WP_POOL_REGION_HEADER WP_POOL_ALIGN(sizeof(wp_pool_region_t))
+
+/*
+ * Threads get slots 0 to WP_POOL_STAT_SLOTS - 2 to themselves while they
+ * live, handed back when they exit; threads beyond that share the last slot,
+ * and pay for atomic adds.
+ */
+#define WP_POOL_STAT_SLOTS 8
+#define WP_POOL_SHARED_SLOT (WP_POOL_STAT_SLOTS - 1)
+
+/* Distinct tags counted per pool; the rest are lumped together. */
+#define WP_POOL_TAGS 64
+
+/* Blocks a parent keeps for its children to reuse; more are freed. */
+#define WP_POOL_SPARES 64
+
+typedef struct wp_pool_stat_slot {
+  /* Signed: a thread may pfree what another allocated. */
+  int64_t live;
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t classes[WP_POOL_STAT_CLASSES];
+} WP_CACHE_ALIGNED wp_pool_stat_slot_t;
+
+typedef struct wp_pool_tag {
+  const char *tag;
+  uint64_t allocations;
+  uint64_t bytes;
+} wp_pool_tag_t;
 
 typedef struct __wp_pool_private_t {
-  void *pool;
+  /* The current block is first; older, fuller blocks follow. */
+  wp_pool_block_t *pool;
   const wp_pool_t *parent;
+  size_t block_size;
+  /* The usable size of a block made for block_size, which mapping may round up. */
+  size_t standard_size;
+  /* Standard blocks given back by children, for them to take again. */
+  wp_pool_block_t *spare;
+  size_t spares;
+  wp_pool_options_t options;
+  /* Blocks are mmap'd rather than malloc'd. */
+  bool mapped;
+  /* A persistent pool's file mapping, holding its only block, and the locked file. */
+  wp_pool_region_t *region;
+  size_t region_length;
+  int region_fd;
+
+  /* Made by the first allocation from each slot's threads. */
+  wp_pool_stat_slot_t *slots[WP_POOL_STAT_SLOTS];
+  size_t reserved;
+  size_t blocks;
+  size_t peak;
+  /* WP_POOL_TAGS entries plus the overflow. */
+  wp_pool_tag_t tags[WP_POOL_TAGS + 1];
+  char name[32];
+
+  /* Registry of live pools. */
+  const wp_pool_t *prev;
+  const wp_pool_t *next;
 } __wp_pool_private_t;
 
+static pthread_mutex_t wp_pool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static const wp_pool_t *wp_pool_registry = NULL;
+
+/* Bit n is set while a thread owns stats slot n. */
+static unsigned wp_pool_thread_slots = 0;
+static pthread_key_t wp_pool_thread_key;
+static pthread_once_t wp_pool_thread_once = PTHREAD_ONCE_INIT;
+static bool wp_pool_thread_key_ready = false;
+static __thread int wp_pool_thread_slot = -1;
+
+/* Relaxed adds: plain read-modify-write for a thread's own slot, atomic for the shared one. */
+#define WP_POOL_STAT_ADD(shared, field, n) \
+  do { \
+    if(shared) { \
+      __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED); \
+    } else { \
+      __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED); \
+    } \
+  } while(0)
+
+/* Runs at thread exit: hand the thread's slot to the next thread to start. */
+static void wp_pool_thread_exit(void *value) {
+  unsigned slot = (unsigned)((uintptr_t)value - 1);
+  __atomic_fetch_and(&wp_pool_thread_slots, ~(1U << slot), __ATOMIC_RELEASE);
+}
+
+static void wp_pool_thread_init(void) {
+  wp_pool_thread_key_ready = pthread_key_create(&wp_pool_thread_key, &wp_pool_thread_exit) == 0;
+}
+
+/**
+ * Claim a free stats slot for the calling thread.
+ * @return the slot, or WP_POOL_SHARED_SLOT if none is free.
+ */
+static int wp_pool_thread_claim(void) {
+  unsigned used = 0;
+
+  pthread_once(&wp_pool_thread_once, &wp_pool_thread_init);
+  if(!wp_pool_thread_key_ready) {
+    return WP_POOL_SHARED_SLOT;
+  }
+
+  used = __atomic_load_n(&wp_pool_thread_slots, __ATOMIC_ACQUIRE);
+  while(~used & ((1U << WP_POOL_SHARED_SLOT) - 1)) {
+    unsigned slot = (unsigned)__builtin_ctz(~used);
+    /* Acquire pairs with the exiting owner's release, so plain adds carry on from its counts. */
+    if(__atomic_compare_exchange_n(&wp_pool_thread_slots, &used, used | (1U << slot), false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      if(pthread_setspecific(wp_pool_thread_key, (void *)(uintptr_t)(slot + 1)) != 0) {
+        __atomic_fetch_and(&wp_pool_thread_slots, ~(1U << slot), __ATOMIC_RELEASE);
+        return WP_POOL_SHARED_SLOT;
+      }
+      return (int)slot;
+    }
+  }
+  return WP_POOL_SHARED_SLOT;
+}
+
+/**
+ * Find the calling thread's stats slot in a pool, making it on first use.
+ * @param d the pool's private data.
+ * @param shared_out set when the slot is shared between threads.
+ * @return the slot, or NULL if it couldn't be allocated.
+ */
+static wp_pool_stat_slot_t *wp_pool_stat_slot(__wp_pool_private_t *d, bool *shared_out) {
+  wp_pool_stat_slot_t *slot = NULL;
+  wp_pool_stat_slot_t *expected = NULL;
+  void *mem = NULL;
+
+  if(wp_pool_thread_slot < 0) {
+    wp_pool_thread_slot = wp_pool_thread_claim();
+  }
+  *shared_out = wp_pool_thread_slot == WP_POOL_SHARED_SLOT;
+
+  if((slot = __atomic_load_n(&d->slots[wp_pool_thread_slot], __ATOMIC_ACQUIRE))) {
+    return slot;
+  }
+  if(posix_memalign(&mem, WP_CACHE_LINE_SIZE, sizeof(*slot)) != 0) {
+    return NULL;
+  }
+  memset(mem, 0, sizeof(*slot));
+  slot = mem;
+  /* Threads sharing the last slot can race to make it. */
+  if(!__atomic_compare_exchange_n(&d->slots[wp_pool_thread_slot], &expected, slot, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    free(slot);
+    slot = expected;
+  }
+  return slot;
+}
+
+/**
+ * Map an aligned allocation size to its stats class.
+ * @param size the size, a non-zero multiple of WP_POOL_ALIGNMENT.
+ * @return the class, 0 to WP_POOL_STAT_CLASSES - 1.
+ */
+static unsigned wp_pool_size_class(size_t size) {
+  /* ceil(log2(size)) - 4, so 16 bytes is class 0. */
+  unsigned bits = size <= 16 ? 4 : (unsigned)(8 * sizeof(unsigned long long)) - (unsigned)__builtin_clzll((unsigned long long)size - 1);
+  return bits - 4 < WP_POOL_STAT_CLASSES ? bits - 4 : WP_POOL_STAT_CLASSES - 1;
+}
+
+/**
+ * Count an allocation against its tag. Tags are compared by address, which
+ * is enough for string literals.
+ * @param d the pool's private data.
+ * @param tag the allocation's tag.
+ * @param size the aligned size of the allocation.
+ */
+static void wp_pool_count_tag(__wp_pool_private_t *d, const char *tag, size_t size) {
+  wp_pool_tag_t *entry = &d->tags[WP_POOL_TAGS];
+
+  for(size_t i = ((uintptr_t)tag >> 3) % WP_POOL_TAGS, n = 0; n < WP_POOL_TAGS; i = (i + 1) % WP_POOL_TAGS, n++) {
+    const char *current = __atomic_load_n(&d->tags[i].tag, __ATOMIC_ACQUIRE);
+    /* Threads can race to claim an empty entry; the loser sees the winner's tag. */
+    if(current == NULL && __atomic_compare_exchange_n(&d->tags[i].tag, &current, tag, false,
+                                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      current = tag;
+    }
+    if(current == tag) {
+      entry = &d->tags[i];
+      break;
+    }
+  }
+
+  __atomic_fetch_add(&entry->allocations, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&entry->bytes, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sum the live bytes of every slot.
+ * @param d the pool's private data.
+ * @return the live bytes.
+ */
+static size_t wp_pool_live(const __wp_pool_private_t *d) {
+  int64_t live = 0;
+  for(int i = 0; i < WP_POOL_STAT_SLOTS; i++) {
+    const wp_pool_stat_slot_t *slot = __atomic_load_n(&d->slots[i], __ATOMIC_ACQUIRE);
+    if(slot) {
+      live += __atomic_load_n(&slot->live, __ATOMIC_RELAXED);
+    }
+  }
+  return live > 0 ? (size_t)live : 0;
+}
+
+/**
+ * Raise the pool's peak to its current live bytes.
+ * @param d the pool's private data.
+ */
+static void wp_pool_sample_peak(__wp_pool_private_t *d) {
+  size_t live = wp_pool_live(d);
+  size_t peak = __atomic_load_n(&d->peak, __ATOMIC_RELAXED);
+  while(live > peak && !__atomic_compare_exchange_n(&d->peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+/**
+ * Map len bytes, 2MB aligned so that huge pages can back them.
+ * @param len a multiple of WP_POOL_HUGE_PAGE_SIZE.
+ * @return the mapping, or MAP_FAILED.
+ */
+static void *wp_pool_map_aligned(size_t len) {
+  char *map = mmap(NULL, len + WP_POOL_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  char *aligned = NULL;
+
+  if(map == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+
+  aligned = (char *)(((uintptr_t)map + WP_POOL_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(WP_POOL_HUGE_PAGE_SIZE - 1));
+  if(aligned > map) {
+    munmap(map, (size_t)(aligned - map));
+  }
+  munmap(aligned + len, (size_t)(map + WP_POOL_HUGE_PAGE_SIZE - aligned));
+  return aligned;
+}
+
+/**
+ * How many NUMA nodes the system may bring online, from the highest number in
+ * /sys/devices/system/node/possible (e.g. "0-3").
+ * @return the node count, or 0 if there's no NUMA support.
+ */
+static int wp_pool_numa_nodes(void) {
+  static int nodes = -1;
+  FILE *file = NULL;
+  char line[256] = {0};
+  int count = 0;
+
+  if(__atomic_load_n(&nodes, __ATOMIC_RELAXED) >= 0) {
+    return nodes;
+  }
+  if((file = fopen("/sys/devices/system/node/possible", "r"))) {
+    if(fgets(line, sizeof(line), file)) {
+      char *last = strrchr(line, '-');
+      char *comma = strrchr(line, ',');
+      last = comma > last ? comma : last;
+      count = atoi(last ? last + 1 : line) + 1;
+    }
+    fclose(file);
+  }
+  __atomic_store_n(&nodes, count, __ATOMIC_RELAXED);
+  return count;
+}
+
+/**
+ * Map a block as the pool's options ask, degrading where they can't be met.
+ * @param options the pool's options.
+ * @param len the mapping length, a multiple of the page size.
+ * @return the mapping, or MAP_FAILED.
+ */
+static void *wp_pool_map(const wp_pool_options_t *options, size_t len) {
+  void *map = MAP_FAILED;
+  /* Policies set after mmap must come before the first fault. */
+  bool late_policy = options->numa_node >= 0;
+  bool huge = len % WP_POOL_HUGE_PAGE_SIZE == 0;
+
+  if(options->hugepages == WP_POOL_HUGEPAGES_EXPLICIT && huge) {
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (options->prefault && !late_policy ? MAP_POPULATE : 0), -1, 0);
+    if(map != MAP_FAILED && !late_policy) {
+      return map;
+    }
+  }
+
+  if(map == MAP_FAILED) {
+    if(options->hugepages != WP_POOL_HUGEPAGES_OFF && huge) {
+      if((map = wp_pool_map_aligned(len)) != MAP_FAILED) {
+        /* Without THP this fails harmlessly and we keep small pages. */
+        madvise(map, len, MADV_HUGEPAGE);
+        late_policy = true;
+      }
+    } else {
+      map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | (options->prefault && !late_policy ? MAP_POPULATE : 0), -1, 0);
+      if(map != MAP_FAILED && !late_policy) {
+        return map;
+      }
+    }
+  }
+
+  if(map == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+
+  if(options->numa_node >= 0 && options->numa_node < WP_POOL_MAX_NUMA_NODES && options->numa_node < wp_pool_numa_nodes()) {
+    unsigned long nodemask[WP_POOL_MAX_NUMA_NODES / WP_POOL_MASK_BITS] = {0};
+    nodemask[options->numa_node / WP_POOL_MASK_BITS] = 1UL << (options->numa_node % WP_POOL_MASK_BITS);
+    /* ENOSYS or EINVAL on kernels and machines without NUMA: keep the default policy. */
+    syscall(SYS_mbind, map, len, MPOL_BIND, nodemask, (unsigned long)WP_POOL_MAX_NUMA_NODES + 1, 0);
+  }
+
+  if(options->prefault && madvise(map, len, MADV_POPULATE_WRITE) != 0) {
+    /* Kernels before 5.14: touch every page ourselves. */
+    long page_size = sysconf(_SC_PAGESIZE);
+    for(size_t offset = 0; offset < len; offset += (size_t)page_size) {
+      ((volatile char *)map)[offset] = 0;
+    }
+  }
+
+  return map;
+}
+
+static wp_pool_block_t *wp_pool_block_new(__wp_pool_private_t *d, size_t size) {
+  wp_pool_block_t *block = NULL;
+  size_t mapped = 0;
+
+  if(d->mapped) {
+    size_t page = d->options.hugepages != WP_POOL_HUGEPAGES_OFF && WP_POOL_BLOCK_HEADER + size >= WP_POOL_HUGE_PAGE_SIZE ?
+                  WP_POOL_HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    mapped = (WP_POOL_BLOCK_HEADER + size + page - 1) & ~(page - 1);
+    if((block = wp_pool_map(&d->options, mapped)) == MAP_FAILED) {
+      return NULL;
+    }
+    /* Use the whole mapping. */
+    size = mapped - WP_POOL_BLOCK_HEADER;
+  } else if((block = malloc(WP_POOL_BLOCK_HEADER + size)) == NULL) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  block->last = SIZE_MAX;
+  block->mapped = mapped;
+
+  __atomic_store_n(&d->reserved, d->reserved + WP_POOL_BLOCK_HEADER + size, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->blocks, d->blocks + 1, __ATOMIC_RELAXED);
+  return block;
+}
+
+static void wp_pool_block_delete(wp_pool_block_t *block) {
+  if(block->mapped) {
+    munmap(block, block->mapped);
+  } else {
+    free(block);
+  }
+}
+
+/**
+ * Get a block for a pool, reusing one of its parent's spares when a standard
+ * block will do.
+ * @param d the pool's private data.
+ * @param size the bytes the block must hold.
+ * @return the empty block, or NULL if one couldn't be allocated.
+ */
+static wp_pool_block_t *wp_pool_block_take(__wp_pool_private_t *d, size_t size) {
+  __wp_pool_private_t *p = d->parent ? d->parent->data : NULL;
+  wp_pool_block_t *block = NULL;
+
+  if(p == NULL || p->spare == NULL || size > d->standard_size) {
+    return wp_pool_block_new(d, size);
+  }
+
+  block = p->spare;
+  p->spare = block->next;
+  p->spares--;
+  __atomic_store_n(&p->reserved, p->reserved - (WP_POOL_BLOCK_HEADER + block->size), __ATOMIC_RELAXED);
+  __atomic_store_n(&p->blocks, p->blocks - 1, __ATOMIC_RELAXED);
+
+  block->next = NULL;
+  block->used = 0;
+  block->last = SIZE_MAX;
+  __atomic_store_n(&d->reserved, d->reserved + WP_POOL_BLOCK_HEADER + block->size, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->blocks, d->blocks + 1, __ATOMIC_RELAXED);
+  return block;
+}
+
+/**
+ * Let go of one of a pool's blocks: a standard block goes to the parent's
+ * spares while it has room, anything else is freed.
+ * @param d the pool's private data.
+ * @param block the block, already unlinked.
+ */
+static void wp_pool_block_give(__wp_pool_private_t *d, wp_pool_block_t *block) {
+  __wp_pool_private_t *p = d->parent ? d->parent->data : NULL;
+
+  __atomic_store_n(&d->reserved, d->reserved - (WP_POOL_BLOCK_HEADER + block->size), __ATOMIC_RELAXED);
+  __atomic_store_n(&d->blocks, d->blocks - 1, __ATOMIC_RELAXED);
+
+  if(p && block->size == d->standard_size && p->spares < WP_POOL_SPARES) {
+    block->next = p->spare;
+    p->spare = block;
+    p->spares++;
+    __atomic_store_n(&p->reserved, p->reserved + WP_POOL_BLOCK_HEADER + block->size, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->blocks, p->blocks + 1, __ATOMIC_RELAXED);
+  } else {
+    wp_pool_block_delete(block);
+  }
+}
+
+/**
+ * Allocate size bytes, aligned for any type, from the pool.
+ * @param self pointer to an instance of the pool.
+ * @param size the number of bytes to allocate.
+ * @param tag the allocation site to count the bytes against, or NULL.
+ * @return the memory, or NULL if a new block couldn't be allocated.
+ */
+static void *wp_pool_palloc_tagged(const wp_pool_t *self, size_t size, const char *tag) {
+  assert(self && self->data);
+  wp_pool_block_t *block = self->data->pool;
+  size_t aligned = WP_POOL_ALIGN(size ? size : 1);
+  wp_pool_stat_slot_t *slot = NULL;
+  bool shared = false;
+
+  if(aligned < size) {
+    return NULL;
+  }
+
+  if(block == NULL || block->size - block->used < aligned) {
+    size_t block_size = self->data->block_size;
+    wp_pool_block_t *fresh = NULL;
+    /* A persistent pool is a single region, and can't grow. */
+    if(self->data->region) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    if((fresh = wp_pool_block_take(self->data, aligned > block_size ? aligned : block_size)) == NULL) {
+      return NULL;
+    }
+    /* Growth is when the peak can have moved by more than a block. */
+    wp_pool_sample_peak(self->data);
+    if(block && aligned > block_size) {
+      /* Oversized allocations get a block of their own behind the current one. */
+      fresh->next = block->next;
+      block->next = fresh;
+      block = fresh;
+    } else {
+      fresh->next = block;
+      self->data->pool = block = fresh;
+    }
+  }
+
+  char *mem = (char *)block + WP_POOL_BLOCK_HEADER + block->used;
+  block->last = block->used;
+  block->used += aligned;
+
+  if((slot = wp_pool_stat_slot(self->data, &shared))) {
+    WP_POOL_STAT_ADD(shared, slot->live, (int64_t)aligned);
+    WP_POOL_STAT_ADD(shared, slot->allocations, 1);
+    WP_POOL_STAT_ADD(shared, slot->classes[wp_pool_size_class(aligned)], 1);
+  }
+  if(tag) {
+    wp_pool_count_tag(self->data, tag, aligned);
+  }
+  return mem;
+}
+
+static void *wp_pool_palloc(const wp_pool_t *self, size_t size) {
+  return wp_pool_palloc_tagged(self, size, NULL);
+}
+
+/**
+ * Give back memory from the pool. Only the most recent allocation of the
+ * current block is actually reclaimed; everything else lives until the pool
+ * is deleted.
+ * @param self pointer to an instance of the pool.
+ * @param what memory returned by palloc, or NULL.
+ */
+static void wp_pool_pfree(const wp_pool_t *self, void *what) {
+  assert(self && self->data);
+  wp_pool_block_t *block = self->data->pool;
+
+  if(what && block && block->last != SIZE_MAX && (char *)what == (char *)block + WP_POOL_BLOCK_HEADER + block->last) {
+    wp_pool_stat_slot_t *slot = NULL;
+    bool shared = false;
+    if((slot = wp_pool_stat_slot(self->data, &shared))) {
+      WP_POOL_STAT_ADD(shared, slot->live, -(int64_t)(block->used - block->last));
+      WP_POOL_STAT_ADD(shared, slot->frees, 1);
+    }
+    block->used = block->last;
+    block->last = SIZE_MAX;
+  }
+}
+
+/**
+ * Release everything allocated from the pool at once. The current block is
+ * kept and rewound, so this is O(1) unless the pool grew; any other blocks
+ * go back to the parent's spares, or are freed.
+ * @param self pointer to an instance of the pool.
+ */
+static void wp_pool_reset(const wp_pool_t *self) {
+  assert(self && self->data);
+  wp_pool_block_t *block = self->data->pool;
+  wp_pool_block_t *rest = NULL;
+  wp_pool_stat_slot_t *slot = NULL;
+  bool shared = false;
+  size_t live = 0;
+
+  if(block == NULL) {
+    return;
+  }
+
+  rest = block->next;
+  block->next = NULL;
+  block->used = 0;
+  block->last = SIZE_MAX;
+  while(rest) {
+    wp_pool_block_t *next = rest->next;
+    wp_pool_block_give(self->data, rest);
+    rest = next;
+  }
+  if(self->data->region) {
+    self->data->region->root = 0;
+  }
+
+  /* Keep the peak, then zero live by taking it out of this thread's slot. */
+  wp_pool_sample_peak(self->data);
+  if((live = wp_pool_live(self->data)) && (slot = wp_pool_stat_slot(self->data, &shared))) {
+    WP_POOL_STAT_ADD(shared, slot->live, -(int64_t)live);
+  }
+}
+
+static void wp_pool_set_name(const wp_pool_t *self, const char *name) {
+  assert(self && self->data);
+  strncpy(self->data->name, name ? name : "", sizeof(self->data->name) - 1);
+  self->data->name[sizeof(self->data->name) - 1] = '\0';
+}
+
+static void wp_pool_get_stats(const wp_pool_t *self, wp_pool_stats_t *stats) {
+  assert(self && self->data && stats);
+  memset(stats, 0, sizeof(*stats));
+
+  wp_pool_sample_peak(self->data);
+  for(int i = 0; i < WP_POOL_STAT_SLOTS; i++) {
+    const wp_pool_stat_slot_t *slot = __atomic_load_n(&self->data->slots[i], __ATOMIC_ACQUIRE);
+    if(slot) {
+      stats->allocations += __atomic_load_n(&slot->allocations, __ATOMIC_RELAXED);
+      stats->frees += __atomic_load_n(&slot->frees, __ATOMIC_RELAXED);
+      for(int c = 0; c < WP_POOL_STAT_CLASSES; c++) {
+        stats->classes[c] += __atomic_load_n(&slot->classes[c], __ATOMIC_RELAXED);
+      }
+    }
+  }
+  stats->live = wp_pool_live(self->data);
+  stats->peak = __atomic_load_n(&self->data->peak, __ATOMIC_RELAXED);
+  if(stats->peak < stats->live) {
+    stats->peak = stats->live;
+  }
+  stats->reserved = __atomic_load_n(&self->data->reserved, __ATOMIC_RELAXED);
+  stats->blocks = __atomic_load_n(&self->data->blocks, __ATOMIC_RELAXED);
+}
+
+void wp_pool_report(const wp_pool_t *self, wp_pool_report_fn fn, void *arg) {
+  assert(self && self->data && fn);
+  wp_pool_stats_t stats;
+  char line[256];
+  int len = 0;
+  const wp_pool_tag_t *tags = NULL;
+  /* Indexes of the busiest tags, by bytes. */
+  int top[8];
+  int ntop = 0;
+
+  self->get_stats(self, &stats);
+  snprintf(line, sizeof(line), "pool %s (%p): live %zu, peak %zu, reserved %zu in %zu blocks, %" PRIu64 " allocations, %" PRIu64 " frees",
+           self->data->name[0] ? self->data->name : "(unnamed)", (const void *)self, stats.live, stats.peak, stats.reserved,
+           stats.blocks, stats.allocations, stats.frees);
+  fn(line, arg);
+
+  len = snprintf(line, sizeof(line), "  size classes:");
+  for(int c = 0; c < WP_POOL_STAT_CLASSES && len < (int)sizeof(line); c++) {
+    if(stats.classes[c]) {
+      len += snprintf(line + len, sizeof(line) - (size_t)len, c < WP_POOL_STAT_CLASSES - 1 ? " <=%zu:%" PRIu64 : " >%zu:%" PRIu64,
+                      (size_t)16 << (c < WP_POOL_STAT_CLASSES - 1 ? c : c - 1), stats.classes[c]);
+    }
+  }
+  if(stats.allocations) {
+    fn(line, arg);
+  }
+
+  tags = self->data->tags;
+  /* Pick the busiest tags, a handful out of WP_POOL_TAGS + 1 entries. */
+  while(ntop < (int)(sizeof(top) / sizeof(top[0]))) {
+    uint64_t best_bytes = 0;
+    int best = -1;
+    for(int i = 0; i <= WP_POOL_TAGS; i++) {
+      uint64_t bytes = __atomic_load_n(&tags[i].bytes, __ATOMIC_RELAXED);
+      bool taken = false;
+      for(int j = 0; j < ntop; j++) {
+        taken = taken || top[j] == i;
+      }
+      if(!taken && bytes > best_bytes) {
+        best_bytes = bytes;
+        best = i;
+      }
+    }
+    if(best < 0) {
+      break;
+    }
+    top[ntop++] = best;
+  }
+  for(int i = 0; i < ntop; i++) {
+    const char *tag = __atomic_load_n(&tags[top[i]].tag, __ATOMIC_ACQUIRE);
+    snprintf(line, sizeof(line), "  %s: %" PRIu64 " bytes allocated in %" PRIu64 " allocations",
+             top[i] == WP_POOL_TAGS || tag == NULL ? "(other tags)" : tag,
+             __atomic_load_n(&tags[top[i]].bytes, __ATOMIC_RELAXED), __atomic_load_n(&tags[top[i]].allocations, __ATOMIC_RELAXED));
+    fn(line, arg);
+  }
+}
+
+size_t wp_pool_report_all(wp_pool_report_fn fn, void *arg) {
+  size_t count = 0;
+
+  pthread_mutex_lock(&wp_pool_registry_lock);
+  for(const wp_pool_t *pool = wp_pool_registry; pool; pool = pool->data->next) {
+    wp_pool_report(pool, fn, arg);
+    count++;
+  }
+  pthread_mutex_unlock(&wp_pool_registry_lock);
+
+  return count;
+}
+
+void wp_pool_report_print(const char *line, void *arg) {
+  fprintf(arg ? (FILE *)arg : stdout, "%s\n", line);
+}
+
+void wp_pool_options_init(wp_pool_options_t *options) {
+  assert(options);
+  options->hugepages = WP_POOL_HUGEPAGES_OFF;
+  options->prefault = false;
+  options->numa_node = -1;
+}
+
+void wp_pool_options_from_config(wp_pool_options_t *options, const wp_configuration_t *config) {
+  assert(options && config);
+  options->hugepages = config->get_pool_hugepages(config);
+  options->prefault = config->get_pool_prefault(config);
+  options->numa_node = config->get_pool_numa_node(config);
+  if(options->numa_node >= WP_POOL_MAX_NUMA_NODES || options->numa_node >= wp_pool_numa_nodes()) {
+    /* No such node here: don't bind at all rather than fail every block. */
+    options->numa_node = -1;
+  }
+}
+
+/**
+ * Fill in a new pool's methods and add it to the registry.
+ * @param self the pool, its private data initialized.
+ */
+static void wp_pool_setup(wp_pool_t *self) {
+  self->palloc = &wp_pool_palloc;
+  self->pfree = &wp_pool_pfree;
+  self->palloc_tagged = &wp_pool_palloc_tagged;
+  self->reset = &wp_pool_reset;
+  self->set_name = &wp_pool_set_name;
+  self->get_stats = &wp_pool_get_stats;
+
+  pthread_mutex_lock(&wp_pool_registry_lock);
+  self->data->next = wp_pool_registry;
+  if(wp_pool_registry) {
+    wp_pool_registry->data->prev = self;
+  }
+  wp_pool_registry = self;
+  pthread_mutex_unlock(&wp_pool_registry_lock);
+}
+
+wp_status_t wp_pool_new_with_options(wp_pool_t **self_out, size_t size, const wp_pool_options_t *options) {
+  wp_status_t ret = WP_FAILURE;
+  wp_pool_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->block_size = WP_POOL_ALIGN(size ? size : 1);
+      self->data->parent = NULL;
+      if(options) {
+        self->data->options = *options;
+      } else {
+        wp_pool_options_init(&self->data->options);
+      }
+      self->data->mapped = self->data->options.hugepages != WP_POOL_HUGEPAGES_OFF ||
+                           self->data->options.prefault || self->data->options.numa_node >= 0;
+      self->data->region_fd = -1;
+      if((self->data->pool = wp_pool_block_new(self->data, self->data->block_size))) {
+        self->data->standard_size = self->data->pool->size;
+        wp_pool_setup(self);
+        *self_out = self;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  return ret;
+}
+
 wp_status_t wp_pool_new(wp_pool_t **self_out, size_t size) {
+  return wp_pool_new_with_options(self_out, size, NULL);
+}
+
+wp_status_t wp_pool_new_child(wp_pool_t **self_out, const wp_pool_t *parent) {
+  assert(self_out && parent && parent->data && parent->data->region == NULL);
   wp_status_t ret = WP_FAILURE;
   wp_pool_t *self = NULL;
 
   if((self = malloc(sizeof(*self)))) {
-    if((self->data = malloc(sizeof(*(self->data))))) {
-      if((self->data->pool = malloc(size))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->parent = parent;
+      self->data->block_size = parent->data->block_size;
+      self->data->standard_size = parent->data->standard_size;
+      self->data->options = parent->data->options;
+      self->data->mapped = parent->data->mapped;
+      self->data->region_fd = -1;
+      if((self->data->pool = wp_pool_block_take(self->data, self->data->block_size))) {
+        wp_pool_setup(self);
         *self_out = self;
         ret = WP_SUCCESS;
       } else {
@@ -35,3 +821,247 @@ wp_status_t wp_pool_new(wp_pool_t **self_out, size_t size) {
 
   return ret;
 }
+
+static wp_pool_block_t *wp_pool_region_block(wp_pool_region_t *region) {
+  return (wp_pool_block_t *)((char *)region + WP_POOL_REGION_HEADER);
+}
+
+static uint64_t wp_pool_region_checksum(wp_pool_region_t *region) {
+  wp_pool_block_t *block = wp_pool_region_block(region);
+  return wp_string_hash_bytes((const char *)block, WP_POOL_BLOCK_HEADER + block->used)
+         ^ wp_string_hash_bytes((const char *)&region->root, sizeof(region->root));
+}
+
+/**
+ * Can a region left by an earlier run be used as it is? Every field is
+ * checked before it's trusted, since the file may be anything at all.
+ * @param region the mapped file.
+ * @param length the file's length.
+ * @param layout the caller's layout version.
+ * @return true if the region was sealed by a compatible run and is intact.
+ */
+static bool wp_pool_region_valid(wp_pool_region_t *region, size_t length, uint32_t layout) {
+  wp_pool_block_t *block = wp_pool_region_block(region);
+
+  return region->magic == WP_POOL_REGION_MAGIC
+      && region->format == WP_POOL_REGION_FORMAT
+      && region->layout == layout
+      && region->length == length
+      && region->sealed == 1
+      && block->next == NULL
+      && block->mapped == 0
+      && block->size == length - WP_POOL_REGION_HEADER - WP_POOL_BLOCK_HEADER
+      && block->used <= block->size
+      && (block->last == SIZE_MAX || block->last < block->used)
+      && region->root < length
+      && region->checksum == wp_pool_region_checksum(region);
+}
+
+/**
+ * Map a persistent pool's file, keeping its contents if they're valid and
+ * starting it afresh otherwise. The region is left unsealed, so that a crash
+ * while it's attached gets it discarded.
+ * @param path the file.
+ * @param length the file's length.
+ * @param layout the caller's layout version.
+ * @param fd_out set to the locked file.
+ * @param reattached_out set to whether the contents were kept.
+ * @return the mapping, or MAP_FAILED.
+ */
+static wp_pool_region_t *wp_pool_region_open(const char *path, size_t length, uint32_t layout, int *fd_out, bool *reattached_out) {
+  wp_pool_region_t *region = MAP_FAILED;
+  wp_pool_block_t *block = NULL;
+  struct stat st;
+  int fd = -1, err = 0;
+
+  *reattached_out = false;
+  if((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+    return MAP_FAILED;
+  }
+  /* Another live instance has it. */
+  if(flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0) {
+    err = errno;
+    close(fd);
+    errno = err;
+    return MAP_FAILED;
+  }
+
+  if((size_t)st.st_size == length
+     && (region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+    *reattached_out = wp_pool_region_valid(region, length, layout);
+  }
+  if(!*reattached_out) {
+    if(region != MAP_FAILED) {
+      munmap(region, length);
+    }
+    /* Truncating to nothing first zeroes every page, so nothing stale is left. */
+    if(ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)length) != 0
+       || (region = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      err = errno;
+      close(fd);
+      errno = err;
+      return MAP_FAILED;
+    }
+    region->magic = WP_POOL_REGION_MAGIC;
+    region->format = WP_POOL_REGION_FORMAT;
+    region->layout = layout;
+    region->length = length;
+    region->root = 0;
+    block = wp_pool_region_block(region);
+    block->next = NULL;
+    block->size = length - WP_POOL_REGION_HEADER - WP_POOL_BLOCK_HEADER;
+    block->used = 0;
+    block->last = SIZE_MAX;
+    block->mapped = 0;
+  }
+
+  region->sealed = 0;
+  *fd_out = fd;
+  return region;
+}
+
+wp_status_t wp_pool_new_persistent(wp_pool_t **self_out, const char *path, size_t size, uint32_t layout, bool *reattached_out) {
+  assert(self_out && path);
+  wp_status_t ret = WP_FAILURE;
+  wp_pool_t *self = NULL;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t length = (WP_POOL_REGION_HEADER + WP_POOL_BLOCK_HEADER + WP_POOL_ALIGN(size ? size : 1) + page - 1) & ~(page - 1);
+  bool reattached = false;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->block_size = length - WP_POOL_REGION_HEADER - WP_POOL_BLOCK_HEADER;
+      self->data->parent = NULL;
+      wp_pool_options_init(&self->data->options);
+      self->data->region_length = length;
+      if((self->data->region = wp_pool_region_open(path, length, layout, &self->data->region_fd, &reattached)) != MAP_FAILED) {
+        self->data->pool = wp_pool_region_block(self->data->region);
+        self->data->reserved = length;
+        self->data->blocks = 1;
+        wp_pool_setup(self);
+
+        /* Count what the previous run left as live, so that stats add up. */
+        if(self->data->pool->used) {
+          wp_pool_stat_slot_t *slot = NULL;
+          bool shared = false;
+          if((slot = wp_pool_stat_slot(self->data, &shared))) {
+            WP_POOL_STAT_ADD(shared, slot->live, (int64_t)self->data->pool->used);
+          }
+          wp_pool_sample_peak(self->data);
+        }
+
+        *self_out = self;
+        ret = WP_SUCCESS;
+      } else {
+        free(self->data);
+        self->data = NULL;
+        free(self);
+        self = NULL;
+      }
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  if(reattached_out) {
+    *reattached_out = reattached;
+  }
+  return ret;
+}
+
+wp_pool_offset_t wp_pool_offset_of(const wp_pool_t *self, const void *ptr) {
+  assert(self && self->data && self->data->region);
+  assert(ptr == NULL || ((const char *)ptr > (const char *)self->data->region
+                         && (const char *)ptr < (const char *)self->data->region + self->data->region_length));
+  return ptr ? (wp_pool_offset_t)((const char *)ptr - (const char *)self->data->region) : 0;
+}
+
+void *wp_pool_pointer_at(const wp_pool_t *self, wp_pool_offset_t offset) {
+  assert(self && self->data && self->data->region);
+  assert(offset < self->data->region_length);
+  return offset ? (char *)self->data->region + offset : NULL;
+}
+
+bool wp_pool_contains(const wp_pool_t *self, const void *ptr) {
+  assert(self && self->data && self->data->region);
+  const char *start = (const char *)self->data->pool + WP_POOL_BLOCK_HEADER;
+  return (const char *)ptr >= start && (const char *)ptr < start + self->data->pool->used;
+}
+
+void wp_pool_rewind(const wp_pool_t *self, const void *mark) {
+  assert(self && self->data && self->data->region);
+  wp_pool_block_t *block = self->data->pool;
+  wp_pool_stat_slot_t *slot = NULL;
+  bool shared = false;
+  size_t used = 0;
+
+  if(mark == NULL || !wp_pool_contains(self, mark)) {
+    return;
+  }
+  used = (size_t)((const char *)mark - ((const char *)block + WP_POOL_BLOCK_HEADER));
+  if((slot = wp_pool_stat_slot(self->data, &shared))) {
+    WP_POOL_STAT_ADD(shared, slot->live, -(int64_t)(block->used - used));
+  }
+  block->used = used;
+  block->last = SIZE_MAX;
+  if(self->data->region->root >= wp_pool_offset_of(self, mark)) {
+    self->data->region->root = 0;
+  }
+}
+
+void wp_pool_set_root(const wp_pool_t *self, const void *root) {
+  assert(self && self->data && self->data->region);
+  self->data->region->root = wp_pool_offset_of(self, root);
+}
+
+void *wp_pool_get_root(const wp_pool_t *self) {
+  assert(self && self->data && self->data->region);
+  return wp_pool_pointer_at(self, self->data->region->root);
+}
+
+void wp_pool_delete(wp_pool_t *self) {
+  assert(self);
+  if(self->data) {
+    wp_pool_block_t *block = self->data->pool;
+
+    pthread_mutex_lock(&wp_pool_registry_lock);
+    if(self->data->prev) {
+      self->data->prev->data->next = self->data->next;
+    } else {
+      wp_pool_registry = self->data->next;
+    }
+    if(self->data->next) {
+      self->data->next->data->prev = self->data->prev;
+    }
+    pthread_mutex_unlock(&wp_pool_registry_lock);
+
+    if(self->data->region) {
+      /*
+       * Seal the region for the next run. Stores to a shared mapping reach
+       * the file without msync; the checksum catches what a power loss tore.
+       */
+      self->data->region->checksum = wp_pool_region_checksum(self->data->region);
+      __atomic_store_n(&self->data->region->sealed, 1, __ATOMIC_RELEASE);
+      munmap(self->data->region, self->data->region_length);
+      close(self->data->region_fd);
+    } else {
+      while(block) {
+        wp_pool_block_t *next = block->next;
+        wp_pool_block_give(self->data, block);
+        block = next;
+      }
+      for(block = self->data->spare; block; ) {
+        wp_pool_block_t *next = block->next;
+        wp_pool_block_delete(block);
+        block = next;
+      }
+    }
+    for(int i = 0; i < WP_POOL_STAT_SLOTS; i++) {
+      free(self->data->slots[i]);
+    }
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
@@ -0,0 +1,617 @@
+/*
+ * File:   wp_profiler.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:55 AM
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <wp_common.h>
+#include <wp_profiler.h>
+
+#ifdef WP_PROFILER_LIBUNWIND
+  #define UNW_LOCAL_ONLY
+  #include <libunwind.h>
+#endif
+
+#ifndef sigev_notify_thread_id
+  #define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#define WP_PROFILER_DEFAULT_HZ 99
+/* Words of samples buffered per thread; the collector drains them every period. */
+#define WP_PROFILER_RING_WORDS (16 * 1024)
+#define WP_PROFILER_COLLECT_MS 250
+
+/* One sampled thread. The signal handler is the only producer into ring. */
+typedef struct wp_profiler_thread {
+  bool used;
+  pid_t tid;
+  timer_t timer;
+  bool has_timer;
+  char name[32];
+  /* The thread's stack; frame pointers outside it end a walk. */
+  uintptr_t stack_lo;
+  uintptr_t stack_hi;
+
+  /* Samples as [depth, frame 0 (the leaf), frame 1, ...], indexed mod WP_PROFILER_RING_WORDS. */
+  uintptr_t *ring;
+  uint64_t head WP_CACHE_ALIGNED;
+  uint64_t dropped;
+  uint64_t tail WP_CACHE_ALIGNED;
+  /* How much of dropped the profiler has already counted. */
+  uint64_t dropped_counted;
+} wp_profiler_thread_t;
+
+/* A distinct stack, and how often it was seen. */
+typedef struct wp_profiler_stack {
+  uint64_t hash;
+  uint64_t count;
+  char thread[32];
+  uint32_t depth;
+  uintptr_t *frames;
+} wp_profiler_stack_t;
+
+typedef struct __wp_profiler_private_t {
+  uint64_t interval_ns;
+
+  /* Guards everything below. */
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  bool running;
+  bool stopping;
+  pthread_t collector;
+
+  wp_profiler_thread_t threads[WP_PROFILER_MAX_THREADS];
+
+  /* Open addressing on hash; the capacity is a power of two. */
+  wp_profiler_stack_t *stacks;
+  size_t stack_count;
+  size_t stack_capacity;
+  uint64_t samples;
+  uint64_t dropped;
+} __wp_profiler_private_t;
+
+/* The calling thread's slot, read by the signal handler. */
+static __thread wp_profiler_thread_t *wp_profiler_current = NULL;
+
+/**
+ * Walk the interrupted stack by frame pointer.
+ * @param uc the interrupted context.
+ * @param t the interrupted thread.
+ * @param frames receives return addresses, leaf first.
+ * @return the number of frames.
+ */
+static int wp_profiler_unwind(const ucontext_t *uc, const wp_profiler_thread_t *t, uintptr_t *frames) {
+  int depth = 0;
+#if defined(WP_PROFILER_LIBUNWIND)
+  (void)uc;
+  (void)t;
+  void *ips[WP_PROFILER_MAX_DEPTH + 2];
+  int n = unw_backtrace(ips, WP_PROFILER_MAX_DEPTH + 2);
+  /* Skip this handler and the kernel's signal trampoline. */
+  for(int i = 2; i < n; i++) {
+    frames[depth++] = (uintptr_t)ips[i];
+  }
+#elif defined(__x86_64__) || defined(__aarch64__)
+  #if defined(__x86_64__)
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+  uintptr_t fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+  #else
+  uintptr_t pc = (uintptr_t)uc->uc_mcontext.pc;
+  uintptr_t fp = (uintptr_t)uc->uc_mcontext.regs[29];
+  #endif
+  frames[depth++] = pc;
+  /* Each frame is [caller's frame pointer, return address]. */
+  while(depth < WP_PROFILER_MAX_DEPTH && fp >= t->stack_lo && fp <= t->stack_hi - 2 * sizeof(uintptr_t)
+        && (fp & (sizeof(uintptr_t) - 1)) == 0) {
+    uintptr_t next = ((const uintptr_t *)fp)[0];
+    uintptr_t ret = ((const uintptr_t *)fp)[1];
+    if(ret == 0) {
+      break;
+    }
+    frames[depth++] = ret;
+    if(next <= fp) {
+      break;
+    }
+    fp = next;
+  }
+#else
+  (void)uc;
+  (void)t;
+  (void)frames;
+#endif
+  return depth;
+}
+
+/**
+ * SIGPROF: append the interrupted stack to the thread's ring, or count it dropped.
+ * @param sig the signal.
+ * @param info unused.
+ * @param context the interrupted context.
+ */
+static void wp_profiler_signal(int sig, siginfo_t *info, void *context) {
+  (void)sig;
+  (void)info;
+  wp_profiler_thread_t *t = wp_profiler_current;
+  uintptr_t frames[WP_PROFILER_MAX_DEPTH];
+  int saved_errno = errno;
+  int depth = 0;
+
+  if(t == NULL || t->ring == NULL) {
+    return;
+  }
+
+  if((depth = wp_profiler_unwind(context, t, frames)) > 0) {
+    uint64_t head = t->head;
+    uint64_t tail = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+    if(WP_PROFILER_RING_WORDS - (head - tail) < (uint64_t)depth + 1) {
+      __atomic_store_n(&t->dropped, t->dropped + 1, __ATOMIC_RELAXED);
+    } else {
+      t->ring[head++ % WP_PROFILER_RING_WORDS] = (uintptr_t)depth;
+      for(int i = 0; i < depth; i++) {
+        t->ring[head++ % WP_PROFILER_RING_WORDS] = frames[i];
+      }
+      __atomic_store_n(&t->head, head, __ATOMIC_RELEASE);
+    }
+  }
+  errno = saved_errno;
+}
+
+static uint64_t wp_profiler_hash(const char *thread, const uintptr_t *frames, uint32_t depth) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for(const char *p = thread; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 0x100000001b3ull;
+  }
+  for(uint32_t i = 0; i < depth; i++) {
+    h = (h ^ frames[i]) * 0x100000001b3ull;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+/**
+ * Count a stack in the table. Called with the lock held.
+ * @param d the profiler's private data.
+ * @param thread the sampled thread's name.
+ * @param frames the stack, leaf first.
+ * @param depth the number of frames.
+ * @return WP_SUCCESS, or WP_FAILURE if the table couldn't grow.
+ */
+static wp_status_t wp_profiler_count(__wp_profiler_private_t *d, const char *thread, const uintptr_t *frames, uint32_t depth) {
+  uint64_t hash = wp_profiler_hash(thread, frames, depth);
+  size_t mask = 0;
+  size_t i = 0;
+
+  if((d->stack_count + 1) * 4 > d->stack_capacity * 3) {
+    size_t capacity = d->stack_capacity ? d->stack_capacity * 2 : 1024;
+    wp_profiler_stack_t *stacks = calloc(capacity, sizeof(*stacks));
+    if(stacks == NULL) {
+      return WP_FAILURE;
+    }
+    for(size_t j = 0; j < d->stack_capacity; j++) {
+      if(d->stacks[j].frames) {
+        size_t k = d->stacks[j].hash & (capacity - 1);
+        while(stacks[k].frames) {
+          k = (k + 1) & (capacity - 1);
+        }
+        stacks[k] = d->stacks[j];
+      }
+    }
+    free(d->stacks);
+    d->stacks = stacks;
+    d->stack_capacity = capacity;
+  }
+
+  mask = d->stack_capacity - 1;
+  for(i = hash & mask; d->stacks[i].frames; i = (i + 1) & mask) {
+    wp_profiler_stack_t *s = &d->stacks[i];
+    if(s->hash == hash && s->depth == depth && strcmp(s->thread, thread) == 0
+       && memcmp(s->frames, frames, depth * sizeof(*frames)) == 0) {
+      s->count++;
+      return WP_SUCCESS;
+    }
+  }
+
+  if((d->stacks[i].frames = malloc(depth * sizeof(*frames))) == NULL) {
+    return WP_FAILURE;
+  }
+  memcpy(d->stacks[i].frames, frames, depth * sizeof(*frames));
+  d->stacks[i].hash = hash;
+  d->stacks[i].count = 1;
+  d->stacks[i].depth = depth;
+  snprintf(d->stacks[i].thread, sizeof(d->stacks[i].thread), "%s", thread);
+  d->stack_count++;
+
+  return WP_SUCCESS;
+}
+
+/**
+ * Map a sampled address to the start of its function, so that samples
+ * anywhere in a function count as the same frame.
+ * @param pc the address.
+ * @param is_return whether pc is a return address, which points past its call.
+ * @return the function's address, or pc if it has no symbol.
+ */
+static uintptr_t wp_profiler_function(uintptr_t pc, bool is_return) {
+  Dl_info info;
+  if(dladdr((void *)(is_return ? pc - 1 : pc), &info) && info.dli_sname && info.dli_saddr) {
+    return (uintptr_t)info.dli_saddr;
+  }
+  return pc;
+}
+
+/**
+ * Move a thread's buffered samples into the table. Called with the lock held.
+ * @param d the profiler's private data.
+ * @param t the thread.
+ */
+static void wp_profiler_drain(__wp_profiler_private_t *d, wp_profiler_thread_t *t) {
+  uintptr_t frames[WP_PROFILER_MAX_DEPTH];
+  uint64_t head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = t->tail;
+  uint64_t dropped = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+
+  while(tail < head) {
+    uint32_t depth = (uint32_t)t->ring[tail++ % WP_PROFILER_RING_WORDS];
+    for(uint32_t i = 0; i < depth; i++) {
+      frames[i] = wp_profiler_function(t->ring[tail++ % WP_PROFILER_RING_WORDS], i > 0);
+    }
+    if(wp_profiler_count(d, t->name, frames, depth) == WP_SUCCESS) {
+      d->samples++;
+    } else {
+      d->dropped++;
+    }
+  }
+  __atomic_store_n(&t->tail, tail, __ATOMIC_RELEASE);
+
+  d->dropped += dropped - t->dropped_counted;
+  t->dropped_counted = dropped;
+}
+
+static void wp_profiler_drain_all(__wp_profiler_private_t *d) {
+  for(int i = 0; i < WP_PROFILER_MAX_THREADS; i++) {
+    if(d->threads[i].used) {
+      wp_profiler_drain(d, &d->threads[i]);
+    }
+  }
+}
+
+/**
+ * Arm or disarm a thread's timer. Called with the lock held.
+ * @param d the profiler's private data.
+ * @param t the thread.
+ * @param on whether to arm it.
+ */
+static void wp_profiler_arm(__wp_profiler_private_t *d, wp_profiler_thread_t *t, bool on) {
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if(on) {
+    spec.it_interval.tv_sec = (time_t)(d->interval_ns / 1000000000ull);
+    spec.it_interval.tv_nsec = (long)(d->interval_ns % 1000000000ull);
+    spec.it_value = spec.it_interval;
+  }
+  if(t->has_timer) {
+    timer_settime(t->timer, 0, &spec, NULL);
+  }
+}
+
+static void *wp_profiler_collector(void *arg) {
+  __wp_profiler_private_t *d = arg;
+
+  pthread_mutex_lock(&d->lock);
+  while(!d->stopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += WP_PROFILER_COLLECT_MS * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&d->wakeup, &d->lock, &deadline);
+    wp_profiler_drain_all(d);
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return NULL;
+}
+
+static wp_status_t wp_profiler_register_thread(const wp_profiler_t *self, const char *name) {
+  assert(self && self->data);
+  __wp_profiler_private_t *d = self->data;
+  wp_profiler_thread_t *t = NULL;
+  struct sigevent sev;
+  pthread_attr_t attr;
+  void *stack_addr = NULL;
+  size_t stack_size = 0;
+
+  if(wp_profiler_current) {
+    return WP_SUCCESS;
+  }
+
+  pthread_mutex_lock(&d->lock);
+  for(int i = 0; i < WP_PROFILER_MAX_THREADS && t == NULL; i++) {
+    if(!d->threads[i].used) {
+      t = &d->threads[i];
+    }
+  }
+  if(t == NULL || (t->ring = malloc(WP_PROFILER_RING_WORDS * sizeof(*t->ring))) == NULL) {
+    pthread_mutex_unlock(&d->lock);
+    return WP_FAILURE;
+  }
+
+  t->tid = (pid_t)syscall(SYS_gettid);
+  snprintf(t->name, sizeof(t->name), "%s", name ? name : "thread");
+  t->head = t->tail = 0;
+  t->dropped = t->dropped_counted = 0;
+  t->stack_lo = 0;
+  t->stack_hi = 0;
+  if(pthread_getattr_np(pthread_self(), &attr) == 0) {
+    if(pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+      t->stack_lo = (uintptr_t)stack_addr;
+      t->stack_hi = (uintptr_t)stack_addr + stack_size;
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = t->tid;
+  t->has_timer = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &t->timer) == 0;
+  if(!t->has_timer) {
+    free(t->ring);
+    t->ring = NULL;
+    pthread_mutex_unlock(&d->lock);
+    return WP_FAILURE;
+  }
+
+  t->used = true;
+  __atomic_store_n(&wp_profiler_current, t, __ATOMIC_RELEASE);
+  if(d->running) {
+    wp_profiler_arm(d, t, true);
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return WP_SUCCESS;
+}
+
+static void wp_profiler_unregister_thread(const wp_profiler_t *self) {
+  assert(self && self->data);
+  __wp_profiler_private_t *d = self->data;
+  wp_profiler_thread_t *t = wp_profiler_current;
+
+  if(t == NULL || t < d->threads || t >= d->threads + WP_PROFILER_MAX_THREADS) {
+    return;
+  }
+
+  pthread_mutex_lock(&d->lock);
+  timer_delete(t->timer);
+  t->has_timer = false;
+  /* A signal already pending finds no thread and does nothing. */
+  __atomic_store_n(&wp_profiler_current, NULL, __ATOMIC_RELEASE);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  wp_profiler_drain(d, t);
+  free(t->ring);
+  t->ring = NULL;
+  t->used = false;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static wp_status_t wp_profiler_start(const wp_profiler_t *self) {
+  assert(self && self->data);
+  __wp_profiler_private_t *d = self->data;
+  wp_status_t res = WP_SUCCESS;
+  struct sigaction sa;
+  sigset_t all, old;
+
+  pthread_mutex_lock(&d->lock);
+  if(d->running) {
+    pthread_mutex_unlock(&d->lock);
+    return WP_SUCCESS;
+  }
+
+#ifdef WP_PROFILER_LIBUNWIND
+  {
+    /* Warm libunwind's caches outside of a signal handler. */
+    void *ip = NULL;
+    unw_backtrace(&ip, 1);
+  }
+#endif
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = &wp_profiler_signal;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if(sigaction(SIGPROF, &sa, NULL) != 0) {
+    res = WP_FAILURE;
+  } else {
+    /* The collector must never be sampled, or take the process's signals. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    d->stopping = false;
+    if(pthread_create(&d->collector, NULL, &wp_profiler_collector, d) == 0) {
+      d->running = true;
+      for(int i = 0; i < WP_PROFILER_MAX_THREADS; i++) {
+        if(d->threads[i].used) {
+          wp_profiler_arm(d, &d->threads[i], true);
+        }
+      }
+    } else {
+      res = WP_FAILURE;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return res;
+}
+
+static void wp_profiler_stop(const wp_profiler_t *self) {
+  assert(self && self->data);
+  __wp_profiler_private_t *d = self->data;
+  bool running = false;
+
+  pthread_mutex_lock(&d->lock);
+  running = d->running;
+  for(int i = 0; i < WP_PROFILER_MAX_THREADS && running; i++) {
+    if(d->threads[i].used) {
+      wp_profiler_arm(d, &d->threads[i], false);
+    }
+  }
+  d->running = false;
+  d->stopping = true;
+  pthread_cond_signal(&d->wakeup);
+  pthread_mutex_unlock(&d->lock);
+
+  if(running) {
+    pthread_join(d->collector, NULL);
+    pthread_mutex_lock(&d->lock);
+    wp_profiler_drain_all(d);
+    pthread_mutex_unlock(&d->lock);
+  }
+}
+
+/**
+ * Write a frame's name: its symbol, else its object and offset, else its address.
+ * @param out the stream.
+ * @param pc the frame's address.
+ */
+static void wp_profiler_write_frame(FILE *out, uintptr_t pc) {
+  Dl_info info;
+  int found;
+
+  memset(&info, 0, sizeof(info));
+  found = dladdr((void *)pc, &info);
+  if(found && info.dli_sname) {
+    fputs(info.dli_sname, out);
+  } else if(found && info.dli_fname && info.dli_fname[0]) {
+    const char *base = strrchr(info.dli_fname, '/');
+    fprintf(out, "[%s+0x%lx]", base ? base + 1 : info.dli_fname, (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+  } else {
+    fprintf(out, "[0x%lx]", (unsigned long)pc);
+  }
+}
+
+static wp_status_t wp_profiler_dump(const wp_profiler_t *self, FILE *out) {
+  assert(self && self->data && out);
+  __wp_profiler_private_t *d = self->data;
+
+  pthread_mutex_lock(&d->lock);
+  wp_profiler_drain_all(d);
+  for(size_t i = 0; i < d->stack_capacity; i++) {
+    const wp_profiler_stack_t *s = &d->stacks[i];
+    if(s->frames == NULL) {
+      continue;
+    }
+    fputs(s->thread, out);
+    /* Root first. */
+    for(uint32_t f = s->depth; f-- > 0;) {
+      fputc(';', out);
+      wp_profiler_write_frame(out, s->frames[f]);
+    }
+    fprintf(out, " %llu\n", (unsigned long long)s->count);
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return fflush(out) == 0 && !ferror(out) ? WP_SUCCESS : WP_FAILURE;
+}
+
+static void wp_profiler_reset(const wp_profiler_t *self) {
+  assert(self && self->data);
+  __wp_profiler_private_t *d = self->data;
+
+  pthread_mutex_lock(&d->lock);
+  wp_profiler_drain_all(d);
+  for(size_t i = 0; i < d->stack_capacity; i++) {
+    free(d->stacks[i].frames);
+  }
+  free(d->stacks);
+  d->stacks = NULL;
+  d->stack_count = d->stack_capacity = 0;
+  d->samples = d->dropped = 0;
+  pthread_mutex_unlock(&d->lock);
+}
+
+static void wp_profiler_get_stats(const wp_profiler_t *self, wp_profiler_stats_t *stats) {
+  assert(self && self->data && stats);
+  __wp_profiler_private_t *d = self->data;
+
+  pthread_mutex_lock(&d->lock);
+  wp_profiler_drain_all(d);
+  stats->samples = d->samples;
+  stats->dropped = d->dropped;
+  stats->threads = 0;
+  for(int i = 0; i < WP_PROFILER_MAX_THREADS; i++) {
+    stats->threads += d->threads[i].used ? 1 : 0;
+  }
+  pthread_mutex_unlock(&d->lock);
+}
+
+wp_status_t wp_profiler_new(wp_profiler_t **self_out, unsigned hz) {
+  wp_status_t ret = WP_FAILURE;
+  wp_profiler_t *self = NULL;
+  pthread_condattr_t attr;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      pthread_condattr_init(&attr);
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+      pthread_mutex_init(&self->data->lock, NULL);
+      pthread_cond_init(&self->data->wakeup, &attr);
+      pthread_condattr_destroy(&attr);
+      self->data->interval_ns = 1000000000ull / (hz ? hz : WP_PROFILER_DEFAULT_HZ);
+
+      self->register_thread = &wp_profiler_register_thread;
+      self->unregister_thread = &wp_profiler_unregister_thread;
+      self->start = &wp_profiler_start;
+      self->stop = &wp_profiler_stop;
+      self->dump = &wp_profiler_dump;
+      self->reset = &wp_profiler_reset;
+      self->get_stats = &wp_profiler_get_stats;
+      ret = WP_SUCCESS;
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_profiler_delete(wp_profiler_t *self) {
+  assert(self);
+  if(self->data) {
+    self->stop(self);
+    self->unregister_thread(self);
+    for(int i = 0; i < WP_PROFILER_MAX_THREADS; i++) {
+      wp_profiler_thread_t *t = &self->data->threads[i];
+      if(t->used) {
+        timer_delete(t->timer);
+        free(t->ring);
+        t->ring = NULL;
+        t->used = false;
+      }
+    }
+    self->reset(self);
+    pthread_cond_destroy(&self->data->wakeup);
+    pthread_mutex_destroy(&self->data->lock);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
@@ -6,10 +6,12 @@
  */
 
 #include <assert.h>
+#include <stdarg.h>
 #include <string.h>
 
 #include <wp_pool.h>
 #include <wp_string.h>
+#include <wp_text.h>
 
 typedef struct __wp_string_private_t {
   /* TODO: Incorporate additional state as needed. */
@@ -17,21 +19,317 @@ typedef struct __wp_string_private_t {
   int ref_count;
   char *str;
   const wp_pool_t *pool;
+  /* 0 until wp_string_hash first runs; a real hash of 0 is just recomputed. */
+  uint64_t hash;
 } __wp_string_private_t;
 
-wp_status_t wp_string_new(wp_string_t **self_out, const wp_pool_t *pool, const char *str) {
+#define WP_STRING_HASH_P0 0xa0761d6478bd642fULL
+#define WP_STRING_HASH_P1 0xe7037ed1a0b428dbULL
+#define WP_STRING_HASH_P2 0x8ebc6af09c88c6e3ULL
+#define WP_STRING_HASH_P3 0x589965cc75374cc3ULL
+
+/**
+ * Multiply two words and fold the 128 bit product back to 64 bits.
+ */
+static inline uint64_t wp_string_mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t r = a * (b | 1);
+  return r ^ (r >> 29) ^ (b * WP_STRING_HASH_P3);
+#endif
+}
+
+static inline uint64_t wp_string_read64(const char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t wp_string_read32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * Lower case the ASCII letters among the bytes of word, all at once.
+ */
+static inline uint64_t wp_string_lower64(uint64_t word) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  uint64_t low = word & (0x7f * ones);
+  uint64_t from_a = low + (0x80 - 'A') * ones;
+  uint64_t past_z = low + (0x80 - 'Z' - 1) * ones;
+  uint64_t upper = from_a & ~past_z & ~word & (0x80 * ones);
+  return word | (upper >> 2);
+}
+
+/**
+ * The hash body, folding case as it reads when fold is set. Inlined into
+ * each caller, so the plain hash pays nothing for it.
+ */
+static inline uint64_t wp_string_hash_folded(const char *bytes, size_t len, bool fold) {
+  uint64_t seed = WP_STRING_HASH_P0 ^ len;
+  uint64_t a = 0, b = 0;
+  const char *p = bytes;
+  size_t left = len;
+
+  /* Word at a time multiply-mix in the style of wyhash. */
+  while(left > 16) {
+    uint64_t x = wp_string_read64(p), y = wp_string_read64(p + 8);
+    if(fold) {
+      x = wp_string_lower64(x);
+      y = wp_string_lower64(y);
+    }
+    seed = wp_string_mix(x ^ WP_STRING_HASH_P1, y ^ seed);
+    p += 16;
+    left -= 16;
+  }
+
+  if(left >= 8) {
+    a = wp_string_read64(p);
+    b = wp_string_read64(p + left - 8);
+  } else if(left >= 4) {
+    a = wp_string_read32(p);
+    b = wp_string_read32(p + left - 4);
+  } else if(left > 0) {
+    a = ((uint64_t)(unsigned char)p[0] << 16) | ((uint64_t)(unsigned char)p[left >> 1] << 8) | (unsigned char)p[left - 1];
+  }
+  if(fold) {
+    a = wp_string_lower64(a);
+    b = wp_string_lower64(b);
+  }
+
+  return wp_string_mix(wp_string_mix(a ^ WP_STRING_HASH_P1, b ^ seed) ^ WP_STRING_HASH_P2, len ^ WP_STRING_HASH_P3);
+}
+
+uint64_t wp_string_hash_bytes(const char *bytes, size_t len) {
+  return wp_string_hash_folded(bytes, len, false);
+}
+
+uint64_t wp_string_hash_bytes_ignore_case(const char *bytes, size_t len) {
+  return wp_string_hash_folded(bytes, len, true);
+}
+
+uint64_t wp_string_hash(const wp_string_t *str) {
+  assert(str && str->data);
+  if(str->data->hash == 0) {
+    str->data->hash = wp_string_hash_bytes(str->data->str, str->data->len - 1);
+  }
+  return str->data->hash;
+}
+
+uint64_t wp_string_hash_ignore_case(const wp_string_t *str) {
+  assert(str && str->data);
+  return wp_string_hash_bytes_ignore_case(str->data->str, str->data->len - 1);
+}
+
+int wp_string_compare(const wp_string_t *left, const wp_string_t *right) {
+  assert(left && left->data && right && right->data);
+  size_t len = left->data->len < right->data->len ? left->data->len : right->data->len;
+  /* len counts the terminator, so a prefix compares less. */
+  return memcmp(left->data->str, right->data->str, len);
+}
+
+int wp_string_get_ref_count(const wp_string_t *str) {
+  assert(str && str->data);
+  return str->data->ref_count;
+}
+
+static bool wp_string_equals(const wp_string_t *self, const wp_string_t *to) {
+  assert(self && self->data && to && to->data);
+  if(self == to) {
+    return true;
+  }
+  if(self->data->len != to->data->len) {
+    return false;
+  }
+  if(self->data->hash && to->data->hash && self->data->hash != to->data->hash) {
+    return false;
+  }
+  return memcmp(self->data->str, to->data->str, self->data->len - 1) == 0;
+}
+
+static bool wp_string_equals_ignore_case(const wp_string_t *self, const wp_string_t *to) {
+  assert(self && self->data && to && to->data);
+  if(self == to) {
+    return true;
+  }
+  if(self->data->len != to->data->len) {
+    return false;
+  }
+  return wp_ascii_equals_ignore_case(self->data->str, to->data->str, self->data->len - 1);
+}
+
+static bool wp_string_is_valid_utf8(const wp_string_t *self) {
+  assert(self && self->data);
+  return wp_utf8_validate(self->data->str, self->data->len - 1);
+}
+
+static const char *wp_string_get_str(const wp_string_t *self) {
+  assert(self && self->data);
+  return self->data->str;
+}
+
+static size_t wp_string_get_length(const wp_string_t *self) {
+  assert(self && self->data);
+  return self->data->len - 1;
+}
+
+static int wp_string_get_hash(const wp_string_t *self) {
+  return (int)wp_string_hash(self);
+}
+
+static wp_pool_t *wp_string_get_pool(const wp_string_t *self) {
+  assert(self && self->data);
+  return (wp_pool_t *)self->data->pool;
+}
+
+static wp_status_t wp_string_new_bytes(wp_string_t **self_out, const wp_pool_t *pool, const char *bytes, size_t len);
+
+static wp_status_t wp_string_concat(const wp_string_t *self, wp_string_t **self_out, ...) {
+  assert(self && self->data && self_out);
+  const wp_pool_t *pool = self->data->pool;
+  const wp_string_t *part = NULL;
+  size_t len = self->data->len - 1;
+  char *buf = NULL;
+  size_t at = 0;
+  va_list args;
+
+  va_start(args, self_out);
+  while((part = va_arg(args, const wp_string_t *))) {
+    len += part->data->len - 1;
+  }
+  va_end(args);
+
+  /* Sized up front, then joined in place. */
+  if(wp_string_new_bytes(self_out, pool, NULL, len) != WP_SUCCESS) {
+    return WP_FAILURE;
+  }
+  buf = (*self_out)->data->str;
+  memcpy(buf, self->data->str, self->data->len - 1);
+  at = self->data->len - 1;
+  va_start(args, self_out);
+  while((part = va_arg(args, const wp_string_t *))) {
+    memcpy(buf + at, part->data->str, part->data->len - 1);
+    at += part->data->len - 1;
+  }
+  va_end(args);
+
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_string_substr(const wp_string_t *self, wp_string_t **self_out, int index, size_t len) {
+  assert(self && self->data && self_out);
+  size_t length = self->data->len - 1;
+  size_t start = 0;
+
+  if(index < 0) {
+    if((size_t)-(long)index > length) {
+      return WP_FAILURE;
+    }
+    start = length - (size_t)-(long)index;
+  } else if((start = (size_t)index) > length) {
+    return WP_FAILURE;
+  }
+  if(len > length - start) {
+    len = length - start;
+  }
+
+  return wp_string_new_bytes(self_out, self->data->pool, self->data->str + start, len);
+}
+
+static bool wp_string_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * Copy self without its leading and/or trailing ASCII white space.
+ * @param self the string.
+ * @param left trim the start.
+ * @param right trim the end.
+ * @return the new string, in self's pool, or NULL if it couldn't be allocated.
+ */
+static wp_string_t *wp_string_trimmed(const wp_string_t *self, bool left, bool right) {
+  assert(self && self->data);
+  const char *begin = self->data->str;
+  const char *end = self->data->str + self->data->len - 1;
+  wp_string_t *out = NULL;
+
+  while(left && begin < end && wp_string_is_space(*begin)) {
+    begin++;
+  }
+  while(right && end > begin && wp_string_is_space(end[-1])) {
+    end--;
+  }
+
+  return wp_string_new_bytes(&out, self->data->pool, begin, (size_t)(end - begin)) == WP_SUCCESS ? out : NULL;
+}
+
+static wp_string_t *wp_string_ltrim(const wp_string_t *self) {
+  return wp_string_trimmed(self, true, false);
+}
+
+static wp_string_t *wp_string_rtrim(const wp_string_t *self) {
+  return wp_string_trimmed(self, false, true);
+}
+
+static wp_string_t *wp_string_trim(const wp_string_t *self) {
+  return wp_string_trimmed(self, true, true);
+}
+
+static wp_status_t wp_string_copy_to_pool(wp_string_t **self_out, const wp_pool_t *pool, const wp_string_t *src) {
+  assert(src && src->data);
+  wp_status_t ret = wp_string_new(self_out, pool, src->data->str);
+  if(ret == WP_SUCCESS) {
+    (*self_out)->data->hash = src->data->hash;
+  }
+  return ret;
+}
+
+static wp_status_t wp_string_copy(wp_string_t **self_out, const wp_string_t *src) {
+  assert(src && src->data);
+  return wp_string_copy_to_pool(self_out, src->data->pool, src);
+}
+
+/**
+ * Make a string of len bytes, which needn't be terminated; with bytes NULL,
+ * the caller fills them in.
+ */
+static wp_status_t wp_string_new_bytes(wp_string_t **self_out, const wp_pool_t *pool, const char *bytes, size_t len) {
   assert(pool);
   wp_status_t ret = WP_FAILURE;
   wp_string_t *self = NULL;
-  size_t len = strlen(str) + 1;
-  if((self = pool->palloc(sizeof(*self)))) {
-    if((self->data = pool->palloc(sizeof(*(self->data))))) {
-      if((self->data->str = pool->palloc(len))) {
-        strncpy(self->data->str, str, len);
+  len += 1;
+  if((self = pool->palloc(pool, sizeof(*self)))) {
+    if((self->data = pool->palloc(pool, sizeof(*(self->data))))) {
+      if((self->data->str = pool->palloc(pool, len))) {
+        if(bytes) {
+          memcpy(self->data->str, bytes, len - 1);
+        }
         (self->data->str)[len - 1] = '\0';
         self->data->ref_count = 1;
         self->data->len = len;
         self->data->pool = pool;
+        self->data->hash = 0;
+
+        self->copy = &wp_string_copy;
+        self->copy_to_pool = &wp_string_copy_to_pool;
+        self->equals = &wp_string_equals;
+        self->compare = &wp_string_compare;
+        self->equals_ignore_case = &wp_string_equals_ignore_case;
+        self->is_valid_utf8 = &wp_string_is_valid_utf8;
+        self->get_str = &wp_string_get_str;
+        self->get_length = &wp_string_get_length;
+        self->get_hash = &wp_string_get_hash;
+        self->get_ref_count = &wp_string_get_ref_count;
+        self->get_pool = &wp_string_get_pool;
+        self->concat = &wp_string_concat;
+        self->substr = &wp_string_substr;
+        self->ltrim = &wp_string_ltrim;
+        self->rtrim = &wp_string_rtrim;
+        self->trim = &wp_string_trim;
         *self_out = self;
         ret = WP_SUCCESS;
       }
@@ -40,3 +338,23 @@ wp_status_t wp_string_new(wp_string_t **self_out, const wp_pool_t *pool, const c
 
   return ret;
 }
+
+wp_status_t wp_string_new(wp_string_t **self_out, const wp_pool_t *pool, const char *str) {
+  return wp_string_new_bytes(self_out, pool, str, strlen(str));
+}
+
+wp_status_t wp_string_delete(wp_string_t **self_out) {
+  assert(self_out);
+  wp_string_t *self = *self_out;
+
+  if(self && self->data && --self->data->ref_count <= 0) {
+    const wp_pool_t *pool = self->data->pool;
+    /* Reverse allocation order, so the pool can roll back a string it just made. */
+    pool->pfree(pool, self->data->str);
+    pool->pfree(pool, self->data);
+    pool->pfree(pool, self);
+  }
+
+  *self_out = NULL;
+  return WP_SUCCESS;
+}
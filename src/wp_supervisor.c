@@ -0,0 +1,512 @@
+/*
+ * File:   wp_supervisor.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:00 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_supervisor.h>
+#include <wp_timer_wheel.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#define WP_SUPERVISOR_TICK_MS        10
+#define WP_SUPERVISOR_BACKOFF_MIN_MS 100
+#define WP_SUPERVISOR_BACKOFF_MAX_MS 30000
+#define WP_SUPERVISOR_STABLE_MS      10000
+/* Without pidfds, also look for exits this often, in case SIGCHLD went to a thread that didn't block it. */
+#define WP_SUPERVISOR_SWEEP_MS       1000
+/* A helper that couldn't be started exits as a shell would report it. */
+#define WP_SUPERVISOR_SPAWN_FAILED   (127 << 8)
+
+extern char **environ;
+
+typedef struct wp_process {
+  struct wp_process *next;
+  const wp_supervisor_t *owner;
+  wp_timer_t restart_timer;
+
+  unsigned id;
+  pid_t pid;
+  int pid_fd;
+  uint64_t started_ns;
+  /* Restarts since the last stable run. */
+  unsigned restarts;
+  bool stopping;
+
+  wp_process_exit_fn fn;
+  void *arg;
+
+  /* The spec, with path, argv and envp pointing at our own copies. */
+  wp_process_spec_t spec;
+  char *path;
+  char **argv;
+  char **envp;
+} wp_process_t;
+
+typedef struct __wp_supervisor_private_t {
+  const wp_event_loop_t *loop;
+  wp_timer_wheel_t *wheel;
+  /* The SIGCHLD signalfd, or -1 when each helper has a pidfd. */
+  int signal_fd;
+  wp_timer_t sweep_timer;
+
+  wp_process_t *processes;
+  size_t count;
+  unsigned next_id;
+} __wp_supervisor_private_t;
+
+static uint64_t wp_supervisor_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int wp_supervisor_pidfd_open(pid_t pid) {
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+/**
+ * Copy a NULL terminated string vector into a single allocation.
+ * @param src the vector to copy.
+ * @return the copy, to be released with free, or NULL on failure.
+ */
+static char **wp_supervisor_copy_vector(char *const *src) {
+  size_t n = 0, bytes = 0, i;
+  char **dst = NULL;
+  char *strings = NULL;
+
+  for(n = 0; src[n]; n++) {
+    bytes += strlen(src[n]) + 1;
+  }
+  if((dst = malloc((n + 1) * sizeof(char *) + bytes))) {
+    strings = (char *)(dst + n + 1);
+    for(i = 0; i < n; i++) {
+      size_t len = strlen(src[i]) + 1;
+      memcpy(strings, src[i], len);
+      dst[i] = strings;
+      strings += len;
+    }
+    dst[n] = NULL;
+  }
+  return dst;
+}
+
+/**
+ * Turn waitid's report into a waitpid style status.
+ * @param info as filled in by waitid.
+ * @return the status.
+ */
+static int wp_supervisor_wait_status(const siginfo_t *info) {
+  switch(info->si_code) {
+    case CLD_EXITED:
+      return (info->si_status & 0xff) << 8;
+    case CLD_KILLED:
+      return info->si_status & 0x7f;
+    case CLD_DUMPED:
+      return (info->si_status & 0x7f) | 0x80;
+  }
+  return 0;
+}
+
+static wp_process_t *wp_supervisor_find(const wp_supervisor_t *self, unsigned id) {
+  wp_process_t *p = NULL;
+
+  for(p = self->data->processes; p && p->id != id; p = p->next)
+    ;
+  return p;
+}
+
+/**
+ * Unlink a helper and release it. It must not be running.
+ * @param self the supervisor.
+ * @param process the helper.
+ */
+static void wp_supervisor_forget(const wp_supervisor_t *self, wp_process_t *process) {
+  wp_process_t **link = &self->data->processes;
+
+  while(*link != process) {
+    link = &(*link)->next;
+  }
+  *link = process->next;
+  self->data->count--;
+
+  self->data->wheel->cancel(self->data->wheel, &process->restart_timer);
+  if(process->pid_fd > -1) {
+    self->data->loop->remove(self->data->loop, process->pid_fd);
+    close(process->pid_fd);
+  }
+  free(process->path);
+  free(process->argv);
+  free(process->envp);
+  free(process);
+}
+
+static void wp_supervisor_on_pid_fd(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg);
+
+/**
+ * Start a helper. posix_spawn vforks, and the child gets default signal
+ * handling and an empty signal mask, whatever the daemon had.
+ * @param self the supervisor.
+ * @param process the helper, not running.
+ * @return WP_SUCCESS if it's running, otherwise WP_FAILURE with errno set.
+ */
+static wp_status_t wp_supervisor_start(const wp_supervisor_t *self, wp_process_t *process) {
+  posix_spawnattr_t attr;
+  sigset_t mask, defaults;
+  pid_t pid = 0;
+  int err = 0;
+
+  if((err = posix_spawnattr_init(&attr)) != 0) {
+    errno = err;
+    return WP_FAILURE;
+  }
+  sigemptyset(&mask);
+  sigfillset(&defaults);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_USEVFORK);
+
+  if(strchr(process->path, '/')) {
+    err = posix_spawn(&pid, process->path, NULL, &attr, process->argv, process->envp ? process->envp : environ);
+  } else {
+    err = posix_spawnp(&pid, process->path, NULL, &attr, process->argv, process->envp ? process->envp : environ);
+  }
+  posix_spawnattr_destroy(&attr);
+  if(err != 0) {
+    errno = err;
+    return WP_FAILURE;
+  }
+
+  process->pid = pid;
+  process->started_ns = wp_supervisor_now_ns();
+  if(self->data->signal_fd < 0) {
+    /* The pid can't be reused before we reap it, so the pidfd is for our child even if it already exited. */
+    if((process->pid_fd = wp_supervisor_pidfd_open(pid)) < 0
+       || self->data->loop->add(self->data->loop, process->pid_fd, EPOLLIN, &wp_supervisor_on_pid_fd, process) != WP_SUCCESS) {
+      err = errno;
+      if(process->pid_fd > -1) {
+        close(process->pid_fd);
+        process->pid_fd = -1;
+      }
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      process->pid = 0;
+      errno = err;
+      return WP_FAILURE;
+    }
+  }
+  return WP_SUCCESS;
+}
+
+static void wp_supervisor_on_restart(wp_timer_t *timer, void *arg);
+
+/**
+ * Handle a helper's exit: schedule its restart or forget it, and tell its owner.
+ * @param self the supervisor.
+ * @param process the helper that exited.
+ * @param status its waitpid style status.
+ */
+static void wp_supervisor_exited(const wp_supervisor_t *self, wp_process_t *process, int status) {
+  const wp_process_spec_t *spec = &process->spec;
+  uint64_t ran_ns = wp_supervisor_now_ns() - process->started_ns;
+  unsigned id = process->id, i;
+  pid_t pid = process->pid;
+  bool restarting = false;
+
+  if(process->pid_fd > -1) {
+    self->data->loop->remove(self->data->loop, process->pid_fd);
+    close(process->pid_fd);
+    process->pid_fd = -1;
+  }
+  process->pid = 0;
+
+  if(ran_ns >= spec->stable_ms * 1000000ull) {
+    process->restarts = 0;
+  }
+  restarting = !process->stopping
+    && (spec->restart == WP_RESTART_ALWAYS || (spec->restart == WP_RESTART_ON_FAILURE && status != 0))
+    && (spec->max_restarts == 0 || process->restarts < spec->max_restarts);
+
+  if(restarting) {
+    uint64_t delay_ms = spec->backoff_min_ms;
+    for(i = 0; i < process->restarts && delay_ms < spec->backoff_max_ms; i++) {
+      delay_ms *= 2;
+    }
+    if(delay_ms > spec->backoff_max_ms) {
+      delay_ms = spec->backoff_max_ms;
+    }
+    process->restarts++;
+    /* Scheduled before the callback so that a stop from inside it cancels the restart. */
+    self->data->wheel->schedule(self->data->wheel, &process->restart_timer, delay_ms, &wp_supervisor_on_restart, process);
+  }
+
+  if(process->fn) {
+    process->fn(self, id, pid, status, restarting, process->arg);
+  }
+  /* The callback may have stopped, and so forgotten, the helper already. */
+  if(!restarting && (process = wp_supervisor_find(self, id))) {
+    wp_supervisor_forget(self, process);
+  }
+}
+
+static void wp_supervisor_on_restart(wp_timer_t *timer, void *arg) {
+  wp_process_t *process = arg;
+  const wp_supervisor_t *self = process->owner;
+  (void)timer;
+
+  if(wp_supervisor_start(self, process) != WP_SUCCESS) {
+    process->started_ns = wp_supervisor_now_ns();
+    wp_supervisor_exited(self, process, WP_SUPERVISOR_SPAWN_FAILED);
+  }
+}
+
+/**
+ * Reap one helper if it has exited.
+ * @param self the supervisor.
+ * @param process a running helper.
+ * @return true if it had exited, and was handled.
+ */
+static bool wp_supervisor_reap(const wp_supervisor_t *self, wp_process_t *process) {
+  siginfo_t info;
+
+  memset(&info, 0, sizeof(info));
+  if(waitid(P_PID, process->pid, &info, WEXITED | WNOHANG) != 0 || info.si_pid == 0) {
+    return false;
+  }
+  wp_supervisor_exited(self, process, wp_supervisor_wait_status(&info));
+  return true;
+}
+
+/**
+ * Reap every helper that has exited. Callbacks may spawn or stop helpers, so
+ * the list is walked again from the start after each exit.
+ * @param self the supervisor.
+ */
+static void wp_supervisor_sweep(const wp_supervisor_t *self) {
+  wp_process_t *p = NULL;
+  bool reaped = false;
+
+  do {
+    reaped = false;
+    for(p = self->data->processes; p && !reaped; p = p->next) {
+      reaped = p->pid > 0 && wp_supervisor_reap(self, p);
+    }
+  } while(reaped);
+}
+
+static void wp_supervisor_on_pid_fd(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  wp_process_t *process = arg;
+  (void)loop;
+  (void)fd;
+  (void)events;
+
+  wp_supervisor_reap(process->owner, process);
+}
+
+static void wp_supervisor_on_signal_fd(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_supervisor_t *self = arg;
+  struct signalfd_siginfo infos[16];
+  (void)loop;
+  (void)events;
+
+  /* SIGCHLDs coalesce, so the count read means nothing; look at every helper. */
+  while(read(fd, infos, sizeof(infos)) > 0)
+    ;
+  wp_supervisor_sweep(self);
+}
+
+static void wp_supervisor_on_sweep(wp_timer_t *timer, void *arg) {
+  const wp_supervisor_t *self = arg;
+
+  wp_supervisor_sweep(self);
+  self->data->wheel->schedule(self->data->wheel, timer, WP_SUPERVISOR_SWEEP_MS, &wp_supervisor_on_sweep, arg);
+}
+
+static wp_status_t wp_supervisor_spawn(const wp_supervisor_t *self, const wp_process_spec_t *spec, wp_process_exit_fn fn, void *arg, unsigned *id_out) {
+  assert(self && self->data && spec && spec->path && spec->argv);
+  wp_process_t *process = NULL;
+  int err = 0;
+
+  if((process = calloc(1, sizeof(*process))) == NULL) {
+    return WP_FAILURE;
+  }
+  process->spec = *spec;
+  process->path = strdup(spec->path);
+  process->argv = wp_supervisor_copy_vector(spec->argv);
+  process->envp = spec->envp ? wp_supervisor_copy_vector(spec->envp) : NULL;
+  if(process->path == NULL || process->argv == NULL || (spec->envp && process->envp == NULL)) {
+    free(process->path);
+    free(process->argv);
+    free(process->envp);
+    free(process);
+    return WP_FAILURE;
+  }
+  process->spec.path = process->path;
+  process->spec.argv = process->argv;
+  process->spec.envp = process->envp;
+  if(process->spec.backoff_min_ms == 0) {
+    process->spec.backoff_min_ms = WP_SUPERVISOR_BACKOFF_MIN_MS;
+  }
+  if(process->spec.backoff_max_ms == 0) {
+    process->spec.backoff_max_ms = WP_SUPERVISOR_BACKOFF_MAX_MS;
+  }
+  if(process->spec.stable_ms == 0) {
+    process->spec.stable_ms = WP_SUPERVISOR_STABLE_MS;
+  }
+  process->owner = self;
+  process->pid_fd = -1;
+  process->fn = fn;
+  process->arg = arg;
+  wp_timer_init(&process->restart_timer);
+
+  if(wp_supervisor_start(self, process) != WP_SUCCESS) {
+    err = errno;
+    free(process->path);
+    free(process->argv);
+    free(process->envp);
+    free(process);
+    errno = err;
+    return WP_FAILURE;
+  }
+
+  process->id = ++self->data->next_id;
+  process->next = self->data->processes;
+  self->data->processes = process;
+  self->data->count++;
+  if(id_out) {
+    *id_out = process->id;
+  }
+  return WP_SUCCESS;
+}
+
+static wp_status_t wp_supervisor_kill(const wp_supervisor_t *self, unsigned id, int sig) {
+  assert(self && self->data);
+  wp_process_t *process = wp_supervisor_find(self, id);
+
+  if(process == NULL || process->pid == 0) {
+    errno = ESRCH;
+    return WP_FAILURE;
+  }
+  /* Not yet reaped, so the pid is still our helper's. */
+  return kill(process->pid, sig) == 0 ? WP_SUCCESS : WP_FAILURE;
+}
+
+static wp_status_t wp_supervisor_stop(const wp_supervisor_t *self, unsigned id) {
+  assert(self && self->data);
+  wp_process_t *process = wp_supervisor_find(self, id);
+
+  if(process == NULL) {
+    errno = ESRCH;
+    return WP_FAILURE;
+  }
+  process->stopping = true;
+  if(process->pid == 0) {
+    wp_supervisor_forget(self, process);
+    return WP_SUCCESS;
+  }
+  return kill(process->pid, SIGTERM) == 0 ? WP_SUCCESS : WP_FAILURE;
+}
+
+static pid_t wp_supervisor_get_pid(const wp_supervisor_t *self, unsigned id) {
+  assert(self && self->data);
+  wp_process_t *process = wp_supervisor_find(self, id);
+  return process ? process->pid : 0;
+}
+
+static size_t wp_supervisor_get_count(const wp_supervisor_t *self) {
+  assert(self && self->data);
+  return self->data->count;
+}
+
+wp_status_t wp_supervisor_new(wp_supervisor_t **self_out, const wp_event_loop_t *loop) {
+  assert(self_out && loop);
+  wp_status_t ret = WP_FAILURE;
+  wp_supervisor_t *self = NULL;
+  sigset_t mask;
+  int probe = -1;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      self->data->loop = loop;
+      self->data->signal_fd = -1;
+      wp_timer_init(&self->data->sweep_timer);
+
+      self->spawn = &wp_supervisor_spawn;
+      self->kill = &wp_supervisor_kill;
+      self->stop = &wp_supervisor_stop;
+      self->get_pid = &wp_supervisor_get_pid;
+      self->get_count = &wp_supervisor_get_count;
+
+      if(wp_timer_wheel_new(&self->data->wheel, loop, WP_SUPERVISOR_TICK_MS) == WP_SUCCESS) {
+        if((probe = wp_supervisor_pidfd_open(getpid())) > -1) {
+          close(probe);
+          ret = WP_SUCCESS;
+        } else {
+          sigemptyset(&mask);
+          sigaddset(&mask, SIGCHLD);
+          pthread_sigmask(SIG_BLOCK, &mask, NULL);
+          if((self->data->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) > -1) {
+            if(loop->add(loop, self->data->signal_fd, EPOLLIN, &wp_supervisor_on_signal_fd, self) == WP_SUCCESS) {
+              self->data->wheel->schedule(self->data->wheel, &self->data->sweep_timer, WP_SUPERVISOR_SWEEP_MS, &wp_supervisor_on_sweep, self);
+              ret = WP_SUCCESS;
+            } else {
+              close(self->data->signal_fd);
+            }
+          }
+        }
+        if(ret != WP_SUCCESS) {
+          wp_timer_wheel_delete(self->data->wheel);
+        }
+      }
+      if(ret != WP_SUCCESS) {
+        free(self->data);
+        self->data = NULL;
+      }
+    }
+    if(ret != WP_SUCCESS) {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_supervisor_delete(wp_supervisor_t *self) {
+  assert(self);
+  if(self->data) {
+    while(self->data->processes) {
+      if(self->data->processes->pid > 0) {
+        kill(self->data->processes->pid, SIGTERM);
+      }
+      wp_supervisor_forget(self, self->data->processes);
+    }
+    if(self->data->signal_fd > -1) {
+      self->data->loop->remove(self->data->loop, self->data->signal_fd);
+      close(self->data->signal_fd);
+    }
+    wp_timer_wheel_delete(self->data->wheel);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
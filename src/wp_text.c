@@ -0,0 +1,356 @@
+/*
+ * File:   wp_text.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 5:11 AM
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wp_text.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define WP_TEXT_X86 1
+  #include <immintrin.h>
+#endif
+
+/*
+ * Scalar UTF-8 validation, for short inputs, the tails of long ones and CPUs
+ * without SSSE3. Follows the well-formed byte sequences table of RFC 3629.
+ */
+static bool wp_utf8_validate_scalar(const unsigned char *p, size_t len) {
+  const unsigned char *end = p + len;
+
+  while(p < end) {
+    unsigned char c = *p;
+    size_t need = 0;
+    unsigned char lo = 0x80, hi = 0xbf;
+
+    if(c < 0x80) {
+      p++;
+      continue;
+    } else if(c >= 0xc2 && c <= 0xdf) {
+      need = 1;
+    } else if(c >= 0xe0 && c <= 0xef) {
+      need = 2;
+      /* No overlongs, no surrogates. */
+      lo = c == 0xe0 ? 0xa0 : 0x80;
+      hi = c == 0xed ? 0x9f : 0xbf;
+    } else if(c >= 0xf0 && c <= 0xf4) {
+      need = 3;
+      /* No overlongs, nothing past U+10FFFF. */
+      lo = c == 0xf0 ? 0x90 : 0x80;
+      hi = c == 0xf4 ? 0x8f : 0xbf;
+    } else {
+      return false;
+    }
+    if((size_t)(end - p) <= need || p[1] < lo || p[1] > hi) {
+      return false;
+    }
+    for(size_t i = 2; i <= need; i++) {
+      if((p[i] & 0xc0) != 0x80) {
+        return false;
+      }
+    }
+    p += need + 1;
+  }
+  return true;
+}
+
+#ifdef WP_TEXT_X86
+
+/*
+ * Vectorized validation after Keiser and Lemire, "Validating UTF-8 In Less
+ * Than One Instruction Per Byte" (2021). Every pair of adjacent bytes is
+ * classified by three 16 entry table lookups, on the high nibble of the
+ * first byte, its low nibble and the high nibble of the second; each error
+ * has a bit, set in all three lookups only when the pair shows it. Third and
+ * fourth bytes of a sequence, which a pair can't vouch for, are checked by
+ * looking two and three bytes back for a lead that needs them.
+ */
+#define WP_UTF8_TOO_SHORT      (1 << 0)
+#define WP_UTF8_TOO_LONG       (1 << 1)
+#define WP_UTF8_OVERLONG_3     (1 << 2)
+#define WP_UTF8_TOO_LARGE      (1 << 3)
+#define WP_UTF8_SURROGATE      (1 << 4)
+#define WP_UTF8_OVERLONG_2     (1 << 5)
+#define WP_UTF8_TOO_LARGE_1000 (1 << 6)
+#define WP_UTF8_OVERLONG_4     (1 << 6)
+#define WP_UTF8_TWO_CONTS      (1 << 7)
+#define WP_UTF8_CARRY          (WP_UTF8_TOO_SHORT | WP_UTF8_TOO_LONG | WP_UTF8_TWO_CONTS)
+
+#define WP_UTF8_BYTE_1_HIGH \
+  WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, \
+  WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, WP_UTF8_TOO_LONG, \
+  WP_UTF8_TWO_CONTS, WP_UTF8_TWO_CONTS, WP_UTF8_TWO_CONTS, WP_UTF8_TWO_CONTS, \
+  WP_UTF8_TOO_SHORT | WP_UTF8_OVERLONG_2, \
+  WP_UTF8_TOO_SHORT, \
+  WP_UTF8_TOO_SHORT | WP_UTF8_OVERLONG_3 | WP_UTF8_SURROGATE, \
+  WP_UTF8_TOO_SHORT | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000 | WP_UTF8_OVERLONG_4
+
+#define WP_UTF8_BYTE_1_LOW \
+  WP_UTF8_CARRY | WP_UTF8_OVERLONG_3 | WP_UTF8_OVERLONG_2 | WP_UTF8_OVERLONG_4, \
+  WP_UTF8_CARRY | WP_UTF8_OVERLONG_2, \
+  WP_UTF8_CARRY, \
+  WP_UTF8_CARRY, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000 | WP_UTF8_SURROGATE, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000, \
+  WP_UTF8_CARRY | WP_UTF8_TOO_LARGE | WP_UTF8_TOO_LARGE_1000
+
+#define WP_UTF8_BYTE_2_HIGH \
+  WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, \
+  WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, \
+  WP_UTF8_TOO_LONG | WP_UTF8_OVERLONG_2 | WP_UTF8_TWO_CONTS | WP_UTF8_OVERLONG_3 | WP_UTF8_TOO_LARGE_1000 | WP_UTF8_OVERLONG_4, \
+  WP_UTF8_TOO_LONG | WP_UTF8_OVERLONG_2 | WP_UTF8_TWO_CONTS | WP_UTF8_OVERLONG_3 | WP_UTF8_TOO_LARGE, \
+  WP_UTF8_TOO_LONG | WP_UTF8_OVERLONG_2 | WP_UTF8_TWO_CONTS | WP_UTF8_SURROGATE | WP_UTF8_TOO_LARGE, \
+  WP_UTF8_TOO_LONG | WP_UTF8_OVERLONG_2 | WP_UTF8_TWO_CONTS | WP_UTF8_SURROGATE | WP_UTF8_TOO_LARGE, \
+  WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT, WP_UTF8_TOO_SHORT
+
+/* Nonzero in the last three lanes if a sequence there runs past the block. */
+#define WP_UTF8_INCOMPLETE_MAX \
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+
+__attribute__((target("ssse3")))
+static inline __m128i wp_utf8_check_128(__m128i input, __m128i prev_input) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i byte_1_high_table = _mm_setr_epi8(WP_UTF8_BYTE_1_HIGH);
+  const __m128i byte_1_low_table = _mm_setr_epi8(WP_UTF8_BYTE_1_LOW);
+  const __m128i byte_2_high_table = _mm_setr_epi8(WP_UTF8_BYTE_2_HIGH);
+  __m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+  __m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+  __m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+
+  __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+  __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble));
+  __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+  __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+  /* Only 111_____ two back and 1111____ three back need a continuation here. */
+  __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+  __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+  __m128i must_continue = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+  return _mm_xor_si128(must_continue, special);
+}
+
+__attribute__((target("ssse3")))
+static bool wp_utf8_validate_ssse3(const unsigned char *p, size_t len) {
+  const __m128i incomplete_max = _mm_setr_epi8(WP_UTF8_INCOMPLETE_MAX);
+  __m128i error = _mm_setzero_si128();
+  __m128i prev_input = _mm_setzero_si128();
+  __m128i prev_incomplete = _mm_setzero_si128();
+  unsigned char tail[16];
+  size_t i = 0;
+
+  for(; i + 16 <= len; i += 16) {
+    __m128i input = _mm_loadu_si128((const __m128i *)(p + i));
+    if(_mm_movemask_epi8(input) == 0) {
+      /* All ASCII: only an unfinished sequence from before can be wrong. */
+      error = _mm_or_si128(error, prev_incomplete);
+    } else {
+      error = _mm_or_si128(error, wp_utf8_check_128(input, prev_input));
+      prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+    }
+    prev_input = input;
+  }
+
+  /* The tail, padded with NULs, which also catch a sequence cut off at the end. */
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, p + i, len - i);
+  error = _mm_or_si128(error, wp_utf8_check_128(_mm_loadu_si128((const __m128i *)tail), prev_input));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i wp_utf8_prev_256(__m256i input, __m256i prev_input, int n) {
+  /* The 32 bytes ending n bytes before the end of input. */
+  __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+  switch(n) {
+    case 1: return _mm256_alignr_epi8(input, shifted, 16 - 1);
+    case 2: return _mm256_alignr_epi8(input, shifted, 16 - 2);
+    default: return _mm256_alignr_epi8(input, shifted, 16 - 3);
+  }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i wp_utf8_check_256(__m256i input, __m256i prev_input) {
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i byte_1_high_table = _mm256_setr_epi8(WP_UTF8_BYTE_1_HIGH, WP_UTF8_BYTE_1_HIGH);
+  const __m256i byte_1_low_table = _mm256_setr_epi8(WP_UTF8_BYTE_1_LOW, WP_UTF8_BYTE_1_LOW);
+  const __m256i byte_2_high_table = _mm256_setr_epi8(WP_UTF8_BYTE_2_HIGH, WP_UTF8_BYTE_2_HIGH);
+  __m256i prev1 = wp_utf8_prev_256(input, prev_input, 1);
+  __m256i prev2 = wp_utf8_prev_256(input, prev_input, 2);
+  __m256i prev3 = wp_utf8_prev_256(input, prev_input, 3);
+
+  __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+  __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+  __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+  __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+  __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80)));
+  __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+  __m256i must_continue = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth), _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static bool wp_utf8_validate_avx2(const unsigned char *p, size_t len) {
+  const __m256i incomplete_max = _mm256_setr_epi8(
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    WP_UTF8_INCOMPLETE_MAX);
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev_input = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  unsigned char tail[32];
+  size_t i = 0;
+
+  for(; i + 32 <= len; i += 32) {
+    __m256i input = _mm256_loadu_si256((const __m256i *)(p + i));
+    if(_mm256_movemask_epi8(input) == 0) {
+      error = _mm256_or_si256(error, prev_incomplete);
+    } else {
+      error = _mm256_or_si256(error, wp_utf8_check_256(input, prev_input));
+      prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+    }
+    prev_input = input;
+  }
+
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, p + i, len - i);
+  error = _mm256_or_si256(error, wp_utf8_check_256(_mm256_loadu_si256((const __m256i *)tail), prev_input));
+  return _mm256_testz_si256(error, error);
+}
+
+#endif /* WP_TEXT_X86 */
+
+typedef bool (*wp_utf8_validate_fn)(const unsigned char *p, size_t len);
+
+static wp_utf8_validate_fn wp_utf8_validate_impl = NULL;
+
+static wp_utf8_validate_fn wp_utf8_select() {
+#ifdef WP_TEXT_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    return &wp_utf8_validate_avx2;
+  }
+  if(__builtin_cpu_supports("ssse3")) {
+    return &wp_utf8_validate_ssse3;
+  }
+#endif
+  return &wp_utf8_validate_scalar;
+}
+
+bool wp_utf8_validate(const char *bytes, size_t len) {
+  assert(bytes || len == 0);
+  wp_utf8_validate_fn fn = __atomic_load_n(&wp_utf8_validate_impl, __ATOMIC_RELAXED);
+
+  /* Below a vector's worth the setup isn't worth it. */
+  if(len < 16) {
+    return wp_utf8_validate_scalar((const unsigned char *)bytes, len);
+  }
+  if(fn == NULL) {
+    /* Threads racing here all pick the same function. */
+    fn = wp_utf8_select();
+    __atomic_store_n(&wp_utf8_validate_impl, fn, __ATOMIC_RELAXED);
+  }
+  return fn((const unsigned char *)bytes, len);
+}
+
+/*
+ * ASCII case folding. A byte is an upper (lower) case letter when it's in
+ * 'A'..'Z' ('a'..'z'); flipping bit 5 changes its case. SSE2 does 16 bytes
+ * at a time with signed compares, which are safe since every byte with the
+ * top bit set is below 'A'; elsewhere 8 bytes at a time in a word.
+ */
+#define WP_TEXT_LSBS 0x0101010101010101ull
+#define WP_TEXT_MSBS 0x8080808080808080ull
+
+/**
+ * The bit 5 of every byte of w in [lo, hi], as a mask to flip case with.
+ */
+static inline uint64_t wp_ascii_range_mask(uint64_t w, unsigned char lo, unsigned char hi) {
+  uint64_t heptets = w & ~WP_TEXT_MSBS;
+  /* Top bits set where the low seven bits are >= lo, and where they're > hi. */
+  uint64_t ge_lo = heptets + WP_TEXT_LSBS * (0x80 - lo);
+  uint64_t gt_hi = heptets + WP_TEXT_LSBS * (0x7f - hi);
+  return ((ge_lo ^ gt_hi) & ~w & WP_TEXT_MSBS) >> 2;
+}
+
+static void wp_ascii_convert(char *dst, const char *src, size_t len, unsigned char lo, unsigned char hi) {
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i below = _mm_set1_epi8((char)(lo - 1));
+  const __m128i above = _mm_set1_epi8((char)(hi + 1));
+  const __m128i flip = _mm_set1_epi8(0x20);
+  for(; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, _mm_and_si128(in_range, flip)));
+  }
+#endif
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, src + i, sizeof(w));
+    w ^= wp_ascii_range_mask(w, lo, hi);
+    memcpy(dst + i, &w, sizeof(w));
+  }
+  for(; i < len; i++) {
+    unsigned char c = (unsigned char)src[i];
+    dst[i] = (char)(c >= lo && c <= hi ? c ^ 0x20 : c);
+  }
+}
+
+void wp_ascii_lower(char *dst, const char *src, size_t len) {
+  assert((dst && src) || len == 0);
+  wp_ascii_convert(dst, src, len, 'A', 'Z');
+}
+
+void wp_ascii_upper(char *dst, const char *src, size_t len) {
+  assert((dst && src) || len == 0);
+  wp_ascii_convert(dst, src, len, 'a', 'z');
+}
+
+bool wp_ascii_equals_ignore_case(const char *a, const char *b, size_t len) {
+  assert((a && b) || len == 0);
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i below = _mm_set1_epi8('A' - 1);
+  const __m128i above = _mm_set1_epi8('Z' + 1);
+  const __m128i flip = _mm_set1_epi8(0x20);
+  for(; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    x = _mm_or_si128(x, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(x, below), _mm_cmplt_epi8(x, above)), flip));
+    y = _mm_or_si128(y, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(y, below), _mm_cmplt_epi8(y, above)), flip));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+      return false;
+    }
+  }
+#endif
+  for(; i + 8 <= len; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    if((x | wp_ascii_range_mask(x, 'A', 'Z')) != (y | wp_ascii_range_mask(y, 'A', 'Z'))) {
+      return false;
+    }
+  }
+  for(; i < len; i++) {
+    if(wp_ascii_tolower((unsigned char)a[i]) != wp_ascii_tolower((unsigned char)b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
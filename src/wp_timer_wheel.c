@@ -0,0 +1,397 @@
+/*
+ * File:   wp_timer_wheel.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:17 AM
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_timer_wheel.h>
+
+/*
+ * Six levels of 64 slots. Level n holds timers due within 64^(n+1) ticks and
+ * is cascaded into the levels below whenever the level beneath it wraps, as in
+ * Varghese & Lauck's hierarchical scheme. Each level keeps a 64 bit occupancy
+ * bitmap so the next interesting tick is found without walking empty slots.
+ */
+#define WP_TIMER_WHEEL_BITS      6
+#define WP_TIMER_WHEEL_SLOTS     (1 << WP_TIMER_WHEEL_BITS)
+#define WP_TIMER_WHEEL_MASK      (WP_TIMER_WHEEL_SLOTS - 1)
+#define WP_TIMER_WHEEL_LEVELS    6
+#define WP_TIMER_WHEEL_BATCH     (WP_TIMER_WHEEL_LEVELS * WP_TIMER_WHEEL_SLOTS)
+#define WP_TIMER_WHEEL_MAX_DELTA ((1ull << (WP_TIMER_WHEEL_BITS * WP_TIMER_WHEEL_LEVELS)) - 1)
+#define WP_TIMER_WHEEL_NEVER     UINT64_MAX
+
+typedef struct __wp_timer_wheel_private_t {
+  const wp_event_loop_t *loop;
+  int timer_fd;
+
+  uint64_t tick_ns;
+  uint64_t origin_ns;
+  /* The next tick to process; every timer due before it has fired. */
+  uint64_t next;
+  /* The tick the timerfd is armed for. */
+  uint64_t armed;
+  size_t count;
+
+  uint64_t occupied[WP_TIMER_WHEEL_LEVELS];
+  /* Slot lists, plus one extra list holding the batch being fired. */
+  wp_timer_t *heads[WP_TIMER_WHEEL_BATCH + 1];
+} __wp_timer_wheel_private_t;
+
+void wp_timer_init(wp_timer_t *timer) {
+  assert(timer);
+  memset(timer, 0, sizeof(*timer));
+}
+
+bool wp_timer_is_pending(const wp_timer_t *timer) {
+  assert(timer);
+  /* slot is stored off by one so that a zeroed timer is idle. */
+  return timer->slot != 0;
+}
+
+static uint64_t wp_timer_wheel_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t wp_timer_wheel_current_tick(const wp_timer_wheel_t *self) {
+  return (wp_timer_wheel_now_ns() - self->data->origin_ns) / self->data->tick_ns;
+}
+
+static inline uint64_t wp_timer_wheel_rotr(uint64_t bits, unsigned n) {
+  return n ? (bits >> n) | (bits << (64 - n)) : bits;
+}
+
+static void wp_timer_wheel_link(const wp_timer_wheel_t *self, wp_timer_t *timer, unsigned index) {
+  wp_timer_t **head = &self->data->heads[index];
+
+  timer->prev = NULL;
+  timer->next = *head;
+  if(*head) {
+    (*head)->prev = timer;
+  }
+  *head = timer;
+  timer->slot = (uint16_t)(index + 1);
+
+  if(index < WP_TIMER_WHEEL_BATCH) {
+    self->data->occupied[index >> WP_TIMER_WHEEL_BITS] |= 1ull << (index & WP_TIMER_WHEEL_MASK);
+  }
+}
+
+static void wp_timer_wheel_unlink(const wp_timer_wheel_t *self, wp_timer_t *timer) {
+  unsigned index = timer->slot - 1u;
+
+  if(timer->prev) {
+    timer->prev->next = timer->next;
+  } else {
+    self->data->heads[index] = timer->next;
+  }
+  if(timer->next) {
+    timer->next->prev = timer->prev;
+  }
+
+  if(index < WP_TIMER_WHEEL_BATCH && self->data->heads[index] == NULL) {
+    self->data->occupied[index >> WP_TIMER_WHEEL_BITS] &= ~(1ull << (index & WP_TIMER_WHEEL_MASK));
+  }
+
+  timer->next = timer->prev = NULL;
+  timer->slot = 0;
+}
+
+static unsigned wp_timer_wheel_level_of(uint64_t delta) {
+  unsigned level = 0;
+  while(level < WP_TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (WP_TIMER_WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+  return level;
+}
+
+/**
+ * Put a timer into the slot matching its expiry relative to the next tick.
+ * @param self pointer to an instance of the wheel.
+ * @param timer the timer, with expires already set and not earlier than next.
+ */
+static void wp_timer_wheel_place(const wp_timer_wheel_t *self, wp_timer_t *timer) {
+  unsigned level = wp_timer_wheel_level_of(timer->expires - self->data->next);
+  unsigned slot = (unsigned)(timer->expires >> (WP_TIMER_WHEEL_BITS * level)) & WP_TIMER_WHEEL_MASK;
+  wp_timer_wheel_link(self, timer, level * WP_TIMER_WHEEL_SLOTS + slot);
+}
+
+/**
+ * Find the first tick at or after next that needs work: either a level 0 slot
+ * to fire or an occupied higher level slot to cascade.
+ * @param self pointer to an instance of the wheel.
+ * @return the tick, or WP_TIMER_WHEEL_NEVER if the wheel is empty.
+ */
+static uint64_t wp_timer_wheel_next_event(const wp_timer_wheel_t *self) {
+  uint64_t next = self->data->next;
+  uint64_t best = WP_TIMER_WHEEL_NEVER;
+
+  if(self->data->occupied[0]) {
+    uint64_t r = wp_timer_wheel_rotr(self->data->occupied[0], (unsigned)(next & WP_TIMER_WHEEL_MASK));
+    best = next + (uint64_t)__builtin_ctzll(r);
+  }
+
+  for(unsigned level = 1; level < WP_TIMER_WHEEL_LEVELS; level++) {
+    uint64_t bits = self->data->occupied[level];
+    if(bits) {
+      unsigned shift = WP_TIMER_WHEEL_BITS * level;
+      /* The first block boundary whose cascade hasn't run yet. */
+      uint64_t block = (next >> shift) + ((next & ((1ull << shift) - 1)) ? 1 : 0);
+      uint64_t r = wp_timer_wheel_rotr(bits, (unsigned)(block & WP_TIMER_WHEEL_MASK));
+      uint64_t tick = (block + (uint64_t)__builtin_ctzll(r)) << shift;
+      if(tick < best) {
+        best = tick;
+      }
+    }
+  }
+
+  return best;
+}
+
+/**
+ * Arm the timerfd for the next tick needing work, skipping the syscall when
+ * it's already armed for that tick.
+ * @param self pointer to an instance of the wheel.
+ */
+static void wp_timer_wheel_arm(const wp_timer_wheel_t *self) {
+  uint64_t tick = wp_timer_wheel_next_event(self);
+  struct itimerspec its;
+
+  if(tick == self->data->armed) {
+    return;
+  }
+
+  memset(&its, 0, sizeof(its));
+  if(tick != WP_TIMER_WHEEL_NEVER) {
+    uint64_t ns = self->data->origin_ns + tick * self->data->tick_ns;
+    its.it_value.tv_sec = (time_t)(ns / 1000000000ull);
+    its.it_value.tv_nsec = (long)(ns % 1000000000ull);
+  }
+  /* A zero it_value disarms. */
+  timerfd_settime(self->data->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+  self->data->armed = tick;
+}
+
+/**
+ * Move the timers of every higher level slot whose block starts at next down
+ * to the levels beneath.
+ * @param self pointer to an instance of the wheel.
+ */
+static void wp_timer_wheel_cascade(const wp_timer_wheel_t *self) {
+  uint64_t next = self->data->next;
+
+  for(unsigned level = 1; level < WP_TIMER_WHEEL_LEVELS; level++) {
+    unsigned shift = WP_TIMER_WHEEL_BITS * level;
+    if(next & ((1ull << shift) - 1)) {
+      break;
+    }
+
+    unsigned index = level * WP_TIMER_WHEEL_SLOTS + ((unsigned)(next >> shift) & WP_TIMER_WHEEL_MASK);
+    wp_timer_t *timer = self->data->heads[index];
+    self->data->heads[index] = NULL;
+    self->data->occupied[level] &= ~(1ull << (index & WP_TIMER_WHEEL_MASK));
+
+    while(timer) {
+      wp_timer_t *following = timer->next;
+      wp_timer_wheel_place(self, timer);
+      timer = following;
+    }
+  }
+}
+
+static void wp_timer_wheel_cancel(const wp_timer_wheel_t *self, wp_timer_t *timer) {
+  assert(self && self->data && timer);
+  if(wp_timer_is_pending(timer)) {
+    wp_timer_wheel_unlink(self, timer);
+    self->data->count--;
+    /* The timerfd is left armed; an early wakeup is cheaper than a syscall. */
+  }
+}
+
+static wp_status_t wp_timer_wheel_schedule(const wp_timer_wheel_t *self, wp_timer_t *timer, uint64_t timeout_ms, wp_timer_fn fn, void *arg) {
+  assert(self && self->data && timer && fn);
+  uint64_t tick_ns = self->data->tick_ns;
+  uint64_t now_ns = wp_timer_wheel_now_ns();
+  uint64_t current = (now_ns - self->data->origin_ns) / tick_ns;
+  uint64_t next, expires, delta, timeout;
+
+  wp_timer_wheel_cancel(self, timer);
+
+  /*
+   * next only advances when the timerfd fires, so it lags behind after the
+   * wheel has been idle. With nothing placed relative to it yet, catch it up;
+   * never move it backwards, or a timer that just fired could fire again.
+   */
+  if(self->data->count == 0 && current > self->data->next) {
+    self->data->next = current;
+  }
+  next = self->data->next;
+
+  if(timeout_ms > WP_TIMER_WHEEL_MAX_DELTA) {
+    timeout_ms = WP_TIMER_WHEEL_MAX_DELTA;
+  }
+  expires = (now_ns - self->data->origin_ns + timeout_ms * 1000000ull + tick_ns - 1) / tick_ns;
+  if(expires < next) {
+    expires = next;
+  }
+
+  delta = expires - next;
+  if(delta > WP_TIMER_WHEEL_MAX_DELTA) {
+    delta = WP_TIMER_WHEEL_MAX_DELTA;
+  }
+  /* Round by the timeout itself, not by how far next happens to lag. */
+  timeout = expires > current ? expires - current : 0;
+  if(delta >= WP_TIMER_WHEEL_SLOTS && timeout >= WP_TIMER_WHEEL_SLOTS) {
+    /* Coalesce far timers onto 1/64th of their level so they share wakeups. */
+    uint64_t granularity = 1ull << (WP_TIMER_WHEEL_BITS * (wp_timer_wheel_level_of(timeout) - 1));
+    delta = ((next + delta + granularity - 1) & ~(granularity - 1)) - next;
+    if(delta > WP_TIMER_WHEEL_MAX_DELTA) {
+      delta = WP_TIMER_WHEEL_MAX_DELTA;
+    }
+  }
+
+  timer->expires = next + delta;
+  timer->fn = fn;
+  timer->arg = arg;
+  wp_timer_wheel_place(self, timer);
+  self->data->count++;
+
+  if(wp_timer_wheel_next_event(self) < self->data->armed) {
+    wp_timer_wheel_arm(self);
+  }
+
+  return WP_SUCCESS;
+}
+
+static size_t wp_timer_wheel_expire(const wp_timer_wheel_t *self) {
+  assert(self && self->data);
+  wp_timer_t **batch = &self->data->heads[WP_TIMER_WHEEL_BATCH];
+  uint64_t now = wp_timer_wheel_current_tick(self);
+  size_t fired = 0;
+
+  while(self->data->next <= now) {
+    uint64_t tick = wp_timer_wheel_next_event(self);
+    if(tick > now) {
+      self->data->next = now + 1;
+      break;
+    }
+    self->data->next = tick;
+    wp_timer_wheel_cascade(self);
+
+    unsigned index = (unsigned)(tick & WP_TIMER_WHEEL_MASK);
+    if(self->data->heads[index]) {
+      /* Detach the whole slot so callbacks can reschedule into it. */
+      *batch = self->data->heads[index];
+      self->data->heads[index] = NULL;
+      self->data->occupied[0] &= ~(1ull << index);
+      for(wp_timer_t *t = *batch; t; t = t->next) {
+        t->slot = WP_TIMER_WHEEL_BATCH + 1;
+      }
+
+      self->data->next = tick + 1;
+      wp_timer_t *timer;
+      while((timer = *batch)) {
+        wp_timer_wheel_unlink(self, timer);
+        self->data->count--;
+        fired++;
+        timer->fn(timer, timer->arg);
+      }
+    } else {
+      self->data->next = tick + 1;
+    }
+  }
+
+  self->data->armed = WP_TIMER_WHEEL_NEVER;
+  wp_timer_wheel_arm(self);
+
+  return fired;
+}
+
+static size_t wp_timer_wheel_get_count(const wp_timer_wheel_t *self) {
+  assert(self && self->data);
+  return self->data->count;
+}
+
+static int wp_timer_wheel_get_fd(const wp_timer_wheel_t *self) {
+  assert(self && self->data);
+  return self->data->timer_fd;
+}
+
+/**
+ * Event loop handler for the timerfd.
+ */
+static void wp_timer_wheel_on_timer_fd(const wp_event_loop_t *loop, int fd, uint32_t events, void *arg) {
+  const wp_timer_wheel_t *self = arg;
+  uint64_t expirations;
+  (void)loop; (void)events;
+
+  /* Drain the fd; the count itself is meaningless with absolute arming. */
+  if(read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+    return;
+  }
+  self->expire(self);
+}
+
+wp_status_t wp_timer_wheel_new(wp_timer_wheel_t **self_out, const wp_event_loop_t *loop, uint64_t tick_ms) {
+  assert(loop);
+  wp_status_t ret = WP_FAILURE;
+  wp_timer_wheel_t *self = NULL;
+
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      if((self->data->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) > -1) {
+        self->data->loop = loop;
+        self->data->tick_ns = (tick_ms ? tick_ms : 1) * 1000000ull;
+        self->data->origin_ns = wp_timer_wheel_now_ns();
+        self->data->next = 0;
+        self->data->armed = WP_TIMER_WHEEL_NEVER;
+        self->data->count = 0;
+
+        self->schedule = &wp_timer_wheel_schedule;
+        self->cancel = &wp_timer_wheel_cancel;
+        self->expire = &wp_timer_wheel_expire;
+        self->get_count = &wp_timer_wheel_get_count;
+        self->get_fd = &wp_timer_wheel_get_fd;
+
+        if(loop->add(loop, self->data->timer_fd, EPOLLIN, &wp_timer_wheel_on_timer_fd, self) == WP_SUCCESS) {
+          ret = WP_SUCCESS;
+        } else {
+          close(self->data->timer_fd);
+        }
+      }
+      if(ret != WP_SUCCESS) {
+        free(self->data);
+        self->data = NULL;
+      }
+    }
+    if(ret != WP_SUCCESS) {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_timer_wheel_delete(wp_timer_wheel_t *self) {
+  assert(self);
+  if(self->data) {
+    self->data->loop->remove(self->data->loop, self->data->timer_fd);
+    close(self->data->timer_fd);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
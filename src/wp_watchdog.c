@@ -0,0 +1,443 @@
+/*
+ * File:   wp_watchdog.c
+ * Author: agent <agent@local>
+ *
+ * Created on October 19, 2026, 4:51 AM
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <wp_common.h>
+#include <wp_event_loop.h>
+#include <wp_watchdog.h>
+
+#define WP_WATCHDOG_FRAMES 64
+/* Handler histograms reported per loop. */
+#define WP_WATCHDOG_CALLBACKS 64
+/* How long to wait for a stalled thread to take the capture signal. */
+#define WP_WATCHDOG_CAPTURE_TIMEOUT_MS 100
+
+typedef struct wp_watchdog_loop {
+  const wp_event_loop_t *loop;
+  char name[32];
+
+  bool stalled;
+  /* The heartbeat the stall was seen at; a change to either ends it. */
+  uint64_t stalled_progress;
+  uint64_t stalled_since_ns;
+  wp_event_handler_fn stalled_handler;
+} wp_watchdog_loop_t;
+
+typedef struct __wp_watchdog_private_t {
+  uint64_t budget_ns;
+  wp_watchdog_report_fn report_fn;
+  void *report_arg;
+  wp_watchdog_healthy_fn healthy_fn;
+  void *healthy_arg;
+
+  /* Guards everything below, and is held while checking. */
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_t thread;
+  bool running;
+  bool stopping;
+
+  wp_watchdog_loop_t loops[WP_WATCHDOG_MAX_LOOPS];
+  size_t loop_count;
+  uint64_t stalls;
+} __wp_watchdog_private_t;
+
+/*
+ * One capture at a time, across watchdogs. Each request carries a generation
+ * number so that a signal arriving after its request timed out can't pass
+ * for the answer to the next one.
+ */
+static pthread_mutex_t wp_watchdog_capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *wp_watchdog_frames[WP_WATCHDOG_FRAMES];
+static volatile int wp_watchdog_depth = 0;
+static volatile int wp_watchdog_captured = 0;
+static int wp_watchdog_generation = 0;
+
+static uint64_t wp_watchdog_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * The capture signal's handler, run on the stalled thread.
+ * @param sig the signal.
+ * @param info carries the generation of the request.
+ * @param context unused.
+ */
+static void wp_watchdog_capture(int sig, siginfo_t *info, void *context) {
+  (void)sig;
+  (void)context;
+  int saved_errno = errno;
+
+  if(info->si_code == SI_QUEUE) {
+    /* backtrace is safe here once libgcc is loaded; start makes sure it is. */
+    wp_watchdog_depth = backtrace(wp_watchdog_frames, WP_WATCHDOG_FRAMES);
+    __atomic_store_n(&wp_watchdog_captured, info->si_value.sival_int, __ATOMIC_RELEASE);
+  }
+  errno = saved_errno;
+}
+
+/**
+ * Name a function by its symbol, or its address when it has none.
+ * @param fn the function.
+ * @param buf receives the name.
+ * @param size the size of buf.
+ * @return buf.
+ */
+static const char *wp_watchdog_symbol(wp_event_handler_fn fn, char *buf, size_t size) {
+  Dl_info info;
+
+  if(fn == NULL) {
+    snprintf(buf, size, "(other handlers)");
+  } else if(dladdr((void *)fn, &info) && info.dli_sname) {
+    snprintf(buf, size, "%s", info.dli_sname);
+  } else {
+    snprintf(buf, size, "%p", (void *)fn);
+  }
+  return buf;
+}
+
+/**
+ * Interrupt a thread to capture its stack, and report the frames.
+ * @param self pointer to an instance of the watchdog.
+ * @param tid the thread.
+ */
+static void wp_watchdog_report_stack(const wp_watchdog_t *self, pid_t tid) {
+  char line[WP_MAX_LINE];
+  siginfo_t info;
+  int generation = 0;
+  char **symbols = NULL;
+  int depth = 0;
+
+  pthread_mutex_lock(&wp_watchdog_capture_lock);
+  generation = ++wp_watchdog_generation;
+
+  memset(&info, 0, sizeof(info));
+  info.si_signo = WP_WATCHDOG_SIGNAL;
+  info.si_code = SI_QUEUE;
+  info.si_pid = getpid();
+  info.si_uid = getuid();
+  info.si_value.sival_int = generation;
+  if(syscall(SYS_rt_tgsigqueueinfo, getpid(), tid, WP_WATCHDOG_SIGNAL, &info) != 0) {
+    snprintf(line, sizeof(line), "  stack unavailable: can't signal thread %d: %s", (int)tid, strerror(errno));
+    self->data->report_fn(line, self->data->report_arg);
+    pthread_mutex_unlock(&wp_watchdog_capture_lock);
+    return;
+  }
+
+  for(int waited = 0; __atomic_load_n(&wp_watchdog_captured, __ATOMIC_ACQUIRE) != generation; waited++) {
+    struct timespec ms = { 0, 1000000 };
+    if(waited >= WP_WATCHDOG_CAPTURE_TIMEOUT_MS) {
+      /* Blocked with the signal masked, or in uninterruptible sleep. */
+      snprintf(line, sizeof(line), "  stack unavailable: thread %d didn't take the signal", (int)tid);
+      self->data->report_fn(line, self->data->report_arg);
+      pthread_mutex_unlock(&wp_watchdog_capture_lock);
+      return;
+    }
+    nanosleep(&ms, NULL);
+  }
+
+  depth = wp_watchdog_depth;
+  if((symbols = backtrace_symbols(wp_watchdog_frames, depth))) {
+    /* Frame 0 is the capture handler itself. */
+    for(int i = 1; i < depth; i++) {
+      snprintf(line, sizeof(line), "  #%-2d %s", i - 1, symbols[i]);
+      self->data->report_fn(line, self->data->report_arg);
+    }
+    free(symbols);
+  }
+  pthread_mutex_unlock(&wp_watchdog_capture_lock);
+}
+
+/**
+ * Check every watched loop once. Called with the lock held.
+ * @param self pointer to an instance of the watchdog.
+ * @return true if no loop is stalled.
+ */
+static bool wp_watchdog_check(const wp_watchdog_t *self) {
+  __wp_watchdog_private_t *d = self->data;
+  char line[WP_MAX_LINE];
+  char symbol[128];
+  bool healthy = true;
+
+  for(size_t i = 0; i < d->loop_count; i++) {
+    wp_watchdog_loop_t *w = &d->loops[i];
+    wp_event_loop_heartbeat_t heartbeat;
+    uint64_t now = 0;
+
+    w->loop->get_heartbeat(w->loop, &heartbeat);
+    now = wp_watchdog_now_ns();
+
+    if(w->stalled) {
+      if(heartbeat.progress == w->stalled_progress && heartbeat.busy_since_ns == w->stalled_since_ns) {
+        healthy = false;
+        continue;
+      }
+      snprintf(line, sizeof(line), "watchdog: loop %s resumed after %llu ms in %s", w->name,
+               (unsigned long long)((now - w->stalled_since_ns) / 1000000),
+               wp_watchdog_symbol(w->stalled_handler, symbol, sizeof(symbol)));
+      d->report_fn(line, d->report_arg);
+      w->stalled = false;
+    }
+
+    if(heartbeat.busy_since_ns && now > heartbeat.busy_since_ns && now - heartbeat.busy_since_ns > d->budget_ns) {
+      w->stalled = true;
+      w->stalled_progress = heartbeat.progress;
+      w->stalled_since_ns = heartbeat.busy_since_ns;
+      w->stalled_handler = heartbeat.handler;
+      d->stalls++;
+      healthy = false;
+
+      snprintf(line, sizeof(line), "watchdog: loop %s stalled for %llu ms in %s (thread %d)", w->name,
+               (unsigned long long)((now - heartbeat.busy_since_ns) / 1000000),
+               wp_watchdog_symbol(heartbeat.handler, symbol, sizeof(symbol)), (int)heartbeat.tid);
+      d->report_fn(line, d->report_arg);
+      if(heartbeat.tid) {
+        wp_watchdog_report_stack(self, heartbeat.tid);
+      }
+    }
+  }
+
+  return healthy;
+}
+
+static void *wp_watchdog_thread(void *arg) {
+  const wp_watchdog_t *self = arg;
+  __wp_watchdog_private_t *d = self->data;
+  uint64_t period_ns = d->budget_ns / 4 ? d->budget_ns / 4 : 1000000;
+
+  pthread_mutex_lock(&d->lock);
+  while(!d->stopping) {
+    struct timespec deadline;
+    uint64_t at = wp_watchdog_now_ns() + period_ns;
+    deadline.tv_sec = (time_t)(at / 1000000000ull);
+    deadline.tv_nsec = (long)(at % 1000000000ull);
+    if(pthread_cond_timedwait(&d->wakeup, &d->lock, &deadline) == ETIMEDOUT && !d->stopping) {
+      if(wp_watchdog_check(self) && d->healthy_fn) {
+        d->healthy_fn(d->healthy_arg);
+      }
+    }
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return NULL;
+}
+
+static wp_status_t wp_watchdog_watch(const wp_watchdog_t *self, const wp_event_loop_t *loop, const char *name) {
+  assert(self && self->data && loop);
+  wp_status_t res = WP_FAILURE;
+
+  pthread_mutex_lock(&self->data->lock);
+  if(self->data->loop_count < WP_WATCHDOG_MAX_LOOPS && loop->set_instrumented(loop, true) == WP_SUCCESS) {
+    wp_watchdog_loop_t *w = &self->data->loops[self->data->loop_count++];
+    memset(w, 0, sizeof(*w));
+    w->loop = loop;
+    snprintf(w->name, sizeof(w->name), "%s", name ? name : "(unnamed)");
+    res = WP_SUCCESS;
+  }
+  pthread_mutex_unlock(&self->data->lock);
+
+  return res;
+}
+
+static void wp_watchdog_unwatch(const wp_watchdog_t *self, const wp_event_loop_t *loop) {
+  assert(self && self->data);
+
+  pthread_mutex_lock(&self->data->lock);
+  for(size_t i = 0; i < self->data->loop_count; i++) {
+    if(self->data->loops[i].loop == loop) {
+      self->data->loops[i] = self->data->loops[--self->data->loop_count];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&self->data->lock);
+}
+
+static wp_status_t wp_watchdog_start(const wp_watchdog_t *self) {
+  assert(self && self->data);
+  wp_status_t res = WP_SUCCESS;
+  struct sigaction sa;
+  sigset_t all, old;
+  void *frame = NULL;
+
+  pthread_mutex_lock(&self->data->lock);
+  if(self->data->running) {
+    pthread_mutex_unlock(&self->data->lock);
+    return WP_SUCCESS;
+  }
+
+  /* Load libgcc's unwinder now; it can't be loaded from a signal handler. */
+  backtrace(&frame, 1);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = &wp_watchdog_capture;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if(sigaction(WP_WATCHDOG_SIGNAL, &sa, NULL) != 0) {
+    res = WP_FAILURE;
+  } else {
+    /* Keep the process's signals off the watchdog thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    self->data->stopping = false;
+    if(pthread_create(&self->data->thread, NULL, &wp_watchdog_thread, (void *)self) == 0) {
+      self->data->running = true;
+    } else {
+      res = WP_FAILURE;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
+  pthread_mutex_unlock(&self->data->lock);
+
+  return res;
+}
+
+static void wp_watchdog_stop(const wp_watchdog_t *self) {
+  assert(self && self->data);
+  bool running = false;
+
+  pthread_mutex_lock(&self->data->lock);
+  running = self->data->running;
+  self->data->stopping = true;
+  self->data->running = false;
+  pthread_cond_signal(&self->data->wakeup);
+  pthread_mutex_unlock(&self->data->lock);
+
+  if(running) {
+    pthread_join(self->data->thread, NULL);
+  }
+}
+
+static void wp_watchdog_set_healthy_method(const wp_watchdog_t *self, wp_watchdog_healthy_fn fn, void *arg) {
+  assert(self && self->data);
+  pthread_mutex_lock(&self->data->lock);
+  self->data->healthy_fn = fn;
+  self->data->healthy_arg = arg;
+  pthread_mutex_unlock(&self->data->lock);
+}
+
+static uint64_t wp_watchdog_get_stall_count(const wp_watchdog_t *self) {
+  assert(self && self->data);
+  uint64_t stalls = 0;
+  pthread_mutex_lock(&self->data->lock);
+  stalls = self->data->stalls;
+  pthread_mutex_unlock(&self->data->lock);
+  return stalls;
+}
+
+/**
+ * Report one histogram on one line.
+ * @param label what was timed.
+ * @param unit what count counts.
+ * @param histogram the histogram.
+ * @param fn receives the line.
+ * @param arg passed through to fn.
+ */
+static void wp_watchdog_report_histogram(const char *label, const char *unit, const wp_latency_histogram_t *histogram,
+                                         wp_watchdog_report_fn fn, void *arg) {
+  char line[WP_MAX_LINE];
+  snprintf(line, sizeof(line), "%s: %llu %s, mean %llu us, p50 <%llu us, p99 <%llu us, p99.9 <%llu us, max %llu us",
+           label, (unsigned long long)histogram->count, unit,
+           (unsigned long long)(histogram->count ? histogram->total_ns / histogram->count / 1000 : 0),
+           (unsigned long long)wp_latency_histogram_percentile_us(histogram, 50),
+           (unsigned long long)wp_latency_histogram_percentile_us(histogram, 99),
+           (unsigned long long)wp_latency_histogram_percentile_us(histogram, 99.9),
+           (unsigned long long)(histogram->max_ns / 1000));
+  fn(line, arg);
+}
+
+static void wp_watchdog_report(const wp_watchdog_t *self, wp_watchdog_report_fn fn, void *arg) {
+  assert(self && self->data && fn);
+  wp_callback_histogram_t *callbacks = NULL;
+  char label[192];
+  char symbol[128];
+
+  if((callbacks = malloc(WP_WATCHDOG_CALLBACKS * sizeof(*callbacks))) == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&self->data->lock);
+  for(size_t i = 0; i < self->data->loop_count; i++) {
+    const wp_event_loop_t *loop = self->data->loops[i].loop;
+    wp_latency_histogram_t lag;
+    size_t count = 0;
+
+    loop->get_lag_histogram(loop, &lag);
+    snprintf(label, sizeof(label), "loop %s lag", self->data->loops[i].name);
+    wp_watchdog_report_histogram(label, "batches", &lag, fn, arg);
+
+    count = loop->get_callback_histograms(loop, callbacks, WP_WATCHDOG_CALLBACKS);
+    for(size_t c = 0; c < count && c < WP_WATCHDOG_CALLBACKS; c++) {
+      snprintf(label, sizeof(label), "  %s", wp_watchdog_symbol(callbacks[c].fn, symbol, sizeof(symbol)));
+      wp_watchdog_report_histogram(label, "calls", &callbacks[c].histogram, fn, arg);
+    }
+  }
+  pthread_mutex_unlock(&self->data->lock);
+
+  free(callbacks);
+}
+
+wp_status_t wp_watchdog_new(wp_watchdog_t **self_out, unsigned budget_ms, wp_watchdog_report_fn fn, void *arg) {
+  wp_status_t ret = WP_FAILURE;
+  wp_watchdog_t *self = NULL;
+  pthread_condattr_t attr;
+
+  assert(fn);
+  if((self = malloc(sizeof(*self)))) {
+    if((self->data = calloc(1, sizeof(*(self->data))))) {
+      pthread_condattr_init(&attr);
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+      pthread_mutex_init(&self->data->lock, NULL);
+      pthread_cond_init(&self->data->wakeup, &attr);
+      pthread_condattr_destroy(&attr);
+
+      self->data->budget_ns = (uint64_t)(budget_ms ? budget_ms : 1) * 1000000ull;
+      self->data->report_fn = fn;
+      self->data->report_arg = arg;
+
+      self->watch = &wp_watchdog_watch;
+      self->unwatch = &wp_watchdog_unwatch;
+      self->start = &wp_watchdog_start;
+      self->stop = &wp_watchdog_stop;
+      self->set_healthy_method = &wp_watchdog_set_healthy_method;
+      self->get_stall_count = &wp_watchdog_get_stall_count;
+      self->report = &wp_watchdog_report;
+      ret = WP_SUCCESS;
+    } else {
+      free(self);
+      self = NULL;
+    }
+  }
+
+  *self_out = self;
+  return ret;
+}
+
+void wp_watchdog_delete(wp_watchdog_t *self) {
+  assert(self);
+  if(self->data) {
+    self->stop(self);
+    pthread_cond_destroy(&self->data->wakeup);
+    pthread_mutex_destroy(&self->data->lock);
+    free(self->data);
+    self->data = NULL;
+  }
+  free(self);
+}
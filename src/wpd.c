@@ -1,5 +1,4 @@
 #include <assert.h>
-#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -8,16 +7,10 @@
 /* sed-begin-wait-loop */
 static void daemon_on_start(const wp_daemonizer_t *self) {
   assert(self); /* make compiler happy */
-  sigset_t mask, oldmask;
-  sigemptyset(&mask);
-  sigaddset(&mask, SIGUSR1);
-  sigprocmask(SIG_BLOCK, &mask, &oldmask);
-  
-  while(true) {
-    sigsuspend(&oldmask);
-  }
-  
-  sigprocmask(SIG_UNBLOCK, &mask, NULL);
+  const wp_event_loop_t *loop = self->get_event_loop(self);
+
+  /* Signals arrive as loop events; SIGTERM drains and stops the loop. */
+  loop->run(loop);
 }
 /* sed-end-wait-loop */
 